@@ -454,7 +454,8 @@ int main() {
         if(ImGui::CollapsingHeader("List of allowed strategies")) {
 
             ImGui::BeginChild("List of allowed strategies##ListStrategies", ImVec2(280, 140), true);
-            std::vector<std::string> list_strategies(va_edit.list_strategies.begin(), va_edit.list_strategies.end());
+            const std::set<std::string> va_list_strategies(va_edit.get_list_strategies());
+            std::vector<std::string> list_strategies(va_list_strategies.begin(), va_list_strategies.end());
             int64_t list_strategies_delete_index = -1;
             for(size_t n = 0; n < list_strategies.size(); ++n) {
                 ImGui::PushID(n);
@@ -490,7 +491,7 @@ int main() {
                     strategy_name_error = false;
                 }
             }
-            va_edit.list_strategies = std::set<std::string>(list_strategies.begin(), list_strategies.end());
+            va_edit.set_list_strategies(std::set<std::string>(list_strategies.begin(), list_strategies.end()));
             if(strategy_name_error) {
                 ImGui::TextColored(ImVec4(1.0,0.0,0.0,1.0), "Error! Strategy name is empty");
             }
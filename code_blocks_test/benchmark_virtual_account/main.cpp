@@ -0,0 +1,318 @@
+/*
+* open-bo-api - C++ API for working with binary options brokers
+*
+* Copyright (c) 2020 Elektro Yar. Email: git.electroyar@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+
+/* Нагрузочный тест виртуальных аккаунтов
+ *
+ * Использование: benchmark_virtual_account [аккаунты] [потоки] [ставок на поток] [шарды]
+ * Без аргументов тест выполняется для 10, 1000 и 100000 аккаунтов,
+ * сначала для VirtualAccounts, затем для ShardedVirtualAccounts с 4 шардами.
+ * Если количество ставок не задано, оно уменьшается с ростом количества аккаунтов.
+ * Если количество шардов равно 0, тест выполняется для VirtualAccounts.
+ *
+ * Для каждой операции выводятся перцентили задержки в микросекундах.
+ * Время записи в базу данных - это время push(true).
+ * Время чтения снимка аккаунтов оценивается отдельным потоком,
+ * который постоянно вызывает check_accounts.
+ */
+#include "open-bo-api-sharded-virtual-accounts.hpp"
+#include <chrono>
+#include <algorithm>
+#include <random>
+#include <cstdio>
+#include <iomanip>
+
+namespace {
+
+    const char *benchmark_database_name = "benchmark_virtual_account.db";
+    const size_t default_shards_number = 4;
+    const uint32_t strategies_number = 16;
+
+    /** \brief Замеры задержки одной операции
+     */
+    class LatencyStats {
+    public:
+        std::vector<double> samples;    /**< Задержка в микросекундах */
+
+        void add(const std::chrono::steady_clock::time_point &start) {
+            const auto stop = std::chrono::steady_clock::now();
+            samples.push_back(std::chrono::duration<double, std::micro>(stop - start).count());
+        }
+
+        void merge(const LatencyStats &other) {
+            samples.insert(samples.end(), other.samples.begin(), other.samples.end());
+        }
+
+        double percentile(const double p) const {
+            if(samples.empty()) return 0.0d;
+            const size_t index = std::min(samples.size() - 1, (size_t)(p * (double)(samples.size() - 1) + 0.5d));
+            return samples[index];
+        }
+
+        void print(const std::string &name) {
+            std::sort(samples.begin(), samples.end());
+            std::cout
+                << std::left << std::setw(16) << name << std::right
+                << std::setw(10) << samples.size()
+                << std::fixed << std::setprecision(1)
+                << std::setw(12) << percentile(0.5d)
+                << std::setw(12) << percentile(0.9d)
+                << std::setw(12) << percentile(0.99d)
+                << std::setw(12) << percentile(0.999d)
+                << std::setw(12) << (samples.empty() ? 0.0d : samples.back())
+                << std::endl;
+        }
+    };
+
+    /** \brief Замеры одного потока ставок
+     */
+    class WorkerStats {
+    public:
+        LatencyStats calc_amount;
+        LatencyStats make_bet;
+        LatencyStats settlement;
+        LatencyStats get_balance;
+    };
+
+    /** \brief Создать синтетические аккаунты
+     */
+    template<class T>
+    void generate_accounts(
+            T &vas,
+            const uint32_t accounts_number,
+            std::mt19937 &gen) {
+        std::uniform_real_distribution<double> balance_dist(100.0d, 10000.0d);
+        std::uniform_int_distribution<uint32_t> strategy_dist(0, strategies_number - 1);
+        std::vector<open_bo_api::VirtualAccount> list_va(accounts_number);
+        const xtime::timestamp_t start_timestamp = xtime::get_first_timestamp_day(xtime::get_timestamp()) - 30 * xtime::SECONDS_IN_DAY;
+        for(uint32_t i = 0; i < accounts_number; ++i) {
+            open_bo_api::VirtualAccount &va = list_va[i];
+            va.va_id = open_bo_api::VirtualAccounts::AUTO_VA_ID;
+            va.holder_name = "holder-" + std::to_string(i);
+            va.start_balance = balance_dist(gen);
+            va.balance = va.start_balance;
+            va.kelly_attenuation_multiplier = 1.0d;
+            va.kelly_attenuation_limiter = 0.1d;
+            va.payout_limiter = 1.0d;
+            va.winrate_limiter = 1.0d;
+            va.demo = false;
+            va.enabled = true;
+            va.start_timestamp = start_timestamp;
+            va.add_strategy("STRATEGY-" + std::to_string(strategy_dist(gen)));
+            va.add_strategy("STRATEGY-" + std::to_string(strategy_dist(gen)));
+            for(uint32_t d = 0; d < 30; ++d) {
+                va.date_balance[start_timestamp + d * xtime::SECONDS_IN_DAY] = va.start_balance;
+            }
+            va.rebuild_daily_index();
+        }
+        vas.import_virtual_accounts(list_va);
+    }
+
+    /** \brief Создать хранилище аккаунтов
+     */
+    template<class T>
+    T *create_accounts(const size_t shards_number);
+
+    template<>
+    open_bo_api::VirtualAccounts *create_accounts<open_bo_api::VirtualAccounts>(const size_t shards_number) {
+        return new open_bo_api::VirtualAccounts(benchmark_database_name);
+    }
+
+    template<>
+    open_bo_api::ShardedVirtualAccounts *create_accounts<open_bo_api::ShardedVirtualAccounts>(const size_t shards_number) {
+        return new open_bo_api::ShardedVirtualAccounts(benchmark_database_name, shards_number);
+    }
+
+    /** \brief Удалить файлы базы данных теста
+     */
+    void remove_database(const size_t shards_number) {
+        std::remove(benchmark_database_name);
+        for(size_t i = 0; i < shards_number; ++i) {
+            std::remove(("benchmark_virtual_account-" + std::to_string(i) + ".db").c_str());
+        }
+    }
+
+    /** \brief Выполнить тест для заданного количества аккаунтов
+     */
+    template<class T>
+    void run_benchmark(
+            const uint32_t accounts_number,
+            const uint32_t threads_number,
+            const uint32_t bets_per_thread,
+            const size_t shards_number) {
+        remove_database(shards_number);
+        std::cout << std::endl << "accounts: " << accounts_number
+            << " threads: " << threads_number
+            << " bets per thread: " << bets_per_thread
+            << " shards: " << shards_number << std::endl;
+
+        LatencyStats flush;
+        LatencyStats reader;
+        LatencyStats import;
+        std::vector<WorkerStats> workers_stats(threads_number);
+        {
+            std::unique_ptr<T> vas_ptr(create_accounts<T>(shards_number));
+            T &vas = *vas_ptr;
+
+            std::mt19937 gen(accounts_number);
+            {
+                const auto start = std::chrono::steady_clock::now();
+                generate_accounts(vas, accounts_number, gen);
+                import.add(start);
+            }
+
+            std::vector<uint32_t> strategy_ids(strategies_number);
+            for(uint32_t s = 0; s < strategies_number; ++s) {
+                strategy_ids[s] = open_bo_api::StrategyRegistry::instance().get_id("STRATEGY-" + std::to_string(s));
+            }
+
+            std::atomic<bool> is_stop(false);
+
+            /* поток записи в базу данных */
+            std::thread flush_thread([&]() {
+                while(!is_stop) {
+                    const auto start = std::chrono::steady_clock::now();
+                    vas.push(true);
+                    flush.add(start);
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                }
+            });
+
+            /* поток оценки времени чтения снимка */
+            std::thread reader_thread([&]() {
+                while(!is_stop) {
+                    const auto start = std::chrono::steady_clock::now();
+                    vas.check_accounts();
+                    reader.add(start);
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            });
+
+            /* потоки ставок */
+            const auto start_bets = std::chrono::steady_clock::now();
+            std::vector<std::thread> workers;
+            for(uint32_t t = 0; t < threads_number; ++t) {
+                workers.push_back(std::thread([&, t]() {
+                    WorkerStats &stats = workers_stats[t];
+                    std::mt19937 worker_gen(t + 1);
+                    std::uniform_int_distribution<uint32_t> strategy_dist(0, strategies_number - 1);
+                    std::uniform_int_distribution<uint32_t> result_dist(0, 99);
+                    const xtime::timestamp_t start_date = xtime::get_timestamp();
+                    for(uint32_t i = 0; i < bets_per_thread; ++i) {
+                        const uint64_t id_deal = (uint64_t)t * 1000000000ULL + i;
+                        const uint32_t strategy_id = strategy_ids[strategy_dist(worker_gen)];
+                        const xtime::timestamp_t date = start_date + i * xtime::SECONDS_IN_MINUTE;
+
+                        double amount = 0;
+                        auto start = std::chrono::steady_clock::now();
+                        vas.calc_amount(amount, strategy_id, false, 0.85, 0.6, 0.4);
+                        stats.calc_amount.add(start);
+                        if(amount <= 0) continue;
+
+                        start = std::chrono::steady_clock::now();
+                        vas.make_bet(id_deal, amount, strategy_id, false, 0.85, 0.6, 0.4, date);
+                        stats.make_bet.add(start);
+
+                        const uint32_t result = result_dist(worker_gen);
+                        start = std::chrono::steady_clock::now();
+                        if(result < 58) vas.set_win(id_deal, date);
+                        else if(result < 98) vas.set_loss(id_deal, date);
+                        else vas.set_standoff(id_deal, date);
+                        stats.settlement.add(start);
+
+                        start = std::chrono::steady_clock::now();
+                        vas.get_balance(false);
+                        stats.get_balance.add(start);
+                    }
+                }));
+            }
+            for(auto &it : workers) {
+                it.join();
+            }
+            const double bets_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_bets).count();
+
+            is_stop = true;
+            flush_thread.join();
+            reader_thread.join();
+
+            const auto start = std::chrono::steady_clock::now();
+            vas.push(true);
+            flush.add(start);
+
+            std::cout << "import: " << std::fixed << std::setprecision(3)
+                << (import.samples[0] / 1000000.0d) << " s"
+                << " bets: " << bets_time << " s" << std::endl;
+        }
+
+        WorkerStats total;
+        for(auto &it : workers_stats) {
+            total.calc_amount.merge(it.calc_amount);
+            total.make_bet.merge(it.make_bet);
+            total.settlement.merge(it.settlement);
+            total.get_balance.merge(it.get_balance);
+        }
+
+        std::cout
+            << std::left << std::setw(16) << "operation (us)" << std::right
+            << std::setw(10) << "count"
+            << std::setw(12) << "p50"
+            << std::setw(12) << "p90"
+            << std::setw(12) << "p99"
+            << std::setw(12) << "p99.9"
+            << std::setw(12) << "max"
+            << std::endl;
+        total.calc_amount.print("calc_amount");
+        total.make_bet.print("make_bet");
+        total.settlement.print("settlement");
+        total.get_balance.print("get_balance");
+        flush.print("flush");
+        reader.print("reader");
+
+        remove_database(shards_number);
+    }
+
+    /** \brief Получить количество ставок на поток по умолчанию
+     */
+    inline uint32_t get_default_bets_per_thread(const uint32_t accounts_number) {
+        return std::max((uint32_t)10, std::min((uint32_t)1000, 100000 / std::max(accounts_number, (uint32_t)1)));
+    }
+};
+
+int main(int argc, char **argv) {
+    const uint32_t threads_number = argc > 2 ? std::stoul(argv[2]) : 4;
+    if(argc > 1) {
+        const uint32_t accounts_number = std::stoul(argv[1]);
+        const uint32_t bets_per_thread = argc > 3 ? std::stoul(argv[3]) : get_default_bets_per_thread(accounts_number);
+        const size_t shards_number = argc > 4 ? std::stoul(argv[4]) : 0;
+        if(shards_number == 0) run_benchmark<open_bo_api::VirtualAccounts>(accounts_number, threads_number, bets_per_thread, 0);
+        else run_benchmark<open_bo_api::ShardedVirtualAccounts>(accounts_number, threads_number, bets_per_thread, shards_number);
+    } else {
+        const uint32_t list_accounts_number[] = {10, 1000, 100000};
+        for(const uint32_t accounts_number : list_accounts_number) {
+            const uint32_t bets_per_thread = get_default_bets_per_thread(accounts_number);
+            run_benchmark<open_bo_api::VirtualAccounts>(accounts_number, threads_number, bets_per_thread, 0);
+            run_benchmark<open_bo_api::ShardedVirtualAccounts>(accounts_number, threads_number, bets_per_thread, default_shards_number);
+        }
+    }
+    return EXIT_SUCCESS;
+}
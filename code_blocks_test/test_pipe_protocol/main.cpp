@@ -0,0 +1,83 @@
+/*
+* open-bo-api - C++ API for working with binary options brokers
+*
+* Copyright (c) 2020 Elektro Yar. Email: git.electroyar@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#include "open-bo-api-pipe-protocol.hpp"
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+
+using namespace open_bo_api::pipe_protocol;
+
+int main(int argc, char **argv) {
+    /* кадр со свечами, размер которого не кратен размеру сообщения канала */
+    std::vector<std::string> symbols;
+    std::vector<CandleRecord> records;
+    for(uint32_t i = 0; i < 28; ++i) {
+        symbols.push_back("SYM" + std::to_string(i));
+        CandleRecord record;
+        record.symbol_index = i;
+        record.timestamp = 1600000000 + i;
+        record.close = 1.0 + i;
+        records.push_back(record);
+    }
+    const std::string frame = encode_candles(symbols, records);
+    std::cout << "frame size: " << frame.size() << std::endl;
+
+    const size_t frames_number = 10000;
+    std::string stream;
+    for(size_t i = 0; i < frames_number; ++i) stream += frame;
+
+    size_t received = 0;
+    FrameDecoder decoder([&](const FrameView &view) {
+        if(view.get_records_number() == records.size()) ++received;
+    });
+
+    /* подаем поток частями по 1024 байта, границы кадров не совпадают с границами частей */
+    const size_t chunk_size = 1024;
+    size_t max_buffer_size = 0;
+    for(size_t offset = 0; offset < stream.size(); offset += chunk_size) {
+        const size_t len = std::min(chunk_size, stream.size() - offset);
+        if(!decoder.push(stream.data() + offset, len)) {
+            std::cout << "error: stream is damaged" << std::endl;
+            return EXIT_FAILURE;
+        }
+        max_buffer_size = std::max(max_buffer_size, decoder.get_buffer_size());
+    }
+    std::cout << "received frames: " << received << " max buffer size: " << max_buffer_size << std::endl;
+
+    if(received != frames_number) {
+        std::cout << "error: frames lost" << std::endl;
+        return EXIT_FAILURE;
+    }
+    /* в буфере не может оставаться больше одного незавершенного кадра */
+    if(max_buffer_size >= frame.size()) {
+        std::cout << "error: decoder buffer is not bounded" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if(decoder.get_buffer_size() != 0) {
+        std::cout << "error: decoder buffer is not empty" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "ok" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,450 @@
+/*
+* open-bo-api - C++ API for working with binary options brokers
+*
+* Copyright (c) 2020 Elektro Yar. Email: git.electroyar@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#if defined(_WIN32)
+/* winsock2.h должен подключаться раньше windows.h */
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#endif
+#include "open-bo-api-telegram.hpp"
+#include <iostream>
+#include <thread>
+#include <cstring>
+#include <cstdlib>
+
+#if defined(_WIN32)
+typedef SOCKET socket_t;
+#else
+typedef int socket_t;
+#define INVALID_SOCKET (-1)
+#define closesocket close
+#endif
+
+/** \brief Минимальный HTTP сервер, отвечающий на запросы sendMessage
+ *
+ * Сервер поддерживает keep-alive, запоминает каждый запрос и может
+ * задерживать ответ или возвращать ошибку для выбранных чатов
+ */
+class LocalHttpServer {
+public:
+    /// Принятый запрос
+    class Request {
+    public:
+        std::string path;
+        int64_t chat_id = 0;
+        std::string text;
+        std::chrono::steady_clock::time_point arrival;
+    };
+
+private:
+    socket_t listen_socket = INVALID_SOCKET;
+    uint16_t port = 0;
+    std::atomic<bool> is_stop = ATOMIC_VAR_INIT(false);
+    std::thread accept_thread;
+
+    std::mutex connections_mutex;
+    std::vector<socket_t> connections;
+    std::vector<std::thread> connection_threads;
+
+    std::mutex requests_mutex;
+    std::vector<Request> requests;
+    std::map<int64_t, uint32_t> delays;     /**< Задержка ответа для чата (мс) */
+    std::map<int64_t, uint32_t> failures;   /**< Количество ответов с ошибкой для чата */
+
+    static std::string url_decode(const std::string &value) {
+        std::string out;
+        for(size_t i = 0; i < value.size(); ++i) {
+            if(value[i] == '+') {
+                out += ' ';
+            } else
+            if(value[i] == '%' && (i + 2) < value.size()) {
+                out += (char)std::stoi(value.substr(i + 1, 2), nullptr, 16);
+                i += 2;
+            } else {
+                out += value[i];
+            }
+        }
+        return out;
+    }
+
+    static std::string get_form_value(const std::string &body, const std::string &key) {
+        const std::string prefix = key + "=";
+        size_t pos = 0;
+        while(pos < body.size()) {
+            size_t end = body.find('&', pos);
+            if(end == std::string::npos) end = body.size();
+            if(body.compare(pos, prefix.size(), prefix) == 0) {
+                return url_decode(body.substr(pos + prefix.size(), end - pos - prefix.size()));
+            }
+            pos = end + 1;
+        }
+        return std::string();
+    }
+
+    static bool send_all(const socket_t s, const std::string &data) {
+        size_t offset = 0;
+        while(offset < data.size()) {
+            const int len = ::send(s, data.data() + offset, (int)(data.size() - offset), 0);
+            if(len <= 0) return false;
+            offset += len;
+        }
+        return true;
+    }
+
+    /** \brief Обработать запрос и сформировать ответ
+     */
+    std::string process_request(const std::string &path, const std::string &body) {
+        Request request;
+        request.path = path;
+        request.chat_id = std::atoll(get_form_value(body, "chat_id").c_str());
+        request.text = get_form_value(body, "text");
+        request.arrival = std::chrono::steady_clock::now();
+
+        uint32_t delay = 0;
+        bool is_failure = false;
+        size_t message_id = 0;
+        {
+            std::lock_guard<std::mutex> lock(requests_mutex);
+            requests.push_back(request);
+            message_id = requests.size();
+            auto it_delay = delays.find(request.chat_id);
+            if(it_delay != delays.end()) delay = it_delay->second;
+            auto it_failure = failures.find(request.chat_id);
+            if(it_failure != failures.end() && it_failure->second > 0) {
+                --it_failure->second;
+                is_failure = true;
+            }
+        }
+        if(delay) std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+
+        std::string content;
+        std::string status;
+        if(is_failure) {
+            status = "429 Too Many Requests";
+            content = "{\"ok\":false,\"error_code\":429,\"description\":\"Too Many Requests\"}";
+        } else {
+            status = "200 OK";
+            content = "{\"ok\":true,\"result\":{\"message_id\":" + std::to_string(message_id) + "}}";
+        }
+        std::string response("HTTP/1.1 ");
+        response += status;
+        response += "\r\nContent-Type: application/json\r\nContent-Length: ";
+        response += std::to_string(content.size());
+        response += "\r\nConnection: keep-alive\r\n\r\n";
+        response += content;
+        return response;
+    }
+
+    /** \brief Поток обработки одного соединения
+     */
+    void connection_loop(const socket_t s) {
+        std::string buffer;
+        char data[4096];
+        while(!is_stop) {
+            /* ждем конец заголовка */
+            const size_t header_end = buffer.find("\r\n\r\n");
+            if(header_end == std::string::npos) {
+                const int len = ::recv(s, data, sizeof(data), 0);
+                if(len <= 0) break;
+                buffer.append(data, len);
+                continue;
+            }
+            const std::string header = buffer.substr(0, header_end);
+            size_t content_length = 0;
+            const std::string CONTENT_LENGTH = "\r\nContent-Length:";
+            const size_t length_pos = header.find(CONTENT_LENGTH);
+            if(length_pos != std::string::npos) {
+                content_length = std::atoi(header.c_str() + length_pos + CONTENT_LENGTH.size());
+            }
+            if(header.find("\r\nExpect: 100-continue") != std::string::npos &&
+                buffer.size() == header_end + 4) {
+                if(!send_all(s, "HTTP/1.1 100 Continue\r\n\r\n")) break;
+            }
+            /* ждем тело запроса */
+            while(buffer.size() < header_end + 4 + content_length) {
+                const int len = ::recv(s, data, sizeof(data), 0);
+                if(len <= 0) return;
+                buffer.append(data, len);
+            }
+            const std::string body = buffer.substr(header_end + 4, content_length);
+            buffer.erase(0, header_end + 4 + content_length);
+
+            /* строка запроса: POST /bot<token>/<method> HTTP/1.1 */
+            const size_t path_beg = header.find(' ');
+            const size_t path_end = header.find(' ', path_beg + 1);
+            const std::string path = header.substr(path_beg + 1, path_end - path_beg - 1);
+            if(!send_all(s, process_request(path, body))) break;
+        }
+    }
+
+    void accept_loop() {
+        while(!is_stop) {
+            const socket_t s = ::accept(listen_socket, NULL, NULL);
+            if(s == INVALID_SOCKET) continue;
+            std::lock_guard<std::mutex> lock(connections_mutex);
+            if(is_stop) {
+                closesocket(s);
+                break;
+            }
+            connections.push_back(s);
+            connection_threads.push_back(std::thread([this, s] {
+                connection_loop(s);
+            }));
+        }
+    }
+
+public:
+
+    LocalHttpServer() {
+#       if defined(_WIN32)
+        WSADATA wsa_data;
+        WSAStartup(MAKEWORD(2, 2), &wsa_data);
+#       endif
+        listen_socket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if(listen_socket == INVALID_SOCKET) return;
+        sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        socklen_t addr_len = sizeof(addr);
+        if(::bind(listen_socket, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+            ::listen(listen_socket, 16) != 0 ||
+            ::getsockname(listen_socket, (sockaddr*)&addr, &addr_len) != 0) {
+            closesocket(listen_socket);
+            listen_socket = INVALID_SOCKET;
+            return;
+        }
+        port = ntohs(addr.sin_port);
+        accept_thread = std::thread([this] {
+            accept_loop();
+        });
+    }
+
+    ~LocalHttpServer() {
+        is_stop = true;
+        if(listen_socket != INVALID_SOCKET) {
+            /* будим accept подключением к самому себе */
+            const socket_t s = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+            sockaddr_in addr;
+            std::memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port = htons(port);
+            ::connect(s, (sockaddr*)&addr, sizeof(addr));
+            accept_thread.join();
+            closesocket(s);
+            closesocket(listen_socket);
+        }
+        {
+            std::lock_guard<std::mutex> lock(connections_mutex);
+#           if defined(_WIN32)
+            for(size_t i = 0; i < connections.size(); ++i) shutdown(connections[i], SD_BOTH);
+#           else
+            for(size_t i = 0; i < connections.size(); ++i) shutdown(connections[i], SHUT_RDWR);
+#           endif
+        }
+        for(size_t i = 0; i < connection_threads.size(); ++i) {
+            connection_threads[i].join();
+            closesocket(connections[i]);
+        }
+#       if defined(_WIN32)
+        WSACleanup();
+#       endif
+    }
+
+    bool is_open() const {
+        return listen_socket != INVALID_SOCKET;
+    }
+
+    std::string get_url() const {
+        return "http://127.0.0.1:" + std::to_string(port);
+    }
+
+    void set_delay(const int64_t chat_id, const uint32_t delay) {
+        std::lock_guard<std::mutex> lock(requests_mutex);
+        delays[chat_id] = delay;
+    }
+
+    void set_failures(const int64_t chat_id, const uint32_t number) {
+        std::lock_guard<std::mutex> lock(requests_mutex);
+        failures[chat_id] = number;
+    }
+
+    std::vector<Request> get_requests(const int64_t chat_id) {
+        std::lock_guard<std::mutex> lock(requests_mutex);
+        std::vector<Request> out;
+        for(size_t i = 0; i < requests.size(); ++i) {
+            if(requests[i].chat_id == chat_id) out.push_back(requests[i]);
+        }
+        return out;
+    }
+
+    std::vector<Request> get_requests() {
+        std::lock_guard<std::mutex> lock(requests_mutex);
+        return requests;
+    }
+};
+
+/** \brief Разбить объединенные сообщения на исходные строки
+ */
+std::vector<std::string> get_lines(const std::vector<LocalHttpServer::Request> &requests) {
+    std::vector<std::string> lines;
+    for(size_t i = 0; i < requests.size(); ++i) {
+        size_t start = 0;
+        while(true) {
+            const size_t end = requests[i].text.find('\n', start);
+            lines.push_back(requests[i].text.substr(start, end - start));
+            if(end == std::string::npos) break;
+            start = end + 1;
+        }
+    }
+    return lines;
+}
+
+inline int64_t get_milliseconds(
+        const std::chrono::steady_clock::time_point &start,
+        const std::chrono::steady_clock::time_point &stop) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
+}
+
+int main(int argc, char **argv) {
+    LocalHttpServer server;
+    if(!server.is_open()) {
+        std::cout << "error: local http server" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "api url: " << server.get_url() << std::endl;
+
+    const std::string token("123456:test-token");
+    open_bo_api::TelegramApi telegram(token, "", "", "curl-ca-bundle.crt", "test_telegram_chat_id.json", 10);
+    telegram.set_api_url(server.get_url());
+    telegram.set_max_connections(4);
+    /* ограничения частоты не должны влиять на проверки */
+    telegram.set_rate_limits(1000.0d, 1000.0d, 1000.0d);
+
+    /* порядок сообщений одного чата и объединение сообщений, пока чат занят отправкой */
+    const int64_t ORDER_CHAT = 101;
+    const size_t ORDER_MESSAGES = 30;
+    server.set_delay(ORDER_CHAT, 300);
+    for(size_t i = 0; i < ORDER_MESSAGES; ++i) {
+        telegram.send_message(ORDER_CHAT, "message " + std::to_string(i) + " & text");
+    }
+    telegram.wait();
+    {
+        const std::vector<LocalHttpServer::Request> requests = server.get_requests(ORDER_CHAT);
+        const std::vector<std::string> lines = get_lines(requests);
+        std::cout << "order: " << ORDER_MESSAGES << " messages, " << requests.size() << " requests" << std::endl;
+        for(size_t i = 0; i < requests.size(); ++i) {
+            if(requests[i].path != "/bot" + token + "/sendMessage") {
+                std::cout << "error: path " << requests[i].path << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        if(lines.size() != ORDER_MESSAGES) {
+            std::cout << "error: received " << lines.size() << " messages" << std::endl;
+            return EXIT_FAILURE;
+        }
+        for(size_t i = 0; i < lines.size(); ++i) {
+            if(lines[i] != "message " + std::to_string(i) + " & text") {
+                std::cout << "error: message " << i << " out of order: " << lines[i] << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        if(requests.size() >= ORDER_MESSAGES) {
+            std::cout << "error: messages were not coalesced" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* медленный чат не задерживает отправку в другой чат */
+    const int64_t SLOW_CHAT = 201;
+    const int64_t FAST_CHAT = -202;
+    const uint32_t SLOW_DELAY = 1500;
+    server.set_delay(SLOW_CHAT, SLOW_DELAY);
+    telegram.send_message(SLOW_CHAT, "slow");
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    telegram.send_message(FAST_CHAT, "fast");
+    telegram.wait();
+    {
+        const std::vector<LocalHttpServer::Request> slow = server.get_requests(SLOW_CHAT);
+        const std::vector<LocalHttpServer::Request> fast = server.get_requests(FAST_CHAT);
+        if(slow.size() != 1 || fast.size() != 1 || slow[0].text != "slow" || fast[0].text != "fast") {
+            std::cout << "error: concurrency, requests " << slow.size() << " " << fast.size() << std::endl;
+            return EXIT_FAILURE;
+        }
+        const int64_t delay = get_milliseconds(slow[0].arrival, fast[0].arrival);
+        std::cout << "concurrency: fast chat after " << delay << " ms" << std::endl;
+        if(delay >= (SLOW_DELAY / 2)) {
+            std::cout << "error: fast chat waited for slow chat" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* сообщение с ошибкой откладывается и блокирует только свой чат */
+    const int64_t RETRY_CHAT = 301;
+    const int64_t OTHER_CHAT = 302;
+    const uint32_t RETRY_FAILURES = 2;
+    server.set_failures(RETRY_CHAT, RETRY_FAILURES);
+    const std::chrono::steady_clock::time_point retry_start = std::chrono::steady_clock::now();
+    telegram.send_message(RETRY_CHAT, "alert 1", true, open_bo_api::TelegramApi::PRIORITY_ALERT);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    telegram.send_message(RETRY_CHAT, "alert 2", true, open_bo_api::TelegramApi::PRIORITY_ALERT);
+    telegram.send_message(OTHER_CHAT, "other");
+    telegram.wait();
+    {
+        const std::vector<LocalHttpServer::Request> retry = server.get_requests(RETRY_CHAT);
+        const std::vector<LocalHttpServer::Request> other = server.get_requests(OTHER_CHAT);
+        const std::vector<std::string> expected = {"alert 1", "alert 1", "alert 1", "alert 2"};
+        std::cout << "retry: " << retry.size() << " requests, delivered after "
+            << (retry.empty() ? 0 : get_milliseconds(retry_start, retry.back().arrival)) << " ms" << std::endl;
+        if(retry.size() != expected.size()) {
+            std::cout << "error: retry requests " << retry.size() << std::endl;
+            return EXIT_FAILURE;
+        }
+        for(size_t i = 0; i < retry.size(); ++i) {
+            if(retry[i].text != expected[i]) {
+                std::cout << "error: retry message " << i << ": " << retry[i].text << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        /* задержки 1000 и 2000 мс между попытками */
+        const int64_t parked_time = get_milliseconds(retry[0].arrival, retry[RETRY_FAILURES].arrival);
+        if(parked_time < 2500) {
+            std::cout << "error: retry was not parked, " << parked_time << " ms" << std::endl;
+            return EXIT_FAILURE;
+        }
+        if(other.size() != 1 || other[0].arrival >= retry[1].arrival) {
+            std::cout << "error: other chat waited for parked message" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::cout << "ok" << std::endl;
+    return EXIT_SUCCESS;
+}
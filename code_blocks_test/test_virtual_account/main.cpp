@@ -42,7 +42,7 @@ int main(int argc, char **argv) {
     open_bo_api::VirtualAccounts vas("test.db");
     std::cout << "vas size: " << vas.get_virtual_accounts().size() << std::endl;
     std::cout << "vas balance: " << vas.get_balance(is_demo) << std::endl;
-    std::string strategy("TEST2");
+    const uint32_t strategy = vas.get_strategy_id("TEST2");
 
     //double b = 10000;
 
@@ -28,11 +28,15 @@
 #include "intrade-bar-common.hpp"
 #include "intrade-bar-api.hpp"
 #include "intrade-bar-payout-model.hpp"
+#include "open-bo-api-payout-table.hpp"
+#include "open-bo-api-common.hpp"
+#include "open-bo-api-symbol-registry.hpp"
 
 /* брокер olymptrade */
 #include "olymp-trade-api.hpp"
 
 #include <mt-bridge.hpp>
+#include <memory>
 
 namespace open_bo_api {
     //using json = nlohmann::json;
@@ -82,6 +86,15 @@ namespace open_bo_api {
     };
 
     class IntradeBar {
+    private:
+
+        /** \brief Получить ссылку на текущую таблицу выплат
+         */
+        inline static std::shared_ptr<const IntradeBarPayoutTable> &payout_table() {
+            static std::shared_ptr<const IntradeBarPayoutTable> table;
+            return table;
+        }
+
     public:
         using Api = intrade_bar::IntradeBarApi;
         using BetStatus = intrade_bar::IntradeBarHttpApi::BetStatus;
@@ -89,11 +102,67 @@ namespace open_bo_api {
 
         IntradeBar() {}
 
+        /** \brief Построить таблицу выплат
+         *
+         * После построения get_amount и get_payout читают проценты выплат из таблицы.
+         * Запросы, которых нет в таблице, по-прежнему вычисляются моделью выплат
+         * \param durations Длительности опционов в секундах
+         * \param timestamp Метка времени недели, для которой строится таблица
+         * \return Вернет true, если таблица построена
+         */
+        inline static bool build_payout_table(
+                const std::vector<uint32_t> &durations,
+                const xtime::timestamp_t timestamp) {
+            IntradeBarPayoutTableConfig config;
+            config.symbols = get_list_symbols();
+            config.durations = durations;
+            return build_payout_table(config, timestamp);
+        }
+
+        /** \brief Построить таблицу выплат
+         * \param config Параметры таблицы выплат
+         * \param timestamp Метка времени недели, для которой строится таблица
+         * \return Вернет true, если таблица построена
+         */
+        inline static bool build_payout_table(
+                const IntradeBarPayoutTableConfig &config,
+                const xtime::timestamp_t timestamp) {
+            std::shared_ptr<IntradeBarPayoutTable> table = std::make_shared<IntradeBarPayoutTable>();
+            if(!table->build(config, timestamp)) return false;
+            std::atomic_store(&payout_table(), std::shared_ptr<const IntradeBarPayoutTable>(table));
+            return true;
+        }
+
+        /** \brief Получить таблицу выплат
+         * \return Таблица выплат или пустой указатель, если таблица не построена
+         */
+        inline static std::shared_ptr<const IntradeBarPayoutTable> get_payout_table() {
+            return std::atomic_load(&payout_table());
+        }
+
         /** \brief Получить список символов
+         *
+         * Список создается один раз, метод возвращает ссылку на него
          * \return список символов
          */
-        inline const static std::vector<std::string> get_list_symbols() {
-            return std::vector<std::string>(intrade_bar_common::currency_pairs.begin(),intrade_bar_common::currency_pairs.end());
+        inline static const std::vector<std::string> &get_list_symbols() {
+            static const std::vector<std::string> list_symbols(
+                intrade_bar_common::currency_pairs.begin(),
+                intrade_bar_common::currency_pairs.end());
+            return list_symbols;
+        }
+
+        /** \brief Получить номера символов в реестре символов
+         *
+         * При первом вызове символы регистрируются в реестре с отметкой брокера intrade.bar
+         * \return номера символов в порядке списка символов
+         */
+        inline static const std::vector<SymbolId> &get_list_symbol_ids() {
+            static const std::vector<SymbolId> list_symbol_ids =
+                SymbolRegistry::instance().register_symbols(
+                    get_list_symbols(),
+                    static_cast<int32_t>(ListBrokers::INTRADE_BAR));
+            return list_symbol_ids;
         }
 
 #if(0)
@@ -122,6 +191,112 @@ namespace open_bo_api {
         }
 #endif
 
+        /** \brief Получить абсолютный размер ставки и процент выплат по индексам таблицы выплат
+         *
+         * Индексы символа и длительности находятся заранее, например один раз на пакет сигналов.
+         * Если таблица не построена или запрос в нее не попадает, используется модель выплат
+         * \param amount Размер ставки в абсолютном значении
+         * \param payout Процент выплат
+         * \param table Таблица выплат (может быть пустой)
+         * \param symbol_index Индекс символа в таблице выплат или -1
+         * \param duration_index Индекс длительности в таблице выплат или -1
+         * \param symbol_name Имя валютной пары для модели выплат
+         * \param timestamp Метка времени (GMT)
+         * \param duration Длительность опциона в секундах
+         * \param is_rub Рублевый счет
+         * \param balance Размер баланса
+         * \param winrate Винрейт стратегии
+         * \param attenuator Ослабление коэффициента Келли
+         * \param payout_limiter Ограничитель процента выплат
+         * \param winrate_limiter Ограничитель винрейта
+         * \return состояние выплаты (0 в случае успеха, иначе см. payout_model::IntradeBar::PayoutCancelType)
+         */
+        inline static int get_amount(
+                double &amount,
+                double &payout,
+                const IntradeBarPayoutTable *table,
+                const int32_t symbol_index,
+                const int32_t duration_index,
+                const std::string &symbol_name,
+                const xtime::timestamp_t timestamp,
+                const uint32_t duration,
+                const bool is_rub,
+                const double balance,
+                const double winrate,
+                const double attenuator,
+                const double payout_limiter = 1.0,
+                const double winrate_limiter = 1.0) {
+            if(table) {
+                int32_t state = payout_model::OK;
+                if(table->find_amount(
+                        amount,
+                        payout,
+                        state,
+                        symbol_index,
+                        timestamp,
+                        duration_index,
+                        is_rub,
+                        balance,
+                        winrate,
+                        attenuator,
+                        payout_limiter,
+                        winrate_limiter)) return state;
+            }
+            payout_model::IntradeBar pm;
+            pm.set_rub_account_currency(is_rub);
+            return pm.get_amount(
+                amount,
+                payout,
+                symbol_name,
+                timestamp,
+                duration,
+                balance,
+                winrate,
+                attenuator,
+                payout_limiter,
+                winrate_limiter);
+        }
+
+        /** \brief Получить проценты выплат по индексам таблицы выплат
+         *
+         * Если таблица не построена или запрос в нее не попадает, используется модель выплат
+         * \param payout Процент выплат
+         * \param table Таблица выплат (может быть пустой)
+         * \param symbol_index Индекс символа в таблице выплат или -1
+         * \param duration_index Индекс длительности в таблице выплат или -1
+         * \param symbol_name Имя валютной пары для модели выплат
+         * \param timestamp Метка времени (GMT)
+         * \param duration Длительность опциона в секундах
+         * \param is_rub Рублевый счет
+         * \param amount Размер ставки
+         * \return состояние выплаты (0 в случае успеха, иначе см. payout_model::IntradeBar::PayoutCancelType)
+         */
+        inline static int get_payout(
+                double &payout,
+                const IntradeBarPayoutTable *table,
+                const int32_t symbol_index,
+                const int32_t duration_index,
+                const std::string &symbol_name,
+                const xtime::timestamp_t timestamp,
+                const uint32_t duration,
+                const bool is_rub,
+                const double amount) {
+            if(table) {
+                int32_t state = payout_model::OK;
+                if(table->find_payout(
+                        payout,
+                        state,
+                        symbol_index,
+                        timestamp,
+                        duration_index,
+                        is_rub,
+                        amount)) return state;
+            }
+            payout_model::IntradeBar pm;
+            pm.set_rub_account_currency(is_rub);
+            return pm.get_payout(payout,symbol_name,timestamp,duration,amount);
+        }
+
          /** \brief Получить абсолютный размер ставки и процент выплат
           *
           * Проценты выплат варьируются обычно от 0 до 1.0, где 1.0 соответствует 100% выплате брокера
@@ -150,14 +325,17 @@ namespace open_bo_api {
                 const double attenuator,
                 const double payout_limiter = 1.0,
                 const double winrate_limiter = 1.0) {
-            payout_model::IntradeBar pm;
-            pm.set_rub_account_currency(is_rub);
-            return pm.get_amount(
+            std::shared_ptr<const IntradeBarPayoutTable> table = get_payout_table();
+            return get_amount(
                 amount,
                 payout,
+                table.get(),
+                table ? table->get_symbol_index(symbol_name) : -1,
+                table ? table->get_duration_index(duration) : -1,
                 symbol_name,
                 timestamp,
                 duration,
+                is_rub,
                 balance,
                 winrate,
                 attenuator,
@@ -184,9 +362,77 @@ namespace open_bo_api {
                 const uint32_t duration,
                 const bool is_rub,
                 const double amount) {
-            payout_model::IntradeBar pm;
-            pm.set_rub_account_currency(is_rub);
-            return pm.get_payout(payout,symbol_name,timestamp,duration,amount);
+            std::shared_ptr<const IntradeBarPayoutTable> table = get_payout_table();
+            return get_payout(
+                payout,
+                table.get(),
+                table ? table->get_symbol_index(symbol_name) : -1,
+                table ? table->get_duration_index(duration) : -1,
+                symbol_name,
+                timestamp,
+                duration,
+                is_rub,
+                amount);
+        }
+
+        /** \brief Получить абсолютный размер ставки и процент выплат по номеру символа
+         *
+         * Номер символа сразу дает индекс в таблице выплат, без поиска по строке
+         * \param symbol_id Номер символа в реестре символов
+         * \return состояние выплаты (0 в случае успеха, иначе см. payout_model::IntradeBar::PayoutCancelType)
+         */
+        inline static int get_amount(
+                double &amount,
+                double &payout,
+                const SymbolId symbol_id,
+                const xtime::timestamp_t timestamp,
+                const uint32_t duration,
+                const bool is_rub,
+                const double balance,
+                const double winrate,
+                const double attenuator,
+                const double payout_limiter = 1.0,
+                const double winrate_limiter = 1.0) {
+            std::shared_ptr<const IntradeBarPayoutTable> table = get_payout_table();
+            return get_amount(
+                amount,
+                payout,
+                table.get(),
+                table ? table->get_symbol_index(symbol_id) : -1,
+                table ? table->get_duration_index(duration) : -1,
+                SymbolRegistry::instance().get_name(symbol_id),
+                timestamp,
+                duration,
+                is_rub,
+                balance,
+                winrate,
+                attenuator,
+                payout_limiter,
+                winrate_limiter);
+        }
+
+        /** \brief Получить проценты выплат по номеру символа
+         * \param symbol_id Номер символа в реестре символов
+         * \return состояние выплаты (0 в случае успеха, иначе см. payout_model::IntradeBar::PayoutCancelType)
+         */
+        inline static int get_payout(
+                double &payout,
+                const SymbolId symbol_id,
+                const xtime::timestamp_t timestamp,
+                const uint32_t duration,
+                const bool is_rub,
+                const double amount) {
+            std::shared_ptr<const IntradeBarPayoutTable> table = get_payout_table();
+            return get_payout(
+                payout,
+                table.get(),
+                table ? table->get_symbol_index(symbol_id) : -1,
+                table ? table->get_duration_index(duration) : -1,
+                SymbolRegistry::instance().get_name(symbol_id),
+                timestamp,
+                duration,
+                is_rub,
+                amount);
         }
     };
 };
@@ -0,0 +1,548 @@
+/*
+* open-bo-api - C++ API for working with binary options brokers
+*
+* Copyright (c) 2020 Elektro Yar. Email: git.electroyar@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef OPEN_BO_API_COMPETITION_ENGINE_HPP_INCLUDED
+#define OPEN_BO_API_COMPETITION_ENGINE_HPP_INCLUDED
+
+#include "open-bo-api-competition.hpp"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+
+namespace open_bo_api {
+
+    /** \brief Интерфейс брокера для конкуренции брокеров
+     *
+     * Чтобы добавить брокера, достаточно реализовать этот интерфейс
+     * и зарегистрировать его в CompetitionEngine
+     */
+    class BrokerAdapter {
+    public:
+
+        virtual ~BrokerAdapter() {};
+
+        /** \brief Получить тип брокера
+         */
+        virtual ListBrokers get_broker() const = 0;
+
+        /** \brief Получить размер ставки и процент выплат
+         *
+         * Метод вызывается на пути принятия решения, поэтому должен использовать
+         * закэшированные проценты выплат, а не запросы к серверу брокера
+         * \param amount Размер ставки в абсолютном значении
+         * \param payout Процент выплат
+         * \param symbol_name Имя валютной пары
+         * \param timestamp Метка времени (GMT)
+         * \param duration Длительность опциона в секундах
+         * \param balance Размер баланса
+         * \param winrate Винрейт стратегии
+         * \param attenuator Ослабление коэффициента Келли
+         * \param payout_limiter Ограничитель процента выплат
+         * \return состояние выплаты (0 в случае успеха)
+         */
+        virtual int get_amount(
+            double &amount,
+            double &payout,
+            const std::string &symbol_name,
+            const xtime::timestamp_t timestamp,
+            const uint32_t duration,
+            const double balance,
+            const double winrate,
+            const double attenuator,
+            const double payout_limiter) = 0;
+
+        /** \brief Получить баланс счета брокера
+         */
+        virtual double get_balance() = 0;
+
+        /** \brief Получить количество секунд до закрытия бара, с которых брокер принимает сделки
+         *
+         * Например, 2 означает, что сделки можно открывать на 58, 59 и 0 секунде
+         */
+        virtual uint32_t get_window_seconds() const = 0;
+
+        /** \brief Проверить, зависит ли процент выплат от минуты открытия сделки
+         *
+         * Если зависит, то до закрытия бара дополнительно проверяются условия
+         * следующей минуты, и сделка откладывается, если они лучше
+         */
+        virtual bool check_time_dependent_payout() const {
+            return false;
+        }
+
+        /** \brief Получить ожидаемую задержку открытия сделки в миллисекундах
+         */
+        virtual uint32_t get_expected_latency() const {
+            return 0;
+        }
+    };
+
+    /** \brief Адаптер брокера intrade.bar
+     *
+     * Проценты выплат берутся из таблицы выплат, если она построена
+     */
+    class IntradeBarAdapter : public BrokerAdapter {
+    private:
+        open_bo_api::IntradeBar::Api &api;
+        bool is_rub = true;
+
+    public:
+
+        IntradeBarAdapter(open_bo_api::IntradeBar::Api &broker_api, const bool is_rub_account) :
+            api(broker_api), is_rub(is_rub_account) {};
+
+        ListBrokers get_broker() const override {
+            return ListBrokers::INTRADE_BAR;
+        }
+
+        int get_amount(
+                double &amount,
+                double &payout,
+                const std::string &symbol_name,
+                const xtime::timestamp_t timestamp,
+                const uint32_t duration,
+                const double balance,
+                const double winrate,
+                const double attenuator,
+                const double payout_limiter) override {
+            return open_bo_api::IntradeBar::get_amount(
+                amount,
+                payout,
+                symbol_name,
+                timestamp,
+                duration,
+                is_rub,
+                balance,
+                winrate,
+                attenuator,
+                payout_limiter);
+        }
+
+        double get_balance() override {
+            return api.get_balance();
+        }
+
+        uint32_t get_window_seconds() const override {
+            return 1;
+        }
+
+        bool check_time_dependent_payout() const override {
+            return true;
+        }
+    };
+
+    /** \brief Адаптер брокера olymptrade
+     */
+    class OlympTradeAdapter : public BrokerAdapter {
+    private:
+        open_bo_api::OlympTrade::Api &api;
+
+    public:
+
+        OlympTradeAdapter(open_bo_api::OlympTrade::Api &broker_api) :
+            api(broker_api) {};
+
+        ListBrokers get_broker() const override {
+            return ListBrokers::OLYMP_TRADE;
+        }
+
+        int get_amount(
+                double &amount,
+                double &payout,
+                const std::string &symbol_name,
+                const xtime::timestamp_t timestamp,
+                const uint32_t duration,
+                const double balance,
+                const double winrate,
+                const double attenuator,
+                const double payout_limiter) override {
+            return open_bo_api::OlympTrade::get_amount(
+                amount,
+                payout,
+                api,
+                symbol_name,
+                duration,
+                balance,
+                winrate,
+                attenuator,
+                payout_limiter);
+        }
+
+        double get_balance() override {
+            return api.get_balance();
+        }
+
+        uint32_t get_window_seconds() const override {
+            return 2;
+        }
+    };
+
+    /** \brief Движок конкуренции брокеров
+     *
+     * Выбирает лучшее условие среди зарегистрированных брокеров.
+     * 1. Сделки принимаются в самом узком окне среди включенных брокеров.
+     * 2. Брокер, у которого ожидаемая задержка открытия сделки превышает
+     * заданный для него бюджет, не участвует в выборе.
+     * 3. Если до закрытия бара у брокера с зависящими от времени выплатами
+     * следующая минута не хуже лучшего текущего условия, сделка откладывается (CANCEL).
+     * 4. При равных процентах выплат выбирается брокер с меньшей задержкой,
+     * затем брокер, зарегистрированный раньше.
+     */
+    class CompetitionEngine {
+    public:
+
+        /** \brief Результат выбора брокера
+         */
+        class Decision {
+        public:
+            int32_t broker_index = -1;  /**< Индекс брокера в движке */
+            ListBrokers broker = ListBrokers::NOT_SELECTED; /**< Тип брокера */
+            double amount = 0.0d;       /**< Размер ставки в абсолютном значении */
+            double payout = 0.0d;       /**< Процент выплат */
+            StateCompetition state = StateCompetition::LOW_PAYMENT; /**< Состояние конкуренции */
+
+            Decision() {};
+        };
+
+    private:
+
+        /** \brief Зарегистрированный брокер
+         */
+        class Venue {
+        public:
+            std::shared_ptr<BrokerAdapter> adapter;
+            bool is_enabled = true;
+            uint32_t latency_budget = 0;    /**< Бюджет задержки в миллисекундах, 0 - без ограничения */
+            uint32_t measured_latency = 0;  /**< Измеренная задержка в миллисекундах */
+            bool is_measured = false;
+
+            Venue() {};
+        };
+
+        /** \brief Снимок состояния брокера на время принятия решения
+         */
+        class VenueState {
+        public:
+            BrokerAdapter *adapter = nullptr;
+            int32_t index = -1;
+            double balance = 0.0d;
+            uint32_t latency = 0;
+
+            VenueState() {};
+        };
+
+        /** \brief Предложение брокера
+         */
+        class Offer {
+        public:
+            const VenueState *venue = nullptr;
+            double amount = 0.0d;
+            double payout = 0.0d;
+
+            Offer() {};
+        };
+
+        mutable std::mutex venues_mutex;
+        std::vector<Venue> venues;  /**< Список брокеров, его меняют только под venues_mutex */
+        std::shared_ptr<const std::vector<Venue>> published_venues; /**< Неизменяемый снимок списка брокеров */
+
+        /** \brief Опубликовать снимок списка брокеров
+         *
+         * Вызывается под venues_mutex после каждого изменения списка
+         */
+        void publish_venues() {
+            std::atomic_store(&published_venues, std::make_shared<const std::vector<Venue>>(venues));
+        }
+
+        /** \brief Получить включенных брокеров
+         * \param snapshot Снимок списка брокеров
+         * \param states Включенные брокеры
+         * \return Количество секунд окна приема сделок
+         */
+        static uint32_t get_venue_states(
+                const std::shared_ptr<const std::vector<Venue>> &snapshot,
+                std::vector<VenueState> &states) {
+            states.clear();
+            uint32_t window_seconds = xtime::SECONDS_IN_MINUTE;
+            if(!snapshot) return window_seconds;
+            for(size_t i = 0; i < snapshot->size(); ++i) {
+                const Venue &venue = (*snapshot)[i];
+                if(!venue.is_enabled) continue;
+                const uint32_t latency = venue.is_measured ?
+                    venue.measured_latency : venue.adapter->get_expected_latency();
+                if(venue.latency_budget != 0 && latency > venue.latency_budget) continue;
+                VenueState state;
+                state.adapter = venue.adapter.get();
+                state.index = i;
+                state.latency = latency;
+                states.push_back(state);
+                window_seconds = std::min(window_seconds, venue.adapter->get_window_seconds());
+            }
+            return window_seconds;
+        }
+
+        /** \brief Проверить, что предложение a лучше предложения b
+         */
+        inline static bool check_better(const Offer &a, const Offer &b) {
+            if(!b.venue) return true;
+            if(a.payout != b.payout) return a.payout > b.payout;
+            if(a.venue->latency != b.venue->latency) return a.venue->latency < b.venue->latency;
+            return a.venue->index < b.venue->index;
+        }
+
+        Decision decide(
+                const std::vector<VenueState> &states,
+                const std::string &symbol_name,
+                const xtime::timestamp_t timestamp,
+                const bool is_next_minute,
+                const uint32_t duration,
+                const double balance,
+                const double winrate,
+                const double attenuator,
+                const double payout_limiter) const {
+            const xtime::timestamp_t next_timestamp =
+                xtime::get_first_timestamp_minute(timestamp) + xtime::SECONDS_IN_MINUTE;
+            Offer best, best_next;
+            double max_payout = 0.0d;
+            for(size_t i = 0; i < states.size(); ++i) {
+                const VenueState &venue = states[i];
+                Offer offer;
+                offer.venue = &venue;
+                venue.adapter->get_amount(
+                    offer.amount,
+                    offer.payout,
+                    symbol_name,
+                    timestamp,
+                    duration,
+                    balance,
+                    winrate,
+                    attenuator,
+                    payout_limiter);
+                max_payout = std::max(max_payout, offer.payout);
+                if(offer.amount > 0 && check_better(offer, best)) best = offer;
+
+                if(!is_next_minute || !venue.adapter->check_time_dependent_payout()) continue;
+                Offer next_offer;
+                next_offer.venue = &venue;
+                venue.adapter->get_amount(
+                    next_offer.amount,
+                    next_offer.payout,
+                    symbol_name,
+                    next_timestamp,
+                    duration,
+                    balance,
+                    winrate,
+                    attenuator,
+                    payout_limiter);
+                if(next_offer.amount > 0 && check_better(next_offer, best_next)) best_next = next_offer;
+            }
+
+            Decision decision;
+            const bool is_wait = best_next.venue && (!best.venue || best_next.payout >= best.payout);
+            const Offer &selected = is_wait ? best_next : best;
+            if(!selected.venue) {
+                decision.payout = max_payout;
+                decision.state = StateCompetition::LOW_PAYMENT;
+                return decision;
+            }
+            decision.broker_index = selected.venue->index;
+            decision.broker = selected.venue->adapter->get_broker();
+            decision.amount = selected.amount;
+            decision.payout = selected.payout;
+            if(decision.amount >= selected.venue->balance) decision.state = StateCompetition::LOW_DEPOSIT_BALANCE;
+            else decision.state = is_wait ? StateCompetition::CANCEL : StateCompetition::OK;
+            return decision;
+        }
+
+        /** \brief Проверить время и подготовить брокеров к принятию решения
+         */
+        StateCompetition prepare(
+                std::vector<VenueState> &states,
+                bool &is_next_minute,
+                const xtime::timestamp_t timestamp) const {
+            /* список брокеров читается из опубликованного снимка без блокировки */
+            const uint32_t window_seconds = get_venue_states(std::atomic_load(&published_venues), states);
+            if(states.empty()) return StateCompetition::NO_BROKERS;
+            const uint32_t second = xtime::get_second_minute(timestamp);
+            if(second != 0 && second < (xtime::SECONDS_IN_MINUTE - window_seconds)) return StateCompetition::WAIT_CLOSING_PRICE;
+            is_next_minute = second != 0;
+            /* балансы запрашиваются один раз на решение */
+            for(size_t i = 0; i < states.size(); ++i) {
+                states[i].balance = states[i].adapter->get_balance();
+            }
+            return StateCompetition::OK;
+        }
+
+    public:
+
+        CompetitionEngine() {};
+
+        /** \brief Зарегистрировать брокера
+         * \param adapter Адаптер брокера
+         * \param latency_budget Бюджет задержки открытия сделки в миллисекундах, 0 - без ограничения
+         * \return Индекс брокера в движке
+         */
+        size_t add_broker(const std::shared_ptr<BrokerAdapter> &adapter, const uint32_t latency_budget = 0) {
+            std::lock_guard<std::mutex> lock(venues_mutex);
+            Venue venue;
+            venue.adapter = adapter;
+            venue.latency_budget = latency_budget;
+            venues.push_back(venue);
+            publish_venues();
+            return venues.size() - 1;
+        }
+
+        /** \brief Включить или выключить брокера
+         * \param broker_index Индекс брокера
+         * \param is_enabled Флаг участия брокера в конкуренции
+         */
+        void set_enabled(const size_t broker_index, const bool is_enabled) {
+            std::lock_guard<std::mutex> lock(venues_mutex);
+            if(broker_index >= venues.size()) return;
+            venues[broker_index].is_enabled = is_enabled;
+            publish_venues();
+        }
+
+        /** \brief Установить бюджет задержки брокера
+         * \param broker_index Индекс брокера
+         * \param latency_budget Бюджет задержки в миллисекундах, 0 - без ограничения
+         */
+        void set_latency_budget(const size_t broker_index, const uint32_t latency_budget) {
+            std::lock_guard<std::mutex> lock(venues_mutex);
+            if(broker_index >= venues.size()) return;
+            venues[broker_index].latency_budget = latency_budget;
+            publish_venues();
+        }
+
+        /** \brief Учесть измеренную задержку открытия сделки
+         *
+         * Задержка сглаживается экспоненциальным средним и заменяет ожидаемую задержку адаптера
+         * \param broker_index Индекс брокера
+         * \param latency Измеренная задержка в миллисекундах
+         */
+        void update_latency(const size_t broker_index, const uint32_t latency) {
+            std::lock_guard<std::mutex> lock(venues_mutex);
+            if(broker_index >= venues.size()) return;
+            Venue &venue = venues[broker_index];
+            if(!venue.is_measured) {
+                venue.measured_latency = latency;
+                venue.is_measured = true;
+            } else {
+                venue.measured_latency = (venue.measured_latency * 7 + latency) / 8;
+            }
+            publish_venues();
+        }
+
+        /** \brief Получить количество зарегистрированных брокеров
+         */
+        size_t size() const {
+            const std::shared_ptr<const std::vector<Venue>> snapshot = std::atomic_load(&published_venues);
+            return snapshot ? snapshot->size() : 0;
+        }
+
+        /** \brief Выбрать брокера для одного сигнала
+         * \param decision Результат выбора брокера
+         * \param symbol_name Имя валютной пары
+         * \param timestamp Метка времени (GMT)
+         * \param duration Длительность опциона в секундах
+         * \param balance Размер баланса
+         * \param winrate Винрейт стратегии
+         * \param attenuator Ослабление коэффициента Келли
+         * \param payout_limiter Ограничитель процента выплат
+         * \return Состояние конкуренции брокеров
+         */
+        StateCompetition calc(
+                Decision &decision,
+                const std::string &symbol_name,
+                const xtime::timestamp_t timestamp,
+                const uint32_t duration,
+                const double balance,
+                const double winrate,
+                const double attenuator,
+                const double payout_limiter = 1.0) const {
+            decision = Decision();
+            std::vector<VenueState> states;
+            bool is_next_minute = false;
+            const StateCompetition state = prepare(states, is_next_minute, timestamp);
+            if(state != StateCompetition::OK) {
+                decision.state = state;
+                return state;
+            }
+            decision = decide(states, symbol_name, timestamp, is_next_minute, duration, balance, winrate, attenuator, payout_limiter);
+            return decision.state;
+        }
+
+        /** \brief Выбрать брокеров для всех сигналов
+         *
+         * Результаты отсортированы так же, как в пакетном calc_brokers_competition
+         * \param results Результаты по каждому сигналу
+         * \param signals Список сигналов
+         * \param timestamp Метка времени (GMT)
+         * \param duration Длительность опциона в секундах
+         * \param balance Размер баланса
+         * \param attenuator Ослабление коэффициента Келли
+         * \param payout_limiter Ограничитель процента выплат
+         * \return Вернет OK, если сигналы были обработаны, иначе состояние, общее для всего пакета
+         */
+        StateCompetition calc(
+                std::vector<CompetitionResult> &results,
+                const std::vector<CompetitionSignal> &signals,
+                const xtime::timestamp_t timestamp,
+                const uint32_t duration,
+                const double balance,
+                const double attenuator,
+                const double payout_limiter = 1.0) const {
+            results.clear();
+            std::vector<VenueState> states;
+            bool is_next_minute = false;
+            const StateCompetition state = prepare(states, is_next_minute, timestamp);
+            if(state != StateCompetition::OK) return state;
+            results.resize(signals.size());
+            for(size_t i = 0; i < signals.size(); ++i) {
+                const Decision decision = decide(
+                    states,
+                    signals[i].symbol_name,
+                    timestamp,
+                    is_next_minute,
+                    duration,
+                    balance,
+                    signals[i].winrate,
+                    attenuator,
+                    payout_limiter);
+                CompetitionResult &result = results[i];
+                result.signal_index = i;
+                result.symbol_name = signals[i].symbol_name;
+                result.broker_index = decision.broker_index;
+                result.broker = decision.broker;
+                result.amount = decision.amount;
+                result.payout = decision.payout;
+                result.state = decision.state;
+            }
+            sort_competition_results(results);
+            return StateCompetition::OK;
+        }
+    };
+};
+
+#endif // OPEN_BO_API_COMPETITION_ENGINE_HPP_INCLUDED
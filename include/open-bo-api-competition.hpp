@@ -28,6 +28,9 @@
 #include "open-bo-api-settings.hpp"
 #include "open-bo-api-brokers.hpp"
 #include "intrade-bar-payout-model.hpp"
+#include <vector>
+#include <memory>
+#include <algorithm>
 
 namespace open_bo_api {
 
@@ -42,6 +45,76 @@ namespace open_bo_api {
         CANCEL = -5,
     };
 
+    /** \brief Выбрать брокера по уже рассчитанным размерам ставок и процентам выплат
+     *
+     * \param broker Возвращаемое значение, тип брокера
+     * \param amount Возвращаемое значение, размер ставки в абсолютном значении
+     * \param payout Возвращаемое значение, процент выплат
+     * \param settings Настройки
+     * \param second Секунда минуты
+     * \param intrade_bar_amount Размер ставки intrade.bar за текущую минуту
+     * \param intrade_bar_payout Процент выплат intrade.bar за текущую минуту
+     * \param intrade_bar_next_amount Размер ставки intrade.bar за следующую минуту
+     * \param intrade_bar_next_payout Процент выплат intrade.bar за следующую минуту
+     * \param olymp_trade_amount Размер ставки olymptrade
+     * \param olymp_trade_payout Процент выплат olymptrade
+     * \param intrade_bar_balance Баланс intrade.bar
+     * \param olymp_trade_balance Баланс olymptrade
+     * \return Состояние конкуренции брокеров
+     */
+    inline StateCompetition select_broker_competition(
+            ListBrokers &broker,
+            double &amount,
+            double &payout,
+            const Settings &settings,
+            const uint32_t second,
+            const double intrade_bar_amount,
+            const double intrade_bar_payout,
+            const double intrade_bar_next_amount,
+            const double intrade_bar_next_payout,
+            const double olymp_trade_amount,
+            const double olymp_trade_payout,
+            const double intrade_bar_balance,
+            const double olymp_trade_balance) {
+        if (settings.is_olymp_trade &&
+            olymp_trade_payout > intrade_bar_next_payout &&
+            olymp_trade_payout > intrade_bar_payout &&
+            olymp_trade_amount > 0) {
+            payout = olymp_trade_payout;
+            amount = olymp_trade_amount;
+            broker = open_bo_api::ListBrokers::OLYMP_TRADE;
+            if(amount >= olymp_trade_balance)
+                return StateCompetition::LOW_DEPOSIT_BALANCE;
+            return StateCompetition::OK;
+        } else
+        if (settings.is_intrade_bar &&
+            intrade_bar_payout > intrade_bar_next_payout &&
+            intrade_bar_amount > 0) {
+            payout = intrade_bar_payout;
+            amount = intrade_bar_amount;
+            broker = open_bo_api::ListBrokers::INTRADE_BAR;
+            if(amount >= intrade_bar_balance)
+                return StateCompetition::LOW_DEPOSIT_BALANCE;
+            return StateCompetition::OK;
+        } else
+        if (settings.is_intrade_bar &&
+            second == 59 &&
+            intrade_bar_payout <= intrade_bar_next_payout &&
+            intrade_bar_next_amount > 0) {
+            payout = intrade_bar_next_payout;
+            amount = intrade_bar_next_amount;
+            broker = open_bo_api::ListBrokers::INTRADE_BAR;
+            if(amount >= intrade_bar_balance)
+                return StateCompetition::LOW_DEPOSIT_BALANCE;
+            return StateCompetition::CANCEL;
+        } else {
+            amount = 0;
+            payout = std::max(olymp_trade_payout, intrade_bar_payout);
+            return StateCompetition::LOW_PAYMENT;
+        }
+        return StateCompetition::OK;
+    }
+
     /** \brief Получить конкурирующий размер ставки и процент выплат
       *
       * Данная функция находит наилучшее условие из предоставленных для торговли брокеров.
@@ -136,45 +209,193 @@ namespace open_bo_api {
                 attenuator,
                 settings.trading_robot_payout_limiter);
 
+        return select_broker_competition(
+            broker,
+            amount,
+            payout,
+            settings,
+            second,
+            intrade_bar_amount,
+            intrade_bar_payout,
+            intrade_bar_next_amount,
+            intrade_bar_next_payout,
+            olymp_trade_amount,
+            olymp_trade_payout,
+            intrade_bar.get_balance(),
+            olymp_trade.get_balance());
+    }
+
+    /** \brief Сигнал для пакетной конкуренции брокеров
+     */
+    class CompetitionSignal {
+    public:
+        std::string symbol_name;    /**< Имя валютной пары */
+        double winrate = 0.0d;      /**< Винрейт стратегии */
+
+        CompetitionSignal() {};
+
+        CompetitionSignal(const std::string &name, const double signal_winrate) :
+            symbol_name(name), winrate(signal_winrate) {};
+    };
+
+    /** \brief Результат пакетной конкуренции брокеров
+     */
+    class CompetitionResult {
+    public:
+        size_t signal_index = 0;    /**< Индекс сигнала в исходном списке */
+        std::string symbol_name;    /**< Имя валютной пары */
+        int32_t broker_index = -1;  /**< Индекс брокера в CompetitionEngine, -1 если брокер не выбран или движок не используется */
+        ListBrokers broker = ListBrokers::NOT_SELECTED; /**< Выбранный брокер */
+        double amount = 0.0d;       /**< Размер ставки в абсолютном значении */
+        double payout = 0.0d;       /**< Процент выплат */
+        StateCompetition state = StateCompetition::LOW_PAYMENT; /**< Состояние конкуренции */
+
+        CompetitionResult() {};
+    };
+
+    /** \brief Отсортировать результаты пакетной конкуренции брокеров
+     *
+     * Сначала идут результаты с состоянием OK по убыванию процента выплат и размера ставки,
+     * затем остальные в исходном порядке
+     * \param results Результаты конкуренции брокеров
+     */
+    inline void sort_competition_results(std::vector<CompetitionResult> &results) {
+        std::stable_sort(results.begin(), results.end(),
+                [](const CompetitionResult &a, const CompetitionResult &b) {
+            const bool is_a_ok = a.state == StateCompetition::OK;
+            const bool is_b_ok = b.state == StateCompetition::OK;
+            if(is_a_ok != is_b_ok) return is_a_ok;
+            if(!is_a_ok) return false;
+            if(a.payout != b.payout) return a.payout > b.payout;
+            return a.amount > b.amount;
+        });
+    }
+
+    /** \brief Получить конкурирующие размеры ставок и проценты выплат для всех сигналов
+      *
+      * Пакетный вариант calc_brokers_competition. Проверка времени и чтение балансов
+      * брокеров выполняются один раз на весь пакет, проценты выплат intrade.bar
+      * за текущую и следующую минуту берутся из таблицы выплат (см. IntradeBar::build_payout_table).
+      * Правила выбора брокера для каждого сигнала такие же, как в calc_brokers_competition:
+      * проценты выплат обоих брокеров считаются всегда, даже если один из них выключен в настройках.
+      * Результаты отсортированы: сначала сигналы с состоянием OK по убыванию процента выплат,
+      * затем остальные в исходном порядке.
+      *
+      * \param results Возвращаемое значение, результаты по каждому сигналу
+      * \param intrade_bar Ссылка на класс брокера Intrade.bar
+      * \param olymp_trade Ссылка на класс брокера OlympTrade
+      * \param settings Настройки
+      * \param signals Список сигналов
+      * \param timestamp Метка времени (GMT)
+      * \param duration Длительность опциона в секундах
+      * \param is_rub Рублевый счет
+      * \param balance Размер баланса
+      * \param attenuator Ослабление коэффициента Келли, желательно использовать значения не боьше 0.4
+      * \return Вернет OK, если сигналы были обработаны, иначе состояние, общее для всего пакета
+      */
+    inline StateCompetition calc_brokers_competition(
+            std::vector<CompetitionResult> &results,
+            open_bo_api::IntradeBar::Api &intrade_bar,
+            open_bo_api::OlympTrade::Api &olymp_trade,
+            const Settings &settings,
+            const std::vector<CompetitionSignal> &signals,
+            const xtime::timestamp_t timestamp,
+            const uint32_t duration,
+            const bool is_rub,
+            const double balance,
+            const double attenuator) {
+        results.clear();
+
+        /* проверяем время один раз для всего пакета */
+        const uint32_t second = xtime::get_second_minute(timestamp);
+        if(settings.is_olymp_trade && (second < 58 && second != 0)) return StateCompetition::WAIT_CLOSING_PRICE;
+        else if(settings.is_intrade_bar && (second != 59 && second != 0)) return StateCompetition::WAIT_CLOSING_PRICE;
+        else if(!settings.is_olymp_trade && !settings.is_intrade_bar) return StateCompetition::NO_BROKERS;
+
+        const bool is_next_minute =
+            (settings.is_olymp_trade && second >= 58) ||
+            (!settings.is_olymp_trade && second == 59);
+        const xtime::timestamp_t next_timestamp =
+            xtime::get_first_timestamp_minute(timestamp) + xtime::SECONDS_IN_MINUTE;
+
+        /* балансы запрашиваются один раз */
         const double intrade_bar_balance = intrade_bar.get_balance();
         const double olymp_trade_balance = olymp_trade.get_balance();
 
-        if (settings.is_olymp_trade &&
-            olymp_trade_payout > intrade_bar_next_payout &&
-            olymp_trade_payout > intrade_bar_payout &&
-            olymp_trade_amount > 0) {
-            payout = olymp_trade_payout;
-            amount = olymp_trade_amount;
-            broker = open_bo_api::ListBrokers::OLYMP_TRADE;
-            if(amount >= olymp_trade_balance)
-                return StateCompetition::LOW_DEPOSIT_BALANCE;
-            return StateCompetition::OK;
-        } else
-        if (settings.is_intrade_bar &&
-            intrade_bar_payout > intrade_bar_next_payout &&
-            intrade_bar_amount > 0) {
-            payout = intrade_bar_payout;
-            amount = intrade_bar_amount;
-            broker = open_bo_api::ListBrokers::INTRADE_BAR;
-            if(amount >= intrade_bar_balance)
-                return StateCompetition::LOW_DEPOSIT_BALANCE;
-            return StateCompetition::OK;
-        } else
-        if (settings.is_intrade_bar &&
-            second == 59 &&
-            intrade_bar_payout <= intrade_bar_next_payout &&
-            intrade_bar_next_amount > 0) {
-            payout = intrade_bar_next_payout;
-            amount = intrade_bar_next_amount;
-            broker = open_bo_api::ListBrokers::INTRADE_BAR;
-            if(amount >= intrade_bar_balance)
-                return StateCompetition::LOW_DEPOSIT_BALANCE;
-            return StateCompetition::CANCEL;
-        } else {
-            amount = 0;
-            payout = std::max(olymp_trade_payout, intrade_bar_payout);
-            return StateCompetition::LOW_PAYMENT;
+        std::shared_ptr<const IntradeBarPayoutTable> table = open_bo_api::IntradeBar::get_payout_table();
+        const int32_t duration_index = table ? table->get_duration_index(duration) : -1;
+
+        results.resize(signals.size());
+        for(size_t i = 0; i < signals.size(); ++i) {
+            const CompetitionSignal &signal = signals[i];
+            CompetitionResult &result = results[i];
+            result.signal_index = i;
+            result.symbol_name = signal.symbol_name;
+
+            /* как и в calc_brokers_competition, выплаты выключенного брокера тоже участвуют в сравнении */
+            double intrade_bar_amount = 0, intrade_bar_payout = 0;
+            double intrade_bar_next_amount = 0, intrade_bar_next_payout = 0;
+            const int32_t symbol_index = table ? table->get_symbol_index(signal.symbol_name) : -1;
+            open_bo_api::IntradeBar::get_amount(
+                intrade_bar_amount,
+                intrade_bar_payout,
+                table.get(),
+                symbol_index,
+                duration_index,
+                signal.symbol_name,
+                timestamp,
+                duration,
+                is_rub,
+                balance,
+                signal.winrate,
+                attenuator,
+                settings.trading_robot_payout_limiter);
+            if(is_next_minute) {
+                open_bo_api::IntradeBar::get_amount(
+                    intrade_bar_next_amount,
+                    intrade_bar_next_payout,
+                    table.get(),
+                    symbol_index,
+                    duration_index,
+                    signal.symbol_name,
+                    next_timestamp,
+                    duration,
+                    is_rub,
+                    balance,
+                    signal.winrate,
+                    attenuator,
+                    settings.trading_robot_payout_limiter);
+            }
+
+            double olymp_trade_amount = 0, olymp_trade_payout = 0;
+            open_bo_api::OlympTrade::get_amount(
+                olymp_trade_amount,
+                olymp_trade_payout,
+                olymp_trade,
+                signal.symbol_name,
+                duration,
+                balance,
+                signal.winrate,
+                attenuator,
+                settings.trading_robot_payout_limiter);
+
+            result.state = select_broker_competition(
+                result.broker,
+                result.amount,
+                result.payout,
+                settings,
+                second,
+                intrade_bar_amount,
+                intrade_bar_payout,
+                intrade_bar_next_amount,
+                intrade_bar_next_payout,
+                olymp_trade_amount,
+                olymp_trade_payout,
+                intrade_bar_balance,
+                olymp_trade_balance);
         }
+
+        sort_competition_results(results);
         return StateCompetition::OK;
     }
 
@@ -0,0 +1,349 @@
+/*
+* open-bo-api - C++ API for working with binary options brokers
+*
+* Copyright (c) 2020 Elektro Yar. Email: git.electroyar@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef OPEN_BO_API_DAILY_BALANCE_INDEX_HPP_INCLUDED
+#define OPEN_BO_API_DAILY_BALANCE_INDEX_HPP_INCLUDED
+
+#include <vector>
+#include <map>
+#include <cmath>
+#include <algorithm>
+
+#include "xtime.hpp"
+
+namespace open_bo_api {
+
+    /** \brief Статистика депозита за диапазон дат
+     */
+    class DailyBalanceStats {
+    public:
+        double start_balance = 0.0d;    /**< Баланс перед началом диапазона */
+        double stop_balance = 0.0d;     /**< Баланс на конец диапазона */
+        double gain = 1.0d;             /**< Усиление депозита за диапазон */
+        double drawdown = 0.0d;         /**< Максимальная относительная просадка внутри диапазона (от 0 до 1) */
+        double volatility = 0.0d;       /**< Стандартное отклонение дневных логарифмических доходностей */
+        uint32_t days = 0;              /**< Количество дней в диапазоне */
+
+        DailyBalanceStats() {};
+    };
+
+    /** \brief Индекс депозита по дням
+     *
+     * Индекс хранит плотный массив балансов на закрытие каждого дня,
+     * начиная с первого дня торговли (дни без торговли наследуют баланс предыдущего дня),
+     * а также префиксные суммы логарифмических доходностей и их квадратов.
+     * Усиление и волатильность за любой диапазон дат считаются за O(1),
+     * просадка - за O(log n) по дереву отрезков.
+     */
+    class DailyBalanceIndex {
+    private:
+
+        /** \brief Узел дерева отрезков для расчета просадки
+         */
+        class Node {
+        public:
+            double max_balance = 0.0d;
+            double min_balance = 0.0d;
+            double drawdown = 0.0d;
+            bool empty = true;
+
+            Node() {};
+
+            Node(const double balance) :
+                max_balance(balance), min_balance(balance), drawdown(0.0d), empty(false) {};
+        };
+
+        xtime::timestamp_t start_day = 0;   /**< Метка времени первого дня индекса */
+        double start_balance = 0.0d;        /**< Баланс до первого дня индекса */
+
+        std::vector<double> balances;           /**< Баланс на закрытие каждого дня */
+        std::vector<double> prefix_log_return;  /**< Префиксная сумма логарифмических доходностей (элемент i включает день i - 1) */
+        std::vector<double> prefix_sq_log_return;   /**< Префиксная сумма квадратов логарифмических доходностей */
+        std::vector<Node> tree;                 /**< Дерево отрезков по балансам */
+        size_t tree_size = 0;                   /**< Количество листьев дерева (степень двойки) */
+
+        static Node combine(const Node &left, const Node &right) {
+            if(left.empty) return right;
+            if(right.empty) return left;
+            Node temp;
+            temp.empty = false;
+            temp.max_balance = std::max(left.max_balance, right.max_balance);
+            temp.min_balance = std::min(left.min_balance, right.min_balance);
+            const double cross_drawdown = left.max_balance > 0.0d ? 1.0d - right.min_balance / left.max_balance : 0.0d;
+            temp.drawdown = std::max(std::max(left.drawdown, right.drawdown), cross_drawdown);
+            return temp;
+        }
+
+        static double calc_log_return(const double prev_balance, const double balance) {
+            if(prev_balance <= 0.0d || balance <= 0.0d) return 0.0d;
+            return std::log(balance / prev_balance);
+        }
+
+        void build_tree() {
+            tree_size = 1;
+            while(tree_size < balances.size()) tree_size <<= 1;
+            tree.assign(2 * tree_size, Node());
+            for(size_t i = 0; i < balances.size(); ++i) {
+                tree[tree_size + i] = Node(balances[i]);
+            }
+            for(size_t i = tree_size - 1; i > 0; --i) {
+                tree[i] = combine(tree[2 * i], tree[2 * i + 1]);
+            }
+        }
+
+        void update_tree(size_t index) {
+            size_t pos = tree_size + index;
+            tree[pos] = Node(balances[index]);
+            for(pos >>= 1; pos > 0; pos >>= 1) {
+                tree[pos] = combine(tree[2 * pos], tree[2 * pos + 1]);
+            }
+        }
+
+        Node query_tree(size_t l, size_t r) const {
+            Node left_node, right_node;
+            for(l += tree_size, r += tree_size + 1; l < r; l >>= 1, r >>= 1) {
+                if(l & 1) left_node = combine(left_node, tree[l++]);
+                if(r & 1) right_node = combine(tree[--r], right_node);
+            }
+            return combine(left_node, right_node);
+        }
+
+        /** \brief Добавить день в конец индекса
+         */
+        void push_back(const double balance) {
+            const double prev_balance = balances.empty() ? start_balance : balances.back();
+            const double log_return = calc_log_return(prev_balance, balance);
+            balances.push_back(balance);
+            prefix_log_return.push_back(prefix_log_return.back() + log_return);
+            prefix_sq_log_return.push_back(prefix_sq_log_return.back() + log_return * log_return);
+            if(balances.size() > tree_size) build_tree();
+            else update_tree(balances.size() - 1);
+        }
+
+        /** \brief Получить номер дня относительно начала индекса
+         */
+        inline int64_t get_day_index(const xtime::timestamp_t date) const {
+            const int64_t day = (int64_t)xtime::get_first_timestamp_day(date);
+            return (day - (int64_t)start_day) / (int64_t)xtime::SECONDS_IN_DAY;
+        }
+
+        /** \brief Получить баланс на закрытие дня с учетом выхода за пределы индекса
+         */
+        inline double get_balance_at(const int64_t index) const {
+            if(index < 0 || balances.empty()) return start_balance;
+            if(index >= (int64_t)balances.size()) return balances.back();
+            return balances[index];
+        }
+
+    public:
+
+        DailyBalanceIndex() {
+            prefix_log_return.push_back(0.0d);
+            prefix_sq_log_return.push_back(0.0d);
+        };
+
+        /** \brief Перестроить индекс
+         *
+         * \param date_balance Данные депозита по дням
+         * \param start_timestamp Дата начала торговли
+         * \param initial_balance Начальный депозит
+         */
+        void build(
+                const std::map<xtime::timestamp_t, double> &date_balance,
+                const xtime::timestamp_t start_timestamp,
+                const double initial_balance) {
+            start_balance = initial_balance;
+            start_day = xtime::get_first_timestamp_day(start_timestamp);
+            if(!date_balance.empty()) {
+                const xtime::timestamp_t first_day = xtime::get_first_timestamp_day(date_balance.begin()->first);
+                /* если дата начала торговли не задана, индекс начинается с первого дня торговли */
+                start_day = start_timestamp == 0 ? first_day : std::min(start_day, first_day);
+            }
+            balances.clear();
+            prefix_log_return.assign(1, 0.0d);
+            prefix_sq_log_return.assign(1, 0.0d);
+            tree_size = 0;
+            for(auto &it : date_balance) {
+                const int64_t index = get_day_index(it.first);
+                /* дни без торговли наследуют баланс предыдущего дня */
+                while((int64_t)balances.size() < index) {
+                    balances.push_back(balances.empty() ? start_balance : balances.back());
+                }
+                if((int64_t)balances.size() == index) balances.push_back(it.second);
+                else balances.back() = it.second;
+            }
+            double prev_balance = start_balance;
+            for(size_t i = 0; i < balances.size(); ++i) {
+                const double log_return = calc_log_return(prev_balance, balances[i]);
+                prefix_log_return.push_back(prefix_log_return.back() + log_return);
+                prefix_sq_log_return.push_back(prefix_sq_log_return.back() + log_return * log_return);
+                prev_balance = balances[i];
+            }
+            build_tree();
+        }
+
+        /** \brief Обновить баланс на закрытие дня
+         *
+         * Обновление последнего дня или добавление новых дней выполняется инкрементально
+         * \param date Метка времени даты
+         * \param balance Баланс
+         * \param date_balance Данные депозита по дням (нужны для перестроения, если день в прошлом)
+         * \param start_timestamp Дата начала торговли
+         * \param initial_balance Начальный депозит
+         */
+        void update(
+                const xtime::timestamp_t date,
+                const double balance,
+                const std::map<xtime::timestamp_t, double> &date_balance,
+                const xtime::timestamp_t start_timestamp,
+                const double initial_balance) {
+            const int64_t index = get_day_index(date);
+            if(balances.empty() || index < 0 || start_balance != initial_balance ||
+               (balances.size() > 0 && index + 1 < (int64_t)balances.size())) {
+                build(date_balance, start_timestamp, initial_balance);
+                return;
+            }
+            if(index + 1 == (int64_t)balances.size()) {
+                /* обновляем последний день */
+                const double prev_balance = get_balance_at(index - 1);
+                const double log_return = calc_log_return(prev_balance, balance);
+                balances[index] = balance;
+                prefix_log_return[index + 1] = prefix_log_return[index] + log_return;
+                prefix_sq_log_return[index + 1] = prefix_sq_log_return[index] + log_return * log_return;
+                update_tree(index);
+                return;
+            }
+            while((int64_t)balances.size() < index) {
+                push_back(balances.empty() ? start_balance : balances.back());
+            }
+            push_back(balance);
+        }
+
+        /** \brief Получить количество дней в индексе
+         */
+        inline size_t size() const {
+            return balances.size();
+        }
+
+        /** \brief Получить статистику депозита за диапазон дат
+         *
+         * \param start_date Первый день диапазона
+         * \param stop_date Последний день диапазона (включительно)
+         * \return Статистика депозита
+         */
+        DailyBalanceStats get_stats(
+                const xtime::timestamp_t start_date,
+                const xtime::timestamp_t stop_date) const {
+            DailyBalanceStats stats;
+            const int64_t a = get_day_index(start_date);
+            const int64_t b = get_day_index(stop_date);
+            if(b < a) return stats;
+            stats.days = b - a + 1;
+            stats.start_balance = get_balance_at(a - 1);
+            stats.stop_balance = get_balance_at(b);
+            stats.gain = stats.start_balance == 0.0d ? 1.0d : stats.stop_balance / stats.start_balance;
+
+            /* дни за пределами индекса имеют нулевую доходность */
+            const int64_t n = balances.size();
+            const int64_t l = std::max(a, (int64_t)0);
+            const int64_t r = std::min(b, n - 1);
+            if(l > r) return stats;
+
+            const double sum = prefix_log_return[r + 1] - prefix_log_return[l];
+            const double sum_sq = prefix_sq_log_return[r + 1] - prefix_sq_log_return[l];
+            const double mean = sum / (double)stats.days;
+            const double variance = sum_sq / (double)stats.days - mean * mean;
+            stats.volatility = variance > 0.0d ? std::sqrt(variance) : 0.0d;
+
+            const Node node = combine(Node(stats.start_balance), query_tree(l, r));
+            stats.drawdown = node.drawdown;
+            return stats;
+        }
+
+        /** \brief Проверить, можно ли добавить незакрытый день к индексу при запросе
+         *
+         * \param tail_date Метка времени незакрытого дня
+         * \return Вернет true, если день идет после последнего дня индекса
+         */
+        inline bool check_tail(const xtime::timestamp_t tail_date) const {
+            const int64_t t = get_day_index(tail_date);
+            return t >= 0 && t >= (int64_t)balances.size();
+        }
+
+        /** \brief Получить статистику депозита за диапазон дат с учетом незакрытого дня
+         *
+         * Незакрытый день не хранится в индексе, а добавляется к нему только на время запроса.
+         * Так индекс не меняется, пока идет торговля внутри дня, и его можно разделять между копиями аккаунта
+         * \param start_date Первый день диапазона
+         * \param stop_date Последний день диапазона (включительно)
+         * \param tail_date Метка времени незакрытого дня (см. check_tail)
+         * \param tail_balance Баланс незакрытого дня
+         * \return Статистика депозита
+         */
+        DailyBalanceStats get_stats(
+                const xtime::timestamp_t start_date,
+                const xtime::timestamp_t stop_date,
+                const xtime::timestamp_t tail_date,
+                const double tail_balance) const {
+            if(!check_tail(tail_date)) return get_stats(start_date, stop_date);
+            DailyBalanceStats stats;
+            const int64_t a = get_day_index(start_date);
+            const int64_t b = get_day_index(stop_date);
+            if(b < a) return stats;
+            const int64_t n = balances.size();
+            const int64_t t = get_day_index(tail_date);
+            const double last_balance = get_balance_at(n - 1);
+            stats.days = b - a + 1;
+            stats.start_balance = a - 1 < t ? get_balance_at(a - 1) : tail_balance;
+            stats.stop_balance = b < t ? get_balance_at(b) : tail_balance;
+            stats.gain = stats.start_balance == 0.0d ? 1.0d : stats.stop_balance / stats.start_balance;
+
+            double sum = 0.0d;
+            double sum_sq = 0.0d;
+            Node node(stats.start_balance);
+            const int64_t l = std::max(a, (int64_t)0);
+            const int64_t r = std::min(b, n - 1);
+            if(l <= r) {
+                sum = prefix_log_return[r + 1] - prefix_log_return[l];
+                sum_sq = prefix_sq_log_return[r + 1] - prefix_sq_log_return[l];
+                node = combine(node, query_tree(l, r));
+            }
+            /* дни между индексом и незакрытым днем наследуют баланс последнего дня индекса */
+            if(std::max(a, n) <= std::min(b, t - 1)) node = combine(node, Node(last_balance));
+            if(a <= t && t <= b) {
+                const double log_return = calc_log_return(last_balance, tail_balance);
+                sum += log_return;
+                sum_sq += log_return * log_return;
+                node = combine(node, Node(tail_balance));
+            }
+
+            const double mean = sum / (double)stats.days;
+            const double variance = sum_sq / (double)stats.days - mean * mean;
+            stats.volatility = variance > 0.0d ? std::sqrt(variance) : 0.0d;
+            stats.drawdown = node.drawdown;
+            return stats;
+        }
+    };
+};
+
+#endif // OPEN_BO_API_DAILY_BALANCE_INDEX_HPP_INCLUDED
@@ -5,6 +5,8 @@
 #include "easy_bo_standard_tester.hpp"
 #include "intrade-bar-payout-model.hpp"
 #include "grandcapital-payout-model.hpp"
+#include "open-bo-api-news-blackout.hpp"
+#include "open-bo-api-news-archive.hpp"
 
 namespace open_bo_api {
 
@@ -96,6 +98,8 @@ namespace open_bo_api {
         std::mutex brokers_mutex;
         std::map<BrokerType, std::shared_ptr<easy_bo::StandardTester>> brokers;
 
+        std::shared_ptr<const NewsBlackout> news_blackout;  /**< Карта запрета торговли по новостям */
+
         /** \brief Имитация загрузки исторических данных
          *
          * \param candles Массив баров. Размерность: индекс символа, бары
@@ -395,6 +399,74 @@ namespace open_bo_api {
             return candles;
         }
 
+        /** \brief Установить карту запрета торговли по новостям
+         *
+         * Карту нужно построить заранее для всего диапазона тестирования,
+         * после этого проверка фильтра новостей сводится к проверке одного бита
+         * \param blackout Карта запрета торговли по новостям
+         */
+        void set_news_blackout(const std::shared_ptr<const NewsBlackout> &blackout) {
+            std::atomic_store(&news_blackout, blackout);
+        }
+
+        /** \brief Построить карту запрета торговли по локальному архиву новостей
+         *
+         * Архив читается без обращения к серверу новостей, поэтому можно тестировать стратегии за несколько лет
+         * \param file_name Имя файла архива новостей
+         * \param parameters Параметры фильтра новостей
+         * \param start_timestamp Начало диапазона тестирования
+         * \param stop_timestamp Конец диапазона тестирования (включительно)
+         * \return Вернет true, если архив покрывает весь диапазон тестирования
+         */
+        bool load_news_archive(
+                const std::string &file_name,
+                const NewsFilterParameters &parameters,
+                const xtime::timestamp_t start_timestamp,
+                const xtime::timestamp_t stop_timestamp) {
+            NewsArchive archive(file_name);
+            if(!archive.open()) return false;
+            const xtime::timestamp_t archive_start = start_timestamp - parameters.indent_timestamp_past;
+            const xtime::timestamp_t archive_stop = stop_timestamp + parameters.indent_timestamp_future;
+            std::vector<ForexprostoolsApiEasy::News> list_news;
+            if(!archive.get_news(archive_start, archive_stop, list_news)) return false;
+            std::shared_ptr<NewsBlackout> blackout = std::make_shared<NewsBlackout>(
+                parameters,
+                start_timestamp,
+                stop_timestamp,
+                all_symbols);
+            blackout->update(list_news);
+            if(!archive.check_range(archive_start, archive_stop)) {
+                std::cerr << "open_bo_api::HistoryTester::load_news_archive(), the archive does not cover the testing range" << std::endl;
+                return false;
+            }
+            set_news_blackout(blackout);
+            return true;
+        }
+
+        /** \brief Проверить фильтр новостей
+         *
+         * Параметры фильтра задаются при построении карты запрета торговли по новостям
+         * \param symbol_name Имя валютной пары
+         * \param timestamp Метка времени
+         * \return Вернет true, если в заданных пределах времени есть новость, подходящая под фильтр
+         */
+        inline bool check_news_filter(const std::string &symbol_name, const xtime::timestamp_t timestamp) {
+            std::shared_ptr<const NewsBlackout> blackout = std::atomic_load(&news_blackout);
+            if(!blackout) return false;
+            return blackout->check(symbol_name, timestamp);
+        }
+
+        /** \brief Проверить фильтр новостей по номеру символа из реестра символов
+         * \param symbol_id Номер символа
+         * \param timestamp Метка времени
+         * \return Вернет true, если в заданных пределах времени есть новость, подходящая под фильтр
+         */
+        inline bool check_news_filter(const SymbolId symbol_id, const xtime::timestamp_t timestamp) {
+            std::shared_ptr<const NewsBlackout> blackout = std::atomic_load(&news_blackout);
+            if(!blackout) return false;
+            return blackout->check(symbol_id, timestamp);
+        }
+
         /** \brief Имитировать подключение к брокеру
          * \param broker_type Тип брокера
          * \param deposit Начальный депозит
@@ -25,16 +25,30 @@
 #define OPEN_BO_API_NAMED_PIPE_CLIENT_HPP_INCLUDED
 
 #include <iostream>
-#include <windows.h>
 #include <mutex>
 #include <atomic>
 #include <future>
+#include <thread>
+#include <functional>
 #include <system_error>
 #include <vector>
 #include <queue>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
 
 namespace open_bo_api {
 
+#if defined(_WIN32)
+
     class NamedPipeClient {
     private:
         HANDLE pipe = INVALID_HANDLE_VALUE;
@@ -283,6 +297,196 @@ namespace open_bo_api {
             stop();
         }
     };
+#else
+
+    /** \brief Класс клиента именованных каналов
+     *
+     * Реализация для POSIX систем на локальных сокетах (AF_UNIX, SOCK_SEQPACKET).
+     * Клиент подключается к файлу сокета /tmp/open-bo-api-<имя канала>.sock,
+     * который создает NamedPipeServer
+     */
+    class NamedPipeClient {
+    private:
+        int pipe = -1;
+        std::future<void> named_pipe_future;    /**< Поток для обработки сообщений */
+        std::atomic<bool> is_reset;             /**< Команда завершения работы */
+        std::atomic<bool> is_connect;
+
+        std::mutex send_mutex;
+
+        /** \brief Класс настроек соединения
+         */
+        class Config {
+        public:
+            std::string name;   /**< Имя */
+            size_t buffer_size; /**< Размер буфера для чтения и записи */
+            size_t timeout;     /**< Время ожидания данных в мс */
+
+            Config() : name("server"), buffer_size(1024), timeout(50) {
+            };
+        } config;
+
+        /** \brief Инициализировать клиент
+         *
+         * \param config Настройки клиента
+         * \return Вернет true, если инициализация прошла успешно
+         */
+        bool init(Config &config) {
+            if(named_pipe_future.valid()) return false;
+            if(config.name.find("/") != std::string::npos) return false;
+
+            /* путь к файлу сокета совпадает с путем на стороне сервера */
+            const std::string socket_path("/tmp/open-bo-api-" + config.name + ".sock");
+            struct sockaddr_un addr;
+            std::memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            if(socket_path.size() >= sizeof(addr.sun_path)) return false;
+            std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size());
+
+            named_pipe_future = std::async(std::launch::async,[
+                    &,
+                    addr,
+                    config]() {
+                /* устанавливаем связь с сервером */
+                while(!is_reset) {
+                    pipe = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+                    if(pipe >= 0 && connect(pipe, (const struct sockaddr*)&addr, sizeof(addr)) == 0) break;
+                    if(pipe >= 0) {
+                        ::close(pipe);
+                        pipe = -1;
+                    }
+                    /* сервер еще не запущен, повторяем попытку */
+                    for(size_t i = 0; i < 20 && !is_reset; ++i) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                    }
+                }
+                if(is_reset) return;
+
+                /* связь с сервером установлена */
+                is_connect = true;
+                if(on_open != nullptr) on_open();
+
+                std::vector<char> buffer(config.buffer_size);
+                while(!is_reset && is_connect) {
+                    /* ждем данные в сокете */
+                    struct pollfd fds;
+                    fds.fd = pipe;
+                    fds.events = POLLIN;
+                    fds.revents = 0;
+                    const int res = poll(&fds, 1, config.timeout);
+                    if(res == 0) continue;
+                    if(res < 0) {
+                        if(errno == EINTR) continue;
+                        if(on_error != nullptr) on_error(std::error_code(errno, std::generic_category()));
+                        break;
+                    }
+
+                    /* узнаем размер сообщения, чтобы не обрезать его */
+                    const ssize_t message_size = recv(pipe, &buffer[0], buffer.size(), MSG_PEEK | MSG_TRUNC);
+                    if(message_size > (ssize_t)buffer.size()) buffer.resize(message_size);
+
+                    /* читаем данные */
+                    const ssize_t bytes_read = recv(pipe, &buffer[0], buffer.size(), 0);
+                    if(is_reset) break;
+                    if(bytes_read == 0) break;
+                    if(bytes_read < 0) {
+                        if(errno == EINTR || errno == EAGAIN) continue;
+                        if(on_error != nullptr) on_error(std::error_code(errno, std::generic_category()));
+                        break;
+                    }
+                    if(on_message != nullptr) on_message(std::string(buffer.begin(), buffer.begin() + bytes_read));
+                } // while
+                {
+                    std::lock_guard<std::mutex> lock(send_mutex);
+                    is_connect = false;
+                    ::close(pipe);
+                    pipe = -1;
+                }
+                if(on_close != nullptr) on_close();
+            });
+            return true;
+        }
+    public:
+
+        std::function<void()> on_open;
+        std::function<void(const std::string &in_message)> on_message;
+        std::function<void()> on_close;
+        std::function<void(const std::error_code &)> on_error;
+
+        /** \brief Конструктор класса
+         * \param name Имя именнованного канала
+         * \param buffer_size Размер буфера
+         */
+        NamedPipeClient(
+            const std::string &name,
+            const size_t buffer_size = 1024) {
+            is_reset = false;
+            is_connect = false;
+            config.name = name;
+            config.buffer_size = buffer_size;
+        }
+
+        /** \brief Отправить сообщение
+         *
+         * Сообщение отправляется сразу из вызывающего потока
+         * \param out_message Сообщение
+         * \return Вернет true в случае успеха
+         */
+        bool send(const std::string &out_message) {
+            std::lock_guard<std::mutex> lock(send_mutex);
+            if(!is_connect) return false;
+            const ssize_t bytes_written = ::send(pipe, out_message.c_str(), out_message.size(), MSG_NOSIGNAL);
+            if(bytes_written < 0 || out_message.size() != (size_t)bytes_written) {
+                /* ошибка записи, закрываем соединение */
+                if(on_error != nullptr) {
+                    on_error(std::error_code(bytes_written < 0 ? errno : EMSGSIZE, std::generic_category()));
+                }
+                is_connect = false;
+                return false;
+            }
+            return true;
+        }
+
+        void close() {
+            is_reset = true;
+        }
+
+        /** \brief Запустить клиент
+         */
+        bool start() {
+            return init(config);
+        }
+
+        /** \brief Остановить клиент
+         */
+        void stop() {
+            is_reset = true;
+            if(named_pipe_future.valid()) {
+                try {
+                    named_pipe_future.wait();
+                    named_pipe_future.get();
+                }
+                catch(...) {}
+            }
+            is_reset = false;
+        }
+
+        /** \brief Проверить соединение
+         * \return Вернет true, если есть соединение
+         */
+        inline bool check_connect() {
+            return is_connect;
+        }
+
+        inline int get_handle() {
+            return pipe;
+        }
+
+        ~NamedPipeClient() {
+            stop();
+        }
+    };
+#endif
 }
 
 #endif // OPEN_BO_API_NAMED_PIPE_CLIENT_HPP_INCLUDED
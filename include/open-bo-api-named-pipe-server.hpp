@@ -25,29 +25,62 @@
 #define OPEN_BO_API_NAMED_PIPE_SERVER_HPP_INCLUDED
 
 #include <iostream>
-#include <windows.h>
+#include <memory>
 #include <mutex>
 #include <atomic>
 #include <future>
+#include <functional>
 #include <system_error>
 #include <list>
 #include <vector>
+#include <map>
+#include <deque>
+#include <thread>
+#include <condition_variable>
+#include <algorithm>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#endif
+#endif
 
 namespace open_bo_api {
 
+    /** \brief Политика для подписчика, который не успевает читать рассылку
+     */
+    enum class PipeSlowConsumerPolicy {
+        DROP_OLDEST,    /**< Удалять самые старые сообщения из очереди */
+        DISCONNECT,     /**< Разорвать соединение */
+    };
+
+#if defined(_WIN32)
+
     /** \brief Класс сервера именованных каналов
+     *
+     * Все соединения обслуживаются одним потоком цикла событий на порте завершения ввода-вывода (IOCP).
+     * Подключение, чтение и запись выполняются асинхронно (overlapped), у каждого соединения
+     * не более одной операции чтения и одной операции записи одновременно.
+     * Обратные вызовы выполняются в пуле рабочих потоков,
+     * при этом события одного соединения всегда обрабатываются по порядку и не параллельно.
      */
     class NamedPipeServer {
     private:
-        HANDLE pipe = INVALID_HANDLE_VALUE;
-        std::future<void> named_pipe_future;    /**< Поток обработки новых подключений */
-        std::atomic<bool> is_reset;             /**< Команда завершения работы */
-        std::atomic<bool> is_error;             /**< Ошибка сервера */
-
-        /* переменные для разблокировки ConnectNamedPipe */
-        std::string connection_pipe_name;
-        std::atomic<bool> is_connection;
-        std::mutex connection_pipe_name_mutex;
+        HANDLE iocp = NULL;                         /**< Порт завершения ввода-вывода */
+        HANDLE accept_pipe = INVALID_HANDLE_VALUE;  /**< Экземпляр канала, ожидающий подключения */
+        std::string pipe_name;                      /**< Полное имя канала */
+        std::future<void> named_pipe_future;        /**< Поток цикла событий */
+        std::atomic<bool> is_reset;                 /**< Команда завершения работы */
+        std::atomic<bool> is_error;                 /**< Ошибка сервера */
 
         /** \brief Класс настроек соединения
          */
@@ -56,157 +89,182 @@ namespace open_bo_api {
             std::string name;   /**< Имя именованного канала */
             size_t buffer_size; /**< Размер буфера для чтения и записи */
             size_t timeout;     /**< Время ожидания */
+            size_t workers;     /**< Количество рабочих потоков для обратных вызовов */
+            size_t send_queue_size;                         /**< Максимальный размер очереди отправки соединения */
+            PipeSlowConsumerPolicy slow_consumer_policy;    /**< Политика при переполнении очереди отправки */
+
+            Config() :
+                name("server"), buffer_size(1024), timeout(50), workers(2),
+                send_queue_size(1024), slow_consumer_policy(PipeSlowConsumerPolicy::DROP_OLDEST) {
+            };
+        };
+
+        /** \brief Тип асинхронной операции
+         */
+        enum class IoType {
+            ACCEPT,
+            READ,
+            WRITE,
+        };
+
+    public:
+
+        using SharedMessage = std::shared_ptr<const std::string>;   /**< Неизменяемое сообщение для рассылки */
+
+        class Connection;
+
+    private:
 
-            Config() : name("server"), buffer_size(1024), timeout(50) {
+        /** \brief Асинхронная операция
+         *
+         * Порт завершения возвращает указатель на OVERLAPPED, по нему находим операцию и соединение
+         */
+        class IoRequest {
+        public:
+            OVERLAPPED overlapped;
+            IoType type = IoType::ACCEPT;
+            Connection *connection = nullptr;
+
+            IoRequest() {
+                std::memset(&overlapped, 0, sizeof(overlapped));
             };
+
+            void reset() {
+                std::memset(&overlapped, 0, sizeof(overlapped));
+            }
         };
 
     public:
 
         /** \brief Класс соединения
          */
-        class Connection {
+        class Connection : public std::enable_shared_from_this<Connection> {
         private:
+            friend class NamedPipeServer;
+
+            NamedPipeServer *server = nullptr;
             HANDLE pipe = INVALID_HANDLE_VALUE;     /**< хендлер именованного канала */
-            std::future<void> connection_future;    /**< Поток обработки входящих сообщений */
-            std::atomic<bool> is_reset;             /**< Команда завершения работы */
             std::atomic<bool> is_error;             /**< Состояние ошибки */
             std::atomic<bool> is_close;             /**< Флаг закрытия соединения */
+            std::vector<char> buffer;               /**< Буфер для чтения */
+            std::string message;                    /**< Части сообщения, которое не поместилось в буфер */
 
-            std::function<void(Connection*)> &on_open;
-            std::function<void(Connection*, const std::string &in_message)> &on_message;
-            std::function<void(Connection*)> &on_close;
-            std::function<void(Connection*, const std::error_code &)> &on_error;
+            /* состояние операций, его меняет только цикл событий */
+            IoRequest read_request;
+            IoRequest write_request;
+            SharedMessage write_message;            /**< Сообщение, которое записывается в канал */
+            bool is_read_pending = false;
+            bool is_write_pending = false;
+            bool is_closing = false;
 
-            size_t buffer_size = 1024;              /**< Размер буфера */
+            /* очередь отправки, ее разбирает цикл событий */
+            std::deque<SharedMessage> send_queue;
+            std::mutex send_queue_mutex;
+            size_t send_queue_size = 1024;
+            PipeSlowConsumerPolicy slow_consumer_policy = PipeSlowConsumerPolicy::DROP_OLDEST;
+            std::atomic<uint64_t> dropped;          /**< Количество отброшенных сообщений */
 
-            /** \brief Прочитать сообщение
+            /** \brief Поставить сообщение в очередь отправки
+             *
+             * \param message Сообщение
+             * \param is_first Вернет true, если очередь была пуста и соединение нужно передать циклу событий
+             * \return Вернет false, если соединение закрыто или разорвано из-за переполнения очереди
              */
-            void read_message() {
-                if(is_error) return;
-
-                /* проверяем наличие данных в кнале */
-                DWORD bytes_to_read = 0;
-                BOOL success = PeekNamedPipe(pipe,NULL,0,NULL,&bytes_to_read,NULL);
-                DWORD err = GetLastError();
-                if(!success) {
-                    /* если соединение закрыто, вернется ERROR_PIPE_NOT_CONNECTED */
-                    if(err == ERROR_PIPE_NOT_CONNECTED) {
+            bool push_send_queue(const SharedMessage &message, bool &is_first) {
+                is_first = false;
+                if(is_error || is_close) return false;
+                std::lock_guard<std::mutex> lock(send_queue_mutex);
+                if(send_queue.size() >= send_queue_size) {
+                    if(slow_consumer_policy == PipeSlowConsumerPolicy::DISCONNECT) {
+                        send_queue.clear();
+                        /* цикл событий закроет соединение, когда получит его из очереди записи */
                         is_error = true;
-                        return;
+                        is_first = true;
+                        return false;
                     }
+                    send_queue.pop_front();
+                    ++dropped;
                 }
-                if(bytes_to_read == 0) return;
-
-                std::vector<char> buf(buffer_size);
-                DWORD bytes_read = 0;
-                std::cout << "start ReadFile" << std::endl;
-                success = ReadFile(
-                    pipe,
-                    &buf[0],
-                    buffer_size,
-                    &bytes_read,
-                    NULL);
-
-                err = GetLastError();
-                std::cout << "ReadFile " << err << std::endl;
-                if(!success || bytes_read == 0) {
-                    if(err == ERROR_BROKEN_PIPE) {
-                        is_error = true;
-                        return;
-                    } else {
-                        on_error(this,std::error_code(static_cast<int>(GetLastError()), std::generic_category()));
-                    }
-                    is_error = true;
-                }
-                on_message(this,std::string(buf.begin(),buf.begin() + bytes_read));
+                is_first = send_queue.empty();
+                send_queue.push_back(message);
+                return true;
             }
 
+            /* очередь обратных вызовов соединения */
+            std::deque<std::function<void()>> tasks;
+            bool is_scheduled = false;              /**< Соединение уже стоит в очереди пула потоков */
+            std::mutex tasks_mutex;
+
         public:
 
             Connection(
+                NamedPipeServer *_server,
                 const HANDLE _pipe,
-                std::function<void(Connection*)> &_on_open,
-                std::function<void(Connection*, const std::string &in_message)> &_on_message,
-                std::function<void(Connection*)> &_on_close,
-                std::function<void(Connection*, const std::error_code &)> &_on_error,
-                const size_t _buffer_size) :
+                const size_t _buffer_size,
+                const size_t _send_queue_size,
+                const PipeSlowConsumerPolicy _slow_consumer_policy) :
+                    server(_server),
                     pipe(_pipe),
-                    on_open(_on_open),
-                    on_message(_on_message),
-                    on_close(_on_close),
-                    on_error(_on_error),
-                    buffer_size(_buffer_size) {
-                is_reset = false;
+                    buffer(_buffer_size),
+                    send_queue_size(_send_queue_size),
+                    slow_consumer_policy(_slow_consumer_policy) {
                 is_error = false;
                 is_close = false;
-                connection_future = std::async(std::launch::async,[&]() {
-                    on_open(this);
-                    while(!is_reset && !is_error) {
-                        read_message();
-                    }
-                    std::cout << "-s1" << std::endl;
-                    FlushFileBuffers(pipe);
-                    DisconnectNamedPipe(pipe);
-                    CloseHandle(pipe);
-                    on_close(this);
-                    is_close = true;
-                    std::cout << "-s2" << std::endl;
-                });
+                dropped = 0;
+                read_request.type = IoType::READ;
+                read_request.connection = this;
+                write_request.type = IoType::WRITE;
+                write_request.connection = this;
             }
 
             ~Connection() {
-                std::cout << "~Connection()1" << std::endl;
-                is_reset = true;
-                CancelIo(pipe);
-                if(connection_future.valid()) {
-                    std::cout << "~Connection()2" << std::endl;
-                    try {
-                        connection_future.wait();
-                        connection_future.get();
-                    }
-                    catch(...) {}
-                }
-                std::cout << "~Connection()3" << std::endl;
+                if(pipe != INVALID_HANDLE_VALUE) CloseHandle(pipe);
             }
 
             /** \brief Отправить сообщение
+             *
+             * Сообщение ставится в очередь отправки соединения, запись выполняет цикл событий.
+             * Ошибки записи в канал приходят в on_error
              * \param out_message Сообщение
              * \param callback Обратный вызов для ошибки
              */
             void send(
                     const std::string &out_message,
                     const std::function<void(const std::error_code &ec)> &callback = nullptr) {
-                if(is_error) {
-                    if(callback != nullptr) {
-                        callback(std::error_code(static_cast<int>(GetLastError()), std::generic_category()));
-                    }
-                    return;
-                }
-                DWORD bytes_written = 0;
-                BOOL success = WriteFile(
-                    pipe,
-                    out_message.c_str(),    // буфер для записи
-                    out_message.size(),     // количество байтов для записи
-                    &bytes_written,         // количество записанных байтов
-                    NULL);                  // не перекрывается I/O
-
-                if(!success || out_message.size() != bytes_written) {
-                    /* ошибка записи, закрываем соединение */
-                    if(callback != nullptr) {
-                        callback(std::error_code(static_cast<int>(GetLastError()), std::generic_category()));
-                    }
-                    on_error(this,std::error_code(static_cast<int>(GetLastError()), std::generic_category()));
-                    CancelIo(pipe);
-                    is_error = true;
+                send(std::make_shared<const std::string>(out_message), callback);
+            }
+
+            /** \brief Отправить неизменяемое сообщение без копирования
+             * \param message Сообщение
+             * \param callback Обратный вызов для ошибки
+             */
+            void send(
+                    const SharedMessage &message,
+                    const std::function<void(const std::error_code &ec)> &callback = nullptr) {
+                bool is_first = false;
+                const bool is_push = push_send_queue(message, is_first);
+                if(is_first) server->schedule_write(shared_from_this());
+                if(!is_push && callback != nullptr) {
+                    callback(std::error_code(ERROR_PIPE_NOT_CONNECTED, std::system_category()));
                 }
             }
 
+            /** \brief Получить количество отброшенных сообщений
+             *
+             * Сообщения отбрасываются, если очередь отправки переполнена
+             * и выбрана политика PipeSlowConsumerPolicy::DROP_OLDEST
+             */
+            inline uint64_t get_dropped() {
+                return dropped;
+            }
+
             /** \brief Закрыть соединение
+             *
+             * Цикл событий отменит операции канала и вызовет on_close
              */
             void close() {
-                CancelIo(pipe);
-                is_reset = true;
+                is_error = true;
+                server->schedule_write(shared_from_this());
             }
 
             /** \brief Проверить закрытие соединения
@@ -221,22 +279,405 @@ namespace open_bo_api {
             }
         };
 
-        void clear_connections() {
-            /* удаляем потоки, где соединение закрыто */
-            if(connections.size() == 0) return;
-            auto it = connections.begin();
-            while(it != connections.end()) {
-                if(it->get()->check_close()) {
-                    it = connections.erase(it);
-                    continue;
+    private:
+
+        std::map<Connection*, std::shared_ptr<Connection>> connections;    /**< Соединения, их меняет только цикл событий */
+        IoRequest accept_request;               /**< Операция ожидания подключения */
+        size_t pending_io = 0;                  /**< Количество незавершенных операций */
+        bool is_stopping = false;               /**< Цикл событий закрывает соединения перед выходом */
+
+        /** \brief Снимок списка соединений для рассылки из других потоков
+         *
+         * Цикл событий публикует новый снимок при подключении и отключении клиента
+         */
+        std::shared_ptr<const std::vector<std::shared_ptr<Connection>>> subscribers;
+
+        /* соединения, у которых появились сообщения в пустой очереди отправки */
+        std::vector<std::shared_ptr<Connection>> write_connections;
+        std::mutex write_connections_mutex;
+
+        /* пул потоков для обратных вызовов */
+        std::vector<std::thread> workers;
+        std::deque<std::shared_ptr<Connection>> ready_connections;
+        std::mutex workers_mutex;
+        std::condition_variable workers_cv;
+        bool is_workers_stop = false;
+
+        /** \brief Добавить обратный вызов в очередь соединения
+         *
+         * \param connection Соединение
+         * \param task Обратный вызов
+         */
+        void post(const std::shared_ptr<Connection> &connection, std::function<void()> task) {
+            {
+                std::lock_guard<std::mutex> lock(connection->tasks_mutex);
+                connection->tasks.push_back(std::move(task));
+                if(connection->is_scheduled) return;
+                connection->is_scheduled = true;
+            }
+            {
+                std::lock_guard<std::mutex> lock(workers_mutex);
+                ready_connections.push_back(connection);
+            }
+            workers_cv.notify_one();
+        }
+
+        /** \brief Рабочий поток пула
+         */
+        void worker_loop() {
+            while(true) {
+                std::shared_ptr<Connection> connection;
+                {
+                    std::unique_lock<std::mutex> lock(workers_mutex);
+                    workers_cv.wait(lock, [&]() {
+                        return is_workers_stop || !ready_connections.empty();
+                    });
+                    if(ready_connections.empty()) return;
+                    connection = std::move(ready_connections.front());
+                    ready_connections.pop_front();
+                }
+                /* выполняем все накопленные обратные вызовы соединения по порядку */
+                while(true) {
+                    std::function<void()> task;
+                    {
+                        std::lock_guard<std::mutex> lock(connection->tasks_mutex);
+                        if(connection->tasks.empty()) {
+                            connection->is_scheduled = false;
+                            break;
+                        }
+                        task = std::move(connection->tasks.front());
+                        connection->tasks.pop_front();
+                    }
+                    task();
                 }
-                it++;
             }
         }
 
-    private:
+        /** \brief Опубликовать снимок списка соединений
+         */
+        void publish_subscribers() {
+            std::shared_ptr<std::vector<std::shared_ptr<Connection>>> temp =
+                std::make_shared<std::vector<std::shared_ptr<Connection>>>();
+            temp->reserve(connections.size());
+            for(auto &it : connections) {
+                if(!it.second->is_closing) temp->push_back(it.second);
+            }
+            std::atomic_store(&subscribers, std::shared_ptr<const std::vector<std::shared_ptr<Connection>>>(temp));
+        }
+
+        /** \brief Разбудить цикл событий
+         */
+        void wake_up() {
+            if(iocp == NULL) return;
+            PostQueuedCompletionStatus(iocp, 0, 0, NULL);
+        }
+
+        /** \brief Передать циклу событий соединения с новыми сообщениями в очереди отправки
+         */
+        void schedule_write(const std::shared_ptr<Connection> &connection) {
+            bool is_wake_up = false;
+            {
+                std::lock_guard<std::mutex> lock(write_connections_mutex);
+                is_wake_up = write_connections.empty();
+                write_connections.push_back(connection);
+            }
+            if(is_wake_up) wake_up();
+        }
+
+        /** \brief Передать ошибку соединения в on_error
+         */
+        void post_error(const std::shared_ptr<Connection> &connection, const DWORD err) {
+            const std::error_code ec(static_cast<int>(err), std::system_category());
+            post(connection, [this, connection, ec]() {
+                if(on_error != nullptr) on_error(connection.get(), ec);
+            });
+        }
+
+        /** \brief Создать экземпляр канала и начать ожидание подключения
+         * \return Вернет false в случае ошибки
+         */
+        bool start_accept() {
+            accept_pipe = CreateNamedPipeA(
+                (LPCSTR)pipe_name.c_str(),  // имя канала
+                PIPE_ACCESS_DUPLEX |        // двунаправленный доступ
+                FILE_FLAG_OVERLAPPED,
+                PIPE_TYPE_MESSAGE |         // message type pipe
+                PIPE_READMODE_MESSAGE |     // message-read mode
+                PIPE_WAIT,                  // blocking mode
+                PIPE_UNLIMITED_INSTANCES,   // max. instances
+                config.buffer_size,         // output buffer size
+                config.buffer_size,         // input buffer size
+                config.timeout,             // client time-out
+                NULL);                      // default security attribute
+
+            if(accept_pipe == INVALID_HANDLE_VALUE) {
+                std::cerr << "CreateNamedPipeA failed, GLE=" << GetLastError() << std::endl;
+                is_error = true;
+                return false;
+            }
+            if(CreateIoCompletionPort(accept_pipe, iocp, 0, 0) == NULL) {
+                std::cerr << "CreateIoCompletionPort failed, GLE=" << GetLastError() << std::endl;
+                CloseHandle(accept_pipe);
+                accept_pipe = INVALID_HANDLE_VALUE;
+                is_error = true;
+                return false;
+            }
+
+            accept_request.reset();
+            const BOOL success = ConnectNamedPipe(accept_pipe, &accept_request.overlapped);
+            const DWORD err = success ? ERROR_SUCCESS : GetLastError();
+            if(success || err == ERROR_IO_PENDING) {
+                ++pending_io;
+                return true;
+            }
+            if(err == ERROR_PIPE_CONNECTED) {
+                /* клиент подключился раньше вызова ConnectNamedPipe, пакет завершения не придет */
+                PostQueuedCompletionStatus(iocp, 0, 0, &accept_request.overlapped);
+                ++pending_io;
+                return true;
+            }
+            std::cerr << "ConnectNamedPipe failed, GLE=" << err << std::endl;
+            CloseHandle(accept_pipe);
+            accept_pipe = INVALID_HANDLE_VALUE;
+            is_error = true;
+            return false;
+        }
+
+        /** \brief Обработать подключение клиента
+         */
+        void on_accept_complete(const DWORD err) {
+            --pending_io;
+            HANDLE connection_pipe = accept_pipe;
+            accept_pipe = INVALID_HANDLE_VALUE;
+            if(is_stopping || (err != ERROR_SUCCESS && err != ERROR_PIPE_CONNECTED)) {
+                CloseHandle(connection_pipe);
+            } else {
+                std::shared_ptr<Connection> connection = std::make_shared<Connection>(
+                    this,
+                    connection_pipe,
+                    config.buffer_size,
+                    config.send_queue_size,
+                    config.slow_consumer_policy);
+                connections[connection.get()] = connection;
+                publish_subscribers();
+                post(connection, [this, connection]() {
+                    if(on_open != nullptr) on_open(connection.get());
+                });
+                start_read(connection);
+            }
+            if(!is_stopping) start_accept();
+        }
+
+        /** \brief Начать чтение сообщения
+         */
+        void start_read(const std::shared_ptr<Connection> &connection) {
+            connection->read_request.reset();
+            const BOOL success = ReadFile(
+                connection->pipe,
+                &connection->buffer[0],
+                (DWORD)connection->buffer.size(),
+                NULL,
+                &connection->read_request.overlapped);
+            const DWORD err = success ? ERROR_SUCCESS : GetLastError();
+            if(success || err == ERROR_IO_PENDING || err == ERROR_MORE_DATA) {
+                connection->is_read_pending = true;
+                ++pending_io;
+                return;
+            }
+            /* если соединение закрыто, вернется ERROR_BROKEN_PIPE */
+            if(err != ERROR_BROKEN_PIPE && err != ERROR_PIPE_NOT_CONNECTED) post_error(connection, err);
+            close_connection(connection);
+        }
+
+        /** \brief Обработать завершение чтения
+         */
+        void on_read_complete(const std::shared_ptr<Connection> &connection, const DWORD bytes_read, const DWORD err) {
+            connection->is_read_pending = false;
+            --pending_io;
+            if(connection->is_closing) {
+                finish_close(connection);
+                return;
+            }
+            if(err == ERROR_SUCCESS || err == ERROR_MORE_DATA) {
+                connection->message.append(connection->buffer.begin(), connection->buffer.begin() + bytes_read);
+                /* ERROR_MORE_DATA означает, что сообщение не поместилось в буфер, дочитываем его */
+                if(err == ERROR_SUCCESS && !connection->message.empty()) {
+                    std::shared_ptr<std::string> message = std::make_shared<std::string>();
+                    message->swap(connection->message);
+                    if(!connection->is_error) {
+                        post(connection, [this, connection, message]() {
+                            if(on_message != nullptr) on_message(connection.get(), *message);
+                        });
+                    }
+                }
+                start_read(connection);
+                return;
+            }
+            if(err != ERROR_BROKEN_PIPE && err != ERROR_PIPE_NOT_CONNECTED) post_error(connection, err);
+            close_connection(connection);
+        }
+
+        /** \brief Начать запись следующего сообщения из очереди отправки
+         */
+        void write_connection(const std::shared_ptr<Connection> &connection) {
+            if(connections.find(connection.get()) == connections.end()) return;
+            if(connection->is_closing || connection->is_write_pending) return;
+            if(connection->is_error) {
+                /* соединение закрыто пользователем или из-за переполнения очереди */
+                close_connection(connection);
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(connection->send_queue_mutex);
+                if(connection->send_queue.empty()) return;
+                connection->write_message = std::move(connection->send_queue.front());
+                connection->send_queue.pop_front();
+            }
+            connection->write_request.reset();
+            const BOOL success = WriteFile(
+                connection->pipe,
+                connection->write_message->c_str(),
+                (DWORD)connection->write_message->size(),
+                NULL,
+                &connection->write_request.overlapped);
+            const DWORD err = success ? ERROR_SUCCESS : GetLastError();
+            if(success || err == ERROR_IO_PENDING) {
+                connection->is_write_pending = true;
+                ++pending_io;
+                return;
+            }
+            connection->write_message.reset();
+            post_error(connection, err);
+            close_connection(connection);
+        }
+
+        /** \brief Обработать завершение записи
+         */
+        void on_write_complete(const std::shared_ptr<Connection> &connection, const DWORD bytes_written, const DWORD err) {
+            connection->is_write_pending = false;
+            --pending_io;
+            const size_t message_size = connection->write_message->size();
+            connection->write_message.reset();
+            if(connection->is_closing) {
+                finish_close(connection);
+                return;
+            }
+            if(err != ERROR_SUCCESS || bytes_written != message_size) {
+                /* ошибка записи, закрываем соединение */
+                post_error(connection, err != ERROR_SUCCESS ? err : (DWORD)ERROR_WRITE_FAULT);
+                close_connection(connection);
+                return;
+            }
+            write_connection(connection);
+        }
+
+        /** \brief Обработать соединения с новыми сообщениями в очереди отправки
+         */
+        void write_scheduled_connections() {
+            std::vector<std::shared_ptr<Connection>> list_connections;
+            {
+                std::lock_guard<std::mutex> lock(write_connections_mutex);
+                list_connections.swap(write_connections);
+            }
+            for(auto &connection : list_connections) {
+                write_connection(connection);
+            }
+        }
+
+        /** \brief Закрыть соединение
+         *
+         * Незавершенные операции отменяются, канал закрывается после получения их пакетов завершения
+         */
+        void close_connection(const std::shared_ptr<Connection> &connection) {
+            if(connection->is_closing) return;
+            connection->is_closing = true;
+            connection->is_error = true;
+            publish_subscribers();
+            {
+                std::lock_guard<std::mutex> lock(connection->send_queue_mutex);
+                connection->send_queue.clear();
+            }
+            if(connection->is_read_pending || connection->is_write_pending) {
+                CancelIoEx(connection->pipe, NULL);
+            }
+            finish_close(connection);
+        }
+
+        /** \brief Освободить канал соединения и вызвать on_close
+         *
+         * Ничего не делает, пока у соединения есть незавершенные операции
+         */
+        void finish_close(const std::shared_ptr<Connection> &connection) {
+            if(connection->is_read_pending || connection->is_write_pending) return;
+            FlushFileBuffers(connection->pipe);
+            DisconnectNamedPipe(connection->pipe);
+            CloseHandle(connection->pipe);
+            connection->pipe = INVALID_HANDLE_VALUE;
+            connections.erase(connection.get());
+            post(connection, [this, connection]() {
+                if(on_close != nullptr) on_close(connection.get());
+                connection->is_close = true;
+            });
+        }
+
+        /** \brief Начать остановку цикла событий
+         */
+        void begin_stop() {
+            is_stopping = true;
+            if(accept_pipe != INVALID_HANDLE_VALUE) CancelIoEx(accept_pipe, NULL);
+            std::vector<std::shared_ptr<Connection>> list_connections;
+            for(auto &it : connections) {
+                list_connections.push_back(it.second);
+            }
+            for(auto &connection : list_connections) {
+                close_connection(connection);
+            }
+        }
+
+        /** \brief Цикл событий
+         */
+        void event_loop() {
+            while(true) {
+                if(is_reset && !is_stopping) begin_stop();
+                /* выходим, когда получены пакеты завершения всех отмененных операций */
+                if(is_stopping && pending_io == 0) break;
 
-        std::list<std::shared_ptr<Connection>> connections; /**< Список соединений */
+                DWORD bytes_transferred = 0;
+                ULONG_PTR key = 0;
+                LPOVERLAPPED overlapped = NULL;
+                const BOOL success = GetQueuedCompletionStatus(
+                    iocp,
+                    &bytes_transferred,
+                    &key,
+                    &overlapped,
+                    INFINITE);
+                const DWORD err = success ? ERROR_SUCCESS : GetLastError();
+                if(overlapped == NULL) {
+                    if(!success) {
+                        std::cerr << "NamedPipeServer GetQueuedCompletionStatus failed, GLE=" << err << std::endl;
+                        is_error = true;
+                        break;
+                    }
+                    /* пробуждение из других потоков */
+                    write_scheduled_connections();
+                    continue;
+                }
+
+                IoRequest *request = CONTAINING_RECORD(overlapped, IoRequest, overlapped);
+                if(request->type == IoType::ACCEPT) {
+                    on_accept_complete(err);
+                    continue;
+                }
+                auto it = connections.find(request->connection);
+                if(it == connections.end()) continue;
+                std::shared_ptr<Connection> connection = it->second;
+                if(request->type == IoType::READ) {
+                    on_read_complete(connection, bytes_transferred, err);
+                } else {
+                    on_write_complete(connection, bytes_transferred, err);
+                }
+            }
+        }
 
         /** \brief Инициализировать сервер
          *
@@ -245,77 +686,737 @@ namespace open_bo_api {
          */
         bool init(Config &config) {
             if(named_pipe_future.valid()) return false;
-            std::string pipename("\\\\.\\pipe\\");
             if(config.name.find("\\") != std::string::npos) return false;
-            pipename += config.name;
-            if(pipename.length() > 256) return false;
+            pipe_name = std::string("\\\\.\\pipe\\") + config.name;
+            if(pipe_name.length() > 256) return false;
+
+            iocp = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+            if(iocp == NULL) {
+                std::cerr << "CreateIoCompletionPort failed, GLE=" << GetLastError() << std::endl;
+                is_error = true;
+                return false;
+            }
+
+            is_reset = false;
+            is_stopping = false;
+            pending_io = 0;
+            accept_request.type = IoType::ACCEPT;
+            /* первый экземпляр канала создаем сразу, чтобы клиенты могли подключаться после start() */
+            if(!start_accept()) {
+                CloseHandle(iocp);
+                iocp = NULL;
+                return false;
+            }
+
+            is_workers_stop = false;
+            const size_t workers_number = std::max(config.workers, (size_t)1);
+            for(size_t i = 0; i < workers_number; ++i) {
+                workers.push_back(std::thread(&NamedPipeServer::worker_loop, this));
+            }
+            named_pipe_future = std::async(std::launch::async, &NamedPipeServer::event_loop, this);
+            return true;
+        }
+    public:
+
+        Config config;                              /**< Настройки сервера */
+        std::function<void(Connection*)> on_open;
+        std::function<void(Connection*, const std::string &in_message)> on_message;
+        std::function<void(Connection*)> on_close;
+        std::function<void(Connection*, const std::error_code &)> on_error;
+
+        NamedPipeServer() {
+            is_reset = false;
+            is_error = false;
+        }
+
+        /** \brief Запустить сервер
+         */
+        bool start() {
+            return init(config);
+        }
 
-            /* запоминаем имя соединения */
+        /** \brief Остановить сервер
+         */
+        void stop() {
+            is_reset = true;
+            wake_up();
+            if(named_pipe_future.valid()) {
+                try {
+                    named_pipe_future.wait();
+                    named_pipe_future.get();
+                }
+                catch(...) {}
+            }
+            /* дожидаемся выполнения оставшихся обратных вызовов */
             {
-                std::lock_guard<std::mutex> lock(connection_pipe_name_mutex);
-                connection_pipe_name = pipename;
-            }
-
-            named_pipe_future = std::async(std::launch::async,[
-                    &,
-                    pipename,
-                    config]() {
-                while(!is_reset) {
-                    pipe = CreateNamedPipeA(
-                      (LPCSTR)pipename.c_str(), // имя канала
-                      PIPE_ACCESS_DUPLEX |      // двунаправленный доступ
-                      FILE_FLAG_OVERLAPPED,
-                      PIPE_TYPE_MESSAGE |       // message type pipe
-                      PIPE_READMODE_MESSAGE |   // message-read mode
-                      PIPE_WAIT,                // blocking mode
-                      PIPE_UNLIMITED_INSTANCES, // max. instances
-                      config.buffer_size,       // output buffer size
-                      config.buffer_size,       // input buffer size
-                      config.timeout,           // client time-out
-                      NULL);                    // default security attribute
-
-                    if(pipe == INVALID_HANDLE_VALUE) {
-                        std::cerr << "CreateNamedPipeA failed, GLE=" << GetLastError() << std::endl;
-                        is_error = false;
-                        /* удаляем потоки, где соединение закрыто */
-                        clear_connections();
-                        return;
-                    }
+                std::lock_guard<std::mutex> lock(workers_mutex);
+                is_workers_stop = true;
+            }
+            workers_cv.notify_all();
+            for(auto &it : workers) {
+                if(it.joinable()) it.join();
+            }
+            workers.clear();
+            if(iocp != NULL) {
+                CloseHandle(iocp);
+                iocp = NULL;
+            }
+            std::atomic_store(&subscribers, std::shared_ptr<const std::vector<std::shared_ptr<Connection>>>());
+        }
 
-                    /* устанавливем флаг соединения (необходим для хака во время остановки сервера) */
-                    is_connection = true;
+        /** \brief Разослать сообщение всем подключенным клиентам
+         *
+         * Сообщение копируется один раз, в очереди соединений попадает указатель на общий буфер.
+         * Запись в каналы выполняет цикл событий асинхронно, поэтому метод не ждет медленных клиентов.
+         * При переполнении очереди соединения применяется Config::slow_consumer_policy
+         * \param message Сообщение
+         * \return Количество соединений, в очередь которых попало сообщение
+         */
+        size_t broadcast(const SharedMessage &message) {
+            std::shared_ptr<const std::vector<std::shared_ptr<Connection>>> current = std::atomic_load(&subscribers);
+            if(!current) return 0;
+            size_t counter = 0;
+            bool is_wake_up = false;
+            for(auto &connection : *current) {
+                bool is_first = false;
+                const bool is_push = connection->push_send_queue(message, is_first);
+                if(is_push) ++counter;
+                if(!is_first) continue;
+                std::lock_guard<std::mutex> lock(write_connections_mutex);
+                if(write_connections.empty()) is_wake_up = true;
+                write_connections.push_back(connection);
+            }
+            if(is_wake_up) wake_up();
+            return counter;
+        }
 
-                    /* ждем соединения с сервером */
-                    BOOL named_pipe_connected;
-                    named_pipe_connected = ConnectNamedPipe(pipe, NULL) ?
-                        TRUE : (GetLastError() == ERROR_PIPE_CONNECTED);
+        /** \brief Разослать сообщение всем подключенным клиентам
+         * \param message Сообщение
+         * \return Количество соединений, в очередь которых попало сообщение
+         */
+        inline size_t broadcast(const std::string &message) {
+            return broadcast(std::make_shared<const std::string>(message));
+        }
 
-                    /* снимаем флаг соединения (необходим для хака во время остановки сервера) */
-                    is_connection = false;
+        /** \brief Проверить наличие ошибки
+         *
+         * \return Вернет true, если есть ошибка
+         */
+        inline bool check_error() {
+            return is_error;
+        }
 
-                    /* если бы сброс, выходим */
-                    if(is_reset) {
-                        clear_connections();
-                        return;
+        ~NamedPipeServer() {
+            stop();
+        }
+    };
+#else
+
+    /** \brief Класс сервера именованных каналов
+     *
+     * Реализация для POSIX систем на локальных сокетах (AF_UNIX, SOCK_SEQPACKET).
+     * Сокет SOCK_SEQPACKET сохраняет границы сообщений так же, как канал в режиме сообщений Windows.
+     * Файл сокета создается по пути /tmp/open-bo-api-<имя канала>.sock
+     *
+     * Все соединения обслуживаются одним потоком цикла событий (epoll в Linux, poll в остальных системах),
+     * у каждого соединения свой буфер чтения, который используется повторно.
+     * Обратные вызовы выполняются в пуле рабочих потоков,
+     * при этом события одного соединения всегда обрабатываются по порядку и не параллельно.
+     */
+    class NamedPipeServer {
+    private:
+        int pipe = -1;                          /**< Слушающий сокет */
+        int wake_pipe[2] = {-1, -1};            /**< Канал для пробуждения цикла событий */
+#if defined(__linux__)
+        int epoll_fd = -1;                      /**< Дескриптор epoll */
+#endif
+        std::string socket_path;                /**< Путь к файлу сокета */
+        std::future<void> named_pipe_future;    /**< Поток цикла событий */
+        std::atomic<bool> is_reset;             /**< Команда завершения работы */
+        std::atomic<bool> is_error;             /**< Ошибка сервера */
+
+        /** \brief Класс настроек соединения
+         */
+        class Config {
+        public:
+            std::string name;   /**< Имя именованного канала */
+            size_t buffer_size; /**< Размер буфера для чтения и записи */
+            size_t timeout;     /**< Время ожидания */
+            size_t workers;     /**< Количество рабочих потоков для обратных вызовов */
+            size_t send_queue_size;                         /**< Максимальный размер очереди отправки соединения */
+            PipeSlowConsumerPolicy slow_consumer_policy;    /**< Политика при переполнении очереди отправки */
+
+            Config() :
+                name("server"), buffer_size(1024), timeout(50), workers(2),
+                send_queue_size(1024), slow_consumer_policy(PipeSlowConsumerPolicy::DROP_OLDEST) {
+            };
+        };
+
+    public:
+
+        using SharedMessage = std::shared_ptr<const std::string>;   /**< Неизменяемое сообщение для рассылки */
+
+        /** \brief Получить путь к файлу сокета по имени канала
+         * \param name Имя именованного канала
+         * \return Путь к файлу сокета
+         */
+        static std::string get_socket_path(const std::string &name) {
+            return "/tmp/open-bo-api-" + name + ".sock";
+        }
+
+        /** \brief Класс соединения
+         */
+        class Connection : public std::enable_shared_from_this<Connection> {
+        private:
+            friend class NamedPipeServer;
+
+            NamedPipeServer *server = nullptr;
+            int pipe = -1;                          /**< Сокет соединения */
+            std::atomic<bool> is_error;             /**< Состояние ошибки */
+            std::atomic<bool> is_close;             /**< Флаг закрытия соединения */
+            std::vector<char> buffer;               /**< Буфер для чтения */
+
+            /* очередь отправки, ее разбирает цикл событий */
+            std::deque<SharedMessage> send_queue;
+            std::mutex send_queue_mutex;
+            size_t send_queue_size = 1024;
+            PipeSlowConsumerPolicy slow_consumer_policy = PipeSlowConsumerPolicy::DROP_OLDEST;
+            std::atomic<uint64_t> dropped;          /**< Количество отброшенных сообщений */
+            bool is_watch_write = false;            /**< Цикл событий ждет готовности сокета к записи */
+
+            /** \brief Поставить сообщение в очередь отправки
+             *
+             * \param message Сообщение
+             * \param is_first Вернет true, если очередь была пуста и соединение нужно передать циклу событий
+             * \return Вернет false, если соединение закрыто или разорвано из-за переполнения очереди
+             */
+            bool push_send_queue(const SharedMessage &message, bool &is_first) {
+                is_first = false;
+                if(is_error || is_close) return false;
+                std::lock_guard<std::mutex> lock(send_queue_mutex);
+                if(send_queue.size() >= send_queue_size) {
+                    if(slow_consumer_policy == PipeSlowConsumerPolicy::DISCONNECT) {
+                        send_queue.clear();
+                        close();
+                        return false;
+                    }
+                    send_queue.pop_front();
+                    ++dropped;
+                }
+                is_first = send_queue.empty();
+                send_queue.push_back(message);
+                return true;
+            }
+
+            /** \brief Записать сообщения из очереди отправки без блокировки
+             *
+             * Вызывается только из цикла событий
+             * \param ec Код ошибки записи
+             * \return Вернет true, если очередь пуста
+             */
+            bool write_send_queue(std::error_code &ec) {
+                std::lock_guard<std::mutex> lock(send_queue_mutex);
+                while(!send_queue.empty()) {
+                    const std::string &message = *send_queue.front();
+                    const ssize_t bytes_written = ::send(pipe, message.c_str(), message.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+                    if(bytes_written < 0) {
+                        if(errno == EINTR) continue;
+                        if(errno == EAGAIN || errno == EWOULDBLOCK) return false;
+                        ec = std::error_code(errno, std::generic_category());
+                        send_queue.clear();
+                        return true;
                     }
+                    send_queue.pop_front();
+                }
+                return true;
+            }
+
+            /* очередь обратных вызовов соединения */
+            std::deque<std::function<void()>> tasks;
+            bool is_scheduled = false;              /**< Соединение уже стоит в очереди пула потоков */
+            std::mutex tasks_mutex;
+
+            std::function<void(Connection*, const std::error_code &)> &on_error;
+
+        public:
+
+            Connection(
+                NamedPipeServer *_server,
+                const int _pipe,
+                std::function<void(Connection*, const std::error_code &)> &_on_error,
+                const size_t _buffer_size,
+                const size_t _send_queue_size,
+                const PipeSlowConsumerPolicy _slow_consumer_policy) :
+                    server(_server),
+                    pipe(_pipe),
+                    buffer(_buffer_size),
+                    send_queue_size(_send_queue_size),
+                    slow_consumer_policy(_slow_consumer_policy),
+                    on_error(_on_error) {
+                is_error = false;
+                is_close = false;
+                dropped = 0;
+            }
+
+            ~Connection() {
+                if(pipe >= 0) ::close(pipe);
+            }
 
-                    if(named_pipe_connected) {
-                        /* создаем отдельный поток для приема и передачи сообщений */
-                        connections.push_back(std::make_shared<Connection>(
-                            pipe,
-                            on_open,
-                            on_message,
-                            on_close,
-                            on_error,
-                            config.buffer_size));
-                    } else {
-                        CloseHandle(pipe);
+            /** \brief Отправить сообщение
+             *
+             * Сообщение ставится в очередь отправки соединения, запись выполняет цикл событий.
+             * Ошибки записи в сокет приходят в on_error
+             * \param out_message Сообщение
+             * \param callback Обратный вызов для ошибки
+             */
+            void send(
+                    const std::string &out_message,
+                    const std::function<void(const std::error_code &ec)> &callback = nullptr) {
+                send(std::make_shared<const std::string>(out_message), callback);
+            }
+
+            /** \brief Отправить неизменяемое сообщение без копирования
+             * \param message Сообщение
+             * \param callback Обратный вызов для ошибки
+             */
+            void send(
+                    const SharedMessage &message,
+                    const std::function<void(const std::error_code &ec)> &callback = nullptr) {
+                bool is_first = false;
+                if(!push_send_queue(message, is_first)) {
+                    if(callback != nullptr) {
+                        callback(std::error_code(ENOTCONN, std::generic_category()));
                     }
+                    return;
+                }
+                if(is_first) server->schedule_write(shared_from_this());
+            }
+
+            /** \brief Получить количество отброшенных сообщений
+             *
+             * Сообщения отбрасываются, если очередь отправки переполнена
+             * и выбрана политика PipeSlowConsumerPolicy::DROP_OLDEST
+             */
+            inline uint64_t get_dropped() {
+                return dropped;
+            }
+
+            /** \brief Закрыть соединение
+             *
+             * Цикл событий увидит закрытие сокета и вызовет on_close
+             */
+            void close() {
+                is_error = true;
+                shutdown(pipe, SHUT_RDWR);
+            }
+
+            /** \brief Проверить закрытие соединения
+             * \return Вернет true, если соединение закрыто
+             */
+            inline bool check_close() {
+                return is_close;
+            }
+
+            inline int get_handle() {
+                return pipe;
+            }
+        };
+
+    private:
+
+        std::map<int, std::shared_ptr<Connection>> connections; /**< Соединения, ключ - сокет */
+
+        /** \brief Снимок списка соединений для рассылки из других потоков
+         *
+         * Цикл событий публикует новый снимок при подключении и отключении клиента
+         */
+        std::shared_ptr<const std::vector<std::shared_ptr<Connection>>> subscribers;
 
-                    /* удаляем потоки, где соединение закрыто */
-                    clear_connections();
+        /* соединения, у которых появились сообщения в пустой очереди отправки */
+        std::vector<std::shared_ptr<Connection>> write_connections;
+        std::mutex write_connections_mutex;
+
+        /* пул потоков для обратных вызовов */
+        std::vector<std::thread> workers;
+        std::deque<std::shared_ptr<Connection>> ready_connections;
+        std::mutex workers_mutex;
+        std::condition_variable workers_cv;
+        bool is_workers_stop = false;
+
+        /** \brief Добавить обратный вызов в очередь соединения
+         *
+         * \param connection Соединение
+         * \param task Обратный вызов
+         */
+        void post(const std::shared_ptr<Connection> &connection, std::function<void()> task) {
+            {
+                std::lock_guard<std::mutex> lock(connection->tasks_mutex);
+                connection->tasks.push_back(std::move(task));
+                if(connection->is_scheduled) return;
+                connection->is_scheduled = true;
+            }
+            {
+                std::lock_guard<std::mutex> lock(workers_mutex);
+                ready_connections.push_back(connection);
+            }
+            workers_cv.notify_one();
+        }
+
+        /** \brief Рабочий поток пула
+         */
+        void worker_loop() {
+            while(true) {
+                std::shared_ptr<Connection> connection;
+                {
+                    std::unique_lock<std::mutex> lock(workers_mutex);
+                    workers_cv.wait(lock, [&]() {
+                        return is_workers_stop || !ready_connections.empty();
+                    });
+                    if(ready_connections.empty()) return;
+                    connection = std::move(ready_connections.front());
+                    ready_connections.pop_front();
                 }
+                /* выполняем все накопленные обратные вызовы соединения по порядку */
+                while(true) {
+                    std::function<void()> task;
+                    {
+                        std::lock_guard<std::mutex> lock(connection->tasks_mutex);
+                        if(connection->tasks.empty()) {
+                            connection->is_scheduled = false;
+                            break;
+                        }
+                        task = std::move(connection->tasks.front());
+                        connection->tasks.pop_front();
+                    }
+                    task();
+                }
+            }
+        }
+
+        /** \brief Опубликовать снимок списка соединений
+         */
+        void publish_subscribers() {
+            std::shared_ptr<std::vector<std::shared_ptr<Connection>>> temp =
+                std::make_shared<std::vector<std::shared_ptr<Connection>>>();
+            temp->reserve(connections.size());
+            for(auto &it : connections) {
+                temp->push_back(it.second);
+            }
+            std::atomic_store(&subscribers, std::shared_ptr<const std::vector<std::shared_ptr<Connection>>>(temp));
+        }
+
+        /** \brief Разбудить цикл событий
+         */
+        void wake_up() {
+            if(wake_pipe[1] < 0) return;
+            const char c = 0;
+            if(write(wake_pipe[1], &c, 1) < 0) {};
+        }
+
+        /** \brief Передать циклу событий соединения с новыми сообщениями в очереди отправки
+         */
+        void schedule_write(const std::shared_ptr<Connection> &connection) {
+            bool is_wake_up = false;
+            {
+                std::lock_guard<std::mutex> lock(write_connections_mutex);
+                is_wake_up = write_connections.empty();
+                write_connections.push_back(connection);
+            }
+            if(is_wake_up) wake_up();
+        }
+
+        /** \brief Подписаться на события сокета
+         */
+        void add_watch(const int fd) {
+#if defined(__linux__)
+            struct epoll_event event;
+            std::memset(&event, 0, sizeof(event));
+            event.events = EPOLLIN | EPOLLRDHUP;
+            event.data.fd = fd;
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+#endif
+        }
+
+        /** \brief Включить или выключить ожидание готовности сокета к записи
+         */
+        void watch_write(const std::shared_ptr<Connection> &connection, const bool is_watch) {
+            if(connection->is_watch_write == is_watch) return;
+            connection->is_watch_write = is_watch;
+#if defined(__linux__)
+            struct epoll_event event;
+            std::memset(&event, 0, sizeof(event));
+            event.events = EPOLLIN | EPOLLRDHUP | (is_watch ? (uint32_t)EPOLLOUT : 0u);
+            event.data.fd = connection->pipe;
+            epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection->pipe, &event);
+#endif
+        }
+
+        /** \brief Записать очередь отправки соединения
+         *
+         * Если сокет не готов к записи, цикл событий подождет его готовности
+         */
+        void write_connection(const std::shared_ptr<Connection> &connection) {
+            if(connections.find(connection->pipe) == connections.end()) return;
+            std::error_code ec;
+            const bool is_empty = connection->write_send_queue(ec);
+            if(ec) {
+                post(connection, [this, connection, ec]() {
+                    if(on_error != nullptr) on_error(connection.get(), ec);
+                });
+                close_connection(connection);
+                return;
+            }
+            watch_write(connection, !is_empty);
+        }
+
+        /** \brief Обработать соединения с новыми сообщениями в очереди отправки
+         */
+        void write_scheduled_connections() {
+            /* очищаем канал пробуждения */
+            char temp[256];
+            while(read(wake_pipe[0], temp, sizeof(temp)) > 0) {};
+
+            std::vector<std::shared_ptr<Connection>> list_connections;
+            {
+                std::lock_guard<std::mutex> lock(write_connections_mutex);
+                list_connections.swap(write_connections);
+            }
+            for(auto &connection : list_connections) {
+                write_connection(connection);
+            }
+        }
+
+        /** \brief Отписаться от событий сокета
+         */
+        void remove_watch(const int fd) {
+#if defined(__linux__)
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+#endif
+        }
+
+        /** \brief Дождаться событий
+         *
+         * \param ready_fd Сокеты, готовые к чтению или закрытые
+         * \return Вернет false в случае ошибки
+         */
+        bool wait_events(std::vector<int> &ready_fd) {
+            ready_fd.clear();
+#if defined(__linux__)
+            const int MAX_EVENTS = 64;
+            struct epoll_event events[MAX_EVENTS];
+            const int res = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+            if(res < 0) return errno == EINTR;
+            for(int i = 0; i < res; ++i) {
+                ready_fd.push_back(events[i].data.fd);
+            }
+#else
+            std::vector<struct pollfd> fds;
+            fds.reserve(connections.size() + 2);
+            struct pollfd item;
+            item.events = POLLIN;
+            item.revents = 0;
+            item.fd = wake_pipe[0];
+            fds.push_back(item);
+            item.fd = pipe;
+            fds.push_back(item);
+            for(auto &it : connections) {
+                item.fd = it.first;
+                item.events = POLLIN | (it.second->is_watch_write ? POLLOUT : 0);
+                fds.push_back(item);
+            }
+            const int res = poll(&fds[0], fds.size(), -1);
+            if(res < 0) return errno == EINTR;
+            for(auto &it : fds) {
+                if(it.revents != 0) ready_fd.push_back(it.fd);
+            }
+#endif
+            return true;
+        }
+
+        /** \brief Принять новые соединения
+         */
+        void accept_connections() {
+            while(true) {
+                const int connection_pipe = accept(pipe, NULL, NULL);
+                if(connection_pipe < 0) return;
+                fcntl(connection_pipe, F_SETFL, fcntl(connection_pipe, F_GETFL, 0) | O_NONBLOCK);
+                std::shared_ptr<Connection> connection = std::make_shared<Connection>(
+                    this,
+                    connection_pipe,
+                    on_error,
+                    config.buffer_size,
+                    config.send_queue_size,
+                    config.slow_consumer_policy);
+                connections[connection_pipe] = connection;
+                add_watch(connection_pipe);
+                publish_subscribers();
+                post(connection, [this, connection]() {
+                    if(on_open != nullptr) on_open(connection.get());
+                });
+            }
+        }
+
+        /** \brief Закрыть соединение и вызвать on_close
+         */
+        void close_connection(const std::shared_ptr<Connection> &connection) {
+            remove_watch(connection->pipe);
+            connections.erase(connection->pipe);
+            publish_subscribers();
+            connection->is_error = true;
+            shutdown(connection->pipe, SHUT_RDWR);
+            {
+                std::lock_guard<std::mutex> lock(connection->send_queue_mutex);
+                connection->send_queue.clear();
+            }
+            post(connection, [this, connection]() {
+                if(on_close != nullptr) on_close(connection.get());
+                connection->is_close = true;
             });
+        }
+
+        /** \brief Прочитать сообщения соединения
+         *
+         * \param connection Соединение
+         */
+        void read_messages(const std::shared_ptr<Connection> &connection) {
+            /* ограничиваем число сообщений за проход, чтобы не задерживать другие соединения */
+            const size_t MAX_MESSAGES = 64;
+            std::vector<char> &buffer = connection->buffer;
+            for(size_t n = 0; n < MAX_MESSAGES; ++n) {
+                /* узнаем размер сообщения, чтобы не обрезать его */
+                const ssize_t message_size = recv(connection->pipe, &buffer[0], buffer.size(), MSG_PEEK | MSG_TRUNC);
+                if(message_size > (ssize_t)buffer.size()) buffer.resize(message_size);
+
+                const ssize_t bytes_read = recv(connection->pipe, &buffer[0], buffer.size(), 0);
+                if(bytes_read == 0) {
+                    /* соединение закрыто */
+                    close_connection(connection);
+                    return;
+                }
+                if(bytes_read < 0) {
+                    if(errno == EAGAIN || errno == EWOULDBLOCK) return;
+                    if(errno == EINTR) continue;
+                    const std::error_code ec(errno, std::generic_category());
+                    post(connection, [this, connection, ec]() {
+                        if(on_error != nullptr) on_error(connection.get(), ec);
+                    });
+                    close_connection(connection);
+                    return;
+                }
+                if(connection->is_error) continue;
+                std::shared_ptr<std::string> message = std::make_shared<std::string>(buffer.begin(), buffer.begin() + bytes_read);
+                post(connection, [this, connection, message]() {
+                    if(on_message != nullptr) on_message(connection.get(), *message);
+                });
+            }
+        }
+
+        /** \brief Цикл событий
+         */
+        void event_loop() {
+            std::vector<int> ready_fd;
+            while(!is_reset) {
+                if(!wait_events(ready_fd)) {
+                    std::cerr << "NamedPipeServer wait events failed, errno=" << errno << std::endl;
+                    is_error = true;
+                    break;
+                }
+                for(const int fd : ready_fd) {
+                    if(fd == wake_pipe[0]) {
+                        write_scheduled_connections();
+                        continue;
+                    }
+                    if(fd == pipe) {
+                        accept_connections();
+                        continue;
+                    }
+                    auto it = connections.find(fd);
+                    if(it == connections.end()) continue;
+                    std::shared_ptr<Connection> connection = it->second;
+                    read_messages(connection);
+                    if(connection->is_watch_write) write_connection(connection);
+                }
+            }
+            while(!connections.empty()) {
+                std::shared_ptr<Connection> connection = connections.begin()->second;
+                close_connection(connection);
+            }
+        }
+
+        /** \brief Освободить дескрипторы сервера
+         */
+        void close_handles() {
+            if(pipe >= 0) {
+                ::close(pipe);
+                pipe = -1;
+                unlink(socket_path.c_str());
+            }
+            for(int &fd : wake_pipe) {
+                if(fd >= 0) ::close(fd);
+                fd = -1;
+            }
+#if defined(__linux__)
+            if(epoll_fd >= 0) ::close(epoll_fd);
+            epoll_fd = -1;
+#endif
+        }
+
+        /** \brief Инициализировать сервер
+         *
+         * \param config Настройки сервера
+         * \return Вернет true, если инициализация прошла успешно
+         */
+        bool init(Config &config) {
+            if(named_pipe_future.valid()) return false;
+            if(config.name.find("/") != std::string::npos) return false;
+            socket_path = get_socket_path(config.name);
+
+            struct sockaddr_un addr;
+            std::memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            if(socket_path.size() >= sizeof(addr.sun_path)) return false;
+            std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size());
+
+            pipe = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+            if(pipe < 0) {
+                std::cerr << "NamedPipeServer socket failed, errno=" << errno << std::endl;
+                is_error = true;
+                return false;
+            }
+
+            /* удаляем файл сокета, оставшийся от прошлого запуска */
+            unlink(socket_path.c_str());
+            if(bind(pipe, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+               listen(pipe, SOMAXCONN) < 0 ||
+               ::pipe(wake_pipe) < 0) {
+                std::cerr << "NamedPipeServer bind failed, errno=" << errno << std::endl;
+                close_handles();
+                is_error = true;
+                return false;
+            }
+            fcntl(pipe, F_SETFL, fcntl(pipe, F_GETFL, 0) | O_NONBLOCK);
+            fcntl(wake_pipe[0], F_SETFL, fcntl(wake_pipe[0], F_GETFL, 0) | O_NONBLOCK);
+            fcntl(wake_pipe[1], F_SETFL, fcntl(wake_pipe[1], F_GETFL, 0) | O_NONBLOCK);
+
+#if defined(__linux__)
+            epoll_fd = epoll_create1(0);
+            if(epoll_fd < 0) {
+                std::cerr << "NamedPipeServer epoll_create1 failed, errno=" << errno << std::endl;
+                close_handles();
+                is_error = true;
+                return false;
+            }
+            add_watch(pipe);
+            add_watch(wake_pipe[0]);
+#endif
+
+            is_reset = false;
+            is_workers_stop = false;
+            const size_t workers_number = std::max(config.workers, (size_t)1);
+            for(size_t i = 0; i < workers_number; ++i) {
+                workers.push_back(std::thread(&NamedPipeServer::worker_loop, this));
+            }
+            named_pipe_future = std::async(std::launch::async, &NamedPipeServer::event_loop, this);
             return true;
         }
     public:
@@ -329,7 +1430,6 @@ namespace open_bo_api {
         NamedPipeServer() {
             is_reset = false;
             is_error = false;
-            is_connection = false;
         }
 
         /** \brief Запустить сервер
@@ -342,27 +1442,7 @@ namespace open_bo_api {
          */
         void stop() {
             is_reset = true;
-            if(is_connection) {
-                /* применяем лайфхак, чтобы разблочить функцию
-                 * ConnectNamedPipe
-                 */
-                 HANDLE hack_pipe;
-                 {
-                     std::lock_guard<std::mutex> lock(connection_pipe_name_mutex);
-                     hack_pipe = CreateFile(
-                        (LPCSTR)connection_pipe_name.c_str(), // имя канала
-                        GENERIC_READ |  // read and write access
-                        GENERIC_WRITE,
-                        0,              // no sharing
-                        NULL,           // default security attributes
-                        OPEN_EXISTING,  // opens existing pipe
-                        0,              // default attributes
-                        NULL);          // no template file
-                }
-                if(hack_pipe != INVALID_HANDLE_VALUE) {
-                    CloseHandle(pipe);
-                }
-            }
+            wake_up();
             if(named_pipe_future.valid()) {
                 try {
                     named_pipe_future.wait();
@@ -370,6 +1450,52 @@ namespace open_bo_api {
                 }
                 catch(...) {}
             }
+            /* дожидаемся выполнения оставшихся обратных вызовов */
+            {
+                std::lock_guard<std::mutex> lock(workers_mutex);
+                is_workers_stop = true;
+            }
+            workers_cv.notify_all();
+            for(auto &it : workers) {
+                if(it.joinable()) it.join();
+            }
+            workers.clear();
+            close_handles();
+            std::atomic_store(&subscribers, std::shared_ptr<const std::vector<std::shared_ptr<Connection>>>());
+        }
+
+        /** \brief Разослать сообщение всем подключенным клиентам
+         *
+         * Сообщение копируется один раз, в очереди соединений попадает указатель на общий буфер.
+         * Запись в сокеты выполняет цикл событий без блокировки, поэтому метод не ждет медленных клиентов.
+         * При переполнении очереди соединения применяется Config::slow_consumer_policy
+         * \param message Сообщение
+         * \return Количество соединений, в очередь которых попало сообщение
+         */
+        size_t broadcast(const SharedMessage &message) {
+            std::shared_ptr<const std::vector<std::shared_ptr<Connection>>> current = std::atomic_load(&subscribers);
+            if(!current) return 0;
+            size_t counter = 0;
+            bool is_wake_up = false;
+            for(auto &connection : *current) {
+                bool is_first = false;
+                if(!connection->push_send_queue(message, is_first)) continue;
+                ++counter;
+                if(!is_first) continue;
+                std::lock_guard<std::mutex> lock(write_connections_mutex);
+                if(write_connections.empty()) is_wake_up = true;
+                write_connections.push_back(connection);
+            }
+            if(is_wake_up) wake_up();
+            return counter;
+        }
+
+        /** \brief Разослать сообщение всем подключенным клиентам
+         * \param message Сообщение
+         * \return Количество соединений, в очередь которых попало сообщение
+         */
+        inline size_t broadcast(const std::string &message) {
+            return broadcast(std::make_shared<const std::string>(message));
         }
 
         /** \brief Проверить наличие ошибки
@@ -384,6 +1510,7 @@ namespace open_bo_api {
             stop();
         }
     };
+#endif
 }
 
 #endif // OPEN_BO_API_NAMED_PIPE_SERVER_HPP_INCLUDED
@@ -0,0 +1,617 @@
+/*
+* open-bo-api - C++ API for working with binary options brokers
+*
+* Copyright (c) 2020 Elektro Yar. Email: git.electroyar@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef OPEN_BO_API_NEWS_ARCHIVE_HPP_INCLUDED
+#define OPEN_BO_API_NEWS_ARCHIVE_HPP_INCLUDED
+
+#include "ForexprostoolsApi.hpp"
+#include <gzip/compress.hpp>
+#include <gzip/decompress.hpp>
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+#include <iostream>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <string>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+
+namespace open_bo_api {
+
+    /** \brief Локальный архив новостей
+     *
+     * Новости хранятся блоками по дням. Каждый блок самодостаточен: в нем своя таблица строк
+     * (валюты и названия новостей), метки времени - разностями от начала дня,
+     * целые числа - в формате varint, и весь блок сжат gzip.
+     * Архив загружается в память в сжатом виде, блок дня распаковывается при чтении.
+     * День считается окончательным, если на момент загрузки он закончился
+     * больше суток назад, такие дни больше не загружаются повторно.
+     *
+     * Окончательные дни хранятся в основном файле архива. Записанные блоки в нем не меняются,
+     * новые окончательные дни дописываются в конец файла.
+     * Остальные дни хранятся в небольшом файле <имя архива>.live, только он перезаписывается
+     * при появлении новых данных новостей.
+     */
+    class NewsArchive {
+    public:
+        static const uint32_t VERSION = 2;
+
+    private:
+        static constexpr const char *MAGIC = "OBNA";
+
+        /** \brief Блок новостей одного дня
+         */
+        class DayBlock {
+        public:
+            bool is_final = false;  /**< День окончательный, повторная загрузка не нужна */
+            bool is_stored = false; /**< Блок записан в основной файл архива */
+            uint32_t count = 0;     /**< Количество новостей */
+            std::string data;       /**< Упакованные и сжатые новости */
+
+            DayBlock() {};
+        };
+
+        std::string file_name;
+        mutable std::recursive_mutex archive_mutex;
+        std::map<xtime::timestamp_t, DayBlock> days;    /**< Блоки по меткам времени начала дня */
+        bool is_rewrite_main = false;   /**< Основной файл нужно переписать целиком (поврежден или изменился записанный день) */
+        bool is_live_changed = false;   /**< Изменились неокончательные дни */
+
+        enum {
+            FLAG_ACTUAL = 0x01,
+            FLAG_FORECAST = 0x02,
+            FLAG_PREVIOUS = 0x04,
+        };
+
+        static void write_varint(std::string &out, uint64_t value) {
+            while(value >= 0x80) {
+                out.push_back((char)((value & 0x7F) | 0x80));
+                value >>= 7;
+            }
+            out.push_back((char)value);
+        }
+
+        static bool read_varint(const std::string &in, size_t &pos, uint64_t &value) {
+            value = 0;
+            for(uint32_t shift = 0; shift < 64; shift += 7) {
+                if(pos >= in.size()) return false;
+                const uint8_t byte = in[pos++];
+                value |= (uint64_t)(byte & 0x7F) << shift;
+                if(!(byte & 0x80)) return true;
+            }
+            return false;
+        }
+
+        static void write_double(std::string &out, const double value) {
+            char buffer[sizeof(double)];
+            std::memcpy(buffer, &value, sizeof(double));
+            out.append(buffer, sizeof(double));
+        }
+
+        static bool read_double(const std::string &in, size_t &pos, double &value) {
+            if(pos + sizeof(double) > in.size()) return false;
+            std::memcpy(&value, in.data() + pos, sizeof(double));
+            pos += sizeof(double);
+            return true;
+        }
+
+        static inline uint64_t encode_zigzag(const int64_t value) {
+            return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+        }
+
+        static inline int64_t decode_zigzag(const uint64_t value) {
+            return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+        }
+
+        static bool read_strings(const std::string &in, size_t &pos, std::vector<std::string> &strings) {
+            uint64_t strings_size = 0;
+            if(!read_varint(in, pos, strings_size)) return false;
+            for(uint64_t i = 0; i < strings_size; ++i) {
+                uint64_t length = 0;
+                if(!read_varint(in, pos, length) || pos + length > in.size()) return false;
+                strings.push_back(in.substr(pos, length));
+                pos += length;
+            }
+            return true;
+        }
+
+        /** \brief Упаковать новости дня
+         */
+        static void encode_day(
+                const xtime::timestamp_t day,
+                std::vector<ForexprostoolsApiEasy::News> list_news,
+                DayBlock &block) {
+            std::stable_sort(list_news.begin(), list_news.end(),
+                    [](const ForexprostoolsApiEasy::News &a, const ForexprostoolsApiEasy::News &b) {
+                return a.timestamp < b.timestamp;
+            });
+            std::vector<std::string> strings;
+            std::map<std::string, uint32_t> string_indexes;
+            auto get_string_index = [&](const std::string &value) -> uint32_t {
+                auto it = string_indexes.find(value);
+                if(it != string_indexes.end()) return it->second;
+                const uint32_t index = strings.size();
+                strings.push_back(value);
+                string_indexes[value] = index;
+                return index;
+            };
+
+            std::string body;
+            xtime::timestamp_t last_timestamp = day;
+            for(size_t i = 0; i < list_news.size(); ++i) {
+                const ForexprostoolsApiEasy::News &news = list_news[i];
+                write_varint(body, news.timestamp - last_timestamp);
+                last_timestamp = news.timestamp;
+                write_varint(body, get_string_index(news.currency));
+                write_varint(body, get_string_index(news.name));
+                write_varint(body, encode_zigzag(news.level_volatility));
+                uint8_t flags = 0;
+                if(news.is_actual) flags |= FLAG_ACTUAL;
+                if(news.is_forecast) flags |= FLAG_FORECAST;
+                if(news.is_previous) flags |= FLAG_PREVIOUS;
+                body.push_back((char)flags);
+                if(news.is_actual) write_double(body, news.actual);
+                if(news.is_forecast) write_double(body, news.forecast);
+                if(news.is_previous) write_double(body, news.previous);
+            }
+
+            std::string raw;
+            write_varint(raw, strings.size());
+            for(size_t i = 0; i < strings.size(); ++i) {
+                write_varint(raw, strings[i].size());
+                raw += strings[i];
+            }
+            raw += body;
+            block.count = list_news.size();
+            block.data = gzip::compress(raw.data(), raw.size());
+        }
+
+        /** \brief Распаковать новости по таблице строк
+         */
+        static bool decode_news(
+                const xtime::timestamp_t day,
+                const uint64_t count,
+                const std::string &in,
+                size_t &pos,
+                const std::vector<std::string> &strings,
+                std::vector<ForexprostoolsApiEasy::News> &list_news) {
+            xtime::timestamp_t last_timestamp = day;
+            for(uint64_t i = 0; i < count; ++i) {
+                ForexprostoolsApiEasy::News news;
+                uint64_t delta = 0, currency = 0, name = 0, level = 0;
+                if(!read_varint(in, pos, delta) ||
+                    !read_varint(in, pos, currency) ||
+                    !read_varint(in, pos, name) ||
+                    !read_varint(in, pos, level)) return false;
+                if(currency >= strings.size() || name >= strings.size() || pos >= in.size()) return false;
+                last_timestamp += delta;
+                news.timestamp = last_timestamp;
+                news.currency = strings[currency];
+                news.name = strings[name];
+                news.level_volatility = decode_zigzag(level);
+                const uint8_t flags = in[pos++];
+                news.is_actual = flags & FLAG_ACTUAL;
+                news.is_forecast = flags & FLAG_FORECAST;
+                news.is_previous = flags & FLAG_PREVIOUS;
+                if(news.is_actual && !read_double(in, pos, news.actual)) return false;
+                if(news.is_forecast && !read_double(in, pos, news.forecast)) return false;
+                if(news.is_previous && !read_double(in, pos, news.previous)) return false;
+                list_news.push_back(news);
+            }
+            return true;
+        }
+
+        /** \brief Распаковать новости дня
+         */
+        static bool decode_day(
+                const xtime::timestamp_t day,
+                const DayBlock &block,
+                std::vector<ForexprostoolsApiEasy::News> &list_news) {
+            std::string raw;
+            try {
+                raw = gzip::decompress(block.data.data(), block.data.size());
+            } catch(...) {
+                return false;
+            }
+            size_t pos = 0;
+            std::vector<std::string> strings;
+            if(!read_strings(raw, pos, strings)) return false;
+            return decode_news(day, block.count, raw, pos, strings, list_news);
+        }
+
+        /** \brief Записать блок дня
+         */
+        static void write_day(std::string &out, const xtime::timestamp_t day, const DayBlock &block) {
+            write_varint(out, day / xtime::SECONDS_IN_DAY);
+            out.push_back(block.is_final ? 1 : 0);
+            write_varint(out, block.count);
+            write_varint(out, block.data.size());
+            out += block.data;
+        }
+
+        static std::string get_header() {
+            std::string buffer(MAGIC);
+            const uint32_t version = VERSION;
+            buffer.append((const char*)&version, sizeof(uint32_t));
+            return buffer;
+        }
+
+        static inline std::string get_live_file_name(const std::string &archive_file_name) {
+            return archive_file_name + ".live";
+        }
+
+        /** \brief Прочитать файл целиком
+         * \return Вернет false, если файла нет
+         */
+        static bool read_file(const std::string &path, std::string &buffer) {
+            std::ifstream file(path, std::ios::binary);
+            if(!file) return false;
+            buffer.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            return true;
+        }
+
+        /** \brief Записать файл через временный файл
+         */
+        static bool replace_file(const std::string &path, const std::string &buffer) {
+            const std::string temp_file = path + ".tmp";
+            std::ofstream file(temp_file, std::ios::binary);
+            if(!file) return false;
+            file.write(buffer.data(), buffer.size());
+            file.close();
+            if(!file) {
+                std::remove(temp_file.c_str());
+                return false;
+            }
+#           if defined(_WIN32)
+            if(!MoveFileExA(temp_file.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+#           else
+            if(std::rename(temp_file.c_str(), path.c_str()) != 0) {
+#           endif
+                std::cerr << "open_bo_api::NewsArchive::save(), file replace error: " << path << std::endl;
+                std::remove(temp_file.c_str());
+                return false;
+            }
+            return true;
+        }
+
+        /** \brief Загрузить архив первой версии
+         *
+         * Дни переупаковываются в блоки текущей версии, при сохранении основной файл будет переписан
+         */
+        bool load_version_1(const std::string &buffer, size_t pos) {
+            std::vector<std::string> strings;
+            if(!read_strings(buffer, pos, strings)) return false;
+            uint64_t days_size = 0;
+            if(!read_varint(buffer, pos, days_size)) return false;
+            xtime::timestamp_t last_day = 0;
+            for(uint64_t i = 0; i < days_size; ++i) {
+                uint64_t day_delta = 0, count = 0, size = 0;
+                if(!read_varint(buffer, pos, day_delta) || pos >= buffer.size()) return false;
+                const bool is_final = buffer[pos++] != 0;
+                if(!read_varint(buffer, pos, count) ||
+                    !read_varint(buffer, pos, size) ||
+                    pos + size > buffer.size()) return false;
+                last_day += day_delta * xtime::SECONDS_IN_DAY;
+                const std::string data = buffer.substr(pos, size);
+                pos += size;
+                size_t data_pos = 0;
+                std::vector<ForexprostoolsApiEasy::News> list_news;
+                if(!decode_news(last_day, count, data, data_pos, strings, list_news)) return false;
+                set_day(last_day, list_news, is_final);
+            }
+            is_rewrite_main = true;
+            return true;
+        }
+
+        /** \brief Загрузить блоки дней из файла
+         *
+         * \param path Путь к файлу
+         * \param is_main Основной файл архива
+         * \return Вернет false, если формат файла не поддерживается
+         */
+        bool load_file(const std::string &path, const bool is_main) {
+            std::string buffer;
+            if(!read_file(path, buffer)) return true;
+
+            const size_t header_size = std::strlen(MAGIC) + sizeof(uint32_t);
+            if(buffer.size() < header_size || buffer.compare(0, std::strlen(MAGIC), MAGIC) != 0) {
+                std::cerr << "open_bo_api::NewsArchive::open(), wrong file format: " << path << std::endl;
+                return false;
+            }
+            uint32_t version = 0;
+            std::memcpy(&version, buffer.data() + std::strlen(MAGIC), sizeof(uint32_t));
+            if(is_main && version == 1) return load_version_1(buffer, header_size);
+            if(version != VERSION) {
+                std::cerr << "open_bo_api::NewsArchive::open(), unsupported version: " << version << std::endl;
+                return false;
+            }
+            size_t pos = header_size;
+            while(pos < buffer.size()) {
+                uint64_t day_number = 0, count = 0, size = 0;
+                if(!read_varint(buffer, pos, day_number) || pos >= buffer.size()) break;
+                const bool is_final = buffer[pos++] != 0;
+                if(!read_varint(buffer, pos, count) ||
+                    !read_varint(buffer, pos, size) ||
+                    pos + size > buffer.size()) break;
+                const xtime::timestamp_t day = day_number * xtime::SECONDS_IN_DAY;
+                DayBlock block;
+                block.is_final = is_main || is_final;
+                block.is_stored = is_main;
+                block.count = count;
+                block.data = buffer.substr(pos, size);
+                pos += size;
+                /* день из основного файла важнее дня из файла неокончательных дней */
+                if(!is_main && days.find(day) != days.end()) {
+                    is_live_changed = true;
+                    continue;
+                }
+                days[day] = std::move(block);
+            }
+            if(pos < buffer.size()) {
+                /* запись последнего дня была прервана, блоки до нее целы */
+                std::cerr << "open_bo_api::NewsArchive::open(), damaged tail: " << path << std::endl;
+                if(is_main) is_rewrite_main = true;
+                else is_live_changed = true;
+            }
+            return true;
+        }
+
+    public:
+
+        /** \brief Конструктор архива новостей
+         * \param archive_file_name Имя файла архива
+         */
+        NewsArchive(const std::string &archive_file_name) :
+            file_name(archive_file_name) {
+        };
+
+        /** \brief Загрузить архив из файлов
+         * \return Вернет true, если архив загружен. Отсутствие файлов не считается ошибкой
+         */
+        bool open() {
+            std::lock_guard<std::recursive_mutex> lock(archive_mutex);
+            days.clear();
+            is_rewrite_main = false;
+            is_live_changed = false;
+            if(!load_file(file_name, true)) return false;
+            return load_file(get_live_file_name(file_name), false);
+        }
+
+        /** \brief Сохранить архив
+         *
+         * Новые окончательные дни дописываются в конец основного файла,
+         * файл неокончательных дней перезаписывается через временный файл, только если они изменились
+         * \return Вернет true, если архив сохранен
+         */
+        bool save() {
+            std::lock_guard<std::recursive_mutex> lock(archive_mutex);
+            if(is_rewrite_main) {
+                std::string buffer = get_header();
+                for(auto &it : days) {
+                    if(it.second.is_final) write_day(buffer, it.first, it.second);
+                }
+                if(!replace_file(file_name, buffer)) return false;
+                for(auto &it : days) {
+                    if(it.second.is_final) it.second.is_stored = true;
+                }
+                is_rewrite_main = false;
+            } else {
+                std::string buffer;
+                {
+                    std::ifstream probe(file_name, std::ios::binary | std::ios::ate);
+                    if(!probe || probe.tellg() <= 0) buffer = get_header();
+                }
+                const size_t header_size = buffer.size();
+                for(auto &it : days) {
+                    if(it.second.is_final && !it.second.is_stored) write_day(buffer, it.first, it.second);
+                }
+                if(buffer.size() > header_size) {
+                    std::ofstream file(file_name, std::ios::binary | std::ios::app);
+                    if(!file) return false;
+                    file.write(buffer.data(), buffer.size());
+                    file.close();
+                    if(!file) {
+                        std::cerr << "open_bo_api::NewsArchive::save(), file append error: " << file_name << std::endl;
+                        is_rewrite_main = true;
+                        return false;
+                    }
+                    for(auto &it : days) {
+                        if(it.second.is_final) it.second.is_stored = true;
+                    }
+                }
+            }
+
+            if(!is_live_changed) return true;
+            std::string buffer = get_header();
+            for(auto &it : days) {
+                if(!it.second.is_final) write_day(buffer, it.first, it.second);
+            }
+            if(!replace_file(get_live_file_name(file_name), buffer)) return false;
+            is_live_changed = false;
+            return true;
+        }
+
+        /** \brief Записать новости дня
+         * \param day Метка времени дня
+         * \param list_news Новости дня
+         * \param is_final День окончательный, повторная загрузка не нужна
+         * \return Вернет true, если блок дня изменился
+         */
+        bool set_day(
+                const xtime::timestamp_t day,
+                const std::vector<ForexprostoolsApiEasy::News> &list_news,
+                const bool is_final) {
+            std::lock_guard<std::recursive_mutex> lock(archive_mutex);
+            const xtime::timestamp_t first_timestamp = xtime::get_first_timestamp_day(day);
+            DayBlock block;
+            encode_day(first_timestamp, list_news, block);
+            block.is_final = is_final;
+            auto it = days.find(first_timestamp);
+            if(it != days.end() &&
+                it->second.is_final == block.is_final &&
+                it->second.count == block.count &&
+                it->second.data == block.data) return false;
+            if(it != days.end()) {
+                /* записанные блоки основного файла не меняются, файл придется переписать */
+                if(it->second.is_stored) is_rewrite_main = true;
+                if(!it->second.is_final) is_live_changed = true;
+            }
+            if(!is_final) is_live_changed = true;
+            days[first_timestamp] = std::move(block);
+            return true;
+        }
+
+        /** \brief Проверить наличие дня в архиве
+         * \param day Метка времени дня
+         * \param is_only_final Учитывать только окончательные дни
+         * \return Вернет true, если день есть в архиве
+         */
+        bool check_day(const xtime::timestamp_t day, const bool is_only_final = false) const {
+            std::lock_guard<std::recursive_mutex> lock(archive_mutex);
+            auto it = days.find(xtime::get_first_timestamp_day(day));
+            if(it == days.end()) return false;
+            return !is_only_final || it->second.is_final;
+        }
+
+        /** \brief Проверить, что все дни диапазона есть в архиве
+         * \param start_timestamp Начало диапазона
+         * \param stop_timestamp Конец диапазона (включительно)
+         * \return Вернет true, если все дни диапазона есть в архиве
+         */
+        bool check_range(const xtime::timestamp_t start_timestamp, const xtime::timestamp_t stop_timestamp) const {
+            std::lock_guard<std::recursive_mutex> lock(archive_mutex);
+            for(xtime::timestamp_t day = xtime::get_first_timestamp_day(start_timestamp);
+                day <= stop_timestamp; day += xtime::SECONDS_IN_DAY) {
+                if(days.find(day) == days.end()) return false;
+            }
+            return true;
+        }
+
+        /** \brief Получить новости за диапазон времени
+         * \param start_timestamp Начало диапазона
+         * \param stop_timestamp Конец диапазона (включительно)
+         * \param list_news Новости диапазона
+         * \return Вернет true, если данные архива не повреждены
+         */
+        bool get_news(
+                const xtime::timestamp_t start_timestamp,
+                const xtime::timestamp_t stop_timestamp,
+                std::vector<ForexprostoolsApiEasy::News> &list_news) const {
+            std::lock_guard<std::recursive_mutex> lock(archive_mutex);
+            list_news.clear();
+            auto it = days.lower_bound(xtime::get_first_timestamp_day(start_timestamp));
+            for(; it != days.end() && it->first <= stop_timestamp; ++it) {
+                std::vector<ForexprostoolsApiEasy::News> day_news;
+                if(!decode_day(it->first, it->second, day_news)) {
+                    std::cerr << "open_bo_api::NewsArchive::get_news(), damaged day: " << xtime::get_str_date(it->first) << std::endl;
+                    return false;
+                }
+                for(size_t i = 0; i < day_news.size(); ++i) {
+                    if(day_news[i].timestamp < start_timestamp || day_news[i].timestamp > stop_timestamp) continue;
+                    list_news.push_back(day_news[i]);
+                }
+            }
+            return true;
+        }
+
+        /** \brief Синхронизировать архив
+         *
+         * Загружаются только дни, которых нет в архиве или которые еще не окончательные.
+         * Соседние недостающие дни загружаются одним запросом.
+         * Архив сохраняется, только если изменился блок хотя бы одного дня
+         * (например, вышли новые данные новости или день стал окончательным).
+         * Новые данные неокончательных дней перезаписывают только небольшой файл <имя архива>.live
+         * \param api Объект API новостей
+         * \param start_timestamp Начало диапазона
+         * \param stop_timestamp Конец диапазона (включительно)
+         * \param current_timestamp Текущее время, нужно чтобы определить окончательные дни
+         * \return Вернет true, если все недостающие дни были загружены
+         */
+        bool sync(
+                ForexprostoolsApi &api,
+                const xtime::timestamp_t start_timestamp,
+                const xtime::timestamp_t stop_timestamp,
+                const xtime::timestamp_t current_timestamp) {
+            /* находим диапазоны недостающих дней */
+            std::vector<std::pair<xtime::timestamp_t, xtime::timestamp_t>> ranges;
+            for(xtime::timestamp_t day = xtime::get_first_timestamp_day(start_timestamp);
+                day <= stop_timestamp; day += xtime::SECONDS_IN_DAY) {
+                if(check_day(day, true)) continue;
+                if(!ranges.empty() && ranges.back().second + 1 == day) {
+                    ranges.back().second = day + xtime::SECONDS_IN_DAY - 1;
+                } else {
+                    ranges.push_back(std::make_pair(day, day + xtime::SECONDS_IN_DAY - 1));
+                }
+            }
+            if(ranges.empty()) return true;
+
+            bool is_ok = true;
+            bool is_changed = false;
+            for(size_t r = 0; r < ranges.size(); ++r) {
+                std::vector<ForexprostoolsApiEasy::News> list_news;
+                int err = ForexprostoolsApi::OK;
+                for(uint32_t attempt = 0; attempt < 5; ++attempt) {
+                    list_news.clear();
+                    err = api.download_all_news(ranges[r].first, ranges[r].second, list_news);
+                    if(err == ForexprostoolsApi::OK) break;
+                }
+                if(err != ForexprostoolsApi::OK) {
+                    is_ok = false;
+                    continue;
+                }
+                /* раскладываем новости по дням */
+                std::map<xtime::timestamp_t, std::vector<ForexprostoolsApiEasy::News>> day_news;
+                for(xtime::timestamp_t day = ranges[r].first; day < ranges[r].second; day += xtime::SECONDS_IN_DAY) {
+                    day_news[day];
+                }
+                for(size_t i = 0; i < list_news.size(); ++i) {
+                    const xtime::timestamp_t day = xtime::get_first_timestamp_day(list_news[i].timestamp);
+                    auto it = day_news.find(day);
+                    if(it == day_news.end()) continue;
+                    it->second.push_back(list_news[i]);
+                }
+                for(auto &it : day_news) {
+                    const bool is_final = it.first + 2 * xtime::SECONDS_IN_DAY <= current_timestamp;
+                    if(set_day(it.first, it.second, is_final)) is_changed = true;
+                }
+            }
+            if(is_changed && !save()) return false;
+            return is_ok;
+        }
+
+        /** \brief Получить количество дней в архиве
+         */
+        size_t size() const {
+            std::lock_guard<std::recursive_mutex> lock(archive_mutex);
+            return days.size();
+        }
+    };
+};
+
+#endif // OPEN_BO_API_NEWS_ARCHIVE_HPP_INCLUDED
@@ -0,0 +1,366 @@
+/*
+* open-bo-api - C++ API for working with binary options brokers
+*
+* Copyright (c) 2020 Elektro Yar. Email: git.electroyar@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef OPEN_BO_API_NEWS_BLACKOUT_HPP_INCLUDED
+#define OPEN_BO_API_NEWS_BLACKOUT_HPP_INCLUDED
+
+#include "open-bo-api-news-index.hpp"
+#include <vector>
+#include <map>
+#include <array>
+#include <tuple>
+#include <iterator>
+#include <string>
+#include <algorithm>
+
+namespace open_bo_api {
+
+    /** \brief Параметры фильтра новостей
+     *
+     * Параметры совпадают с параметрами News::check_news_filter
+     */
+    class NewsFilterParameters {
+    public:
+        xtime::timestamp_t indent_timestamp_past = 0;   /**< Максимальный отступ до метки времени */
+        xtime::timestamp_t indent_timestamp_future = 0; /**< Максимальный отступ после метки времени */
+        bool is_only_select = false;    /**< Использовать только выбранные уровни силы новости */
+        bool is_low = false;            /**< Использовать слабые новости */
+        bool is_moderate = false;       /**< Использовать новости средней силы */
+        bool is_high = false;           /**< Использовать сильные новости */
+
+        NewsFilterParameters() {};
+
+        NewsFilterParameters(
+                const xtime::timestamp_t past,
+                const xtime::timestamp_t future,
+                const bool only_select,
+                const bool low,
+                const bool moderate,
+                const bool high) :
+            indent_timestamp_past(past), indent_timestamp_future(future),
+            is_only_select(only_select), is_low(low), is_moderate(moderate), is_high(high) {};
+    };
+
+    /** \brief Карта запрета торговли по новостям
+     *
+     * Для каждого символа хранится битовая карта с разрешением в одну минуту:
+     * бит установлен, если фильтр новостей для начала этой минуты вернул бы true.
+     * Проверка фильтра сводится к проверке одного бита.
+     * При обновлении списка новостей пересчитываются только минуты, на которые
+     * повлияли добавленные, удаленные или измененные новости.
+     * Класс не потокобезопасен, для работы из нескольких потоков используйте снимки (shared_ptr).
+     */
+    class NewsBlackout {
+    private:
+
+        /** \brief Новость в карте запрета
+         */
+        class Item {
+        public:
+            std::string currency;
+            xtime::timestamp_t timestamp = 0;
+            int level = -1;
+
+            Item() {};
+
+            Item(const std::string &item_currency, const xtime::timestamp_t item_timestamp, const int item_level) :
+                currency(item_currency), timestamp(item_timestamp), level(item_level) {};
+
+            bool operator < (const Item &other) const {
+                return std::tie(currency, timestamp, level) < std::tie(other.currency, other.timestamp, other.level);
+            }
+
+            bool operator == (const Item &other) const {
+                return currency == other.currency && timestamp == other.timestamp && level == other.level;
+            }
+        };
+
+        typedef std::vector<std::pair<xtime::timestamp_t, int>> CurrencyNews;
+
+        NewsFilterParameters parameters;
+        xtime::timestamp_t start_minute = 0;    /**< Первая минута карты (номер минуты от начала эпохи) */
+        size_t minutes = 0;                     /**< Количество минут в карте */
+
+        std::vector<std::string> symbols;
+        std::map<std::string, uint32_t> symbol_indexes;
+        std::vector<int32_t> symbol_id_indexes;     /**< Индексы символов по номерам из реестра символов */
+        std::vector<std::pair<std::string, std::string>> symbol_currencies;
+        std::vector<std::vector<uint64_t>> bits;    /**< Битовые карты символов */
+
+        std::vector<Item> items;                    /**< Отсортированный список новостей */
+        std::map<std::string, CurrencyNews> currency_news;
+        bool is_init = false;
+
+        inline void set_bit(std::vector<uint64_t> &symbol_bits, const size_t index, const bool value) {
+            const uint64_t mask = (uint64_t)1 << (index & 63);
+            if(value) symbol_bits[index >> 6] |= mask;
+            else symbol_bits[index >> 6] &= ~mask;
+        }
+
+        /** \brief Объединить новости валют символа
+         */
+        void get_symbol_news(const uint32_t symbol_index, CurrencyNews &news) const {
+            news.clear();
+            const std::string &currency_1 = symbol_currencies[symbol_index].first;
+            const std::string &currency_2 = symbol_currencies[symbol_index].second;
+            auto it_1 = currency_news.find(currency_1);
+            if(it_1 != currency_news.end()) news = it_1->second;
+            if(currency_2 != currency_1) {
+                auto it_2 = currency_news.find(currency_2);
+                if(it_2 != currency_news.end()) {
+                    const size_t middle = news.size();
+                    news.insert(news.end(), it_2->second.begin(), it_2->second.end());
+                    std::inplace_merge(news.begin(), news.begin() + middle, news.end());
+                }
+            }
+        }
+
+        /** \brief Пересчитать биты символа в диапазоне минут
+         *
+         * Окно фильтра сдвигается по минутам, количество новостей
+         * каждого уровня в окне обновляется двумя указателями
+         * \param symbol_index Индекс символа
+         * \param news Объединенные новости валют символа
+         * \param first Первая минута диапазона (индекс в карте)
+         * \param last Минута после последней минуты диапазона (индекс в карте)
+         */
+        void fill_range(
+                const uint32_t symbol_index,
+                const CurrencyNews &news,
+                const size_t first,
+                const size_t last) {
+            std::vector<uint64_t> &symbol_bits = bits[symbol_index];
+            std::array<uint32_t, NewsIndex::LEVELS> count;
+            count.fill(0);
+            const xtime::timestamp_t first_timestamp = (start_minute + first) * xtime::SECONDS_IN_MINUTE;
+            /* начальные положения указателей */
+            const xtime::timestamp_t window_start = first_timestamp - parameters.indent_timestamp_past;
+            size_t lo = std::lower_bound(news.begin(), news.end(), std::make_pair(window_start, -1)) - news.begin();
+            size_t hi = lo;
+            for(size_t m = first; m < last; ++m) {
+                const xtime::timestamp_t timestamp = (start_minute + m) * xtime::SECONDS_IN_MINUTE;
+                const xtime::timestamp_t start_timestamp = timestamp - parameters.indent_timestamp_past;
+                const xtime::timestamp_t stop_timestamp = timestamp + parameters.indent_timestamp_future;
+                while(hi < news.size() && news[hi].first <= stop_timestamp) {
+                    if(news[hi].second >= 0) ++count[news[hi].second];
+                    ++hi;
+                }
+                while(lo < hi && news[lo].first < start_timestamp) {
+                    if(news[lo].second >= 0) --count[news[lo].second];
+                    ++lo;
+                }
+                set_bit(symbol_bits, m, NewsIndex::check_filter(
+                    count,
+                    parameters.is_only_select,
+                    parameters.is_low,
+                    parameters.is_moderate,
+                    parameters.is_high));
+            }
+        }
+
+        /** \brief Получить диапазон минут, на которые влияет новость
+         */
+        bool get_affected_range(const xtime::timestamp_t timestamp, size_t &first, size_t &last) const {
+            const int64_t first_minute = ((int64_t)timestamp - (int64_t)parameters.indent_timestamp_future +
+                (int64_t)xtime::SECONDS_IN_MINUTE - 1) / (int64_t)xtime::SECONDS_IN_MINUTE - (int64_t)start_minute;
+            const int64_t last_minute = ((int64_t)timestamp + (int64_t)parameters.indent_timestamp_past) /
+                (int64_t)xtime::SECONDS_IN_MINUTE - (int64_t)start_minute + 1;
+            const int64_t a = std::max(first_minute, (int64_t)0);
+            const int64_t b = std::min(last_minute, (int64_t)minutes);
+            if(a >= b) return false;
+            first = a;
+            last = b;
+            return true;
+        }
+
+    public:
+
+        NewsBlackout() {};
+
+        /** \brief Инициализировать карту запрета
+         *
+         * \param filter_parameters Параметры фильтра новостей
+         * \param start_timestamp Начало диапазона дат
+         * \param stop_timestamp Конец диапазона дат (включительно)
+         * \param list_symbols Список символов
+         */
+        NewsBlackout(
+                const NewsFilterParameters &filter_parameters,
+                const xtime::timestamp_t start_timestamp,
+                const xtime::timestamp_t stop_timestamp,
+                const std::vector<std::string> &list_symbols) :
+                parameters(filter_parameters), symbols(list_symbols) {
+            start_minute = start_timestamp / xtime::SECONDS_IN_MINUTE;
+            const xtime::timestamp_t stop_minute = stop_timestamp / xtime::SECONDS_IN_MINUTE;
+            minutes = stop_minute >= start_minute ? stop_minute - start_minute + 1 : 0;
+            bits.assign(symbols.size(), std::vector<uint64_t>((minutes + 63) / 64, 0));
+            symbol_currencies.resize(symbols.size());
+            for(size_t i = 0; i < symbols.size(); ++i) {
+                symbol_indexes[symbols[i]] = i;
+                const SymbolId symbol_id = SymbolRegistry::instance().get_id(symbols[i]);
+                if(symbol_id.is_valid()) {
+                    if(symbol_id.value >= symbol_id_indexes.size()) symbol_id_indexes.resize(symbol_id.value + 1, -1);
+                    symbol_id_indexes[symbol_id.value] = i;
+                }
+                /* валюты символа разобраны при регистрации в реестре символов */
+                const SymbolInfo &info = SymbolRegistry::instance().get_info(symbol_id);
+                symbol_currencies[i].first = info.base_currency;
+                symbol_currencies[i].second = info.quote_currency;
+            }
+        }
+
+        /** \brief Обновить карту по списку новостей
+         *
+         * Первый вызов строит карту целиком, последующие пересчитывают
+         * только минуты, на которые повлияли изменения списка новостей
+         * \param list_news Список новостей
+         */
+        void update(const std::vector<ForexprostoolsApiEasy::News> &list_news) {
+            std::vector<Item> new_items;
+            new_items.reserve(list_news.size());
+            for(size_t i = 0; i < list_news.size(); ++i) {
+                new_items.push_back(Item(
+                    list_news[i].currency,
+                    list_news[i].timestamp,
+                    NewsIndex::get_level(list_news[i].level_volatility)));
+            }
+            std::sort(new_items.begin(), new_items.end());
+            new_items.erase(std::unique(new_items.begin(), new_items.end()), new_items.end());
+
+            /* находим отличия от предыдущего списка */
+            std::vector<Item> changes;
+            std::set_symmetric_difference(
+                items.begin(), items.end(),
+                new_items.begin(), new_items.end(),
+                std::back_inserter(changes));
+            if(is_init && changes.empty()) return;
+
+            items.swap(new_items);
+            currency_news.clear();
+            for(size_t i = 0; i < items.size(); ++i) {
+                currency_news[items[i].currency].push_back(std::make_pair(items[i].timestamp, items[i].level));
+            }
+
+            CurrencyNews news;
+            for(uint32_t s = 0; s < symbols.size(); ++s) {
+                /* диапазоны минут, которые нужно пересчитать */
+                std::vector<std::pair<size_t, size_t>> ranges;
+                if(!is_init) {
+                    if(minutes > 0) ranges.push_back(std::make_pair((size_t)0, minutes));
+                } else {
+                    for(size_t i = 0; i < changes.size(); ++i) {
+                        if(changes[i].currency != symbol_currencies[s].first &&
+                            changes[i].currency != symbol_currencies[s].second) continue;
+                        size_t first = 0, last = 0;
+                        if(get_affected_range(changes[i].timestamp, first, last)) {
+                            ranges.push_back(std::make_pair(first, last));
+                        }
+                    }
+                    std::sort(ranges.begin(), ranges.end());
+                }
+                if(ranges.empty()) continue;
+                get_symbol_news(s, news);
+                size_t first = ranges[0].first, last = ranges[0].second;
+                for(size_t i = 1; i < ranges.size(); ++i) {
+                    if(ranges[i].first <= last) {
+                        last = std::max(last, ranges[i].second);
+                        continue;
+                    }
+                    fill_range(s, news, first, last);
+                    first = ranges[i].first;
+                    last = ranges[i].second;
+                }
+                fill_range(s, news, first, last);
+            }
+            is_init = true;
+        }
+
+        /** \brief Получить индекс символа
+         * \param symbol_name Имя символа
+         * \return Индекс символа или -1, если символа нет в карте
+         */
+        inline int32_t get_symbol_index(const std::string &symbol_name) const {
+            auto it = symbol_indexes.find(symbol_name);
+            if(it == symbol_indexes.end()) return -1;
+            return it->second;
+        }
+
+        /** \brief Получить индекс символа по номеру из реестра символов
+         * \param symbol_id Номер символа
+         * \return Индекс символа или -1, если символа нет в карте
+         */
+        inline int32_t get_symbol_index(const SymbolId symbol_id) const {
+            if(symbol_id.value >= symbol_id_indexes.size()) return -1;
+            return symbol_id_indexes[symbol_id.value];
+        }
+
+        /** \brief Проверить запрет торговли
+         *
+         * Проверяется минута, в которую попадает метка времени
+         * \param symbol_index Индекс символа
+         * \param timestamp Метка времени
+         * \return Вернет true, если для минуты есть новость, подходящая под фильтр
+         */
+        inline bool check(const int32_t symbol_index, const xtime::timestamp_t timestamp) const {
+            if(symbol_index < 0 || (size_t)symbol_index >= bits.size()) return false;
+            const xtime::timestamp_t minute = timestamp / xtime::SECONDS_IN_MINUTE;
+            if(minute < start_minute) return false;
+            const size_t index = minute - start_minute;
+            if(index >= minutes) return false;
+            return (bits[symbol_index][index >> 6] >> (index & 63)) & 1;
+        }
+
+        /** \brief Проверить запрет торговли
+         * \param symbol_name Имя символа
+         * \param timestamp Метка времени
+         * \return Вернет true, если для минуты есть новость, подходящая под фильтр
+         */
+        inline bool check(const std::string &symbol_name, const xtime::timestamp_t timestamp) const {
+            return check(get_symbol_index(symbol_name), timestamp);
+        }
+
+        /** \brief Проверить запрет торговли по номеру символа из реестра символов
+         * \param symbol_id Номер символа
+         * \param timestamp Метка времени
+         * \return Вернет true, если для минуты есть новость, подходящая под фильтр
+         */
+        inline bool check(const SymbolId symbol_id, const xtime::timestamp_t timestamp) const {
+            return check(get_symbol_index(symbol_id), timestamp);
+        }
+
+        /** \brief Проверить, попадает ли метка времени в диапазон карты
+         */
+        inline bool check_range(const xtime::timestamp_t timestamp) const {
+            const xtime::timestamp_t minute = timestamp / xtime::SECONDS_IN_MINUTE;
+            return minute >= start_minute && minute - start_minute < minutes;
+        }
+
+        /** \brief Получить параметры фильтра новостей
+         */
+        inline const NewsFilterParameters &get_parameters() const {
+            return parameters;
+        }
+    };
+};
+
+#endif // OPEN_BO_API_NEWS_BLACKOUT_HPP_INCLUDED
@@ -0,0 +1,386 @@
+/*
+* open-bo-api - C++ API for working with binary options brokers
+*
+* Copyright (c) 2020 Elektro Yar. Email: git.electroyar@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef OPEN_BO_API_NEWS_INDEX_HPP_INCLUDED
+#define OPEN_BO_API_NEWS_INDEX_HPP_INCLUDED
+
+#include "ForexprostoolsApi.hpp"
+#include "open-bo-api-symbol-registry.hpp"
+#include <vector>
+#include <map>
+#include <array>
+#include <string>
+#include <algorithm>
+
+namespace open_bo_api {
+
+    /** \brief Индекс новостей по валютам
+     *
+     * Для каждой валюты хранится отсортированный массив меток времени новостей
+     * и префиксные суммы количества новостей каждого уровня силы.
+     * Проверка фильтра новостей выполняется двумя бинарными поисками
+     * на каждую валюту пары и не выделяет память.
+     * Индекс строится один раз после обновления списка новостей и далее только читается.
+     */
+    class NewsIndex {
+    public:
+
+        /// Уровни силы новостей в индексе
+        enum {
+            LEVEL_LOW = 0,
+            LEVEL_MODERATE = 1,
+            LEVEL_HIGH = 2,
+            LEVELS = 3,
+        };
+
+        /** \brief Валюты символа
+         */
+        class SymbolCurrencies {
+        public:
+            int32_t currency_1 = -1;    /**< Номер первой валюты в индексе или -1, если новостей по валюте нет */
+            int32_t currency_2 = -1;    /**< Номер второй валюты в индексе или -1, если новостей по валюте нет */
+
+            SymbolCurrencies() {};
+
+            SymbolCurrencies(const int32_t c1, const int32_t c2) :
+                currency_1(c1), currency_2(c2) {};
+        };
+
+    private:
+
+        /** \brief Новости одной валюты
+         */
+        class CurrencyNews {
+        public:
+            std::vector<xtime::timestamp_t> timestamps;             /**< Отсортированные метки времени новостей */
+            std::vector<std::array<uint32_t, LEVELS>> prefix_count; /**< Префиксные суммы количества новостей по уровням */
+
+            CurrencyNews() {};
+        };
+
+        std::map<std::string, int32_t> currencies;      /**< Номера валют */
+        std::vector<CurrencyNews> currency_news;        /**< Новости по номерам валют */
+        std::vector<xtime::timestamp_t> all_timestamps; /**< Метки времени всех новостей */
+        std::map<std::string, SymbolCurrencies> symbols;    /**< Валюты символов, разобранные заранее */
+        std::vector<SymbolCurrencies> symbol_id_currencies; /**< Валюты символов по номерам из реестра символов */
+        std::vector<bool> symbol_id_resolved;               /**< Флаги символов, разобранных заранее, по номерам из реестра */
+
+        /** \brief Найти диапазон новостей
+         * \param timestamps Отсортированные метки времени
+         * \param start_timestamp Начало диапазона (включительно)
+         * \param stop_timestamp Конец диапазона (включительно)
+         * \param first Индекс первой новости диапазона
+         * \param last Индекс после последней новости диапазона
+         */
+        static inline void find_range(
+                const std::vector<xtime::timestamp_t> &timestamps,
+                const xtime::timestamp_t start_timestamp,
+                const xtime::timestamp_t stop_timestamp,
+                size_t &first,
+                size_t &last) {
+            first = std::lower_bound(timestamps.begin(), timestamps.end(), start_timestamp) - timestamps.begin();
+            last = std::upper_bound(timestamps.begin() + first, timestamps.end(), stop_timestamp) - timestamps.begin();
+        }
+
+        /** \brief Добавить количество новостей валюты в диапазоне
+         */
+        inline void add_count(
+                const int32_t currency,
+                const xtime::timestamp_t start_timestamp,
+                const xtime::timestamp_t stop_timestamp,
+                std::array<uint32_t, LEVELS> &count) const {
+            if(currency < 0) return;
+            const CurrencyNews &news = currency_news[currency];
+            size_t first = 0, last = 0;
+            find_range(news.timestamps, start_timestamp, stop_timestamp, first, last);
+            if(first == last) return;
+            for(size_t l = 0; l < LEVELS; ++l) {
+                count[l] += news.prefix_count[last][l] - news.prefix_count[first][l];
+            }
+        }
+
+        /** \brief Получить номера валют символа
+         *
+         * Валюты символа разобраны один раз при регистрации в реестре символов
+         * \param info Данные символа из реестра символов
+         */
+        SymbolCurrencies resolve_symbol(const SymbolInfo &info) const {
+            if(!info.check_currencies()) return SymbolCurrencies();
+            return SymbolCurrencies(get_currency_id(info.base_currency), get_currency_id(info.quote_currency));
+        }
+
+    public:
+
+        NewsIndex() {};
+
+        /** \brief Получить уровень силы новости в индексе
+         * \param level_volatility Уровень силы новости
+         * \return Уровень в индексе или -1, если уровень не учитывается
+         */
+        static inline int get_level(const int level_volatility) {
+            if(level_volatility == ForexprostoolsApiEasy::LOW) return LEVEL_LOW;
+            if(level_volatility == ForexprostoolsApiEasy::MODERATE) return LEVEL_MODERATE;
+            if(level_volatility == ForexprostoolsApiEasy::HIGH) return LEVEL_HIGH;
+            return -1;
+        }
+
+        /** \brief Построить индекс
+         *
+         * \param list_news Список новостей
+         * \param list_symbols Список символов, валюты которых нужно разобрать заранее
+         */
+        void build(
+                const std::vector<ForexprostoolsApiEasy::News> &list_news,
+                const std::vector<std::string> &list_symbols = std::vector<std::string>()) {
+            currencies.clear();
+            currency_news.clear();
+            symbols.clear();
+            symbol_id_currencies.clear();
+            symbol_id_resolved.clear();
+            all_timestamps.clear();
+            all_timestamps.reserve(list_news.size());
+
+            /* группируем новости по валютам */
+            std::vector<std::vector<std::pair<xtime::timestamp_t, int>>> temp;
+            for(size_t i = 0; i < list_news.size(); ++i) {
+                all_timestamps.push_back(list_news[i].timestamp);
+                auto it = currencies.find(list_news[i].currency);
+                if(it == currencies.end()) {
+                    it = currencies.insert(std::make_pair(list_news[i].currency, (int32_t)temp.size())).first;
+                    temp.resize(temp.size() + 1);
+                }
+                temp[it->second].push_back(std::make_pair(list_news[i].timestamp, get_level(list_news[i].level_volatility)));
+            }
+            std::sort(all_timestamps.begin(), all_timestamps.end());
+
+            currency_news.resize(temp.size());
+            for(size_t c = 0; c < temp.size(); ++c) {
+                std::sort(temp[c].begin(), temp[c].end());
+                CurrencyNews &news = currency_news[c];
+                news.timestamps.resize(temp[c].size());
+                news.prefix_count.resize(temp[c].size() + 1);
+                news.prefix_count[0].fill(0);
+                for(size_t i = 0; i < temp[c].size(); ++i) {
+                    news.timestamps[i] = temp[c][i].first;
+                    news.prefix_count[i + 1] = news.prefix_count[i];
+                    if(temp[c][i].second >= 0) ++news.prefix_count[i + 1][temp[c][i].second];
+                }
+            }
+
+            /* разбираем символы заранее, чтобы проверка фильтра не работала со строками */
+            for(size_t i = 0; i < list_symbols.size(); ++i) {
+                const SymbolId symbol_id = SymbolRegistry::instance().get_id(list_symbols[i]);
+                const SymbolCurrencies symbol_currencies = resolve_symbol(SymbolRegistry::instance().get_info(symbol_id));
+                symbols[list_symbols[i]] = symbol_currencies;
+                if(!symbol_id.is_valid()) continue;
+                if(symbol_id.value >= symbol_id_currencies.size()) {
+                    symbol_id_currencies.resize(symbol_id.value + 1);
+                    symbol_id_resolved.resize(symbol_id.value + 1, false);
+                }
+                symbol_id_currencies[symbol_id.value] = symbol_currencies;
+                symbol_id_resolved[symbol_id.value] = true;
+            }
+        }
+
+        /** \brief Получить номер валюты
+         * \param currency Валюта
+         * \return Номер валюты или -1, если новостей по валюте нет
+         */
+        inline int32_t get_currency_id(const std::string &currency) const {
+            auto it = currencies.find(currency);
+            if(it == currencies.end()) return -1;
+            return it->second;
+        }
+
+        /** \brief Получить валюты символа
+         * \param symbol_name Имя символа
+         * \param symbol_currencies Валюты символа
+         * \return Вернет true, если символ удалось разобрать
+         */
+        bool get_symbol_currencies(const std::string &symbol_name, SymbolCurrencies &symbol_currencies) const {
+            auto it = symbols.find(symbol_name);
+            if(it != symbols.end()) {
+                symbol_currencies = it->second;
+                return true;
+            }
+            /* символ не был разобран заранее, валюты берем из реестра символов без регистрации имени */
+            const SymbolId symbol_id = SymbolRegistry::instance().find_id(symbol_name);
+            if(symbol_id.is_valid()) return get_symbol_currencies(symbol_id, symbol_currencies);
+            /* символа нет в реестре, разбираем имя так же, как это сделал бы реестр */
+            std::string base_currency, quote_currency;
+            if(ForexprostoolsApiEasy::get_currencies(
+                    symbol_name,
+                    base_currency,
+                    quote_currency) != ForexprostoolsApiEasy::OK) return false;
+            symbol_currencies = SymbolCurrencies(get_currency_id(base_currency), get_currency_id(quote_currency));
+            return true;
+        }
+
+        /** \brief Получить валюты символа по номеру из реестра символов
+         * \param symbol_id Номер символа
+         * \param symbol_currencies Валюты символа
+         * \return Вернет true, если символ удалось разобрать
+         */
+        bool get_symbol_currencies(const SymbolId symbol_id, SymbolCurrencies &symbol_currencies) const {
+            if(symbol_id.value < symbol_id_resolved.size() && symbol_id_resolved[symbol_id.value]) {
+                symbol_currencies = symbol_id_currencies[symbol_id.value];
+                return true;
+            }
+            const SymbolInfo &info = SymbolRegistry::instance().get_info(symbol_id);
+            if(!info.check_currencies()) return false;
+            symbol_currencies = resolve_symbol(info);
+            return true;
+        }
+
+        /** \brief Проверить наличие любых новостей в диапазоне времени
+         * \param start_timestamp Начало диапазона (включительно)
+         * \param stop_timestamp Конец диапазона (включительно)
+         * \return Вернет true, если в диапазоне есть хотя бы одна новость
+         */
+        inline bool check_news(
+                const xtime::timestamp_t start_timestamp,
+                const xtime::timestamp_t stop_timestamp) const {
+            size_t first = 0, last = 0;
+            find_range(all_timestamps, start_timestamp, stop_timestamp, first, last);
+            return first != last;
+        }
+
+        /** \brief Получить количество новостей символа по уровням силы
+         * \param symbol_currencies Валюты символа
+         * \param start_timestamp Начало диапазона (включительно)
+         * \param stop_timestamp Конец диапазона (включительно)
+         * \param count Количество новостей каждого уровня силы
+         */
+        inline void get_count(
+                const SymbolCurrencies &symbol_currencies,
+                const xtime::timestamp_t start_timestamp,
+                const xtime::timestamp_t stop_timestamp,
+                std::array<uint32_t, LEVELS> &count) const {
+            count.fill(0);
+            add_count(symbol_currencies.currency_1, start_timestamp, stop_timestamp, count);
+            if(symbol_currencies.currency_2 != symbol_currencies.currency_1) {
+                add_count(symbol_currencies.currency_2, start_timestamp, stop_timestamp, count);
+            }
+        }
+
+        /** \brief Проверить фильтр новостей по количеству новостей каждого уровня
+         * \param count Количество новостей каждого уровня силы
+         * \param is_only_select Использовать только выбранные уровни силы новости
+         * \param is_low Использовать слабые новости
+         * \param is_moderate Использовать новости средней силы
+         * \param is_high Использовать сильные новости
+         * \return Вернет true, если новость подходит под фильтр
+         */
+        static inline bool check_filter(
+                const std::array<uint32_t, LEVELS> &count,
+                const bool is_only_select,
+                const bool is_low,
+                const bool is_moderate,
+                const bool is_high) {
+            const bool select[LEVELS] = {is_low, is_moderate, is_high};
+            bool is_news = false;
+            for(size_t l = 0; l < LEVELS; ++l) {
+                if(count[l] == 0) continue;
+                if(select[l]) is_news = true;
+                else if(is_only_select) return false;
+            }
+            return is_news;
+        }
+
+        /** \brief Проверить новости в заданных пределах времени и по заданным критериям
+         *
+         * \param symbol_name Имя валютной пары
+         * \param timestamp Метка времени
+         * \param indent_timestamp_past Максимальный отступ до метки времени
+         * \param indent_timestamp_future Максимальный отступ после метки времени
+         * \param is_only_select Использовать только выбранные уровни силы новости
+         * \param is_low Использовать слабые новости
+         * \param is_moderate Использовать новости средней силы
+         * \param is_high Использовать сильные новости
+         * \return Вернет true, если в заданных пределах времени есть новость, подходящая по указанным параметрам
+         */
+        bool check_news_filter(
+                const std::string &symbol_name,
+                const xtime::timestamp_t timestamp,
+                const xtime::timestamp_t indent_timestamp_past,
+                const xtime::timestamp_t indent_timestamp_future,
+                const bool is_only_select,
+                const bool is_low,
+                const bool is_moderate,
+                const bool is_high) const {
+            SymbolCurrencies symbol_currencies;
+            if(!get_symbol_currencies(symbol_name, symbol_currencies)) return false;
+            std::array<uint32_t, LEVELS> count;
+            get_count(
+                symbol_currencies,
+                timestamp - indent_timestamp_past,
+                timestamp + indent_timestamp_future,
+                count);
+            return check_filter(count, is_only_select, is_low, is_moderate, is_high);
+        }
+
+        /** \brief Проверить новости в заданных пределах времени и по заданным критериям
+         *
+         * Вариант для номера символа из реестра символов, работает без строк
+         * \param symbol_id Номер символа
+         * \return Вернет true, если в заданных пределах времени есть новость, подходящая по указанным параметрам
+         */
+        bool check_news_filter(
+                const SymbolId symbol_id,
+                const xtime::timestamp_t timestamp,
+                const xtime::timestamp_t indent_timestamp_past,
+                const xtime::timestamp_t indent_timestamp_future,
+                const bool is_only_select,
+                const bool is_low,
+                const bool is_moderate,
+                const bool is_high) const {
+            SymbolCurrencies symbol_currencies;
+            if(!get_symbol_currencies(symbol_id, symbol_currencies)) return false;
+            std::array<uint32_t, LEVELS> count;
+            get_count(
+                symbol_currencies,
+                timestamp - indent_timestamp_past,
+                timestamp + indent_timestamp_future,
+                count);
+            return check_filter(count, is_only_select, is_low, is_moderate, is_high);
+        }
+
+        /** \brief Получить количество новостей в индексе
+         */
+        inline size_t size() const {
+            return all_timestamps.size();
+        }
+
+        /** \brief Получить список валют индекса
+         */
+        std::vector<std::string> get_currencies() const {
+            std::vector<std::string> temp;
+            for(auto &it : currencies) {
+                temp.push_back(it.first);
+            }
+            return temp;
+        }
+    };
+};
+
+#endif // OPEN_BO_API_NEWS_INDEX_HPP_INCLUDED
@@ -25,11 +25,87 @@
 #define OPEN_BO_API_NEWS_HPP_INCLUDED
 
 #include "ForexprostoolsApi.hpp"
+#include "open-bo-api-news-index.hpp"
+#include "open-bo-api-news-archive.hpp"
+#include "open-bo-api-news-blackout.hpp"
 #include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
 #include <atomic>
+#include <memory>
+#include <vector>
+#include <algorithm>
 
 namespace open_bo_api {
 
+    /** \brief Карта запрета торговли по новостям, обновляемая вместе со списком новостей
+     *
+     * Карту нужно зарегистрировать через News::add_news_blackout.
+     * После каждой публикации нового списка новостей карта обновляется инкрементально,
+     * читатели получают неизменяемый снимок карты без блокировок
+     */
+    class LiveNewsBlackout {
+    private:
+        std::shared_ptr<const NewsBlackout> blackout;
+
+    public:
+
+        /** \brief Инициализировать карту запрета
+         *
+         * \param filter_parameters Параметры фильтра новостей
+         * \param start_timestamp Начало диапазона дат
+         * \param stop_timestamp Конец диапазона дат (включительно)
+         * \param list_symbols Список символов
+         */
+        LiveNewsBlackout(
+                const NewsFilterParameters &filter_parameters,
+                const xtime::timestamp_t start_timestamp,
+                const xtime::timestamp_t stop_timestamp,
+                const std::vector<std::string> &list_symbols) :
+                blackout(std::make_shared<const NewsBlackout>(
+                    filter_parameters,
+                    start_timestamp,
+                    stop_timestamp,
+                    list_symbols)) {};
+
+        /** \brief Обновить карту по списку новостей
+         *
+         * Обновляется копия карты, затем она публикуется атомарной заменой указателя.
+         * Вызовы должны быть упорядочены, News делает это под своей блокировкой
+         * \param list_news Список новостей
+         */
+        void update(const std::vector<ForexprostoolsApiEasy::News> &list_news) {
+            std::shared_ptr<NewsBlackout> next = std::make_shared<NewsBlackout>(*get());
+            next->update(list_news);
+            std::atomic_store(&blackout, std::shared_ptr<const NewsBlackout>(next));
+        }
+
+        /** \brief Получить снимок карты запрета
+         */
+        inline std::shared_ptr<const NewsBlackout> get() const {
+            return std::atomic_load(&blackout);
+        }
+
+        /** \brief Проверить фильтр новостей
+         * \param symbol_name Имя валютной пары
+         * \param timestamp Метка времени
+         * \return Вернет true, если в заданных пределах времени есть новость, подходящая под фильтр
+         */
+        inline bool check(const std::string &symbol_name, const xtime::timestamp_t timestamp) const {
+            return get()->check(symbol_name, timestamp);
+        }
+
+        /** \brief Проверить фильтр новостей по номеру символа из реестра символов
+         * \param symbol_id Номер символа
+         * \param timestamp Метка времени
+         * \return Вернет true, если в заданных пределах времени есть новость, подходящая под фильтр
+         */
+        inline bool check(const SymbolId symbol_id, const xtime::timestamp_t timestamp) const {
+            return get()->check(symbol_id, timestamp);
+        }
+    };
+
     /** \brief Класс для работы с новостями
      */
     class News {
@@ -37,19 +113,94 @@ namespace open_bo_api {
         static inline std::recursive_mutex list_news_mutex;
         static inline ForexprostoolsApiEasy::NewsList news_data;
         static inline std::atomic<bool> is_error = ATOMIC_VAR_INIT(false);
-    public:
+        static inline std::shared_ptr<const NewsIndex> news_index;  /**< Снимок индекса новостей для проверки фильтра */
+        static inline std::vector<std::string> news_symbols;        /**< Символы, валюты которых разбираются при построении индекса */
+        static inline std::vector<ForexprostoolsApiEasy::News> published_news;  /**< Последний опубликованный список новостей */
+        static inline std::shared_ptr<NewsArchive> news_archive;    /**< Локальный архив новостей */
+        static inline std::vector<std::shared_ptr<LiveNewsBlackout>> news_blackouts;   /**< Карты запрета, обновляемые при публикации новостей */
 
-        /** \brief Обновить список новостей
+        /** \brief Фоновое обновление новостей
+         *
+         * Один долгоживущий поток выполняет не более одной загрузки одновременно.
+         * Запросы, поступившие во время загрузки или до истечения минимального
+         * интервала обновления, объединяются в один (используется последняя метка времени)
+         */
+        class Refresher {
+        public:
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::thread thread;
+            bool is_request = false;
+            bool is_shutdown = false;
+            xtime::timestamp_t request_timestamp = 0;
+            std::string sert_file;
+            std::chrono::steady_clock::duration min_interval = std::chrono::seconds(60);
+            std::chrono::steady_clock::time_point last_update;
+            bool is_updated = false;
+
+            Refresher() {};
+
+            ~Refresher() {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    is_shutdown = true;
+                }
+                cv.notify_all();
+                if(thread.joinable()) thread.join();
+            }
+        };
+
+        static inline Refresher refresher;
+
+        /** \brief Сравнить списки новостей
+         * \return Вернет true, если списки совпадают
+         */
+        static bool is_equal_news(
+                const std::vector<ForexprostoolsApiEasy::News> &a,
+                const std::vector<ForexprostoolsApiEasy::News> &b) {
+            if(a.size() != b.size()) return false;
+            for(size_t i = 0; i < a.size(); ++i) {
+                if(a[i].timestamp != b[i].timestamp ||
+                    a[i].level_volatility != b[i].level_volatility ||
+                    a[i].currency != b[i].currency ||
+                    a[i].name != b[i].name ||
+                    a[i].is_actual != b[i].is_actual ||
+                    a[i].actual != b[i].actual ||
+                    a[i].is_forecast != b[i].is_forecast ||
+                    a[i].forecast != b[i].forecast ||
+                    a[i].is_previous != b[i].is_previous ||
+                    a[i].previous != b[i].previous) return false;
+            }
+            return true;
+        }
+
+        /** \brief Загрузить новости за сутки до и после метки времени
          *
+         * Если задан локальный архив, загружаются только недостающие дни.
+         * При недоступности сервера используются данные архива, если они покрывают весь диапазон
+         * \param api Объект API новостей
          * \param timestamp Метка времени
          * \return Вернет true, если новости были загружены
          */
-        inline static bool update(
-                const xtime::timestamp_t timestamp,
-                const std::string &sert_file = std::string("curl-ca-bundle.crt")) {
+        static bool download_news(ForexprostoolsApi &api, const xtime::timestamp_t timestamp) {
             const xtime::timestamp_t start_timestamp = timestamp - xtime::SECONDS_IN_DAY;
-            const xtime::timestamp_t stop_timestamp = timestamp - xtime::SECONDS_IN_DAY;
-            ForexprostoolsApi api(sert_file);
+            const xtime::timestamp_t stop_timestamp = timestamp + xtime::SECONDS_IN_DAY;
+            std::shared_ptr<NewsArchive> archive = std::atomic_load(&news_archive);
+            if(archive) {
+                const bool is_sync = archive->sync(api, start_timestamp, stop_timestamp, timestamp);
+                if(!is_sync && !archive->check_range(start_timestamp, stop_timestamp)) {
+                    is_error = true;
+                    return false;
+                }
+                std::vector<ForexprostoolsApiEasy::News> list_news;
+                if(!archive->get_news(start_timestamp, stop_timestamp, list_news)) {
+                    is_error = true;
+                    return false;
+                }
+                publish_news(list_news);
+                is_error = false;
+                return is_sync;
+            }
             for(uint32_t attempt = 0; attempt < 5; ++attempt) {
                 std::vector<ForexprostoolsApiEasy::News> list_news;
                 int err = api.download_all_news(
@@ -57,8 +208,7 @@ namespace open_bo_api {
                     stop_timestamp,
                     list_news);
                 if(err == ForexprostoolsApi::OK) {
-                    std::lock_guard<std::recursive_mutex> lock(list_news_mutex);
-                    news_data = ForexprostoolsApiEasy::NewsList(list_news);
+                    publish_news(list_news);
                     is_error = false;
                     return true;
                 }
@@ -67,34 +217,163 @@ namespace open_bo_api {
             return false;
         }
 
+        /** \brief Поток фонового обновления новостей
+         */
+        static void refresh_loop() {
+            std::unique_ptr<ForexprostoolsApi> api;
+            std::string api_sert_file;
+            std::unique_lock<std::mutex> lock(refresher.mutex);
+            while(true) {
+                refresher.cv.wait(lock, [] {
+                    return refresher.is_shutdown || refresher.is_request;
+                });
+                if(refresher.is_shutdown) break;
+                /* соблюдаем минимальный интервал между загрузками */
+                while(refresher.is_updated && !refresher.is_shutdown) {
+                    const std::chrono::steady_clock::time_point next_update = refresher.last_update + refresher.min_interval;
+                    if(std::chrono::steady_clock::now() >= next_update) break;
+                    refresher.cv.wait_until(lock, next_update);
+                }
+                if(refresher.is_shutdown) break;
+                const xtime::timestamp_t timestamp = refresher.request_timestamp;
+                const std::string sert_file = refresher.sert_file;
+                refresher.is_request = false;
+                lock.unlock();
+
+                /* объект API создается один раз и переиспользуется между загрузками */
+                if(!api || api_sert_file != sert_file) {
+                    api.reset(new ForexprostoolsApi(sert_file));
+                    api_sert_file = sert_file;
+                }
+                download_news(*api, timestamp);
+
+                lock.lock();
+                refresher.last_update = std::chrono::steady_clock::now();
+                refresher.is_updated = true;
+            }
+        }
+
+        /** \brief Опубликовать новый список новостей
+         *
+         * Индекс строится до захвата блокировки, читатели получают его через атомарную замену указателя
+         * \param list_news Список новостей
+         */
+        inline static void publish_news(const std::vector<ForexprostoolsApiEasy::News> &list_news) {
+            {
+                std::lock_guard<std::recursive_mutex> lock(list_news_mutex);
+                if(news_index && is_equal_news(published_news, list_news)) return;
+                published_news = list_news;
+            }
+            std::vector<std::string> symbols;
+            {
+                std::lock_guard<std::recursive_mutex> lock(list_news_mutex);
+                symbols = news_symbols;
+            }
+            std::shared_ptr<NewsIndex> index = std::make_shared<NewsIndex>();
+            index->build(list_news, symbols);
+            std::lock_guard<std::recursive_mutex> lock(list_news_mutex);
+            news_data = ForexprostoolsApiEasy::NewsList(list_news);
+            std::atomic_store(&news_index, std::shared_ptr<const NewsIndex>(index));
+            /* карты обновляются под блокировкой, чтобы списки новостей применялись по порядку */
+            for(size_t i = 0; i < news_blackouts.size(); ++i) {
+                news_blackouts[i]->update(list_news);
+            }
+        }
+
+    public:
+
+        /** \brief Задать список символов для проверки фильтра новостей
+         *
+         * Валюты указанных символов разбираются один раз при построении индекса.
+         * Остальные символы тоже можно проверять, но медленнее
+         * \param symbols Список символов
+         */
+        inline static void set_symbols(const std::vector<std::string> &symbols) {
+            std::lock_guard<std::recursive_mutex> lock(list_news_mutex);
+            news_symbols = symbols;
+        }
+
+        /** \brief Зарегистрировать карту запрета торговли по новостям
+         *
+         * Если список новостей уже загружен, карта сразу строится по нему.
+         * Далее карта обновляется при каждой публикации нового списка новостей
+         * \param blackout Карта запрета торговли по новостям
+         */
+        inline static void add_news_blackout(const std::shared_ptr<LiveNewsBlackout> &blackout) {
+            if(!blackout) return;
+            std::lock_guard<std::recursive_mutex> lock(list_news_mutex);
+            if(std::find(news_blackouts.begin(), news_blackouts.end(), blackout) != news_blackouts.end()) return;
+            if(news_index) blackout->update(published_news);
+            news_blackouts.push_back(blackout);
+        }
+
+        /** \brief Отменить регистрацию карты запрета торговли по новостям
+         * \param blackout Карта запрета торговли по новостям
+         */
+        inline static void remove_news_blackout(const std::shared_ptr<LiveNewsBlackout> &blackout) {
+            std::lock_guard<std::recursive_mutex> lock(list_news_mutex);
+            news_blackouts.erase(
+                std::remove(news_blackouts.begin(), news_blackouts.end(), blackout),
+                news_blackouts.end());
+        }
+
+        /** \brief Подключить локальный архив новостей
+         *
+         * После подключения загружаются только дни, которых нет в архиве,
+         * а при недоступности сервера новости берутся из архива
+         * \param file_name Имя файла архива
+         * \return Вернет true, если архив был открыт
+         */
+        inline static bool set_archive(const std::string &file_name) {
+            std::shared_ptr<NewsArchive> archive = std::make_shared<NewsArchive>(file_name);
+            if(!archive->open()) return false;
+            std::atomic_store(&news_archive, archive);
+            return true;
+        }
+
         /** \brief Обновить список новостей
          *
          * \param timestamp Метка времени
+         * \return Вернет true, если новости были загружены
+         */
+        inline static bool update(
+                const xtime::timestamp_t timestamp,
+                const std::string &sert_file = std::string("curl-ca-bundle.crt")) {
+            ForexprostoolsApi api(sert_file);
+            return download_news(api, timestamp);
+        }
+
+        /** \brief Обновить список новостей в фоновом потоке
+         *
+         * Метод не блокирует вызывающий поток. Пока идет загрузка или не прошел
+         * минимальный интервал обновления, повторные вызовы объединяются в один запрос
+         * \param timestamp Метка времени
          */
         inline static void async_update(
                 const xtime::timestamp_t timestamp,
                 const std::string &sert_file = std::string("curl-ca-bundle.crt")) {
-            /* запускаем асинхронное открытие сделки */
-            std::thread news_thread = std::thread([&,sert_file,timestamp] {
-                const xtime::timestamp_t start_timestamp = timestamp - xtime::SECONDS_IN_DAY;
-                const xtime::timestamp_t stop_timestamp = timestamp + xtime::SECONDS_IN_DAY;
-                ForexprostoolsApi api(sert_file);
-                for(uint32_t attempt = 0; attempt < 5; ++attempt) {
-                    std::vector<ForexprostoolsApiEasy::News> list_news;
-                    int err = api.download_all_news(
-                        start_timestamp,
-                        stop_timestamp,
-                        list_news);
-                    if(err == ForexprostoolsApi::OK) {
-                        std::lock_guard<std::recursive_mutex> lock(list_news_mutex);
-                        news_data = ForexprostoolsApiEasy::NewsList(list_news);
-                        is_error = false;
-                        return;
-                    }
+            {
+                std::lock_guard<std::mutex> lock(refresher.mutex);
+                if(refresher.is_shutdown) return;
+                refresher.request_timestamp = timestamp;
+                refresher.sert_file = sert_file;
+                refresher.is_request = true;
+                if(!refresher.thread.joinable()) {
+                    refresher.thread = std::thread(refresh_loop);
                 }
-                is_error = true;
-            });
-            news_thread.detach();
+            }
+            refresher.cv.notify_one();
+        }
+
+        /** \brief Установить минимальный интервал между фоновыми загрузками новостей
+         * \param seconds Интервал в секундах
+         */
+        inline static void set_min_refresh_interval(const uint32_t seconds) {
+            {
+                std::lock_guard<std::mutex> lock(refresher.mutex);
+                refresher.min_interval = std::chrono::seconds(seconds);
+            }
+            refresher.cv.notify_one();
         }
 
         /** \brief Проверить новости в заданных пределах времени и по заданным критериям
@@ -119,53 +398,63 @@ namespace open_bo_api {
                 const bool is_low,
                 const bool is_moderate,
                 const bool is_high) {
-            /* получаем массив новостей */
-            std::vector<ForexprostoolsApiEasy::News> list_news_data;
-            {
-                std::lock_guard<std::recursive_mutex> lock(list_news_mutex);
-                int err = 0;
-                if((err = news_data.get_news(
-                    timestamp,
-                    indent_timestamp_past,
-                    indent_timestamp_future,
-                    list_news_data)) != ForexprostoolsApiEasy::OK) {
-                    /* ошибка, нет данных новостей
-                     * если новости были загружены с ошибкой, то это значит
-                     * что система не работает!
-                     * Поэтому, если флаг is_error вернем значение, якобы новость есть
-                     * чтобы сделки не были открыты
-                     */
-                    if(is_error) return true;
-                    return false;
-                }
+            std::shared_ptr<const NewsIndex> index = std::atomic_load(&news_index);
+            if(!index || !index->check_news(
+                    timestamp - indent_timestamp_past,
+                    timestamp + indent_timestamp_future)) {
+                /* ошибка, нет данных новостей
+                 * если новости были загружены с ошибкой, то это значит
+                 * что система не работает!
+                 * Поэтому, если флаг is_error вернем значение, якобы новость есть
+                 * чтобы сделки не были открыты
+                 */
+                if(is_error) return true;
+                return false;
             }
-
-            /* раскладываем имя валютной пары на составляющие */
-            std::string currency_1, currency_2;
-            int err = ForexprostoolsApiEasy::get_currencies(
+            return index->check_news_filter(
                 symbol_name,
-                currency_1,
-                currency_2);
-            if(err != ForexprostoolsApiEasy::OK) return false;
-
-            bool is_news = false;
-            for(size_t i = 0; i < list_news_data.size(); ++i) {
-                if(list_news_data[i].currency != currency_1 &&
-                    list_news_data[i].currency != currency_2) continue;
-                if(list_news_data[i].level_volatility == ForexprostoolsApiEasy::LOW) {
-                    if(is_low) is_news = true;
-                    else if(is_only_select) return false;
-                } else
-                if(list_news_data[i].level_volatility == ForexprostoolsApiEasy::MODERATE) {
-                    if(is_moderate) is_news = true;
-                    else if(is_only_select) return false;
-                } else
-                if(list_news_data[i].level_volatility == ForexprostoolsApiEasy::HIGH) {
-                    if(is_high) is_news = true;
-                    else if(is_only_select) return false;
-                }
+                timestamp,
+                indent_timestamp_past,
+                indent_timestamp_future,
+                is_only_select,
+                is_low,
+                is_moderate,
+                is_high);
+        }
+
+        /** \brief Проверить новости в заданных пределах времени и по заданным критериям
+         *
+         * Вариант для номера символа из реестра символов. Валюты символов,
+         * заданных через set_symbols, берутся по номеру без работы со строками
+         * \param symbol_id Номер символа
+         * \return Вернет true, если в заданных пределах времени есть новость, подходящая по указанным параметрам
+         */
+        inline static bool check_news_filter(
+                const SymbolId symbol_id,
+                const xtime::timestamp_t timestamp,
+                const xtime::timestamp_t indent_timestamp_past,
+                const xtime::timestamp_t indent_timestamp_future,
+                const bool is_only_select,
+                const bool is_low,
+                const bool is_moderate,
+                const bool is_high) {
+            std::shared_ptr<const NewsIndex> index = std::atomic_load(&news_index);
+            if(!index || !index->check_news(
+                    timestamp - indent_timestamp_past,
+                    timestamp + indent_timestamp_future)) {
+                /* при ошибке загрузки новостей сделки блокируются, как и в варианте с именем символа */
+                if(is_error) return true;
+                return false;
             }
-            return is_news;
+            return index->check_news_filter(
+                symbol_id,
+                timestamp,
+                indent_timestamp_past,
+                indent_timestamp_future,
+                is_only_select,
+                is_low,
+                is_moderate,
+                is_high);
         }
 
         /** \brief Получить данные экономических новостей
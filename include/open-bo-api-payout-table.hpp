@@ -0,0 +1,329 @@
+/*
+* open-bo-api - C++ API for working with binary options brokers
+*
+* Copyright (c) 2020 Elektro Yar. Email: git.electroyar@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef OPEN_BO_API_PAYOUT_TABLE_HPP_INCLUDED
+#define OPEN_BO_API_PAYOUT_TABLE_HPP_INCLUDED
+
+#include "intrade-bar-payout-model.hpp"
+#include "open-bo-api-symbol-registry.hpp"
+#include <xtime.hpp>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+
+namespace open_bo_api {
+
+    /** \brief Параметры таблицы выплат IntradeBar
+     */
+    class IntradeBarPayoutTableConfig {
+    public:
+        std::vector<std::string> symbols;   /**< Символы */
+        std::vector<uint32_t> durations;    /**< Длительности опционов в секундах */
+        /** \brief Ступени размера ставки для долларового счета
+         *
+         * Первая ступень - минимальная ставка. Процент выплат внутри ступени
+         * должен быть постоянным, иначе таблица будет отличаться от модели
+         */
+        std::vector<double> usd_amount_tiers = {1.0d, 80.0d};
+        std::vector<double> rub_amount_tiers = {50.0d, 5000.0d};    /**< Ступени размера ставки для рублевого счета */
+        double usd_max_amount = 500.0d;     /**< Максимальная ставка для долларового счета */
+        double rub_max_amount = 25000.0d;   /**< Максимальная ставка для рублевого счета */
+
+        IntradeBarPayoutTableConfig() {};
+    };
+
+    /** \brief Таблица выплат IntradeBar
+     *
+     * Модель выплат вычисляется один раз при построении таблицы для каждой минуты недели,
+     * символа, длительности, ступени ставки и валюты счета. После этого процент выплат
+     * получается одним чтением из плотного массива. Записи одной минуты лежат рядом,
+     * поэтому проверка всех символов в момент закрытия бара читает непрерывный участок памяти
+     */
+    class IntradeBarPayoutTable {
+    public:
+        static const uint32_t MINUTES_IN_WEEK = 7 * 24 * 60;
+
+    private:
+        IntradeBarPayoutTableConfig config;
+        std::unordered_map<std::string, uint32_t> symbol_indexes;
+        std::vector<int32_t> symbol_id_indexes;    /**< Индексы символов по номерам из реестра символов */
+        std::vector<double> payouts;    /**< Проценты выплат */
+        std::vector<int8_t> states;     /**< Состояния выплат */
+        size_t num_symbols = 0;
+        size_t num_durations = 0;
+        size_t num_tiers = 0;
+
+        /** \brief Получить минуту недели
+         */
+        inline static uint32_t get_minute_week(const xtime::timestamp_t timestamp) {
+            return (timestamp / xtime::SECONDS_IN_MINUTE) % MINUTES_IN_WEEK;
+        }
+
+        inline const std::vector<double> &get_tiers(const bool is_rub) const {
+            return is_rub ? config.rub_amount_tiers : config.usd_amount_tiers;
+        }
+
+        inline size_t get_offset(
+                const uint32_t minute_week,
+                const bool is_rub,
+                const size_t duration_index,
+                const size_t symbol_index,
+                const size_t tier_index) const {
+            return ((((size_t)minute_week * 2 + (is_rub ? 1 : 0)) * num_durations + duration_index) *
+                num_symbols + symbol_index) * num_tiers + tier_index;
+        }
+
+        /** \brief Найти ступень ставки
+         * \return Вернет индекс ступени или -1, если ставка меньше минимальной
+         */
+        inline int32_t find_tier(const bool is_rub, const double amount) const {
+            const std::vector<double> &tiers = get_tiers(is_rub);
+            auto it = std::upper_bound(tiers.begin(), tiers.end(), amount);
+            return (int32_t)(it - tiers.begin()) - 1;
+        }
+
+    public:
+
+        IntradeBarPayoutTable() {};
+
+        /** \brief Построить таблицу выплат
+         *
+         * Модель вычисляется для недели, в которую попадает опорная метка времени
+         * \param table_config Параметры таблицы
+         * \param reference_timestamp Опорная метка времени
+         * \return Вернет true, если таблица построена
+         */
+        bool build(
+                const IntradeBarPayoutTableConfig &table_config,
+                const xtime::timestamp_t reference_timestamp) {
+            config = table_config;
+            std::sort(config.usd_amount_tiers.begin(), config.usd_amount_tiers.end());
+            std::sort(config.rub_amount_tiers.begin(), config.rub_amount_tiers.end());
+            num_symbols = config.symbols.size();
+            num_durations = config.durations.size();
+            num_tiers = std::max(config.usd_amount_tiers.size(), config.rub_amount_tiers.size());
+            payouts.clear();
+            states.clear();
+            symbol_indexes.clear();
+            symbol_id_indexes.clear();
+            if(num_symbols == 0 || num_durations == 0 || num_tiers == 0 ||
+                config.usd_amount_tiers.empty() || config.rub_amount_tiers.empty()) return false;
+            for(size_t i = 0; i < num_symbols; ++i) {
+                symbol_indexes[config.symbols[i]] = i;
+                const SymbolId symbol_id = SymbolRegistry::instance().get_id(config.symbols[i]);
+                if(!symbol_id.is_valid()) continue;
+                if(symbol_id.value >= symbol_id_indexes.size()) symbol_id_indexes.resize(symbol_id.value + 1, -1);
+                symbol_id_indexes[symbol_id.value] = i;
+            }
+            const size_t size = (size_t)MINUTES_IN_WEEK * 2 * num_durations * num_symbols * num_tiers;
+            payouts.resize(size);
+            states.resize(size);
+
+            const xtime::timestamp_t week_timestamp =
+                xtime::get_first_timestamp_minute(reference_timestamp) -
+                get_minute_week(reference_timestamp) * xtime::SECONDS_IN_MINUTE;
+            for(uint32_t c = 0; c < 2; ++c) {
+                const bool is_rub = c == 1;
+                const std::vector<double> &tiers = get_tiers(is_rub);
+                payout_model::IntradeBar pm;
+                pm.set_rub_account_currency(is_rub);
+                for(uint32_t m = 0; m < MINUTES_IN_WEEK; ++m) {
+                    const xtime::timestamp_t timestamp = week_timestamp + m * xtime::SECONDS_IN_MINUTE;
+                    for(size_t d = 0; d < num_durations; ++d) {
+                        for(size_t s = 0; s < num_symbols; ++s) {
+                            for(size_t t = 0; t < num_tiers; ++t) {
+                                /* если ступеней меньше, повторяем последнюю */
+                                const double amount = tiers[std::min(t, tiers.size() - 1)];
+                                const size_t offset = get_offset(m, is_rub, d, s, t);
+                                states[offset] = pm.get_payout(payouts[offset], config.symbols[s], timestamp, config.durations[d], amount);
+                            }
+                        }
+                    }
+                }
+            }
+            return true;
+        }
+
+        /** \brief Получить индекс символа
+         * \return Вернет индекс символа или -1, если символа нет в таблице
+         */
+        inline int32_t get_symbol_index(const std::string &symbol_name) const {
+            auto it = symbol_indexes.find(symbol_name);
+            if(it == symbol_indexes.end()) return -1;
+            return it->second;
+        }
+
+        /** \brief Получить индекс символа по номеру из реестра символов
+         * \return Вернет индекс символа или -1, если символа нет в таблице
+         */
+        inline int32_t get_symbol_index(const SymbolId symbol_id) const {
+            if(symbol_id.value >= symbol_id_indexes.size()) return -1;
+            return symbol_id_indexes[symbol_id.value];
+        }
+
+        /** \brief Получить индекс длительности
+         * \return Вернет индекс длительности или -1, если длительности нет в таблице
+         */
+        inline int32_t get_duration_index(const uint32_t duration) const {
+            for(size_t i = 0; i < num_durations; ++i) {
+                if(config.durations[i] == duration) return i;
+            }
+            return -1;
+        }
+
+        /** \brief Получить процент выплат по индексам
+         * \param payout Процент выплат
+         * \param state Состояние выплаты
+         * \param symbol_index Индекс символа
+         * \param timestamp Метка времени (GMT)
+         * \param duration_index Индекс длительности
+         * \param is_rub Рублевый счет
+         * \param amount Размер ставки
+         * \return Вернет false, если запись не попадает в таблицу
+         */
+        inline bool find_payout(
+                double &payout,
+                int32_t &state,
+                const int32_t symbol_index,
+                const xtime::timestamp_t timestamp,
+                const int32_t duration_index,
+                const bool is_rub,
+                const double amount) const {
+            if(symbol_index < 0 || duration_index < 0) return false;
+            const int32_t tier_index = find_tier(is_rub, amount);
+            /* ставки меньше минимальной и больше максимальной отдаем модели, она вернет причину отказа */
+            if(tier_index < 0) return false;
+            if(amount > (is_rub ? config.rub_max_amount : config.usd_max_amount)) return false;
+            const size_t offset = get_offset(get_minute_week(timestamp), is_rub, duration_index, symbol_index, tier_index);
+            payout = payouts[offset];
+            state = states[offset];
+            return true;
+        }
+
+        /** \brief Получить процент выплат
+         * \param payout Процент выплат
+         * \param state Состояние выплаты (0 в случае успеха, иначе см. payout_model::IntradeBar::PayoutCancelType)
+         * \param symbol_name Имя валютной пары
+         * \param timestamp Метка времени (GMT)
+         * \param duration Длительность опциона в секундах
+         * \param is_rub Рублевый счет
+         * \param amount Размер ставки
+         * \return Вернет false, если запись не попадает в таблицу
+         */
+        inline bool find_payout(
+                double &payout,
+                int32_t &state,
+                const std::string &symbol_name,
+                const xtime::timestamp_t timestamp,
+                const uint32_t duration,
+                const bool is_rub,
+                const double amount) const {
+            return find_payout(
+                payout,
+                state,
+                get_symbol_index(symbol_name),
+                timestamp,
+                get_duration_index(duration),
+                is_rub,
+                amount);
+        }
+
+        /** \brief Получить размер ставки по критерию Келли и процент выплат
+         *
+         * Размер ставки считается так же, как в виртуальном аккаунте. Если ставка
+         * попадает на другую ступень с другим процентом выплат, расчет повторяется
+         * \param amount Размер ставки в абсолютном значении
+         * \param payout Процент выплат
+         * \param state Состояние выплаты
+         * \param symbol_index Индекс символа
+         * \param timestamp Метка времени (GMT)
+         * \param duration_index Индекс длительности
+         * \param is_rub Рублевый счет
+         * \param balance Размер баланса
+         * \param winrate Винрейт стратегии
+         * \param attenuator Ослабление коэффициента Келли
+         * \param payout_limiter Ограничитель процента выплат
+         * \param winrate_limiter Ограничитель винрейта
+         * \return Вернет false, если расчет нужно выполнить по модели выплат
+         */
+        bool find_amount(
+                double &amount,
+                double &payout,
+                int32_t &state,
+                const int32_t symbol_index,
+                const xtime::timestamp_t timestamp,
+                const int32_t duration_index,
+                const bool is_rub,
+                const double balance,
+                const double winrate,
+                const double attenuator,
+                const double payout_limiter = 1.0,
+                const double winrate_limiter = 1.0) const {
+            if(symbol_index < 0 || duration_index < 0) return false;
+            const std::vector<double> &tiers = get_tiers(is_rub);
+            const uint32_t minute_week = get_minute_week(timestamp);
+            const double calc_winrate = std::min(winrate, winrate_limiter);
+            const double max_amount = is_rub ? config.rub_max_amount : config.usd_max_amount;
+            int32_t tier_index = 0;
+            for(size_t attempt = 0; attempt <= num_tiers; ++attempt) {
+                const size_t offset = get_offset(minute_week, is_rub, duration_index, symbol_index, tier_index);
+                if(states[offset] != payout_model::OK || payouts[offset] <= 0.0d) {
+                    amount = 0.0d;
+                    payout = payouts[offset];
+                    state = states[offset];
+                    return true;
+                }
+                const double calc_payout = std::min(payouts[offset], payout_limiter);
+                const double calc_risk = (((1.0d + calc_payout) * calc_winrate - 1.0d) / calc_payout) * attenuator;
+                const double calc_amount = balance * calc_risk;
+                /* нет преимущества или ставка вне пределов - причину отказа вернет модель */
+                if(calc_amount < tiers.front() || calc_amount > max_amount) return false;
+                const int32_t next_tier_index = find_tier(is_rub, calc_amount);
+                if(next_tier_index == tier_index) {
+                    amount = calc_amount;
+                    payout = payouts[offset];
+                    state = states[offset];
+                    return true;
+                }
+                tier_index = next_tier_index;
+            }
+            return false;
+        }
+
+        /** \brief Проверить, построена ли таблица
+         */
+        inline bool empty() const {
+            return payouts.empty();
+        }
+
+        /** \brief Получить параметры таблицы
+         */
+        inline const IntradeBarPayoutTableConfig &get_config() const {
+            return config;
+        }
+    };
+};
+
+#endif // OPEN_BO_API_PAYOUT_TABLE_HPP_INCLUDED
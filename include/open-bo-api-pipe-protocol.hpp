@@ -0,0 +1,408 @@
+/*
+* open-bo-api - C++ API for working with binary options brokers
+*
+* Copyright (c) 2020 Elektro Yar. Email: git.electroyar@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef OPEN_BO_API_PIPE_PROTOCOL_HPP_INCLUDED
+#define OPEN_BO_API_PIPE_PROTOCOL_HPP_INCLUDED
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <functional>
+
+#include <xquotes_common.hpp>
+#include <xtime.hpp>
+
+namespace open_bo_api {
+
+    /** \brief Бинарный протокол кадров для передачи свечей и сигналов через именованные каналы
+     *
+     * Кадр состоит из заголовка, таблицы имен символов и массива упакованных записей:
+     * uint32 размер кадра (включая заголовок), uint16 тип, uint16 версия,
+     * uint32 количество символов, uint32 количество записей,
+     * далее имена символов (uint16 длина + байты), выравнивание до 8 байт и записи.
+     * Числа записываются в порядке байтов платформы, так как кадры не покидают компьютер.
+     *
+     * Канал Windows может разбить большое сообщение на части по Config::buffer_size,
+     * поэтому на приемной стороне части собираются в FrameDecoder.
+     */
+    namespace pipe_protocol {
+
+        const uint16_t VERSION = 1;                         /**< Версия протокола */
+        const uint32_t HEADER_SIZE = 16;                    /**< Размер заголовка кадра */
+        const uint32_t MAX_FRAME_SIZE = 64 * 1024 * 1024;   /**< Максимальный размер кадра */
+
+        /** \brief Тип кадра
+         */
+        enum class FrameType : uint16_t {
+            CANDLES = 1,    /**< Массив свечей */
+            SIGNALS = 2,    /**< Массив сигналов */
+        };
+
+        /** \brief Упакованная запись свечи
+         */
+        class CandleRecord {
+        public:
+            uint32_t symbol_index = 0;      /**< Номер символа в таблице имен кадра */
+            uint32_t reserved = 0;
+            uint64_t timestamp = 0;
+            double open = 0;
+            double high = 0;
+            double low = 0;
+            double close = 0;
+            double volume = 0;
+        };
+
+        /** \brief Упакованная запись сигнала
+         */
+        class SignalRecord {
+        public:
+            uint32_t symbol_index = 0;      /**< Номер символа в таблице имен кадра */
+            int32_t contract_type = 0;      /**< Тип контракта BUY или SELL */
+            uint32_t duration = 0;          /**< Длительность контракта в секундах */
+            uint32_t reserved = 0;
+            uint64_t timestamp = 0;         /**< Метка времени сигнала */
+            double amount = 0;              /**< Размер ставки */
+            double probability = 0;         /**< Вероятность успеха сигнала */
+        };
+
+        static_assert(sizeof(CandleRecord) == 56, "CandleRecord must be packed");
+        static_assert(sizeof(SignalRecord) == 40, "SignalRecord must be packed");
+
+        inline size_t align8(const size_t value) {
+            return (value + 7) & ~((size_t)7);
+        }
+
+        template<class T>
+        inline void write_pod(std::string &buffer, const size_t offset, const T &value) {
+            std::memcpy(&buffer[offset], &value, sizeof(T));
+        }
+
+        template<class T>
+        inline T read_pod(const char *data) {
+            T value;
+            std::memcpy(&value, data, sizeof(T));
+            return value;
+        }
+
+        /** \brief Собрать кадр
+         *
+         * \param type Тип кадра
+         * \param symbols Таблица имен символов
+         * \param records Указатель на упакованные записи
+         * \param records_number Количество записей
+         * \param record_size Размер одной записи
+         * \return Кадр
+         */
+        inline std::string encode_frame(
+                const FrameType type,
+                const std::vector<std::string> &symbols,
+                const void *records,
+                const size_t records_number,
+                const size_t record_size) {
+            size_t names_size = 0;
+            for(auto &symbol : symbols) {
+                names_size += sizeof(uint16_t) + std::min(symbol.size(), (size_t)0xFFFF);
+            }
+            const size_t records_offset = align8(HEADER_SIZE + names_size);
+            const size_t frame_size = records_offset + records_number * record_size;
+            if(frame_size > MAX_FRAME_SIZE) {
+                std::cerr << "pipe_protocol error: frame is too large, size: " << frame_size << std::endl;
+                return std::string();
+            }
+            std::string buffer(frame_size, '\0');
+            write_pod(buffer, 0, (uint32_t)frame_size);
+            write_pod(buffer, 4, (uint16_t)type);
+            write_pod(buffer, 6, VERSION);
+            write_pod(buffer, 8, (uint32_t)symbols.size());
+            write_pod(buffer, 12, (uint32_t)records_number);
+            size_t offset = HEADER_SIZE;
+            for(auto &symbol : symbols) {
+                const uint16_t len = std::min(symbol.size(), (size_t)0xFFFF);
+                write_pod(buffer, offset, len);
+                offset += sizeof(uint16_t);
+                std::memcpy(&buffer[offset], symbol.data(), len);
+                offset += len;
+            }
+            if(records_number > 0) std::memcpy(&buffer[records_offset], records, records_number * record_size);
+            return buffer;
+        }
+
+        /** \brief Собрать кадр со свечами
+         *
+         * \param symbols Таблица имен символов
+         * \param records Записи свечей
+         * \return Кадр
+         */
+        inline std::string encode_candles(
+                const std::vector<std::string> &symbols,
+                const std::vector<CandleRecord> &records) {
+            return encode_frame(FrameType::CANDLES, symbols, records.data(), records.size(), sizeof(CandleRecord));
+        }
+
+        /** \brief Собрать кадр со свечами всех символов
+         *
+         * \param candles Свечи, ключ - имя символа
+         * \return Кадр
+         */
+        inline std::string encode_candles(const std::map<std::string, xquotes_common::Candle> &candles) {
+            std::vector<std::string> symbols;
+            std::vector<CandleRecord> records;
+            symbols.reserve(candles.size());
+            records.reserve(candles.size());
+            for(auto &it : candles) {
+                CandleRecord record;
+                record.symbol_index = symbols.size();
+                record.timestamp = it.second.timestamp;
+                record.open = it.second.open;
+                record.high = it.second.high;
+                record.low = it.second.low;
+                record.close = it.second.close;
+                record.volume = it.second.volume;
+                symbols.push_back(it.first);
+                records.push_back(record);
+            }
+            return encode_candles(symbols, records);
+        }
+
+        /** \brief Собрать кадр с сигналами
+         *
+         * \param symbols Таблица имен символов
+         * \param records Записи сигналов
+         * \return Кадр
+         */
+        inline std::string encode_signals(
+                const std::vector<std::string> &symbols,
+                const std::vector<SignalRecord> &records) {
+            return encode_frame(FrameType::SIGNALS, symbols, records.data(), records.size(), sizeof(SignalRecord));
+        }
+
+        /** \brief Представление кадра без копирования данных
+         *
+         * Представление ссылается на буфер декодера и действительно только внутри обратного вызова
+         */
+        class FrameView {
+        private:
+            const char *data = nullptr;
+            size_t size = 0;
+            size_t records_offset = 0;
+            std::vector<std::pair<const char*, uint16_t>> symbols;
+
+        public:
+
+            FrameView() {};
+
+            /** \brief Разобрать кадр
+             *
+             * \param frame_data Указатель на начало кадра
+             * \param frame_size Размер кадра
+             * \return Вернет false, если кадр поврежден
+             */
+            bool parse(const char *frame_data, const size_t frame_size) {
+                data = frame_data;
+                size = frame_size;
+                symbols.clear();
+                if(size < HEADER_SIZE) return false;
+                if(read_pod<uint32_t>(data) != size) return false;
+                if(read_pod<uint16_t>(data + 6) != VERSION) return false;
+                const uint32_t symbols_number = read_pod<uint32_t>(data + 8);
+                size_t offset = HEADER_SIZE;
+                for(uint32_t i = 0; i < symbols_number; ++i) {
+                    if(offset + sizeof(uint16_t) > size) return false;
+                    const uint16_t len = read_pod<uint16_t>(data + offset);
+                    offset += sizeof(uint16_t);
+                    if(offset + len > size) return false;
+                    symbols.push_back(std::make_pair(data + offset, len));
+                    offset += len;
+                }
+                records_offset = align8(offset);
+                const size_t record_size = get_record_size();
+                if(record_size == 0) return false;
+                return records_offset + (size_t)get_records_number() * record_size == size;
+            }
+
+            inline FrameType get_type() const {
+                return (FrameType)read_pod<uint16_t>(data + 4);
+            }
+
+            inline size_t get_record_size() const {
+                switch(get_type()) {
+                case FrameType::CANDLES:
+                    return sizeof(CandleRecord);
+                case FrameType::SIGNALS:
+                    return sizeof(SignalRecord);
+                };
+                return 0;
+            }
+
+            inline uint32_t get_records_number() const {
+                return read_pod<uint32_t>(data + 12);
+            }
+
+            inline size_t get_symbols_number() const {
+                return symbols.size();
+            }
+
+            /** \brief Получить имя символа по номеру
+             */
+            inline std::string get_symbol(const size_t index) const {
+                if(index >= symbols.size()) return std::string();
+                return std::string(symbols[index].first, symbols[index].second);
+            }
+
+            /** \brief Получить запись свечи
+             *
+             * \param index Номер записи
+             * \return Запись свечи
+             */
+            inline CandleRecord get_candle_record(const size_t index) const {
+                return read_pod<CandleRecord>(data + records_offset + index * sizeof(CandleRecord));
+            }
+
+            /** \brief Получить запись сигнала
+             *
+             * \param index Номер записи
+             * \return Запись сигнала
+             */
+            inline SignalRecord get_signal_record(const size_t index) const {
+                return read_pod<SignalRecord>(data + records_offset + index * sizeof(SignalRecord));
+            }
+
+            /** \brief Получить свечу
+             *
+             * \param index Номер записи
+             * \param symbol Имя символа
+             * \param candle Свеча
+             */
+            void get_candle(const size_t index, std::string &symbol, xquotes_common::Candle &candle) const {
+                const CandleRecord record = get_candle_record(index);
+                symbol = get_symbol(record.symbol_index);
+                candle.timestamp = record.timestamp;
+                candle.open = record.open;
+                candle.high = record.high;
+                candle.low = record.low;
+                candle.close = record.close;
+                candle.volume = record.volume;
+            }
+
+            /** \brief Получить свечи всех символов
+             *
+             * \param candles Свечи, ключ - имя символа
+             */
+            void get_candles(std::map<std::string, xquotes_common::Candle> &candles) const {
+                if(get_type() != FrameType::CANDLES) return;
+                const uint32_t records_number = get_records_number();
+                for(uint32_t i = 0; i < records_number; ++i) {
+                    std::string symbol;
+                    xquotes_common::Candle candle;
+                    get_candle(i, symbol, candle);
+                    candles[symbol] = candle;
+                }
+            }
+        };
+
+        /** \brief Сборщик кадров из частей сообщений
+         *
+         * Сборщик принимает сообщения канала в порядке получения
+         * и вызывает обработчик для каждого полностью собранного кадра
+         */
+        class FrameDecoder {
+        private:
+            std::vector<char> buffer;
+            size_t start = 0;
+            FrameView view;
+
+        public:
+
+            std::function<void(const FrameView &frame)> on_frame;
+
+            FrameDecoder() {};
+
+            FrameDecoder(std::function<void(const FrameView &frame)> callback) :
+                on_frame(callback) {};
+
+            /** \brief Добавить данные
+             *
+             * \param data Указатель на данные
+             * \param size Размер данных
+             * \return Вернет false, если поток поврежден (буфер сборщика будет сброшен)
+             */
+            bool push(const char *data, const size_t size) {
+                /* если буфер пуст и пришли целые кадры, разбираем их без копирования */
+                const char *ptr = data;
+                size_t len = size;
+                if(buffer.size() == start) {
+                    buffer.clear();
+                    start = 0;
+                    while(len >= sizeof(uint32_t)) {
+                        const uint32_t frame_size = read_pod<uint32_t>(ptr);
+                        if(frame_size < HEADER_SIZE || frame_size > MAX_FRAME_SIZE) return reset();
+                        if(frame_size > len) break;
+                        if(!view.parse(ptr, frame_size)) return reset();
+                        if(on_frame != nullptr) on_frame(view);
+                        ptr += frame_size;
+                        len -= frame_size;
+                    }
+                    if(len == 0) return true;
+                }
+                buffer.insert(buffer.end(), ptr, ptr + len);
+                while(buffer.size() - start >= sizeof(uint32_t)) {
+                    const uint32_t frame_size = read_pod<uint32_t>(&buffer[start]);
+                    if(frame_size < HEADER_SIZE || frame_size > MAX_FRAME_SIZE) return reset();
+                    if(buffer.size() - start < frame_size) break;
+                    if(!view.parse(&buffer[start], frame_size)) return reset();
+                    if(on_frame != nullptr) on_frame(view);
+                    start += frame_size;
+                }
+                /* удаляем разобранные кадры, чтобы буфер не рос, когда границы кадров не совпадают с границами сообщений */
+                if(start > 0) {
+                    buffer.erase(buffer.begin(), buffer.begin() + start);
+                    start = 0;
+                }
+                return true;
+            }
+
+            inline bool push(const std::string &message) {
+                return push(message.data(), message.size());
+            }
+
+            /** \brief Получить количество байт незавершенного кадра в буфере
+             */
+            inline size_t get_buffer_size() const {
+                return buffer.size() - start;
+            }
+
+            /** \brief Сбросить сборщик
+             * \return Всегда false
+             */
+            bool reset() {
+                buffer.clear();
+                start = 0;
+                return false;
+            }
+        };
+    }; // pipe_protocol
+};
+
+#endif // OPEN_BO_API_PIPE_PROTOCOL_HPP_INCLUDED
@@ -0,0 +1,637 @@
+/*
+* open-bo-api - C++ API for working with binary options brokers
+*
+* Copyright (c) 2020 Elektro Yar. Email: git.electroyar@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef OPEN_BO_API_SHARDED_VIRTUAL_ACCOUNTS_HPP_INCLUDED
+#define OPEN_BO_API_SHARDED_VIRTUAL_ACCOUNTS_HPP_INCLUDED
+
+#include "open-bo-api-virtual-account.hpp"
+#include <thread>
+#include <deque>
+#include <condition_variable>
+
+namespace open_bo_api {
+
+    /** \brief Поток для выполнения задач шарда
+     *
+     * Поток создается один раз и выполняет задачи из очереди по порядку,
+     * поэтому на каждую операцию над шардами не нужно запускать новый поток,
+     * а задачи могут ставить в очередь несколько потоков одновременно
+     */
+    class ShardWorker {
+    private:
+        std::thread worker_thread;
+        std::mutex worker_mutex;
+        std::condition_variable worker_cv;
+        std::deque<std::function<void()>> tasks;
+        uint64_t submitted = 0; /**< Количество поставленных задач */
+        uint64_t completed = 0; /**< Количество выполненных задач */
+        bool is_stop = false;
+
+    public:
+
+        ShardWorker() {
+            worker_thread = std::thread([&]() {
+                while(true) {
+                    std::unique_lock<std::mutex> lock(worker_mutex);
+                    worker_cv.wait(lock, [&]() {
+                        return !tasks.empty() || is_stop;
+                    });
+                    if(tasks.empty()) return;
+                    std::function<void()> current_task = std::move(tasks.front());
+                    tasks.pop_front();
+                    lock.unlock();
+                    current_task();
+                    lock.lock();
+                    ++completed;
+                    lock.unlock();
+                    worker_cv.notify_all();
+                }
+            });
+        }
+
+        ~ShardWorker() {
+            {
+                std::lock_guard<std::mutex> lock(worker_mutex);
+                is_stop = true;
+            }
+            worker_cv.notify_all();
+            if(worker_thread.joinable()) worker_thread.join();
+        }
+
+        ShardWorker(const ShardWorker&) = delete;
+        ShardWorker &operator=(const ShardWorker&) = delete;
+
+        /** \brief Поставить задачу в очередь
+         * \param f Задача
+         * \return Номер задачи для wait
+         */
+        uint64_t run(std::function<void()> f) {
+            uint64_t ticket = 0;
+            {
+                std::lock_guard<std::mutex> lock(worker_mutex);
+                tasks.push_back(std::move(f));
+                ticket = ++submitted;
+            }
+            worker_cv.notify_all();
+            return ticket;
+        }
+
+        /** \brief Дождаться завершения задачи
+         * \param ticket Номер задачи
+         */
+        void wait(const uint64_t ticket) {
+            std::unique_lock<std::mutex> lock(worker_mutex);
+            worker_cv.wait(lock, [&]() {
+                return completed >= ticket;
+            });
+        }
+    };
+
+    /** \brief Класс для работы с виртуальными аккаунтами, разбитыми на шарды
+     *
+     * Аккаунты распределяются по шардам по ID (va_id % количество шардов).
+     * Каждый шард - это отдельный VirtualAccounts со своей блокировкой,
+     * своим файлом базы данных и своим потоком записи в базу данных.
+     * Количество шардов записывается в базу данных каждого шарда,
+     * и базы данных, созданные для другого количества шардов, не открываются.
+     * ID новых аккаунтов выдает общий счетчик, поэтому ID не повторяются между шардами.
+     */
+    class ShardedVirtualAccounts {
+    private:
+        std::vector<std::unique_ptr<VirtualAccounts>> shards;
+        std::vector<std::unique_ptr<ShardWorker>> workers; /**< Потоки шардов, кроме первого */
+        std::atomic<uint64_t> next_va_id;
+        bool is_error = false;
+
+        /** \brief Получить имя файла базы данных шарда
+         *
+         * Например, для "virtual_accounts.db" и шарда 3 получится "virtual_accounts-3.db"
+         * \param database_name Файл базы данных
+         * \param index Номер шарда
+         * \return Имя файла базы данных шарда
+         */
+        static std::string get_shard_file_name(const std::string &database_name, const size_t index) {
+            const std::size_t pos_dot = database_name.find_last_of('.');
+            const std::size_t pos_slash = database_name.find_last_of("/\\");
+            if(pos_dot == std::string::npos ||
+               (pos_slash != std::string::npos && pos_dot < pos_slash)) {
+                return database_name + "-" + std::to_string(index);
+            }
+            return database_name.substr(0, pos_dot) + "-" + std::to_string(index) + database_name.substr(pos_dot);
+        }
+
+        static int shard_info_callback(void *userdata, int argc, char **argv, char **key_name) {
+            std::vector<uint64_t> *info = static_cast<std::vector<uint64_t>*>(userdata);
+            if(!info || argc < 2 || !argv[0] || !argv[1]) return 0;
+            info->push_back(atoll(argv[0]));
+            info->push_back(atoll(argv[1]));
+            return 0;
+        }
+
+        /** \brief Проверить, что база данных шарда создана для того же количества шардов
+         *
+         * При первом открытии количество шардов и номер шарда записываются в базу данных
+         * \param file_name Файл базы данных шарда
+         * \param index Номер шарда
+         * \param shards_number Количество шардов
+         * \return Вернет true, если база данных подходит
+         */
+        static bool check_shard_info(const std::string &file_name, const size_t index, const size_t shards_number) {
+            sqlite3 *db = 0;
+            if(sqlite3_open(file_name.c_str(), &db) != SQLITE_OK) {
+                std::cerr << "ShardedVirtualAccounts Error opening / creating a database: " << sqlite3_errmsg(db) << std::endl;
+                sqlite3_close(db);
+                return false;
+            }
+            std::string buffer(
+                "CREATE TABLE IF NOT EXISTS shard_info ("
+                "id                 INT     PRIMARY KEY NOT NULL,"
+                "shards_number      INTEGER NOT NULL,"
+                "shard_index        INTEGER NOT NULL); "
+                "INSERT OR IGNORE INTO shard_info (id,shards_number,shard_index) VALUES (0,");
+            buffer += std::to_string(shards_number);
+            buffer += ",";
+            buffer += std::to_string(index);
+            buffer += "); SELECT shards_number,shard_index FROM shard_info WHERE id = 0";
+            std::vector<uint64_t> info;
+            char *err = 0;
+            if(sqlite3_exec(db, buffer.c_str(), shard_info_callback, &info, &err) != SQLITE_OK) {
+                std::cerr << "ShardedVirtualAccounts SQL error: " << err << std::endl;
+                sqlite3_free(err);
+                sqlite3_close(db);
+                return false;
+            }
+            sqlite3_close(db);
+            if(info.size() != 2 || info[0] != shards_number || info[1] != index) {
+                std::cerr << "ShardedVirtualAccounts error: database " << file_name
+                    << " was created for another number of shards" << std::endl;
+                return false;
+            }
+            return true;
+        }
+
+        /** \brief Получить шард, в котором хранится аккаунт
+         *
+         * \param va_id ID аккаунта
+         * \return Шард
+         */
+        inline VirtualAccounts &get_shard(const uint64_t va_id) {
+            return *shards[va_id % shards.size()];
+        }
+
+        /** \brief Выполнить функцию для каждого шарда параллельно
+         *
+         * Первый шард обрабатывается в вызывающем потоке, остальные - в потоках шардов.
+         * Общей блокировки нет: задачи разных вызовов выполняются потоками шардов по очереди
+         * \param f Функция, принимающая шард и номер шарда
+         */
+        template<class T>
+        void for_each_shard(T f) {
+            std::vector<uint64_t> tickets(workers.size(), 0);
+            for(size_t i = 1; i < shards.size(); ++i) {
+                VirtualAccounts *shard = shards[i].get();
+                tickets[i - 1] = workers[i - 1]->run([&f, shard, i]() {
+                    f(*shard, i);
+                });
+            }
+            f(*shards[0], 0);
+            for(size_t i = 0; i < workers.size(); ++i) {
+                workers[i]->wait(tickets[i]);
+            }
+        }
+
+    public:
+
+        /** \brief Инициализация класса
+         *
+         * \param database_name Файл базы данных виртуальных аккаунтов. Для каждого шарда к имени добавляется номер
+         * \param shards_number Количество шардов
+         */
+        ShardedVirtualAccounts(const std::string &database_name, const size_t shards_number) {
+            next_va_id = 0;
+            const size_t n = shards_number == 0 ? 1 : shards_number;
+            shards.reserve(n);
+            for(size_t i = 0; i < n; ++i) {
+                const std::string file_name(get_shard_file_name(database_name, i));
+                if(!check_shard_info(file_name, i, n)) is_error = true;
+                shards.push_back(std::unique_ptr<VirtualAccounts>(new VirtualAccounts(file_name)));
+                if(shards.back()->check_errors()) is_error = true;
+            }
+            /* первый шард обрабатывается в вызывающем потоке */
+            workers.reserve(n - 1);
+            for(size_t i = 1; i < n; ++i) {
+                workers.push_back(std::unique_ptr<ShardWorker>(new ShardWorker()));
+            }
+
+            /* проверяем, что аккаунты лежат в своих шардах, и продолжаем нумерацию с максимального ID */
+            uint64_t max_va_id = 0;
+            bool is_found = false;
+            for(size_t i = 0; i < n; ++i) {
+                std::shared_ptr<const VirtualAccountsSnapshot> current = shards[i]->get_snapshot();
+                if(!current) continue;
+                for(auto &state : current->accounts) {
+                    if(state->va_id % n != i) {
+                        std::cerr << "ShardedVirtualAccounts error: account " << state->va_id
+                            << " is stored in shard " << i << std::endl;
+                        is_error = true;
+                    }
+                    if(!is_found || state->va_id > max_va_id) max_va_id = state->va_id;
+                    is_found = true;
+                }
+            }
+            if(is_found) next_va_id = max_va_id + 1;
+        }
+
+        inline bool check_errors() {
+            return is_error;
+        }
+
+        /** \brief Получить количество шардов
+         */
+        inline size_t get_shards_number() const {
+            return shards.size();
+        }
+
+        /** \brief Проверить наличие аккаунтов
+         *
+         * \return Вернет true, если аккаунты есть в наличии
+         */
+        bool check_accounts() {
+            for(auto &shard : shards) {
+                if(shard->check_accounts()) return true;
+            }
+            return false;
+        }
+
+        /** \brief Получить баланс виртуальных аккаунтов
+         *
+         * \param demo Демо аккаунт
+         * \return Баланс виртуальных аккаунтов
+         */
+        double get_balance(const bool demo) {
+            double sum_balance = 0.0d;
+            for(auto &shard : shards) {
+                sum_balance += shard->get_balance(demo);
+            }
+            return sum_balance;
+        }
+
+        /** \brief Проверить баланс виртуальных аккаунтов
+         *
+         * \param total_balance Общий баланас торговли
+         * \param demo Демо аккаунт
+         * \return Вернет true, если баланс виртуальных аккаунтов меньше или равен реальному балансу
+         */
+        bool check_balance(const double total_balance, const bool demo) {
+            if(get_balance(demo) > total_balance) return false;
+            return true;
+        }
+
+        /** \brief Добавить виртуальный аккаунт
+         *
+         * ID аккаунта назначается автоматически и записывается в va.va_id
+         * \param va Виртуальный аккаунт
+         * \return Вернет true в случае успеха
+         */
+        bool add_virtual_account(VirtualAccount &va) {
+            if(is_error) return false;
+            va.va_id = next_va_id++;
+            return get_shard(va.va_id).insert_virtual_account(va);
+        }
+
+        /** \brief Добавить или заменить массив аккаунтов
+         *
+         * Аккаунты записываются в свои шарды, каждый шард пишет свою часть одной транзакцией
+         * \param list_va Массив аккаунтов. Аккаунтам с va_id == VirtualAccounts::AUTO_VA_ID будет назначен новый ID
+         * \return Вернет true в случае успеха
+         */
+        bool import_virtual_accounts(std::vector<VirtualAccount> &list_va) {
+            if(is_error) return false;
+            uint64_t max_va_id = 0;
+            bool is_found = false;
+            for(auto &va : list_va) {
+                if(va.va_id == VirtualAccounts::AUTO_VA_ID) continue;
+                if(!is_found || va.va_id > max_va_id) max_va_id = va.va_id;
+                is_found = true;
+            }
+            /* счетчик не должен выдать ID, который уже занят импортом */
+            if(is_found) {
+                uint64_t current_va_id = next_va_id;
+                while(current_va_id <= max_va_id &&
+                      !next_va_id.compare_exchange_weak(current_va_id, max_va_id + 1)) {}
+            }
+            std::vector<std::vector<VirtualAccount>> shard_list_va(shards.size());
+            for(auto &va : list_va) {
+                if(va.va_id == VirtualAccounts::AUTO_VA_ID) va.va_id = next_va_id++;
+                shard_list_va[va.va_id % shards.size()].push_back(va);
+            }
+            std::atomic<bool> is_ok(true);
+            for_each_shard([&](VirtualAccounts &shard, const size_t index) {
+                if(shard_list_va[index].empty()) return;
+                if(!shard.import_virtual_accounts(shard_list_va[index])) is_ok = false;
+            });
+            return is_ok;
+        }
+
+        bool update_virtual_account(const VirtualAccount &va) {
+            if(is_error) return false;
+            return get_shard(va.va_id).update_virtual_account(va);
+        }
+
+        bool delete_virtual_account(const uint64_t va_id) {
+            if(is_error) return false;
+            return get_shard(va_id).delete_virtual_account(va_id);
+        }
+
+        bool delete_virtual_account(const VirtualAccount &va) {
+            return delete_virtual_account(va.va_id);
+        }
+
+        /** \brief Получить копию массива виртуальных аккаунтов всех шардов
+         *
+         * \return Массив виртуальных аккаунтов
+         */
+        std::map<uint64_t, VirtualAccount> get_virtual_accounts() {
+            std::map<uint64_t, VirtualAccount> temp;
+            for(auto &shard : shards) {
+                std::map<uint64_t, VirtualAccount> shard_accounts = shard->get_virtual_accounts();
+                temp.insert(shard_accounts.begin(), shard_accounts.end());
+            }
+            return temp;
+        }
+
+        /** \brief Рассчитать размер ставки
+         *
+         * Части шардов считаются по их снимкам без блокировок
+         * \param amount Посчитанный размер ставки
+         * \param strategy_id Номер стратегии в StrategyRegistry
+         * \param demo Использовать демо аккаунт
+         * \param payout Процент выплаты брокера
+         * \param winrate Винрейт
+         * \param kelly_attenuation Коэффициент ослабления Келли
+         * \return Вернет true в случае успеха
+         */
+        bool calc_amount(double &amount,
+                         const uint32_t strategy_id,
+                         const bool demo,
+                         const double payout,
+                         const double winrate,
+                         const double kelly_attenuation) {
+            /* чтение снимков не блокирует шарды, поэтому передавать его потокам шардов не нужно */
+            amount = 0.0d;
+            for(auto &shard : shards) {
+                double shard_amount = 0.0d;
+                shard->calc_amount(shard_amount, strategy_id, demo, payout, winrate, kelly_attenuation);
+                amount += shard_amount;
+            }
+            return amount > 0.0d;
+        }
+
+        /** \brief Рассчитать размер ставки
+         *
+         * \param amount Посчитанный размер ставки
+         * \param strategy_name Имя стратегии
+         * \param demo Использовать демо аккаунт
+         * \param payout Процент выплаты брокера
+         * \param winrate Винрейт
+         * \param kelly_attenuation Коэффициент ослабления Келли
+         * \return Вернет true в случае успеха
+         */
+        inline bool calc_amount(double &amount,
+                                const std::string &strategy_name,
+                                const bool demo,
+                                const double payout,
+                                const double winrate,
+                                const double kelly_attenuation) {
+            return calc_amount(
+                amount,
+                StrategyRegistry::instance().find_id(strategy_name),
+                demo,
+                payout,
+                winrate,
+                kelly_attenuation);
+        }
+
+        /** \brief Сделать ставку
+         *
+         * Ставка amount делится между аккаунтами всех шардов пропорционально их расчетным ставкам,
+         * поэтому нужна общая сумма расчетных ставок. Шарды считают свои части по своим снимкам
+         * без блокировок, затем параллельно применяют ставку, каждый под своей блокировкой.
+         * Если между этими шагами в шарде прошла другая сделка, доли аккаунтов считаются
+         * по их текущему балансу, и сумма долей может немного отличаться от amount
+         * \param id_deal Уникальный номер сделки
+         * \param amount Посчитанный размер ставки
+         * \param strategy_id Номер стратегии в StrategyRegistry
+         * \param demo Использовать демо аккаунт
+         * \param payout Процент выплаты брокера
+         * \param winrate Винрейт
+         * \param kelly_attenuation Коэффициент ослабления Келли
+         * \param date Метка времени даты
+         * \param precision Точность, указывать число кратное 10
+         * \return Вернет true в случае успеха
+         */
+        bool make_bet(const uint64_t id_deal,
+                      const double amount,
+                      const uint32_t strategy_id,
+                      const bool demo,
+                      const double payout,
+                      const double winrate,
+                      const double kelly_attenuation,
+                      const xtime::timestamp_t date,
+                      const uint64_t precision = 2) {
+            if(is_error) return false;
+            double total_sum_amount = 0.0d;
+            if(!calc_amount(total_sum_amount, strategy_id, demo, payout, winrate, kelly_attenuation)) return false;
+
+            std::atomic<bool> is_bet(false);
+            for_each_shard([&](VirtualAccounts &shard, const size_t) {
+                if(shard.make_bet_part(
+                        id_deal,
+                        amount,
+                        total_sum_amount,
+                        strategy_id,
+                        demo,
+                        payout,
+                        winrate,
+                        kelly_attenuation,
+                        date,
+                        precision)) {
+                    is_bet = true;
+                }
+            });
+            return is_bet;
+        }
+
+        /** \brief Сделать ставку
+         *
+         * \param id_deal Уникальный номер сделки
+         * \param amount Посчитанный размер ставки
+         * \param strategy_name Имя стратегии
+         * \param demo Использовать демо аккаунт
+         * \param payout Процент выплаты брокера
+         * \param winrate Винрейт
+         * \param kelly_attenuation Коэффициент ослабления Келли
+         * \param date Метка времени даты
+         * \param precision Точность, указывать число кратное 10
+         * \return Вернет true в случае успеха
+         */
+        inline bool make_bet(const uint64_t id_deal,
+                             const double amount,
+                             const std::string &strategy_name,
+                             const bool demo,
+                             const double payout,
+                             const double winrate,
+                             const double kelly_attenuation,
+                             const xtime::timestamp_t date,
+                             const uint64_t precision = 2) {
+            return make_bet(
+                id_deal,
+                amount,
+                StrategyRegistry::instance().find_id(strategy_name),
+                demo,
+                payout,
+                winrate,
+                kelly_attenuation,
+                date,
+                precision);
+        }
+
+        /** \brief Установить выиграш ставки
+         *
+         * \param id_deal Уникальный номер сделки
+         * \param date Метка времени даты
+         * \param callback Функция для обратного вызова. Может вызываться из разных потоков одновременно
+         * \return Вернет true в случае успеха
+         */
+        bool set_win(
+                const uint64_t id_deal,
+                const xtime::timestamp_t date,
+                std::function<void(const VirtualAccount &va)> callback = nullptr) {
+            for_each_shard([&](VirtualAccounts &shard, const size_t) {
+                shard.set_win(id_deal, date, callback);
+            });
+            return true;
+        }
+
+        /** \brief Установить проигрыш ставки
+         *
+         * \param id_deal Уникальный номер сделки
+         * \param date Метка времени даты
+         * \param callback Функция для обратного вызова. Может вызываться из разных потоков одновременно
+         * \return Вернет true в случае успеха
+         */
+        bool set_loss(
+                const uint64_t id_deal,
+                const xtime::timestamp_t date,
+                std::function<void(const VirtualAccount &va)> callback = nullptr) {
+            for_each_shard([&](VirtualAccounts &shard, const size_t) {
+                shard.set_loss(id_deal, date, callback);
+            });
+            return true;
+        }
+
+        /** \brief Установить ничью
+         *
+         * \param id_deal Уникальный номер сделки
+         * \param date Метка времени даты
+         * \param callback Функция для обратного вызова. Может вызываться из разных потоков одновременно
+         * \return Вернет true в случае успеха
+         */
+        bool set_standoff(
+                const uint64_t id_deal,
+                const xtime::timestamp_t date,
+                std::function<void(const VirtualAccount &va)> callback = nullptr) {
+            for_each_shard([&](VirtualAccounts &shard, const size_t) {
+                shard.set_standoff(id_deal, date, callback);
+            });
+            return true;
+        }
+
+        /** \brief Загрузить изменения виртуальных счетов в базу данных
+         *
+         * Каждый шард записывает свою базу данных в своем потоке.
+         * Ожидание записи не занимает потоки шардов, чтобы не задерживать ставки
+         * \param is_wait Флаг ожидания результата
+         */
+        void push(const bool is_wait = false) {
+            if(!is_wait) {
+                for(auto &shard : shards) {
+                    shard->push(false);
+                }
+                return;
+            }
+            std::vector<std::future<void>> futures;
+            futures.reserve(shards.size() - 1);
+            for(size_t i = 1; i < shards.size(); ++i) {
+                VirtualAccounts *shard = shards[i].get();
+                futures.push_back(std::async(std::launch::async, [shard]() {
+                    shard->push(true);
+                }));
+            }
+            shards[0]->push(true);
+            for(auto &it : futures) {
+                it.wait();
+            }
+        }
+
+        /** \brief Получить усиление за день
+         *
+         * \param date Дата
+         * \param demo Демо счет
+         * \param callback Функция обратного вызова
+         */
+        void get_gain_per_day(
+                const xtime::timestamp_t date,
+                const bool demo,
+                std::function<void(
+                    const uint64_t va_id,
+                    const std::string &holder_name,
+                    const double gain)> callback) {
+            for(auto &shard : shards) {
+                shard->get_gain_per_day(date, demo, callback);
+            }
+        }
+
+        /** \brief Получить статистику депозита за диапазон дат для всех аккаунтов
+         *
+         * \param start_date Первый день диапазона
+         * \param stop_date Последний день диапазона (включительно)
+         * \param demo Демо счет
+         * \param callback Функция обратного вызова
+         */
+        void get_daily_stats(
+                const xtime::timestamp_t start_date,
+                const xtime::timestamp_t stop_date,
+                const bool demo,
+                std::function<void(
+                    const uint64_t va_id,
+                    const std::string &holder_name,
+                    const DailyBalanceStats &stats)> callback) {
+            for(auto &shard : shards) {
+                shard->get_daily_stats(start_date, stop_date, demo, callback);
+            }
+        }
+    };
+};
+
+#endif // OPEN_BO_API_SHARDED_VIRTUAL_ACCOUNTS_HPP_INCLUDED
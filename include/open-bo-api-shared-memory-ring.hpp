@@ -0,0 +1,495 @@
+/*
+* open-bo-api - C++ API for working with binary options brokers
+*
+* Copyright (c) 2020 Elektro Yar. Email: git.electroyar@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef OPEN_BO_API_SHARED_MEMORY_RING_HPP_INCLUDED
+#define OPEN_BO_API_SHARED_MEMORY_RING_HPP_INCLUDED
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#include "open-bo-api-pipe-protocol.hpp"
+
+namespace open_bo_api {
+
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared memory ring requires lock-free 64-bit atomics");
+
+    /** \brief Общая часть кольцевого буфера в разделяемой памяти
+     *
+     * Буфер состоит из заголовка и массива ячеек одинакового размера.
+     * Каждая ячейка защищена счетчиком версии (seqlock): нечетное значение - идет запись,
+     * четное значение 2 * (номер + 1) - в ячейке лежит сообщение с этим номером.
+     * Писатель один, читателей может быть сколько угодно, читатели ничего не пишут в общую память.
+     * При перезапуске писатель создает новый буфер с новым номером поколения, а старый помечает закрытым,
+     * читатели это видят и заново открывают буфер по имени.
+     */
+    class SharedMemoryRingBase {
+    protected:
+        static const uint64_t MAGIC = 0x474E495241424F4FULL;   /**< Метка "OOBARING" */
+        static const uint32_t VERSION = 2;
+
+        /** \brief Заголовок буфера
+         */
+        class Header {
+        public:
+            uint64_t magic;
+            uint32_t version;
+            uint32_t slots_number;          /**< Количество ячеек (степень двойки) */
+            uint32_t slot_size;             /**< Размер данных ячейки */
+            std::atomic<uint32_t> is_closed;    /**< Писатель закрыл буфер */
+            std::atomic<uint64_t> generation;   /**< Номер поколения, новый при каждом создании буфера */
+            alignas(64) std::atomic<uint64_t> write_seq;   /**< Номер следующего сообщения */
+        };
+
+        /** \brief Заголовок ячейки
+         */
+        class Slot {
+        public:
+            std::atomic<uint64_t> version;  /**< Версия ячейки */
+            uint64_t size;                  /**< Размер сообщения */
+        };
+
+        Header *header = nullptr;
+        char *memory = nullptr;
+        size_t memory_size = 0;
+        size_t slot_stride = 0;
+        uint64_t slots_mask = 0;
+        std::string shared_name;
+        bool is_owner = false;
+        uint64_t generation = 0;    /**< Номер поколения открытого буфера */
+
+#if defined(_WIN32)
+        HANDLE mapping = NULL;
+#else
+        int shm_fd = -1;
+#endif
+
+        inline static size_t get_slot_stride(const uint32_t slot_size) {
+            return (sizeof(Slot) + slot_size + 63) & ~((size_t)63);
+        }
+
+        inline static size_t get_header_size() {
+            return (sizeof(Header) + 63) & ~((size_t)63);
+        }
+
+        inline Slot *get_slot(const uint64_t seq) {
+            return reinterpret_cast<Slot*>(memory + get_header_size() + (seq & slots_mask) * slot_stride);
+        }
+
+        inline char *get_slot_data(Slot *slot) {
+            return reinterpret_cast<char*>(slot) + sizeof(Slot);
+        }
+
+        /** \brief Отобразить разделяемую память
+         *
+         * \param name Имя буфера
+         * \param size Размер памяти (0 - узнать размер по заголовку существующего буфера)
+         * \param is_create Создать буфер
+         * \return Вернет true в случае успеха
+         */
+        bool map_memory(const std::string &name, size_t size, const bool is_create) {
+#if defined(_WIN32)
+            shared_name = "Local\\open-bo-api-" + name;
+            if(is_create) {
+                mapping = CreateFileMappingA(
+                    INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                    (DWORD)((uint64_t)size >> 32), (DWORD)(size & 0xFFFFFFFF),
+                    (LPCSTR)shared_name.c_str());
+            } else {
+                mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, (LPCSTR)shared_name.c_str());
+            }
+            if(mapping == NULL) {
+                std::cerr << "SharedMemoryRing error: CreateFileMapping failed, GLE=" << GetLastError() << std::endl;
+                return false;
+            }
+            memory = (char*)MapViewOfFile(mapping, is_create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, size);
+            if(memory == NULL) {
+                std::cerr << "SharedMemoryRing error: MapViewOfFile failed, GLE=" << GetLastError() << std::endl;
+                CloseHandle(mapping);
+                mapping = NULL;
+                return false;
+            }
+            if(size == 0) {
+                MEMORY_BASIC_INFORMATION info;
+                VirtualQuery(memory, &info, sizeof(info));
+                size = info.RegionSize;
+            }
+#else
+            shared_name = "/open-bo-api-" + name;
+            if(is_create) {
+                /* читатели прошлого запуска могут держать старый буфер, помечаем его закрытым */
+                mark_closed(shared_name);
+                shm_unlink(shared_name.c_str());
+                shm_fd = shm_open(shared_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+            } else {
+                shm_fd = shm_open(shared_name.c_str(), O_RDONLY, 0);
+            }
+            if(shm_fd < 0) {
+                if(is_create) std::cerr << "SharedMemoryRing error: shm_open failed, errno=" << errno << std::endl;
+                return false;
+            }
+            if(is_create) {
+                if(ftruncate(shm_fd, size) < 0) {
+                    std::cerr << "SharedMemoryRing error: ftruncate failed, errno=" << errno << std::endl;
+                    unmap_memory();
+                    return false;
+                }
+            } else {
+                struct stat info;
+                if(fstat(shm_fd, &info) < 0 || (size_t)info.st_size < get_header_size()) {
+                    unmap_memory();
+                    return false;
+                }
+                size = info.st_size;
+            }
+            void *ptr = mmap(NULL, size, is_create ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, shm_fd, 0);
+            if(ptr == MAP_FAILED) {
+                std::cerr << "SharedMemoryRing error: mmap failed, errno=" << errno << std::endl;
+                unmap_memory();
+                return false;
+            }
+            memory = (char*)ptr;
+#endif
+            memory_size = size;
+            is_owner = is_create;
+            header = reinterpret_cast<Header*>(memory);
+            return true;
+        }
+
+#if !defined(_WIN32)
+        /** \brief Пометить закрытым буфер, который остался от прошлого запуска писателя
+         *
+         * Нужно, если прошлый писатель завершился аварийно и не успел закрыть буфер сам
+         * \param name Имя разделяемой памяти
+         */
+        static void mark_closed(const std::string &name) {
+            const int fd = shm_open(name.c_str(), O_RDWR, 0);
+            if(fd < 0) return;
+            struct stat info;
+            if(fstat(fd, &info) == 0 && (size_t)info.st_size >= get_header_size()) {
+                void *ptr = mmap(NULL, get_header_size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                if(ptr != MAP_FAILED) {
+                    Header *old_header = reinterpret_cast<Header*>(ptr);
+                    if(old_header->magic == MAGIC) old_header->is_closed.store(1, std::memory_order_release);
+                    munmap(ptr, get_header_size());
+                }
+            }
+            ::close(fd);
+        }
+#endif
+
+        /** \brief Освободить разделяемую память
+         */
+        void unmap_memory() {
+#if defined(_WIN32)
+            if(memory != nullptr) UnmapViewOfFile(memory);
+            if(mapping != NULL) CloseHandle(mapping);
+            mapping = NULL;
+#else
+            if(memory != nullptr) munmap(memory, memory_size);
+            if(shm_fd >= 0) ::close(shm_fd);
+            if(is_owner && shm_fd >= 0) shm_unlink(shared_name.c_str());
+            shm_fd = -1;
+#endif
+            memory = nullptr;
+            header = nullptr;
+            memory_size = 0;
+            is_owner = false;
+        }
+
+        SharedMemoryRingBase() {};
+        SharedMemoryRingBase(const SharedMemoryRingBase&) = delete;
+        SharedMemoryRingBase &operator=(const SharedMemoryRingBase&) = delete;
+
+        ~SharedMemoryRingBase() {
+            unmap_memory();
+        }
+
+    public:
+
+        /** \brief Проверить, что буфер открыт
+         */
+        inline bool check_open() const {
+            return header != nullptr;
+        }
+
+        /** \brief Получить максимальный размер сообщения
+         */
+        inline uint32_t get_slot_size() const {
+            return header == nullptr ? 0 : header->slot_size;
+        }
+    };
+
+    /** \brief Писатель кольцевого буфера в разделяемой памяти
+     *
+     * Быстрая альтернатива NamedPipeServer для процессов на том же компьютере:
+     * публикация сообщения не требует системных вызовов и не ждет читателей.
+     * Если читатель не успевает, старые сообщения перезаписываются, а читатель узнает о пропуске.
+     * Публиковать сообщения должен один поток.
+     */
+    class SharedMemoryRingServer : public SharedMemoryRingBase {
+    private:
+
+        /** \brief Получить номер поколения для нового буфера
+         */
+        static uint64_t create_generation() {
+            std::random_device rd;
+            const uint64_t value = ((uint64_t)rd() << 32) ^ (uint64_t)rd() ^
+                (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+            return value == 0 ? 1 : value;
+        }
+
+    public:
+
+        /** \brief Конструктор
+         *
+         * \param name Имя буфера
+         * \param slots_number Количество ячеек (округляется вверх до степени двойки)
+         * \param slot_size Максимальный размер сообщения в байтах
+         */
+        SharedMemoryRingServer(
+                const std::string &name,
+                const uint32_t slots_number = 1024,
+                const uint32_t slot_size = 64 * 1024) {
+            uint32_t n = 1;
+            while(n < slots_number) n <<= 1;
+            const size_t stride = get_slot_stride(slot_size);
+            const size_t size = get_header_size() + (size_t)n * stride;
+            if(!map_memory(name, size, true)) return;
+            std::memset(memory, 0, size);
+            slot_stride = stride;
+            slots_mask = n - 1;
+            generation = create_generation();
+            header->version = VERSION;
+            header->slots_number = n;
+            header->slot_size = slot_size;
+            header->is_closed.store(0, std::memory_order_relaxed);
+            header->generation.store(generation, std::memory_order_relaxed);
+            header->write_seq.store(0, std::memory_order_relaxed);
+            /* метка записывается последней, после нее читатели могут открыть буфер */
+            std::atomic_thread_fence(std::memory_order_release);
+            header->magic = MAGIC;
+        }
+
+        /** \brief Опубликовать сообщение
+         *
+         * \param data Указатель на данные
+         * \param size Размер данных
+         * \return Номер сообщения или 0, если сообщение не поместилось в ячейку
+         */
+        uint64_t publish(const void *data, const size_t size) {
+            if(header == nullptr || size > header->slot_size) return 0;
+            const uint64_t seq = header->write_seq.load(std::memory_order_relaxed);
+            Slot *slot = get_slot(seq);
+            slot->version.store(2 * seq + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot->size = size;
+            std::memcpy(get_slot_data(slot), data, size);
+            slot->version.store(2 * seq + 2, std::memory_order_release);
+            header->write_seq.store(seq + 1, std::memory_order_release);
+            return seq + 1;
+        }
+
+        inline uint64_t publish(const std::string &message) {
+            return publish(message.data(), message.size());
+        }
+
+        /** \brief Закрыть буфер
+         *
+         * Читатели увидят метку закрытия и будут ждать буфер нового писателя
+         */
+        void close() {
+            if(header == nullptr) return;
+            header->is_closed.store(1, std::memory_order_release);
+            unmap_memory();
+        }
+
+        ~SharedMemoryRingServer() {
+            close();
+        }
+
+        /** \brief Опубликовать свечи всех символов
+         *
+         * Свечи кодируются кадром pipe_protocol, как и при передаче через именованный канал
+         * \param candles Свечи, ключ - имя символа
+         * \return Номер сообщения или 0 в случае ошибки
+         */
+        inline uint64_t publish_candles(const std::map<std::string, xquotes_common::Candle> &candles) {
+            return publish(pipe_protocol::encode_candles(candles));
+        }
+    };
+
+    /** \brief Читатель кольцевого буфера в разделяемой памяти
+     *
+     * Читатель не блокирует писателя и других читателей.
+     * Каждый экземпляр читателя должен использоваться одним потоком.
+     */
+    class SharedMemoryRingClient : public SharedMemoryRingBase {
+    private:
+        std::string name;
+        uint64_t read_seq = 0;      /**< Номер следующего сообщения для чтения */
+        uint64_t lost = 0;          /**< Количество пропущенных сообщений */
+        bool is_reopen = false;     /**< Буфер уже открывался, писатель был перезапущен */
+
+        /** \brief Открыть буфер, если писатель уже создал его
+         *
+         * Если писатель закрыл буфер или пересоздал его, старое отображение освобождается
+         * и открывается текущий буфер с этим именем
+         */
+        bool try_open() {
+            if(header != nullptr) {
+                if(header->is_closed.load(std::memory_order_acquire) == 0 &&
+                   header->generation.load(std::memory_order_relaxed) == generation) return true;
+                unmap_memory();
+                is_reopen = true;
+            }
+            if(!map_memory(name, 0, false)) return false;
+            if(header->magic != MAGIC || header->version != VERSION ||
+               header->is_closed.load(std::memory_order_acquire) != 0) {
+                unmap_memory();
+                return false;
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            slot_stride = get_slot_stride(header->slot_size);
+            slots_mask = header->slots_number - 1;
+            if(get_header_size() + (size_t)header->slots_number * slot_stride > memory_size) {
+                unmap_memory();
+                return false;
+            }
+            generation = header->generation.load(std::memory_order_relaxed);
+            /* при первом открытии начинаем с самого нового сообщения,
+             * после перезапуска писателя читаем новый буфер с начала
+             */
+            read_seq = is_reopen ? 0 : header->write_seq.load(std::memory_order_acquire);
+            return true;
+        }
+
+    public:
+
+        /** \brief Конструктор
+         * \param _name Имя буфера
+         */
+        SharedMemoryRingClient(const std::string &_name) : name(_name) {
+            try_open();
+        }
+
+        /** \brief Прочитать следующее сообщение без ожидания
+         *
+         * Если читатель отстал больше чем на размер буфера,
+         * он переходит к самому старому доступному сообщению, а пропуск учитывается в get_lost()
+         * \param message Сообщение
+         * \param seq Номер сообщения
+         * \return Вернет true, если сообщение прочитано
+         */
+        bool read(std::string &message, uint64_t &seq) {
+            if(!try_open()) return false;
+            while(true) {
+                const uint64_t write_seq = header->write_seq.load(std::memory_order_acquire);
+                if(read_seq >= write_seq) return false;
+                const uint64_t slots_number = slots_mask + 1;
+                if(write_seq - read_seq > slots_number) {
+                    /* писатель обогнал читателя */
+                    lost += write_seq - slots_number - read_seq;
+                    read_seq = write_seq - slots_number;
+                }
+                Slot *slot = get_slot(read_seq);
+                const uint64_t version = slot->version.load(std::memory_order_acquire);
+                if(version == 2 * read_seq + 2) {
+                    const uint64_t size = std::min(slot->size, (uint64_t)header->slot_size);
+                    message.assign(get_slot_data(slot), size);
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if(slot->version.load(std::memory_order_relaxed) == version) {
+                        seq = ++read_seq;
+                        return true;
+                    }
+                }
+                /* ячейка перезаписана во время чтения, переходим к более новым сообщениям */
+                ++lost;
+                ++read_seq;
+            }
+        }
+
+        /** \brief Прочитать следующее сообщение с ожиданием
+         *
+         * Ожидание выполняется активным опросом, чтобы не терять микросекунды на пробуждение потока
+         * \param message Сообщение
+         * \param seq Номер сообщения
+         * \param timeout Время ожидания
+         * \return Вернет true, если сообщение прочитано
+         */
+        bool wait_read(
+                std::string &message,
+                uint64_t &seq,
+                const std::chrono::microseconds timeout) {
+            const auto stop_time = std::chrono::steady_clock::now() + timeout;
+            while(!read(message, seq)) {
+                if(std::chrono::steady_clock::now() >= stop_time) return false;
+                std::this_thread::yield();
+            }
+            return true;
+        }
+
+        /** \brief Прочитать свечи всех символов
+         *
+         * \param candles Свечи, ключ - имя символа
+         * \param seq Номер сообщения
+         * \return Вернет true, если прочитан кадр со свечами
+         */
+        bool read_candles(std::map<std::string, xquotes_common::Candle> &candles, uint64_t &seq) {
+            std::string message;
+            while(read(message, seq)) {
+                pipe_protocol::FrameView view;
+                if(!view.parse(message.data(), message.size())) continue;
+                if(view.get_type() != pipe_protocol::FrameType::CANDLES) continue;
+                candles.clear();
+                view.get_candles(candles);
+                return true;
+            }
+            return false;
+        }
+
+        /** \brief Получить количество пропущенных сообщений
+         */
+        inline uint64_t get_lost() const {
+            return lost;
+        }
+    };
+};
+
+#endif // OPEN_BO_API_SHARED_MEMORY_RING_HPP_INCLUDED
@@ -0,0 +1,184 @@
+/*
+* open-bo-api - C++ API for working with binary options brokers
+*
+* Copyright (c) 2020 Elektro Yar. Email: git.electroyar@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef OPEN_BO_API_STRATEGY_REGISTRY_HPP_INCLUDED
+#define OPEN_BO_API_STRATEGY_REGISTRY_HPP_INCLUDED
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <bitset>
+#include <mutex>
+
+namespace open_bo_api {
+
+    /** \brief Реестр стратегий
+     *
+     * Реестр присваивает каждому имени стратегии компактный номер.
+     * Номера действуют в пределах процесса и не сохраняются в базе данных,
+     * поэтому в базе данных стратегии по прежнему хранятся по именам.
+     */
+    class StrategyRegistry {
+    public:
+        static const uint32_t MAX_STRATEGIES = 256;         /**< Максимальное количество стратегий */
+        static const uint32_t INVALID_ID = 0xFFFFFFFF;      /**< Номер несуществующей стратегии */
+
+        using Mask = std::bitset<MAX_STRATEGIES>;           /**< Битовая маска стратегий */
+
+    private:
+        std::vector<std::string> names;
+        std::map<std::string, uint32_t> ids;
+        mutable std::mutex registry_mutex;
+
+        StrategyRegistry() {};
+        StrategyRegistry(const StrategyRegistry&) = delete;
+        StrategyRegistry &operator=(const StrategyRegistry&) = delete;
+
+    public:
+
+        /** \brief Получить реестр стратегий процесса
+         * \return Ссылка на реестр
+         */
+        static StrategyRegistry &instance() {
+            static StrategyRegistry registry;
+            return registry;
+        }
+
+        /** \brief Получить номер стратегии, зарегистрировав ее при необходимости
+         *
+         * \param strategy_name Имя стратегии
+         * \return Номер стратегии или INVALID_ID, если реестр заполнен
+         */
+        uint32_t get_id(const std::string &strategy_name) {
+            if(strategy_name.empty()) return INVALID_ID;
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            auto it = ids.find(strategy_name);
+            if(it != ids.end()) return it->second;
+            if(names.size() >= MAX_STRATEGIES) {
+                std::cerr << "StrategyRegistry error: registry is full, strategy: " << strategy_name << std::endl;
+                return INVALID_ID;
+            }
+            const uint32_t strategy_id = names.size();
+            names.push_back(strategy_name);
+            ids[strategy_name] = strategy_id;
+            return strategy_id;
+        }
+
+        /** \brief Найти номер стратегии без регистрации
+         *
+         * \param strategy_name Имя стратегии
+         * \return Номер стратегии или INVALID_ID, если стратегия не зарегистрирована
+         */
+        uint32_t find_id(const std::string &strategy_name) const {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            auto it = ids.find(strategy_name);
+            if(it == ids.end()) return INVALID_ID;
+            return it->second;
+        }
+
+        /** \brief Получить имя стратегии по номеру
+         *
+         * \param strategy_id Номер стратегии
+         * \return Имя стратегии или пустая строка
+         */
+        std::string get_name(const uint32_t strategy_id) const {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            if(strategy_id >= names.size()) return std::string();
+            return names[strategy_id];
+        }
+
+        /** \brief Разобрать строку списка стратегий сразу в битовую маску
+         *
+         * \param value Список стратегий через запятую
+         * \param mask Битовая маска стратегий
+         * \return Вернет false, если хотя бы одна стратегия не поместилась в реестр
+         */
+        bool parse_list(const std::string &value, Mask &mask) {
+            bool is_ok = true;
+            std::size_t start_pos = 0;
+            while(start_pos < value.size()) {
+                std::size_t found_beg = value.find_first_of(",", start_pos);
+                if(found_beg == std::string::npos) found_beg = value.size();
+                std::size_t len = found_beg - start_pos;
+                if(len > 0) {
+                    const uint32_t strategy_id = get_id(value.substr(start_pos, len));
+                    if(strategy_id != INVALID_ID) mask.set(strategy_id);
+                    else is_ok = false;
+                }
+                start_pos = found_beg + 1;
+            }
+            return is_ok;
+        }
+
+        /** \brief Преобразовать битовую маску в строку списка стратегий
+         *
+         * \param mask Битовая маска стратегий
+         * \return Список стратегий через запятую (с запятой в конце)
+         */
+        std::string to_str_list(const Mask &mask) const {
+            std::string temp;
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            for(size_t i = 0; i < names.size(); ++i) {
+                if(!mask.test(i)) continue;
+                temp += names[i];
+                temp += ",";
+            }
+            return temp;
+        }
+
+        /** \brief Преобразовать битовую маску в множество имен стратегий
+         *
+         * \param mask Битовая маска стратегий
+         * \return Множество имен стратегий
+         */
+        std::set<std::string> to_set(const Mask &mask) const {
+            std::set<std::string> temp;
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            for(size_t i = 0; i < names.size(); ++i) {
+                if(mask.test(i)) temp.insert(names[i]);
+            }
+            return temp;
+        }
+
+        /** \brief Преобразовать множество имен стратегий в битовую маску
+         *
+         * \param list_strategies Множество имен стратегий
+         * \param mask Битовая маска стратегий
+         * \return Вернет false, если хотя бы одна стратегия не поместилась в реестр
+         */
+        bool to_mask(const std::set<std::string> &list_strategies, Mask &mask) {
+            bool is_ok = true;
+            mask.reset();
+            for(auto &strategy_name : list_strategies) {
+                const uint32_t strategy_id = get_id(strategy_name);
+                if(strategy_id != INVALID_ID) mask.set(strategy_id);
+                else is_ok = false;
+            }
+            return is_ok;
+        }
+    };
+};
+
+#endif // OPEN_BO_API_STRATEGY_REGISTRY_HPP_INCLUDED
@@ -0,0 +1,243 @@
+/*
+* open-bo-api - C++ API for working with binary options brokers
+*
+* Copyright (c) 2020 Elektro Yar. Email: git.electroyar@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef OPEN_BO_API_SYMBOL_REGISTRY_HPP_INCLUDED
+#define OPEN_BO_API_SYMBOL_REGISTRY_HPP_INCLUDED
+
+#include "ForexprostoolsApi.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+namespace open_bo_api {
+
+    /** \brief Номер символа в реестре символов
+     *
+     * Отдельный тип нужен, чтобы перегрузки функций по номеру символа
+     * не путались с индексами символов в таблицах и картах
+     */
+    class SymbolId {
+    public:
+        static const uint32_t INVALID_ID = 0xFFFFFFFF;  /**< Номер несуществующего символа */
+
+        uint32_t value = INVALID_ID;
+
+        SymbolId() {};
+
+        explicit SymbolId(const uint32_t id) : value(id) {};
+
+        inline bool is_valid() const {
+            return value != INVALID_ID;
+        }
+
+        inline bool operator == (const SymbolId &other) const {
+            return value == other.value;
+        }
+
+        inline bool operator != (const SymbolId &other) const {
+            return value != other.value;
+        }
+
+        inline bool operator < (const SymbolId &other) const {
+            return value < other.value;
+        }
+    };
+
+    /** \brief Данные символа
+     */
+    class SymbolInfo {
+    public:
+        SymbolId id;                    /**< Номер символа */
+        std::string name;               /**< Имя символа */
+        std::string base_currency;      /**< Базовая валюта */
+        std::string quote_currency;     /**< Валюта котировки */
+        std::atomic<uint32_t> brokers{0};   /**< Битовая маска брокеров, у которых есть символ (бит на значение ListBrokers) */
+
+        SymbolInfo() {};
+
+        /** \brief Проверить, что валюты символа разобраны
+         * \return Вернет true, если известны обе валюты символа
+         */
+        inline bool check_currencies() const {
+            return !base_currency.empty() && !quote_currency.empty();
+        }
+
+        /** \brief Проверить доступность символа у брокера
+         * \param broker Номер брокера (значение ListBrokers)
+         * \return Вернет true, если символ есть у брокера
+         */
+        inline bool check_broker(const int32_t broker) const {
+            if(broker < 0 || broker >= 32) return false;
+            return (brokers.load(std::memory_order_relaxed) >> broker) & 1;
+        }
+    };
+
+    /** \brief Реестр символов
+     *
+     * Реестр присваивает каждому имени символа компактный номер и один раз
+     * разбирает данные символа. Номера действуют в пределах процесса.
+     * Данные символа читаются по номеру без блокировки, поэтому на горячих
+     * путях вместо строк можно сравнивать и использовать как индекс целые числа.
+     */
+    class SymbolRegistry {
+    public:
+        static const uint32_t MAX_SYMBOLS = 1024;   /**< Максимальное количество символов */
+
+    private:
+        std::unique_ptr<SymbolInfo[]> infos;
+        std::atomic<uint32_t> count{0};
+        std::map<std::string, uint32_t> ids;
+        mutable std::mutex registry_mutex;
+
+        SymbolRegistry() : infos(new SymbolInfo[MAX_SYMBOLS]) {};
+        SymbolRegistry(const SymbolRegistry&) = delete;
+        SymbolRegistry &operator=(const SymbolRegistry&) = delete;
+
+        static const SymbolInfo &get_empty_info() {
+            static const SymbolInfo info;
+            return info;
+        }
+
+        /** \brief Разобрать валюты символа
+         *
+         * Валюты разбираются так же, как в фильтре новостей (ForexprostoolsApiEasy::get_currencies),
+         * чтобы новости и символы сопоставлялись одинаково
+         */
+        static void parse_currencies(SymbolInfo &info) {
+            if(ForexprostoolsApiEasy::get_currencies(
+                    info.name,
+                    info.base_currency,
+                    info.quote_currency) == ForexprostoolsApiEasy::OK) return;
+            info.base_currency.clear();
+            info.quote_currency.clear();
+        }
+
+    public:
+
+        /** \brief Получить реестр символов процесса
+         * \return Ссылка на реестр
+         */
+        static SymbolRegistry &instance() {
+            static SymbolRegistry registry;
+            return registry;
+        }
+
+        /** \brief Получить номер символа, зарегистрировав его при необходимости
+         *
+         * \param symbol_name Имя символа
+         * \return Номер символа или недействительный номер, если реестр заполнен
+         */
+        SymbolId get_id(const std::string &symbol_name) {
+            if(symbol_name.empty()) return SymbolId();
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            auto it = ids.find(symbol_name);
+            if(it != ids.end()) return SymbolId(it->second);
+            const uint32_t symbol_id = count.load(std::memory_order_relaxed);
+            if(symbol_id >= MAX_SYMBOLS) {
+                std::cerr << "SymbolRegistry error: registry is full, symbol: " << symbol_name << std::endl;
+                return SymbolId();
+            }
+            SymbolInfo &info = infos[symbol_id];
+            info.id = SymbolId(symbol_id);
+            info.name = symbol_name;
+            parse_currencies(info);
+            ids[symbol_name] = symbol_id;
+            /* данные символа становятся видны читателям только после записи */
+            count.store(symbol_id + 1, std::memory_order_release);
+            return info.id;
+        }
+
+        /** \brief Найти номер символа без регистрации
+         *
+         * \param symbol_name Имя символа
+         * \return Номер символа или недействительный номер, если символ не зарегистрирован
+         */
+        SymbolId find_id(const std::string &symbol_name) const {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            auto it = ids.find(symbol_name);
+            if(it == ids.end()) return SymbolId();
+            return SymbolId(it->second);
+        }
+
+        /** \brief Зарегистрировать список символов брокера
+         *
+         * \param list_symbols Список символов
+         * \param broker Номер брокера (значение ListBrokers) или -1, если брокер не указан
+         * \return Номера символов в порядке списка
+         */
+        std::vector<SymbolId> register_symbols(
+                const std::vector<std::string> &list_symbols,
+                const int32_t broker = -1) {
+            std::vector<SymbolId> symbol_ids;
+            symbol_ids.reserve(list_symbols.size());
+            for(size_t i = 0; i < list_symbols.size(); ++i) {
+                const SymbolId symbol_id = get_id(list_symbols[i]);
+                if(symbol_id.is_valid() && broker >= 0 && broker < 32) {
+                    infos[symbol_id.value].brokers.fetch_or(1U << broker, std::memory_order_relaxed);
+                }
+                symbol_ids.push_back(symbol_id);
+            }
+            return symbol_ids;
+        }
+
+        /** \brief Проверить номер символа
+         * \param symbol_id Номер символа
+         * \return Вернет true, если символ зарегистрирован
+         */
+        inline bool check_id(const SymbolId symbol_id) const {
+            return symbol_id.value < count.load(std::memory_order_acquire);
+        }
+
+        /** \brief Получить данные символа по номеру
+         *
+         * Метод не использует блокировку
+         * \param symbol_id Номер символа
+         * \return Данные символа или пустые данные для незарегистрированного номера
+         */
+        inline const SymbolInfo &get_info(const SymbolId symbol_id) const {
+            if(!check_id(symbol_id)) return get_empty_info();
+            return infos[symbol_id.value];
+        }
+
+        /** \brief Получить имя символа по номеру
+         * \param symbol_id Номер символа
+         * \return Имя символа или пустая строка
+         */
+        inline const std::string &get_name(const SymbolId symbol_id) const {
+            return get_info(symbol_id).name;
+        }
+
+        /** \brief Получить количество зарегистрированных символов
+         */
+        inline uint32_t size() const {
+            return count.load(std::memory_order_acquire);
+        }
+    };
+};
+
+#endif // OPEN_BO_API_SYMBOL_REGISTRY_HPP_INCLUDED
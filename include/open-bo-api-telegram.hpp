@@ -2,10 +2,28 @@
 #define OPEN_BO_API_TELEGRAM_HPP_INCLUDED
 
 #include <curl/curl.h>
+#if defined(_WIN32)
+#include <windows.h>
+#endif
 #include <gzip/decompress.hpp>
 #include <nlohmann/json.hpp>
 #include <xtime.hpp>
 #include <algorithm>
+#include <vector>
+#include <map>
+#include <deque>
+#include <tuple>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <thread>
+#include <atomic>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <cstring>
+#include <cstdio>
 
 #define OPEN_BO_API_TELEGRAM_EMOJI_TIME u8"🕓"
 #define OPEN_BO_API_TELEGRAM_EMOJI_WARNING u8"⚠️"
@@ -20,6 +38,7 @@
 #define OPEN_BO_API_TELEGRAM_EMOJI_DOWN u8"🔽"
 
 namespace open_bo_api {
+    using json = nlohmann::json;
 
     /** \brief Класс API телеграмма
      */
@@ -37,7 +56,19 @@ namespace open_bo_api {
             UNKNOWN_ERROR = -8,
         };
 
+        /// Приоритеты сообщений
+        enum MessagePriority {
+            PRIORITY_ALERT = 0,     ///< Важные уведомления, отправляются первыми
+            PRIORITY_NORMAL = 1,    ///< Обычные сообщения
+            PRIORITY_LOG = 2,       ///< Журнал сделок
+        };
+
         const uint32_t REPEAT_DELAY = 10000;
+        const uint32_t RETRY_MIN_DELAY = 1000;      /**< Начальная задержка повторной отправки сообщения */
+        const uint32_t RETRY_MAX_DELAY = 60000;     /**< Максимальная задержка повторной отправки сообщения */
+        const uint32_t MAX_SEND_ATTEMPTS = 10;      /**< Количество попыток отправить сообщение */
+        const uint32_t LONG_POLL_TIMEOUT = 50;      /**< Время ожидания обновлений в одном запросе getUpdates (секунды) */
+        const size_t MAX_MESSAGE_LENGTH = 4096;     /**< Максимальная длина сообщения (в единицах UTF-16) */
     private:
         std::string token;
         std::string proxy;
@@ -47,6 +78,14 @@ namespace open_bo_api {
 
         uint32_t timeout = 120;
 
+        std::string api_url = "https://api.telegram.org";   /**< Адрес сервера API */
+        std::atomic<uint32_t> max_connections = ATOMIC_VAR_INIT(4); /**< Максимальное количество одновременных соединений */
+
+        /* пул curl handle: соединения и TLS-сессии переиспользуются между запросами */
+        std::mutex curl_pool_mutex;
+        std::vector<CURL*> curl_pool;
+        struct curl_slist *http_headers = NULL;
+
         std::atomic<bool> is_token = ATOMIC_VAR_INIT(false);
 
         std::mutex chats_id_mutex;
@@ -59,7 +98,11 @@ namespace open_bo_api {
 
         // для работы с массивом сообщений на отправление (начало)
         std::future<void> messages_future;
+        std::vector<std::future<void>> send_futures;
         std::mutex array_sent_messages_mutex;
+        std::condition_variable messages_cv;    /**< Пробуждает поток планировщика */
+        std::condition_variable send_cv;        /**< Пробуждает потоки отправки */
+        std::condition_variable wait_cv;        /**< Пробуждает метод wait() */
 
         /** \brief Класс для хранения собщений на отправку
          */
@@ -67,23 +110,175 @@ namespace open_bo_api {
         public:
             int64_t chat_id = 0;
             std::string message;
+            uint32_t priority = PRIORITY_NORMAL;
+            uint32_t parts = 1;     /**< Количество исходных сообщений, объединенных в это сообщение */
+            int error = OK;         /**< Результат отправки */
             OutputMessage() {};
 
-            OutputMessage(const int64_t send_chat_id, const std::string &send_message) :
-                chat_id(send_chat_id), message(send_message) {};
+            OutputMessage(const int64_t send_chat_id, const std::string &send_message, const uint32_t send_priority = PRIORITY_NORMAL) :
+                chat_id(send_chat_id), message(send_message), priority(send_priority) {};
+        };
+
+        /* следующие поля защищены array_sent_messages_mutex */
+        std::vector<OutputMessage> array_sent_messages;     /**< Новые сообщения */
+        std::deque<OutputMessage> ready_messages;           /**< Сообщения, готовые к отправке */
+        std::vector<OutputMessage> completed_messages;      /**< Сообщения, отправка которых завершена */
+        size_t pending_messages = 0;                        /**< Количество неотправленных сообщений */
+
+        /** \brief Ведро токенов для ограничения частоты запросов
+         */
+        class TokenBucket {
+        public:
+            double rate = 1.0d;         /**< Скорость пополнения, токенов в секунду */
+            double capacity = 1.0d;     /**< Емкость ведра (допустимый всплеск) */
+            double tokens = 1.0d;
+            std::chrono::steady_clock::time_point last_update;
+
+            TokenBucket() : last_update(std::chrono::steady_clock::now()) {};
+
+            TokenBucket(const double bucket_rate, const double bucket_capacity) :
+                rate(bucket_rate), capacity(bucket_capacity), tokens(bucket_capacity),
+                last_update(std::chrono::steady_clock::now()) {};
+
+            /** \brief Проверить наличие токена
+             * \param now Текущее время
+             * \return Вернет true, если токен есть
+             */
+            bool check(const std::chrono::steady_clock::time_point &now) {
+                const double elapsed = std::chrono::duration<double>(now - last_update).count();
+                if(elapsed > 0.0d) {
+                    tokens = std::min(capacity, tokens + elapsed * rate);
+                    last_update = now;
+                }
+                return tokens >= 1.0d;
+            }
+
+            inline void take() {
+                tokens -= 1.0d;
+            }
+
+            /** \brief Получить время до появления токена
+             */
+            std::chrono::steady_clock::duration get_delay() const {
+                if(tokens >= 1.0d) return std::chrono::steady_clock::duration::zero();
+                if(rate <= 0.0d) return std::chrono::hours(1);
+                return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>((1.0d - tokens) / rate));
+            }
+        };
+
+        /** \brief Очередь сообщений одного чата
+         */
+        class ChatQueue {
+        public:
+            std::deque<std::string> messages[PRIORITY_LOG + 1];   /**< Сообщения по приоритетам */
+            TokenBucket bucket;
+            uint64_t first_seq = 0;     /**< Порядковый номер самого старого сообщения в очереди */
+
+            OutputMessage parked;       /**< Сообщение, ожидающее повторной отправки */
+            bool is_parked = false;
+            bool is_sending = false;    /**< Сообщение чата отправляется */
+            uint32_t attempts = 0;      /**< Количество неудачных попыток отправки */
+            std::chrono::steady_clock::time_point next_attempt;
+
+            ChatQueue() {};
+
+            bool empty() const {
+                if(is_parked) return false;
+                for(size_t p = 0; p <= PRIORITY_LOG; ++p) {
+                    if(!messages[p].empty()) return false;
+                }
+                return true;
+            }
+
+            uint32_t get_top_priority() const {
+                for(size_t p = 0; p <= PRIORITY_LOG; ++p) {
+                    if(!messages[p].empty()) return p;
+                }
+                return PRIORITY_LOG;
+            }
         };
 
-        std::vector<OutputMessage> array_sent_messages;
+        std::map<int64_t, ChatQueue> chat_queues;   /**< Очереди чатов (используются только потоком отправки) */
+        TokenBucket global_bucket;
+        uint64_t chat_queues_seq = 0;
+        size_t sending_messages = 0;                /**< Количество отправляемых сообщений */
+
+        std::atomic<double> global_rate = ATOMIC_VAR_INIT(25.0d);       /**< Сообщений в секунду для всех чатов */
+        std::atomic<double> chat_rate = ATOMIC_VAR_INIT(1.0d);          /**< Сообщений в секунду для личного чата */
+        std::atomic<double> group_chat_rate = ATOMIC_VAR_INIT(1.0d / 3.0d);  /**< Сообщений в секунду для группы или канала */
+        const double CHAT_BURST = 3.0d;     /**< Допустимый всплеск сообщений в один чат */
 
-        int add_send_message(const int64_t chat_id, const std::string &message) {
+        /** \brief Получить длину текста в единицах UTF-16
+         *
+         * Telegram ограничивает длину сообщения в единицах UTF-16
+         * \param text Текст в кодировке UTF-8
+         * \return Длина текста
+         */
+        static size_t get_text_length(const std::string &text) {
+            size_t length = 0;
+            for(size_t i = 0; i < text.size(); ++i) {
+                const unsigned char c = text[i];
+                if((c & 0xC0) == 0x80) continue;
+                /* символы за пределами BMP занимают две единицы UTF-16 */
+                length += (c >= 0xF0) ? 2 : 1;
+            }
+            return length;
+        }
+
+        /** \brief Разбить длинное сообщение на части
+         *
+         * Разбиение выполняется по границам символов UTF-8, по возможности по переводу строки
+         * \param message Сообщение
+         * \param parts Части сообщения
+         */
+        void split_message(const std::string &message, std::vector<std::string> &parts) const {
+            size_t start = 0;
+            size_t remaining = get_text_length(message);
+            while(remaining > MAX_MESSAGE_LENGTH) {
+                size_t length = 0;
+                size_t pos = start;
+                size_t last_line = std::string::npos;
+                while(pos < message.size()) {
+                    const unsigned char c = message[pos];
+                    size_t char_size = 1;
+                    if(c >= 0xF0) char_size = 4;
+                    else if(c >= 0xE0) char_size = 3;
+                    else if(c >= 0xC0) char_size = 2;
+                    const size_t char_length = c >= 0xF0 ? 2 : 1;
+                    if(length + char_length > MAX_MESSAGE_LENGTH) break;
+                    length += char_length;
+                    if(c == '\n') last_line = pos;
+                    pos += char_size;
+                }
+                size_t stop = pos;
+                if(last_line != std::string::npos && last_line > start) stop = last_line;
+                parts.push_back(message.substr(start, stop - start));
+                remaining -= get_text_length(parts.back());
+                if(stop == last_line) {
+                    /* перевод строки на месте разбиения не нужен */
+                    start = stop + 1;
+                    --remaining;
+                } else start = stop;
+            }
+            parts.push_back(message.substr(start));
+        }
+
+        int add_send_message(const int64_t chat_id, const std::string &message, const uint32_t priority = PRIORITY_NORMAL) {
+            std::vector<std::string> parts;
+            split_message(message, parts);
             {
                 std::lock_guard<std::mutex> lock(array_sent_messages_mutex);
-                array_sent_messages.push_back(OutputMessage(chat_id, message));
+                for(size_t i = 0; i < parts.size(); ++i) {
+                    array_sent_messages.push_back(OutputMessage(chat_id, std::move(parts[i]), std::min(priority, (uint32_t)PRIORITY_LOG)));
+                }
+                pending_messages += parts.size();
             }
+            messages_cv.notify_one();
             return OK;
         }
 
-        int add_send_message(const std::string &chat_name, const std::string &message) {
+        int add_send_message(const std::string &chat_name, const std::string &message, const uint32_t priority = PRIORITY_NORMAL) {
             int64_t chat_id = 0;
             {
                 std::lock_guard<std::mutex> lock(chats_id_mutex);
@@ -91,10 +286,12 @@ namespace open_bo_api {
                 if(it == chats_id.end()) return CHAT_ID_NOT_FOUND;
                 chat_id = it->second;
             }
-            return add_send_message(chat_id, message);
+            return add_send_message(chat_id, message, priority);
         }
 
-        std::atomic<bool> is_update_chats_id_store = ATOMIC_VAR_INIT(false);
+        std::future<void> updates_future;
+        std::atomic<bool> is_update_chats_id_store = ATOMIC_VAR_INIT(false);    /**< Поток получения обновлений запущен */
+        std::atomic<int64_t> update_offset = ATOMIC_VAR_INIT(0);                /**< Номер следующего обновления */
         // для работы с массивом сообщений на отправление (конец)
 
         /** \brief Разобрать путь на составляющие
@@ -167,6 +364,16 @@ namespace open_bo_api {
             return buffer_size;
         }
 
+        /** \brief Callback-функция прогресса запроса
+         *
+         * Прерывает запрос (в том числе ожидание getUpdates) при завершении работы
+         * Данный метод нужен для внутреннего использования
+         */
+        static int progress_callback(void *userdata, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
+            TelegramApi *api = (TelegramApi*)userdata;
+            return api->is_request_future_shutdown ? 1 : 0;
+        }
+
         static int writer(char *data, size_t size, size_t nmemb, std::string *buffer) {
             int result = 0;
             if (buffer != NULL) {
@@ -296,6 +503,69 @@ namespace open_bo_api {
         }
 #endif
 
+        /** \brief Создать список заголовков запроса
+         *
+         * Список создается один раз и используется всеми запросами
+         */
+        void init_http_headers() {
+            http_headers = curl_slist_append(http_headers, "User-Agent: Mozilla/5.0 (Windows NT 10.0; rv:68.0) Gecko/20100101 Firefox/68.0");
+            http_headers = curl_slist_append(http_headers, "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8");
+            http_headers = curl_slist_append(http_headers, "Accept-Language: en-US,en;q=0.5");
+            http_headers = curl_slist_append(http_headers, "Accept-Encoding: gzip, deflate");
+            http_headers = curl_slist_append(http_headers, "Content-Type: application/x-www-form-urlencoded; charset=UTF-8");
+            http_headers = curl_slist_append(http_headers, "Connection: keep-alive");
+        }
+
+        /** \brief Взять curl handle из пула
+         *
+         * Handle из пула сохраняет открытые соединения и кэш TLS-сессий,
+         * поэтому повторные запросы не тратят время на рукопожатие и CONNECT через прокси
+         * \return Указатель на curl handle или NULL
+         */
+        CURL *acquire_curl() {
+            {
+                std::lock_guard<std::mutex> lock(curl_pool_mutex);
+                if(!curl_pool.empty()) {
+                    CURL *curl = curl_pool.back();
+                    curl_pool.pop_back();
+                    /* сбрасываем только настройки, соединения остаются открытыми */
+                    curl_easy_reset(curl);
+                    return curl;
+                }
+            }
+            return curl_easy_init();
+        }
+
+        /** \brief Вернуть curl handle в пул
+         * \param curl Указатель на curl handle
+         */
+        void release_curl(CURL *curl) {
+            std::lock_guard<std::mutex> lock(curl_pool_mutex);
+            curl_pool.push_back(curl);
+        }
+
+        /** \brief Закодировать строку для передачи в теле запроса
+         * \param value Строка
+         * \return Закодированная строка
+         */
+        static std::string url_encode(const std::string &value) {
+            static const char hex[] = "0123456789ABCDEF";
+            std::string out;
+            out.reserve(value.size() * 3);
+            for(size_t i = 0; i < value.size(); ++i) {
+                const unsigned char c = value[i];
+                if((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                    c == '-' || c == '_' || c == '.' || c == '~') {
+                    out += (char)c;
+                } else {
+                    out += '%';
+                    out += hex[c >> 4];
+                    out += hex[c & 0x0F];
+                }
+            }
+            return out;
+        }
+
         /** \brief Отправить запрос
          *
          * \param is_post_request Тип запроса
@@ -312,11 +582,11 @@ namespace open_bo_api {
                 const std::string &method_name,
                 const std::string &request_body,
                 std::string &response) {
-            CURL *curl;
-            curl = curl_easy_init();
+            CURL *curl = acquire_curl();
             if(!curl) return CURL_EASY_INIT_ERROR;
             /* формируем запрос */
-            std::string url("https://api.telegram.org/bot");
+            std::string url(api_url);
+            url += "/bot";
             url += token;
             url += "/";
             url += method_name;
@@ -354,31 +624,26 @@ namespace open_bo_api {
             curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buffer);
 
             curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout);
+            curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+            curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+            curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+            curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, progress_callback);
+            curl_easy_setopt(curl, CURLOPT_XFERINFODATA, this);
 
             curl_easy_setopt(curl, CURLOPT_HEADERDATA, &content_encoding);
             curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
 
-            struct curl_slist *http_headers = NULL;
-            http_headers = curl_slist_append(http_headers, "Host: api.telegram.org");
-            http_headers = curl_slist_append(http_headers, "User-Agent: Mozilla/5.0 (Windows NT 10.0; rv:68.0) Gecko/20100101 Firefox/68.0");
-            http_headers = curl_slist_append(http_headers, "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8");
-            http_headers = curl_slist_append(http_headers, "Accept-Language: en-US,en;q=0.5");
-            http_headers = curl_slist_append(http_headers, "Accept-Encoding: gzip, deflate");
-            //http_headers = curl_slist_append(http_headers, "Content-Type: application/x-www-form-urlencoded; charset=UTF-8");
-            http_headers = curl_slist_append(http_headers, "Upgrade-Insecure-Requests: 1");
-            http_headers = curl_slist_append(http_headers, "Connection: keep-alive");
-
             curl_easy_setopt(curl, CURLOPT_HTTPHEADER, http_headers);
 
-            if(is_post_request) curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request_body.c_str());
+            if(is_post_request) {
+                curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)request_body.size());
+                curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request_body.c_str());
+            }
 
             CURLcode result;
             result = curl_easy_perform(curl);
 
-            curl_slist_free_all(http_headers);
-            http_headers = NULL;
-
-            curl_easy_cleanup(curl);
+            release_curl(curl);
             if(result == CURLE_OK) {
                 if(content_encoding == USE_CONTENT_ENCODING_GZIP) {
                     if(buffer.size() == 0) return NO_ANSWER;
@@ -395,65 +660,79 @@ namespace open_bo_api {
                 }
                 return OK;
             }
+            /* запрос прерван при завершении работы */
+            if(result == CURLE_ABORTED_BY_CALLBACK) return result;
             std::cerr << "open_bo_api::TelegramApi::do_request curl error: [" << result << "] - " << error_buffer << std::endl;
             return result;
         }
 
-        int do_get_updates() {
+        /** \brief Запомнить номер чата
+         * \param name Имя пользователя или название чата
+         * \param chat_id Номер чата
+         * \return Вернет true, если хранилище чатов изменилось
+         */
+        bool set_chat_id(const std::string &name, const int64_t chat_id) {
+            std::lock_guard<std::mutex> lock(chats_id_mutex);
+            auto it = chats_id.find(name);
+            if(it != chats_id.end() && it->second == chat_id) return false;
+            chats_id[name] = chat_id;
+            return true;
+        }
+
+        /** \brief Получить новые обновления
+         *
+         * Запрашиваются только обновления после последнего полученного (параметр offset).
+         * Хранилище чатов записывается в файл, только если оно изменилось
+         * \param poll_timeout Время ожидания новых обновлений сервером (секунды)
+         * \return Код ошибки
+         */
+        int do_get_updates(const uint32_t poll_timeout = 0) {
+            std::string body("offset=");
+            body += std::to_string(update_offset.load());
+            body += "&timeout=";
+            body += std::to_string(poll_timeout);
+            body += "&allowed_updates=";
+            body += url_encode("[\"message\",\"channel_post\"]");
             std::string response;
-            int err = do_request(true, proxy, proxy_pwd, token, "getUpdates", "", response);
+            int err = do_request(true, proxy, proxy_pwd, token, "getUpdates", body, response);
             if(err != OK) return err;
-            //std::cout << response << std::endl;
+            bool is_changed = false;
             try {
                 json j = json::parse(response);
                 if(j["ok"] != true) return REQUEST_RETURN_ERROR;
-                const size_t result_size = j["result"].size();
-                //std::cout << "result_size: " << result_size << std::endl;
-                for(size_t i = 0; i < result_size; ++i) {
-                    int64_t chat_id = 0;
-                    json j_result = j["result"][i];
+                const json &j_results = j["result"];
+                for(size_t i = 0; i < j_results.size(); ++i) {
+                    const json &j_result = j_results[i];
+                    const int64_t update_id = j_result.value("update_id", (int64_t)0);
+                    if(update_id >= update_offset) update_offset = update_id + 1;
+
                     auto it_json = j_result.find("message");
-                    if(it_json != j_result.end()) {
-                        chat_id = (*it_json)["chat"]["id"];
-                    } else {
+                    if(it_json == j_result.end()) {
                         it_json = j_result.find("channel_post");
-                        if(it_json != j_result.end()) {
-                            chat_id = (*it_json)["chat"]["id"];
-                        } else continue;
+                        if(it_json == j_result.end()) continue;
                     }
-
-                    //int64_t chat_id = j["result"][i]["channel_post"]["chat"]["id"];
-                    //j["result"][i]["message"]["chat"]["type"]
-
-                    //std::cout << "chat_id: " << chat_id << std::endl;
-                    if((*it_json)["chat"]["type"] == "private") {
+                    auto it_chat = it_json->find("chat");
+                    if(it_chat == it_json->end()) continue;
+                    const json &j_chat = *it_chat;
+                    const int64_t chat_id = j_chat.value("id", (int64_t)0);
+                    if(chat_id == 0) continue;
+                    const std::string type = j_chat.value("type", std::string());
+
+                    if(type == "private") {
                         std::string username;
-                        if((*it_json)["chat"]["username"] != nullptr) {
-                            username = (*it_json)["chat"]["username"];
+                        if(j_chat.find("username") != j_chat.end()) {
+                            username = j_chat["username"];
                         } else
-                        if((*it_json)["chat"]["first_name"] != nullptr) {
-                            username = (*it_json)["chat"]["first_name"];
-                            if((*it_json)["last_name"] != nullptr) {
-                                username += " ";
-                                username += (*it_json)["chat"]["last_name"];
-                            }
+                        if(j_chat.find("first_name") != j_chat.end()) {
+                            username = j_chat["first_name"];
                         } else {
                             continue;
                         }
-                        {
-                            std::lock_guard<std::mutex> lock(chats_id_mutex);
-                            chats_id[username] = chat_id;
-                        }
-                        //std::cout << "username: " << username << " id: " << chat_id << std::endl;
+                        if(set_chat_id(username, chat_id)) is_changed = true;
                     } else
-                    if((*it_json)["chat"]["type"] == "group" ||
-                        (*it_json)["chat"]["type"] == "channel") {
-                        std::string title = (*it_json)["chat"]["title"];
-                        {
-                            std::lock_guard<std::mutex> lock(chats_id_mutex);
-                            chats_id[title] = chat_id;
-                        }
-                        //std::cout << "title: " << title << " id: " << chat_id << std::endl;
+                    if(type == "group" || type == "supergroup" || type == "channel") {
+                        if(j_chat.find("title") == j_chat.end()) continue;
+                        if(set_chat_id(j_chat["title"], chat_id)) is_changed = true;
                     }
                 }
             }
@@ -469,10 +748,21 @@ namespace open_bo_api {
                 std::cerr << "open_bo_api::TelegramApi::do_get_updates(), json parser error" << std::endl;
                 return PARSER_ERROR;
             }
+            if(!is_changed) return OK;
+            return save_chat_id();
+        }
 
+        /** \brief Сохранить хранилище чатов в файл
+         *
+         * Данные записываются во временный файл, который затем заменяет основной,
+         * поэтому при сбое файл не окажется записанным наполовину
+         * \return Код ошибки
+         */
+        int save_chat_id() {
             std::lock_guard<std::mutex> lock(file_chats_id_mutex);
             create_directory(chat_id_json_file);
-            std::ofstream file(chat_id_json_file);
+            const std::string temp_file = chat_id_json_file + ".tmp";
+            std::ofstream file(temp_file);
             if(!file) return UNKNOWN_ERROR;
             try {
                 json j_chat_id;
@@ -482,29 +772,60 @@ namespace open_bo_api {
                 }
                 file << std::setw(4) << j_chat_id << std::endl;
             }
-            catch (json::parse_error &e) {
-                std::cerr << "open_bo_api::TelegramApi::do_get_updates(), json parser error: " << std::string(e.what()) << std::endl;
-                return PARSER_ERROR;
-            }
             catch (std::exception e) {
-                std::cerr << "open_bo_api::TelegramApi::do_get_updates(), json parser error: " << std::string(e.what()) << std::endl;
+                std::cerr << "open_bo_api::TelegramApi::save_chat_id(), json error: " << std::string(e.what()) << std::endl;
                 return PARSER_ERROR;
             }
             catch(...) {
-                std::cerr << "open_bo_api::TelegramApi::do_get_updates(), json parser error" << std::endl;
+                std::cerr << "open_bo_api::TelegramApi::save_chat_id(), json error" << std::endl;
                 return PARSER_ERROR;
             }
             file.close();
+            if(!file) {
+                std::remove(temp_file.c_str());
+                return UNKNOWN_ERROR;
+            }
+#           if defined(_WIN32)
+            if(!MoveFileExA(temp_file.c_str(), chat_id_json_file.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+#           else
+            if(std::rename(temp_file.c_str(), chat_id_json_file.c_str()) != 0) {
+#           endif
+                std::cerr << "open_bo_api::TelegramApi::save_chat_id(), file replace error: " << chat_id_json_file << std::endl;
+                std::remove(temp_file.c_str());
+                return UNKNOWN_ERROR;
+            }
             return OK;
         }
 
+        /** \brief Поток получения обновлений
+         *
+         * Держит один запрос getUpdates в режиме длинного опроса,
+         * при ошибках повторяет запрос с растущей задержкой
+         */
+        void updates_loop() {
+            uint32_t attempts = 0;
+            while(!is_request_future_shutdown) {
+                if(do_get_updates(LONG_POLL_TIMEOUT) == OK) {
+                    attempts = 0;
+                    continue;
+                }
+                if(is_request_future_shutdown) break;
+                const uint32_t shift = std::min(attempts++, (uint32_t)16);
+                const uint32_t delay = std::min((uint64_t)RETRY_MIN_DELAY << shift, (uint64_t)RETRY_MAX_DELAY);
+                std::unique_lock<std::mutex> lock(array_sent_messages_mutex);
+                wait_cv.wait_for(lock, std::chrono::milliseconds(delay), [&] {
+                    return is_request_future_shutdown.load();
+                });
+            }
+        }
+
         int do_send_message(const int64_t chat_id, const std::string &message) {
             std::string response;
-            std::string method_name("sendMessage?chat_id=");
-            method_name += std::to_string(chat_id);
-            method_name += "&text=";
-            method_name += message;
-            int err = do_request(true, proxy, proxy_pwd, token, method_name, "", response);
+            std::string body("chat_id=");
+            body += std::to_string(chat_id);
+            body += "&text=";
+            body += url_encode(message);
+            int err = do_request(true, proxy, proxy_pwd, token, "sendMessage", body, response);
             if(err != OK) return err;
             try {
                 json j = json::parse(response);
@@ -565,6 +886,242 @@ namespace open_bo_api {
             return OK;
         }
 
+        /** \brief Распределить новые сообщения по очередям чатов
+         * \param messages Новые сообщения
+         */
+        void push_chat_queues(std::vector<OutputMessage> &messages) {
+            for(size_t i = 0; i < messages.size(); ++i) {
+                auto it = chat_queues.find(messages[i].chat_id);
+                if(it == chat_queues.end()) {
+                    /* группы и каналы имеют отрицательный номер и более строгое ограничение */
+                    const double rate = messages[i].chat_id < 0 ? group_chat_rate.load() : chat_rate.load();
+                    it = chat_queues.insert(std::make_pair(messages[i].chat_id, ChatQueue())).first;
+                    it->second.bucket = TokenBucket(rate, CHAT_BURST);
+                }
+                if(it->second.empty()) it->second.first_seq = chat_queues_seq;
+                ++chat_queues_seq;
+                it->second.messages[messages[i].priority].push_back(std::move(messages[i].message));
+            }
+        }
+
+        /** \brief Объединить сообщения чата в одно сообщение
+         *
+         * Сообщения берутся по убыванию приоритета, внутри приоритета - по порядку поступления,
+         * пока длина объединенного сообщения не превысит MAX_MESSAGE_LENGTH
+         * \param chat_id Номер чата
+         * \param queue Очередь чата
+         * \return Объединенное сообщение
+         */
+        OutputMessage coalesce_messages(const int64_t chat_id, ChatQueue &queue) {
+            OutputMessage output(chat_id, std::string(), queue.get_top_priority());
+            output.parts = 0;
+            size_t length = 0;
+            for(size_t p = output.priority; p <= PRIORITY_LOG; ++p) {
+                std::deque<std::string> &messages = queue.messages[p];
+                while(!messages.empty()) {
+                    const size_t message_length = get_text_length(messages.front());
+                    const size_t separator_length = output.parts == 0 ? 0 : 1;
+                    if(output.parts > 0 && length + separator_length + message_length > MAX_MESSAGE_LENGTH) return output;
+                    if(separator_length) output.message += "\n";
+                    output.message += messages.front();
+                    length += separator_length + message_length;
+                    ++output.parts;
+                    messages.pop_front();
+                }
+            }
+            return output;
+        }
+
+        /** \brief Выбрать сообщения для отправки
+         *
+         * Из каждого готового чата берется одно объединенное сообщение. Чаты с более
+         * приоритетными и более старыми сообщениями обслуживаются первыми.
+         * Соблюдаются общее ограничение частоты и ограничения каждого чата.
+         * Сообщение, ожидающее повторной отправки, блокирует только свой чат
+         * \param output_messages Сообщения на отправку
+         * \return Время, когда планировщик нужно разбудить
+         */
+        std::chrono::steady_clock::time_point schedule_messages(std::vector<OutputMessage> &output_messages) {
+            const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            std::chrono::steady_clock::time_point wake_time = std::chrono::steady_clock::time_point::max();
+            if(global_bucket.rate != global_rate.load()) {
+                global_bucket = TokenBucket(global_rate.load(), global_rate.load());
+            }
+
+            /* приоритет, порядковый номер, номер чата */
+            std::vector<std::tuple<uint32_t, uint64_t, int64_t>> candidates;
+            for(auto it = chat_queues.begin(); it != chat_queues.end();) {
+                ChatQueue &queue = it->second;
+                if(queue.is_sending) {
+                    ++it;
+                    continue;
+                }
+                if(queue.empty()) {
+                    /* очередь пустого чата храним, пока ведро не наполнится */
+                    queue.bucket.check(now);
+                    if(queue.bucket.tokens >= queue.bucket.capacity) it = chat_queues.erase(it);
+                    else ++it;
+                    continue;
+                }
+                if(queue.is_parked && now < queue.next_attempt) {
+                    wake_time = std::min(wake_time, queue.next_attempt);
+                } else
+                if(!queue.bucket.check(now)) {
+                    wake_time = std::min(wake_time, now + queue.bucket.get_delay());
+                } else {
+                    const uint32_t priority = queue.is_parked ? queue.parked.priority : queue.get_top_priority();
+                    candidates.push_back(std::make_tuple(priority, queue.first_seq, it->first));
+                }
+                ++it;
+            }
+            std::sort(candidates.begin(), candidates.end());
+
+            const size_t max_messages = std::max(max_connections.load(), (uint32_t)1);
+            for(size_t i = 0; i < candidates.size() && sending_messages < max_messages; ++i) {
+                if(!global_bucket.check(now)) {
+                    wake_time = std::min(wake_time, now + global_bucket.get_delay());
+                    break;
+                }
+                ChatQueue &queue = chat_queues[std::get<2>(candidates[i])];
+                global_bucket.take();
+                queue.bucket.take();
+                if(queue.is_parked) {
+                    output_messages.push_back(std::move(queue.parked));
+                    queue.is_parked = false;
+                } else {
+                    output_messages.push_back(coalesce_messages(std::get<2>(candidates[i]), queue));
+                }
+                queue.is_sending = true;
+                queue.first_seq = chat_queues_seq;
+                ++sending_messages;
+            }
+            return wake_time;
+        }
+
+        /** \brief Уменьшить количество неотправленных сообщений
+         * \param parts Количество сообщений
+         */
+        void finish_messages(const size_t parts) {
+            std::lock_guard<std::mutex> lock(array_sent_messages_mutex);
+            pending_messages -= parts;
+            if(pending_messages == 0) wait_cv.notify_all();
+        }
+
+        /** \brief Обработать результаты отправки
+         *
+         * Сообщение, которое не удалось отправить, откладывается с экспоненциально
+         * растущей задержкой, остальные чаты продолжают отправку
+         * \param sent_messages Сообщения, отправка которых завершена
+         * \param now Текущее время
+         */
+        void process_sent_messages(
+                std::vector<OutputMessage> &sent_messages,
+                const std::chrono::steady_clock::time_point &now) {
+            for(size_t i = 0; i < sent_messages.size(); ++i) {
+                OutputMessage &message = sent_messages[i];
+                ChatQueue &queue = chat_queues[message.chat_id];
+                queue.is_sending = false;
+                --sending_messages;
+                if(message.error == OK) {
+                    queue.attempts = 0;
+                    is_error = false;
+                    finish_messages(message.parts);
+                    continue;
+                }
+                if(++queue.attempts >= MAX_SEND_ATTEMPTS) {
+                    std::cerr << "open_bo_api::TelegramApi, message to chat " << message.chat_id
+                        << " dropped, error: " << message.error << std::endl;
+                    queue.attempts = 0;
+                    is_error = true;
+                    finish_messages(message.parts);
+                    continue;
+                }
+                const uint32_t shift = std::min(queue.attempts - 1, (uint32_t)16);
+                const uint32_t delay = std::min((uint64_t)RETRY_MIN_DELAY << shift, (uint64_t)RETRY_MAX_DELAY);
+                queue.next_attempt = now + std::chrono::milliseconds(delay);
+                queue.parked = std::move(message);
+                queue.is_parked = true;
+            }
+        }
+
+        /** \brief Поток отправки сообщений
+         */
+        void send_loop() {
+            while(true) {
+                OutputMessage message;
+                {
+                    std::unique_lock<std::mutex> lock(array_sent_messages_mutex);
+                    send_cv.wait(lock, [&] {
+                        return is_request_future_shutdown || !ready_messages.empty();
+                    });
+                    if(is_request_future_shutdown) return;
+                    message = std::move(ready_messages.front());
+                    ready_messages.pop_front();
+                }
+                message.error = do_send_message(message.chat_id, message.message);
+                {
+                    std::lock_guard<std::mutex> lock(array_sent_messages_mutex);
+                    completed_messages.push_back(std::move(message));
+                }
+                messages_cv.notify_one();
+            }
+        }
+
+        /** \brief Запустить недостающие потоки отправки
+         */
+        void start_send_threads() {
+            const size_t threads = std::max(max_connections.load(), (uint32_t)1);
+            while(send_futures.size() < threads) {
+                send_futures.push_back(std::async(std::launch::async, [&] {
+                    send_loop();
+                }));
+            }
+        }
+
+        /** \brief Поток планировщика сообщений
+         *
+         * Поток спит, пока не появятся новые сообщения, результаты отправки
+         * или не наступит время следующей отправки
+         */
+        void schedule_loop() {
+            std::chrono::steady_clock::time_point wake_time = std::chrono::steady_clock::time_point::max();
+            while(true) {
+                std::vector<OutputMessage> new_messages;
+                std::vector<OutputMessage> sent_messages;
+                {
+                    std::unique_lock<std::mutex> lock(array_sent_messages_mutex);
+                    auto is_wake_up = [&] {
+                        return is_request_future_shutdown ||
+                            !array_sent_messages.empty() || !completed_messages.empty();
+                    };
+                    if(wake_time == std::chrono::steady_clock::time_point::max()) messages_cv.wait(lock, is_wake_up);
+                    else messages_cv.wait_until(lock, wake_time, is_wake_up);
+                    if(is_request_future_shutdown) break;
+                    new_messages.swap(array_sent_messages);
+                    sent_messages.swap(completed_messages);
+                }
+                const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                process_sent_messages(sent_messages, now);
+                push_chat_queues(new_messages);
+
+                std::vector<OutputMessage> output_messages;
+                wake_time = schedule_messages(output_messages);
+                if(output_messages.empty()) continue;
+                start_send_threads();
+                {
+                    std::lock_guard<std::mutex> lock(array_sent_messages_mutex);
+                    for(size_t i = 0; i < output_messages.size(); ++i) {
+                        ready_messages.push_back(std::move(output_messages[i]));
+                    }
+                }
+                send_cv.notify_all();
+            }
+            send_cv.notify_all();
+            for(size_t i = 0; i < send_futures.size(); ++i) {
+                send_futures[i].wait();
+            }
+        }
+
     public:
 
         TelegramApi(
@@ -583,61 +1140,23 @@ namespace open_bo_api {
                 return;
             }
             if(!is_token) return;
+            init_http_headers();
             load_chat_id();
             messages_future = std::async(std::launch::async,[&] {
-                while(!is_request_future_shutdown) {
-                    if(is_update_chats_id_store) {
-                        int err = OK;
-                        const size_t attempts = 10;
-                        for(size_t n = 0; n < attempts; ++n) {
-                            if(is_request_future_shutdown) break;
-                            if((err = do_get_updates()) == OK) {
-                                is_error = false;
-                                break;
-                            }
-                            std::this_thread::sleep_for(std::chrono::milliseconds(REPEAT_DELAY));
-                        }
-                        is_update_chats_id_store = false;
-                        if(err == OK) continue;
-                        is_error = true;
-                    }
-
-                    std::this_thread::yield();
-                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
-
-                    std::vector<OutputMessage> output_messages;
-                    {
-                        std::lock_guard<std::mutex> lock(array_sent_messages_mutex);
-                        if(array_sent_messages.size() == 0) continue;
-                        output_messages = array_sent_messages;
-                        array_sent_messages.clear();
-                    }
-
-                    std::this_thread::yield();
-
-                    for(size_t i = 0; i < output_messages.size(); ++i) {
-                        int err = OK;
-                        const size_t attempts = 10;
-                        for(size_t n = 0; n < attempts; ++n) {
-                            if(is_request_future_shutdown) break;
-                            if((err = do_send_message(output_messages[i].chat_id, output_messages[i].message)) == OK) {
-                                is_error = false;
-                                break;
-                            }
-                            std::this_thread::sleep_for(std::chrono::milliseconds(REPEAT_DELAY));
-                        }
-                        if(err == OK) continue;
-                        is_error = true;
-                        break;
-                    }
-                    std::this_thread::yield();
-                }
+                schedule_loop();
             });
         };
 
         ~TelegramApi() {
             if(!is_token) return;
-            is_request_future_shutdown = true;
+            {
+                std::lock_guard<std::mutex> lock(array_sent_messages_mutex);
+                is_request_future_shutdown = true;
+            }
+            messages_cv.notify_all();
+            send_cv.notify_all();
+            wait_cv.notify_all();
+            if(updates_future.valid()) updates_future.wait();
             if(messages_future.valid()) {
                 try {
                     messages_future.wait();
@@ -650,15 +1169,62 @@ namespace open_bo_api {
                     std::cerr << "open_bo_api::~TelegramApi() error" << std::endl;
                 }
             }
+            for(size_t i = 0; i < curl_pool.size(); ++i) {
+                curl_easy_cleanup(curl_pool[i]);
+            }
+            curl_pool.clear();
+            if(http_headers) curl_slist_free_all(http_headers);
+            http_headers = NULL;
+        }
+
+        /** \brief Установить адрес сервера API
+         *
+         * Метод нужен, например, для работы через локальный сервер или для тестов.
+         * Вызывать до отправки сообщений
+         * \param url Адрес сервера API, например http://127.0.0.1:8081
+         */
+        void set_api_url(const std::string &url) {
+            api_url = url;
+        }
+
+        /** \brief Установить максимальное количество одновременных соединений
+         *
+         * Сообщения разным чатам отправляются параллельно, не более указанного количества соединений
+         * \param connections Количество соединений
+         */
+        void set_max_connections(const uint32_t connections) {
+            max_connections = std::max(connections, (uint32_t)1);
+        }
+
+        /** \brief Установить ограничения частоты отправки сообщений
+         *
+         * Сообщения, ожидающие отправки в один чат, объединяются в одно сообщение,
+         * поэтому ограничения не приводят к накоплению очереди
+         * \param all_chats_rate Сообщений в секунду для всех чатов
+         * \param private_chat_rate Сообщений в секунду для личного чата
+         * \param group_rate Сообщений в секунду для группы или канала
+         */
+        void set_rate_limits(
+                const double all_chats_rate,
+                const double private_chat_rate,
+                const double group_rate) {
+            global_rate = all_chats_rate;
+            chat_rate = private_chat_rate;
+            group_chat_rate = group_rate;
         }
 
 
         /** \brief Обновить список чатов
+         *
+         * В асинхронном режиме запускается поток, который получает обновления длинным опросом
+         * и обновляет список чатов до уничтожения объекта. Повторный вызов ничего не делает
          * \param is_async Флаг выполнения метода в асинхронном режиме
          * \return Вернет true в случае успешного завершения (не справедливо для асинхронного метода)
          */
         bool update_chats_id_store(const bool is_async = true) {
             if(!is_token) return false;
+            /* одновременные запросы getUpdates не допускаются сервером */
+            if(is_update_chats_id_store) return true;
             if(!is_async) {
                 int err = OK;
                 const size_t attempts = 10;
@@ -666,9 +1232,12 @@ namespace open_bo_api {
                     if((err = do_get_updates()) == OK) return true;
                     std::this_thread::sleep_for(std::chrono::milliseconds(REPEAT_DELAY));
                 }
-                return true;
+                return false;
             }
-            is_update_chats_id_store = true;
+            if(is_update_chats_id_store.exchange(true)) return true;
+            updates_future = std::async(std::launch::async,[&] {
+                updates_loop();
+            });
             return true;
         }
 
@@ -676,10 +1245,15 @@ namespace open_bo_api {
          * \param chat Чат. Указать или уникальный номер чата (int64_t) или имя пользователя/чата в виде строки std::string
          * \param message Текс сообщения
          * \param is_async Флаг выполнения метода в асинхронном режиме
+         * \param priority Приоритет сообщения (только для асинхронного метода)
          * \return Вернет true в случае успешного завершения (не справедливо для асинхронного метода)
          */
         template<class CHAT_TYPE>
-        bool send_message(const CHAT_TYPE chat, const std::string &message, const bool is_async = true) {
+        bool send_message(
+                const CHAT_TYPE chat,
+                const std::string &message,
+                const bool is_async = true,
+                const MessagePriority priority = PRIORITY_NORMAL) {
             if(!is_token) return false;
             if(!is_async) {
                 int err = OK;
@@ -691,7 +1265,7 @@ namespace open_bo_api {
                 is_error = true;
                 return false;
             }
-            if(add_send_message(chat, message) != OK) return false;
+            if(add_send_message(chat, message, priority) != OK) return false;
             return true;
         }
 
@@ -699,15 +1273,10 @@ namespace open_bo_api {
          */
         void wait() {
             if(!is_token) return;
-            while(!is_request_future_shutdown) {
-                std::this_thread::yield();
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
-                {
-                    std::lock_guard<std::mutex> lock(array_sent_messages_mutex);
-                    if(array_sent_messages.size() != 0) continue;
-                }
-                break;
-            }
+            std::unique_lock<std::mutex> lock(array_sent_messages_mutex);
+            wait_cv.wait(lock, [&] {
+                return pending_messages == 0 || is_request_future_shutdown;
+            });
         }
 
     };
@@ -0,0 +1,465 @@
+/*
+* open-bo-api - C++ API for working with binary options brokers
+*
+* Copyright (c) 2020 Elektro Yar. Email: git.electroyar@gmail.com
+*
+* Permission is hereby granted, free of charge, to any person obtaining a copy
+* of this software and associated documentation files (the "Software"), to deal
+* in the Software without restriction, including without limitation the rights
+* to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+* copies of the Software, and to permit persons to whom the Software is
+* furnished to do so, subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be included in
+* all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*/
+#ifndef OPEN_BO_API_VIRTUAL_ACCOUNT_IO_HPP_INCLUDED
+#define OPEN_BO_API_VIRTUAL_ACCOUNT_IO_HPP_INCLUDED
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <limits>
+#include <cmath>
+
+#include "open-bo-api-virtual-account.hpp"
+
+namespace open_bo_api {
+
+    /** \brief Массовый импорт и экспорт виртуальных аккаунтов
+     *
+     * Поддерживается два формата:
+     * CSV - первая строка содержит имена столбцов (как в таблице virtual_accounts),
+     * пустой id означает, что ID нужно назначить автоматически;
+     * бинарный формат - заголовок "OBVA", версия и записи аккаунтов
+     * (числа записываются в порядке байтов платформы).
+     *
+     * Строки разбираются потоково, а преобразование и проверка строк выполняется параллельно.
+     * Запись в базу данных выполняется одной транзакцией, см. VirtualAccounts::import_virtual_accounts
+     */
+    class VirtualAccountsBulk {
+    public:
+        using ErrorCallback = std::function<void(const uint64_t row, const std::string &message)>;
+
+    private:
+        static const uint32_t CSV_COLUMNS = 19;
+        static const uint32_t BINARY_VERSION = 1;
+        static const uint32_t MAX_STRING_SIZE = 1024 * 1024;   /**< Максимальная длина строки в бинарном формате */
+        static const size_t CSV_BATCH_SIZE = 4096;              /**< Количество строк CSV, которые преобразуются за один раз */
+
+        /** \brief Записать поле CSV, экранируя кавычки при необходимости
+         */
+        static void write_csv_field(std::ostream &stream, const std::string &value) {
+            if(value.find_first_of(",\"\r\n") == std::string::npos) {
+                stream << value;
+                return;
+            }
+            stream << '"';
+            for(const char c : value) {
+                if(c == '"') stream << '"';
+                stream << c;
+            }
+            stream << '"';
+        }
+
+        /** \brief Прочитать одну строку CSV
+         *
+         * Поля в кавычках могут содержать запятые и переносы строк
+         * \param stream Поток
+         * \param fields Поля строки
+         * \return Вернет false, если поток закончился
+         */
+        static bool read_csv_row(std::istream &stream, std::vector<std::string> &fields) {
+            fields.clear();
+            std::string field;
+            bool is_quoted = false;
+            bool is_data = false;
+            char c = 0;
+            while(stream.get(c)) {
+                is_data = true;
+                if(is_quoted) {
+                    if(c == '"') {
+                        if(stream.peek() == '"') {
+                            stream.get(c);
+                            field += '"';
+                        } else {
+                            is_quoted = false;
+                        }
+                    } else {
+                        field += c;
+                    }
+                    continue;
+                }
+                if(c == '"') {
+                    is_quoted = true;
+                } else
+                if(c == ',') {
+                    fields.push_back(std::move(field));
+                    field.clear();
+                } else
+                if(c == '\n') {
+                    fields.push_back(std::move(field));
+                    return true;
+                } else
+                if(c != '\r') {
+                    field += c;
+                }
+            }
+            if(!is_data) return false;
+            fields.push_back(std::move(field));
+            return true;
+        }
+
+        static std::string to_str(const double value) {
+            std::ostringstream ss;
+            ss << std::setprecision(std::numeric_limits<double>::max_digits10) << value;
+            return ss.str();
+        }
+
+        /** \brief Преобразовать поля строки CSV в аккаунт
+         *
+         * \return Пустая строка в случае успеха, иначе описание ошибки
+         */
+        static std::string convert_csv_row(
+                const std::vector<std::string> &fields,
+                VirtualAccount &va) {
+            if(fields.size() != CSV_COLUMNS) return "invalid number of columns";
+            try {
+                va.va_id = fields[0].empty() ? VirtualAccounts::AUTO_VA_ID : std::stoull(fields[0]);
+                va.holder_name = fields[1];
+                va.note = fields[2];
+                va.start_balance = std::stod(fields[3]);
+                va.balance = std::stod(fields[4]);
+                va.absolute_stop_loss = std::stod(fields[5]);
+                va.absolute_take_profit = std::stod(fields[6]);
+                va.kelly_attenuation_multiplier = std::stod(fields[7]);
+                va.kelly_attenuation_limiter = std::stod(fields[8]);
+                va.payout_limiter = std::stod(fields[9]);
+                va.winrate_limiter = std::stod(fields[10]);
+                va.strategy_mask.reset();
+                if(!StrategyRegistry::instance().parse_list(fields[11], va.strategy_mask)) return "strategy registry is full";
+                va.demo = std::stoi(fields[12]) != 0;
+                va.enabled = std::stoi(fields[13]) != 0;
+                va.start_timestamp = std::stoull(fields[14]);
+                va.timestamp = std::stoull(fields[15]);
+                va.wins = std::stoull(fields[16]);
+                va.losses = std::stoull(fields[17]);
+            } catch(...) {
+                return "invalid number format";
+            }
+            va.convert_json_to_date_balance(fields[18].empty() ? std::string("{}") : fields[18]);
+            return std::string();
+        }
+
+        template<class T>
+        static void write_pod(std::ostream &stream, const T &value) {
+            stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        template<class T>
+        static bool read_pod(std::istream &stream, T &value) {
+            return (bool)stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+        }
+
+        static void write_string(std::ostream &stream, const std::string &value) {
+            write_pod(stream, (uint32_t)value.size());
+            stream.write(value.data(), value.size());
+        }
+
+        /** \brief Прочитать строку бинарного формата
+         *
+         * Длина строки берется из файла, поэтому слишком длинные строки считаются ошибкой
+         * и память под них не выделяется
+         * \return Вернет false, если поток закончился или длина строки некорректна
+         */
+        static bool read_string(std::istream &stream, std::string &value) {
+            uint32_t len = 0;
+            if(!read_pod(stream, len)) return false;
+            if(len > MAX_STRING_SIZE) return false;
+            value.resize(len);
+            if(len == 0) return true;
+            return (bool)stream.read(&value[0], len);
+        }
+
+        /** \brief Выполнить функцию для диапазона индексов в нескольких потоках
+         */
+        template<class T>
+        static void parallel_for(const size_t n, T f) {
+            const size_t threads = std::max((size_t)1, std::min((size_t)std::thread::hardware_concurrency(), n / 256));
+            if(threads <= 1) {
+                for(size_t i = 0; i < n; ++i) f(i);
+                return;
+            }
+            std::vector<std::future<void>> futures;
+            const size_t step = (n + threads - 1) / threads;
+            for(size_t t = 0; t < threads; ++t) {
+                const size_t start = t * step;
+                const size_t stop = std::min(n, start + step);
+                if(start >= stop) break;
+                futures.push_back(std::async(std::launch::async, [&f, start, stop]() {
+                    for(size_t i = start; i < stop; ++i) f(i);
+                }));
+            }
+            for(auto &it : futures) {
+                it.wait();
+            }
+        }
+
+        /** \brief Проверить аккаунты параллельно и записать их одной транзакцией
+         *
+         * \param list_row Номера строк аккаунтов для сообщений об ошибках. Если массив пуст, используется номер аккаунта
+         */
+        static bool validate_and_import(
+                VirtualAccounts &vas,
+                std::vector<VirtualAccount> &list_va,
+                std::vector<std::string> &errors,
+                const std::vector<uint64_t> &list_row,
+                ErrorCallback callback_error) {
+            parallel_for(list_va.size(), [&](const size_t i) {
+                if(errors[i].empty()) errors[i] = validate(list_va[i]);
+            });
+            bool is_error = false;
+            for(size_t i = 0; i < errors.size(); ++i) {
+                if(errors[i].empty()) continue;
+                is_error = true;
+                if(callback_error != nullptr) callback_error(list_row.empty() ? i : list_row[i], errors[i]);
+            }
+            if(is_error) return false;
+            return vas.import_virtual_accounts(list_va);
+        }
+
+    public:
+
+        /** \brief Проверить аккаунт перед импортом
+         *
+         * \param va Виртуальный аккаунт
+         * \return Пустая строка, если аккаунт корректен, иначе описание ошибки
+         */
+        static std::string validate(const VirtualAccount &va) {
+            const double values[] = {
+                va.start_balance, va.balance,
+                va.absolute_stop_loss, va.absolute_take_profit,
+                va.kelly_attenuation_multiplier, va.kelly_attenuation_limiter,
+                va.payout_limiter, va.winrate_limiter};
+            for(const double value : values) {
+                if(!std::isfinite(value)) return "value is not a finite number";
+                if(value < 0.0d) return "value is negative";
+            }
+            if(va.payout_limiter > 1.0d) return "payout_limiter is greater than 1";
+            if(va.winrate_limiter > 1.0d) return "winrate_limiter is greater than 1";
+            for(auto &it : va.date_balance) {
+                if(!std::isfinite(it.second)) return "daily balance is not a finite number";
+            }
+            return std::string();
+        }
+
+        /** \brief Экспортировать аккаунты в CSV
+         *
+         * \param vas Виртуальные аккаунты
+         * \param stream Поток для записи
+         * \return Вернет true в случае успеха
+         */
+        static bool export_csv(VirtualAccounts &vas, std::ostream &stream) {
+            stream << "id,holder_name,note,start_balance,balance,"
+                "absolute_stop_loss,absolute_take_profit,"
+                "kelly_attenuation_multiplier,kelly_attenuation_limiter,"
+                "payout_limiter,winrate_limiter,list_strategies,"
+                "demo,enabled,start_timestamp,timestamp,"
+                "wins,losses,json\n";
+            const std::map<uint64_t, VirtualAccount> accounts = vas.get_virtual_accounts();
+            for(auto &it : accounts) {
+                const VirtualAccount &va = it.second;
+                stream << va.va_id << ',';
+                write_csv_field(stream, va.holder_name);
+                stream << ',';
+                write_csv_field(stream, va.note);
+                stream << ','
+                    << to_str(va.start_balance) << ','
+                    << to_str(va.balance) << ','
+                    << to_str(va.absolute_stop_loss) << ','
+                    << to_str(va.absolute_take_profit) << ','
+                    << to_str(va.kelly_attenuation_multiplier) << ','
+                    << to_str(va.kelly_attenuation_limiter) << ','
+                    << to_str(va.payout_limiter) << ','
+                    << to_str(va.winrate_limiter) << ',';
+                write_csv_field(stream, StrategyRegistry::instance().to_str_list(va.strategy_mask));
+                stream << ','
+                    << (va.demo ? 1 : 0) << ','
+                    << (va.enabled ? 1 : 0) << ','
+                    << va.start_timestamp << ','
+                    << va.timestamp << ','
+                    << va.wins << ','
+                    << va.losses << ',';
+                write_csv_field(stream, va.convert_date_balance_to_str_json());
+                stream << '\n';
+            }
+            return (bool)stream;
+        }
+
+        /** \brief Импортировать аккаунты из CSV
+         *
+         * Если хотя бы одна строка некорректна, ничего не импортируется.
+         * Строки читаются и преобразуются пакетами по CSV_BATCH_SIZE строк,
+         * поэтому в памяти не хранится весь текст файла
+         * \param vas Виртуальные аккаунты
+         * \param stream Поток для чтения
+         * \param callback_error Функция обратного вызова для ошибок (номер строки данных начиная с 0, пустые строки тоже учитываются)
+         * \return Вернет true в случае успеха
+         */
+        static bool import_csv(
+                VirtualAccounts &vas,
+                std::istream &stream,
+                ErrorCallback callback_error = nullptr) {
+            std::vector<std::string> fields;
+            /* пропускаем заголовок */
+            if(!read_csv_row(stream, fields)) return false;
+
+            std::vector<VirtualAccount> list_va;
+            std::vector<std::string> errors;
+            std::vector<uint64_t> list_row;
+            std::vector<std::vector<std::string>> rows;
+            rows.reserve(CSV_BATCH_SIZE);
+            uint64_t row = 0;
+            bool is_eof = false;
+            while(!is_eof) {
+                rows.clear();
+                while(rows.size() < CSV_BATCH_SIZE) {
+                    if(!read_csv_row(stream, fields)) {
+                        is_eof = true;
+                        break;
+                    }
+                    const uint64_t current_row = row++;
+                    if(fields.size() == 1 && fields[0].empty()) continue;
+                    rows.push_back(std::move(fields));
+                    list_row.push_back(current_row);
+                }
+                const size_t offset = list_va.size();
+                list_va.resize(offset + rows.size());
+                errors.resize(offset + rows.size());
+                parallel_for(rows.size(), [&](const size_t i) {
+                    errors[offset + i] = convert_csv_row(rows[i], list_va[offset + i]);
+                });
+            }
+            return validate_and_import(vas, list_va, errors, list_row, callback_error);
+        }
+
+        /** \brief Экспортировать аккаунты в бинарный формат
+         *
+         * \param vas Виртуальные аккаунты
+         * \param stream Поток для записи (должен быть открыт в режиме std::ios::binary)
+         * \return Вернет true в случае успеха
+         */
+        static bool export_binary(VirtualAccounts &vas, std::ostream &stream) {
+            const uint32_t version = BINARY_VERSION;
+            stream.write("OBVA", 4);
+            write_pod(stream, version);
+            const std::map<uint64_t, VirtualAccount> accounts = vas.get_virtual_accounts();
+            for(auto &it : accounts) {
+                const VirtualAccount &va = it.second;
+                write_pod(stream, va.va_id);
+                write_string(stream, va.holder_name);
+                write_string(stream, va.note);
+                write_pod(stream, va.start_balance);
+                write_pod(stream, va.balance);
+                write_pod(stream, va.absolute_stop_loss);
+                write_pod(stream, va.absolute_take_profit);
+                write_pod(stream, va.kelly_attenuation_multiplier);
+                write_pod(stream, va.kelly_attenuation_limiter);
+                write_pod(stream, va.payout_limiter);
+                write_pod(stream, va.winrate_limiter);
+                write_string(stream, StrategyRegistry::instance().to_str_list(va.strategy_mask));
+                const uint8_t flags = (va.demo ? 0x01 : 0x00) | (va.enabled ? 0x02 : 0x00);
+                write_pod(stream, flags);
+                write_pod(stream, va.start_timestamp);
+                write_pod(stream, va.timestamp);
+                write_pod(stream, va.wins);
+                write_pod(stream, va.losses);
+                write_pod(stream, (uint32_t)va.date_balance.size());
+                for(auto &it_day : va.date_balance) {
+                    write_pod(stream, it_day.first);
+                    write_pod(stream, it_day.second);
+                }
+            }
+            return (bool)stream;
+        }
+
+        /** \brief Импортировать аккаунты из бинарного формата
+         *
+         * Если файл поврежден или хотя бы один аккаунт некорректен, ничего не импортируется
+         * \param vas Виртуальные аккаунты
+         * \param stream Поток для чтения (должен быть открыт в режиме std::ios::binary)
+         * \param callback_error Функция обратного вызова для ошибок (номер записи начиная с 0)
+         * \return Вернет true в случае успеха
+         */
+        static bool import_binary(
+                VirtualAccounts &vas,
+                std::istream &stream,
+                ErrorCallback callback_error = nullptr) {
+            char magic[4] = {0};
+            uint32_t version = 0;
+            if(!stream.read(magic, 4) || std::string(magic, 4) != "OBVA" ||
+               !read_pod(stream, version) || version != BINARY_VERSION) {
+                if(callback_error != nullptr) callback_error(0, "invalid header");
+                return false;
+            }
+            std::vector<VirtualAccount> list_va;
+            while(stream.peek() != std::char_traits<char>::eof()) {
+                VirtualAccount va;
+                std::string str_list_strategies;
+                uint8_t flags = 0;
+                uint32_t days = 0;
+                bool is_ok =
+                    read_pod(stream, va.va_id) &&
+                    read_string(stream, va.holder_name) &&
+                    read_string(stream, va.note) &&
+                    read_pod(stream, va.start_balance) &&
+                    read_pod(stream, va.balance) &&
+                    read_pod(stream, va.absolute_stop_loss) &&
+                    read_pod(stream, va.absolute_take_profit) &&
+                    read_pod(stream, va.kelly_attenuation_multiplier) &&
+                    read_pod(stream, va.kelly_attenuation_limiter) &&
+                    read_pod(stream, va.payout_limiter) &&
+                    read_pod(stream, va.winrate_limiter) &&
+                    read_string(stream, str_list_strategies) &&
+                    read_pod(stream, flags) &&
+                    read_pod(stream, va.start_timestamp) &&
+                    read_pod(stream, va.timestamp) &&
+                    read_pod(stream, va.wins) &&
+                    read_pod(stream, va.losses) &&
+                    read_pod(stream, days);
+                for(uint32_t i = 0; is_ok && i < days; ++i) {
+                    xtime::timestamp_t date = 0;
+                    double balance = 0;
+                    is_ok = read_pod(stream, date) && read_pod(stream, balance);
+                    if(is_ok) va.date_balance[date] = balance;
+                }
+                if(!is_ok) {
+                    if(callback_error != nullptr) callback_error(list_va.size(), "unexpected end of data or invalid string length");
+                    return false;
+                }
+                if(!StrategyRegistry::instance().parse_list(str_list_strategies, va.strategy_mask)) {
+                    if(callback_error != nullptr) callback_error(list_va.size(), "strategy registry is full");
+                    return false;
+                }
+                va.demo = (flags & 0x01) != 0;
+                va.enabled = (flags & 0x02) != 0;
+                list_va.push_back(std::move(va));
+            }
+            std::vector<std::string> errors(list_va.size());
+            parallel_for(list_va.size(), [&](const size_t i) {
+                list_va[i].rebuild_daily_index();
+            });
+            return validate_and_import(vas, list_va, errors, std::vector<uint64_t>(), callback_error);
+        }
+    };
+};
+
+#endif // OPEN_BO_API_VIRTUAL_ACCOUNT_IO_HPP_INCLUDED
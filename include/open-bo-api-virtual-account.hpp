@@ -28,12 +28,17 @@
 #include <set>
 #include <map>
 #include <vector>
+#include <algorithm>
 #include <cstring>
 #include <memory>
 #include <mutex>
 #include <atomic>
 #include <future>
+#include <thread>
+#include <functional>
 
+#include "open-bo-api-strategy-registry.hpp"
+#include "open-bo-api-daily-balance-index.hpp"
 #include "xtime.hpp"
 #include "sqlite3.h"
 #include <nlohmann/json.hpp>
@@ -66,23 +71,87 @@ namespace open_bo_api {
         xtime::timestamp_t start_timestamp = 0; /**< Дата начала торговли */
         xtime::timestamp_t timestamp = 0;       /**< Последняя дата обновления баланса */
 
-        std::set<std::string> list_strategies;  /**< Список используемых стратегий */
+        StrategyRegistry::Mask strategy_mask;   /**< Битовая маска используемых стратегий, см. StrategyRegistry */
+        bool is_strategies_lost = false;        /**< Часть стратегий не поместилась в реестр стратегий. Такой аккаунт нельзя сохранить в базу данных */
 
         bool demo = true;       /**< Использовать демо-аккаунт */
         bool enabled = false;   /**< Виртуальный аккаунт включен или выключен */
 
         //json j_data;            /**< Данные в формате json */
         std::map<xtime::timestamp_t, double> date_balance;  /**< Данные депозита по дням */
+        DailyBalanceIndex daily_index;                      /**< Индекс депозита по дням для запросов по диапазону дат */
+        bool is_date_balance_loaded = true;                 /**< История депозита загружена из базы данных. Если false, date_balance содержит только новые дни */
 
         std::map<uint64_t, double> mem_profit;
         std::map<uint64_t, double> mem_amount;
 
         VirtualAccount() {};
 
+        /** \brief Проверить, подписан ли аккаунт на стратегию
+         *
+         * \param strategy_id Номер стратегии в StrategyRegistry
+         * \return Вернет true, если стратегия разрешена
+         */
+        inline bool check_strategy(const uint32_t strategy_id) const {
+            if(strategy_id >= StrategyRegistry::MAX_STRATEGIES) return false;
+            return strategy_mask.test(strategy_id);
+        }
+
+        /** \brief Проверить, подписан ли аккаунт хотя бы на одну стратегию из маски
+         *
+         * \param mask Битовая маска стратегий
+         * \return Вернет true, если есть хотя бы одна общая стратегия
+         */
+        inline bool check_strategies(const StrategyRegistry::Mask &mask) const {
+            return (strategy_mask & mask).any();
+        }
+
+        /** \brief Добавить стратегию
+         *
+         * \param strategy_name Имя стратегии
+         * \return Вернет false, если стратегия не поместилась в реестр стратегий
+         */
+        bool add_strategy(const std::string &strategy_name) {
+            const uint32_t strategy_id = StrategyRegistry::instance().get_id(strategy_name);
+            if(strategy_id == StrategyRegistry::INVALID_ID) {
+                is_strategies_lost = true;
+                return false;
+            }
+            strategy_mask.set(strategy_id);
+            return true;
+        }
+
+        /** \brief Удалить стратегию
+         *
+         * \param strategy_name Имя стратегии
+         */
+        void remove_strategy(const std::string &strategy_name) {
+            const uint32_t strategy_id = StrategyRegistry::instance().find_id(strategy_name);
+            if(strategy_id != StrategyRegistry::INVALID_ID) strategy_mask.reset(strategy_id);
+        }
+
+        /** \brief Получить список используемых стратегий
+         *
+         * \return Множество имен стратегий
+         */
+        std::set<std::string> get_list_strategies() const {
+            return StrategyRegistry::instance().to_set(strategy_mask);
+        }
+
+        /** \brief Установить список используемых стратегий
+         *
+         * \param list_strategies Множество имен стратегий
+         * \return Вернет false, если хотя бы одна стратегия не поместилась в реестр стратегий
+         */
+        bool set_list_strategies(const std::set<std::string> &list_strategies) {
+            is_strategies_lost = !StrategyRegistry::instance().to_mask(list_strategies, strategy_mask);
+            return !is_strategies_lost;
+        }
+
         /** \brief Рассчитать размер ставки
          *
          * \param amount Посчитанный размер ставки
-         * \param strategy_name Имя стратегии
+         * \param strategy_id Номер стратегии в StrategyRegistry
          * \param is_demo Использовать демо аккаунт
          * \param payout Процент выплаты брокера
          * \param winrate Винрейт
@@ -90,28 +159,73 @@ namespace open_bo_api {
          * \return Вернет true в случае успеха
          */
         bool calc_amount(double &amount,
-                         const std::string strategy_name,
+                         const uint32_t strategy_id,
                          const bool is_demo,
                          const double payout,
                          const double winrate,
-                         const double kelly_attenuation) {
+                         const double kelly_attenuation) const {
+            return calc_amount(amount, balance, strategy_id, is_demo, payout, winrate, kelly_attenuation);
+        }
+
+        /** \brief Рассчитать размер ставки для заданного баланса
+         *
+         * \param amount Посчитанный размер ставки
+         * \param current_balance Текущий депозит
+         * \param strategy_id Номер стратегии в StrategyRegistry
+         * \param is_demo Использовать демо аккаунт
+         * \param payout Процент выплаты брокера
+         * \param winrate Винрейт
+         * \param kelly_attenuation Коэффициент ослабления Келли
+         * \return Вернет true в случае успеха
+         */
+        bool calc_amount(double &amount,
+                         const double current_balance,
+                         const uint32_t strategy_id,
+                         const bool is_demo,
+                         const double payout,
+                         const double winrate,
+                         const double kelly_attenuation) const {
             amount = 0.0d;
             if(!enabled) return false;
             if(demo != is_demo) return false;
-            if(absolute_stop_loss != 0 && balance < absolute_stop_loss) return false;
-            if(absolute_take_profit != 0 && balance > absolute_take_profit) return false;
-            if(list_strategies.find(strategy_name) == list_strategies.end()) return false;
+            if(!check_strategy(strategy_id)) return false;
+            if(absolute_stop_loss != 0 && current_balance < absolute_stop_loss) return false;
+            if(absolute_take_profit != 0 && current_balance > absolute_take_profit) return false;
             const double threshold_winrate = 1.0d/(1.0d + payout);
             if(winrate <= threshold_winrate) return false;
-            if(list_strategies.find(strategy_name) == list_strategies.end()) return false;
             const double calc_payout = std::min(payout, payout_limiter);
             const double calc_kelly_attenuation = std::min(kelly_attenuation * kelly_attenuation_multiplier, kelly_attenuation_limiter);
             const double calc_winrate = std::min(winrate, winrate_limiter);
             const double calc_risk = (((1.0d + calc_payout) * calc_winrate - 1.0d) / calc_payout) * calc_kelly_attenuation;
-            amount = balance * calc_risk;
+            amount = current_balance * calc_risk;
             return true;
         }
 
+        /** \brief Рассчитать размер ставки
+         *
+         * \param amount Посчитанный размер ставки
+         * \param strategy_name Имя стратегии
+         * \param is_demo Использовать демо аккаунт
+         * \param payout Процент выплаты брокера
+         * \param winrate Винрейт
+         * \param kelly_attenuation Коэффициент ослабления Келли
+         * \return Вернет true в случае успеха
+         */
+        inline bool calc_amount(double &amount,
+                                const std::string &strategy_name,
+                                const bool is_demo,
+                                const double payout,
+                                const double winrate,
+                                const double kelly_attenuation) const {
+            return calc_amount(
+                amount,
+                StrategyRegistry::instance().find_id(strategy_name),
+                is_demo,
+                payout,
+                winrate,
+                kelly_attenuation);
+        }
+
         /** \brief Получить винрейт
          *
          * \return Винрейт
@@ -122,7 +236,61 @@ namespace open_bo_api {
             return sum == 0 ? 0.0d : (double)wins / (double)sum;
         }
 
+        /** \brief Записать текущий баланс как баланс на закрытие дня
+         *
+         * \param date Метка времени даты
+         */
+        void update_date_balance(const xtime::timestamp_t date) {
+            const xtime::timestamp_t day = xtime::get_first_timestamp_day(date);
+            date_balance[day] = balance;
+            /* индекс будет построен, когда история депозита загрузится */
+            if(is_date_balance_loaded) daily_index.update(day, balance, date_balance, start_timestamp, start_balance);
+        }
+
+        /** \brief Объединить загруженную историю депозита с новыми днями
+         *
+         * \param history_date_balance История депозита из базы данных
+         */
+        void merge_date_balance(std::map<xtime::timestamp_t, double> &history_date_balance) {
+            for(auto &it : date_balance) {
+                history_date_balance[it.first] = it.second;
+            }
+            date_balance.swap(history_date_balance);
+            is_date_balance_loaded = true;
+            rebuild_daily_index();
+        }
+
+        /** \brief Перестроить индекс депозита по дням
+         *
+         * Метод нужно вызвать после прямого редактирования date_balance
+         */
+        void rebuild_daily_index() {
+            daily_index.build(date_balance, start_timestamp, start_balance);
+        }
+
+        /** \brief Получить статистику депозита за диапазон дат
+         *
+         * \param start_date Первый день диапазона
+         * \param stop_date Последний день диапазона (включительно)
+         * \return Статистика депозита (усиление, просадка, волатильность)
+         */
+        inline DailyBalanceStats get_daily_stats(
+                const xtime::timestamp_t start_date,
+                const xtime::timestamp_t stop_date) const {
+            return daily_index.get_stats(start_date, stop_date);
+        }
+
         const std::string convert_date_balance_to_str_json() const {
+            return convert_date_balance_to_str_json(date_balance);
+        }
+
+        /** \brief Преобразовать историю депозита в строку json
+         *
+         * \param date_balance Данные депозита по дням
+         * \return Строка json
+         */
+        static std::string convert_date_balance_to_str_json(
+                const std::map<xtime::timestamp_t, double> &date_balance) {
             std::string temp;
             try {
                 json j;
@@ -139,6 +307,19 @@ namespace open_bo_api {
         }
 
         void convert_json_to_date_balance(const std::string &str_data) {
+            parse_date_balance(str_data, date_balance);
+            is_date_balance_loaded = true;
+            rebuild_daily_index();
+        }
+
+        /** \brief Разобрать историю депозита из строки json
+         *
+         * \param str_data Строка json
+         * \param date_balance Данные депозита по дням
+         */
+        static void parse_date_balance(
+                const std::string &str_data,
+                std::map<xtime::timestamp_t, double> &date_balance) {
             try {
                 date_balance.clear();
                 json j;
@@ -160,6 +341,272 @@ namespace open_bo_api {
 
     };
 
+    /** \brief История депозита аккаунта по закрытым дням
+     *
+     * История неизменяемая и разделяется между записями аккаунта.
+     * Новая копия истории создается только при закрытии дня или загрузке истории из базы данных
+     */
+    class VirtualAccountHistory {
+    public:
+        std::map<xtime::timestamp_t, double> date_balance;  /**< Баланс на закрытие дня по закрытым дням */
+        DailyBalanceIndex daily_index;                      /**< Индекс закрытых дней. Строится, когда история загружена */
+        bool is_loaded = true;                              /**< История загружена из базы данных. Если false, date_balance содержит только новые дни */
+
+        VirtualAccountHistory() {};
+    };
+
+    /** \brief Торговое состояние аккаунта
+     *
+     * Неизменяемая запись с полями аккаунта, которые меняются при каждой сделке.
+     * При ставке или результате сделки для аккаунта создается новая небольшая запись,
+     * а настройки и история депозита разделяются между записями по указателю.
+     * Баланс текущего дня не хранится в истории: баланс на закрытие текущего дня равен balance
+     */
+    class VirtualAccountState {
+    public:
+        std::shared_ptr<const VirtualAccount> config;          /**< Настройки аккаунта. Торговые поля и история депозита в нем не используются */
+        std::shared_ptr<const VirtualAccountHistory> history;  /**< История депозита по закрытым дням */
+
+        uint64_t va_id = 0;                 /**< ID аккаунта */
+        double balance = 0.0d;              /**< Текущий депозит */
+        uint64_t wins = 0;
+        uint64_t losses = 0;
+        xtime::timestamp_t timestamp = 0;   /**< Последняя дата обновления баланса */
+        xtime::timestamp_t day = 0;         /**< Текущий торговый день. Равен 0, если после загрузки торговли не было */
+
+        std::map<uint64_t, double> mem_profit;
+        std::map<uint64_t, double> mem_amount;
+
+        VirtualAccountState() {};
+
+        /** \brief Создать запись из аккаунта
+         *
+         * \param va Виртуальный аккаунт
+         * \return Запись аккаунта
+         */
+        static std::shared_ptr<const VirtualAccountState> create(const VirtualAccount &va) {
+            std::shared_ptr<VirtualAccountHistory> next_history = std::make_shared<VirtualAccountHistory>();
+            next_history->date_balance = va.date_balance;
+            next_history->is_loaded = va.is_date_balance_loaded;
+            if(next_history->is_loaded) {
+                next_history->daily_index.build(next_history->date_balance, va.start_timestamp, va.start_balance);
+            }
+
+            std::shared_ptr<VirtualAccount> next_config = std::make_shared<VirtualAccount>(va);
+            next_config->date_balance.clear();
+            next_config->daily_index = DailyBalanceIndex();
+            next_config->mem_profit.clear();
+            next_config->mem_amount.clear();
+
+            std::shared_ptr<VirtualAccountState> state = std::make_shared<VirtualAccountState>();
+            state->config = next_config;
+            state->history = next_history;
+            state->va_id = va.va_id;
+            state->balance = va.balance;
+            state->wins = va.wins;
+            state->losses = va.losses;
+            state->timestamp = va.timestamp;
+            state->mem_profit = va.mem_profit;
+            state->mem_amount = va.mem_amount;
+            return state;
+        }
+
+        /** \brief Рассчитать размер ставки
+         *
+         * \param amount Посчитанный размер ставки
+         * \param strategy_id Номер стратегии в StrategyRegistry
+         * \param is_demo Использовать демо аккаунт
+         * \param payout Процент выплаты брокера
+         * \param winrate Винрейт
+         * \param kelly_attenuation Коэффициент ослабления Келли
+         * \return Вернет true в случае успеха
+         */
+        inline bool calc_amount(double &amount,
+                                const uint32_t strategy_id,
+                                const bool is_demo,
+                                const double payout,
+                                const double winrate,
+                                const double kelly_attenuation) const {
+            return config->calc_amount(amount, balance, strategy_id, is_demo, payout, winrate, kelly_attenuation);
+        }
+
+        /** \brief Перейти на день сделки
+         *
+         * Если начался новый день, баланс на закрытие предыдущего дня записывается
+         * в новую копию истории. Сделки прошлых дней учитываются в текущем дне.
+         * Метод нужно вызывать до изменения баланса
+         * \param date Метка времени даты сделки
+         */
+        void roll_day(const xtime::timestamp_t date) {
+            const xtime::timestamp_t next_day = xtime::get_first_timestamp_day(date);
+            if(next_day <= day) return;
+            const bool is_close = day != 0;
+            /* в загруженной истории может быть баланс нового дня, теперь его хранит запись */
+            const bool is_erase = history->date_balance.lower_bound(next_day) != history->date_balance.end();
+            if(is_close || is_erase) {
+                std::shared_ptr<VirtualAccountHistory> next_history = std::make_shared<VirtualAccountHistory>(*history);
+                if(is_erase) {
+                    next_history->date_balance.erase(
+                        next_history->date_balance.lower_bound(next_day),
+                        next_history->date_balance.end());
+                }
+                if(is_close) next_history->date_balance[day] = balance;
+                /* индекс будет построен, когда история депозита загрузится */
+                if(next_history->is_loaded) {
+                    if(is_erase) {
+                        next_history->daily_index.build(
+                            next_history->date_balance,
+                            config->start_timestamp,
+                            config->start_balance);
+                    } else {
+                        next_history->daily_index.update(
+                            day,
+                            balance,
+                            next_history->date_balance,
+                            config->start_timestamp,
+                            config->start_balance);
+                    }
+                }
+                history = next_history;
+            }
+            day = next_day;
+        }
+
+        /** \brief Объединить загруженную историю депозита с новыми днями
+         *
+         * \param history_date_balance История депозита из базы данных
+         */
+        void merge_date_balance(std::map<xtime::timestamp_t, double> &history_date_balance) {
+            for(auto &it : history->date_balance) {
+                history_date_balance[it.first] = it.second;
+            }
+            if(day != 0) {
+                history_date_balance.erase(history_date_balance.lower_bound(day), history_date_balance.end());
+            }
+            std::shared_ptr<VirtualAccountHistory> next_history = std::make_shared<VirtualAccountHistory>();
+            next_history->date_balance.swap(history_date_balance);
+            next_history->is_loaded = true;
+            next_history->daily_index.build(next_history->date_balance, config->start_timestamp, config->start_balance);
+            history = next_history;
+        }
+
+        /** \brief Проверить, загружена ли история депозита
+         */
+        inline bool is_date_balance_loaded() const {
+            return history->is_loaded;
+        }
+
+        /** \brief Проверить, есть ли данные депозита по дням
+         */
+        inline bool has_date_balance() const {
+            return day != 0 || !history->date_balance.empty();
+        }
+
+        /** \brief Получить данные депозита по дням вместе с текущим днем
+         *
+         * \param date_balance Данные депозита по дням
+         */
+        void get_date_balance(std::map<xtime::timestamp_t, double> &date_balance) const {
+            date_balance = history->date_balance;
+            if(day != 0) date_balance[day] = balance;
+        }
+
+        /** \brief Получить статистику депозита за диапазон дат
+         *
+         * \param start_date Первый день диапазона
+         * \param stop_date Последний день диапазона (включительно)
+         * \return Статистика депозита (усиление, просадка, волатильность)
+         */
+        DailyBalanceStats get_daily_stats(
+                const xtime::timestamp_t start_date,
+                const xtime::timestamp_t stop_date) const {
+            if(day == 0) return history->daily_index.get_stats(start_date, stop_date);
+            if(history->daily_index.check_tail(day)) {
+                return history->daily_index.get_stats(start_date, stop_date, day, balance);
+            }
+            /* текущий день раньше начала индекса, считаем по временному индексу */
+            std::map<xtime::timestamp_t, double> date_balance;
+            get_date_balance(date_balance);
+            DailyBalanceIndex daily_index;
+            daily_index.build(date_balance, config->start_timestamp, config->start_balance);
+            return daily_index.get_stats(start_date, stop_date);
+        }
+
+        /** \brief Собрать копию аккаунта
+         *
+         * \return Виртуальный аккаунт с настройками, торговыми полями и историей депозита
+         */
+        VirtualAccount get_virtual_account() const {
+            VirtualAccount va(*config);
+            va.balance = balance;
+            va.wins = wins;
+            va.losses = losses;
+            va.timestamp = timestamp;
+            va.mem_profit = mem_profit;
+            va.mem_amount = mem_amount;
+            va.date_balance = history->date_balance;
+            va.daily_index = history->daily_index;
+            va.is_date_balance_loaded = history->is_loaded;
+            if(day != 0) va.update_date_balance(day);
+            return va;
+        }
+    };
+
+    /** \brief Снимок состояния виртуальных аккаунтов
+     *
+     * Снимок неизменяемый и читается без блокировок. Каждая сделка публикует новый снимок,
+     * в котором заменены только записи измененных аккаунтов, остальные записи
+     * разделяются с предыдущим снимком по указателю. Поэтому снимок всегда
+     * соответствует состоянию после целиком примененной сделки, а суммарный баланс - записям снимка
+     */
+    class VirtualAccountsSnapshot {
+    public:
+        std::vector<std::shared_ptr<const VirtualAccountState>> accounts;   /**< Записи аккаунтов, упорядоченные по ID */
+        double demo_balance = 0.0d; /**< Баланс включенных демо аккаунтов */
+        double real_balance = 0.0d; /**< Баланс включенных реальных аккаунтов */
+
+        VirtualAccountsSnapshot() {};
+
+        /** \brief Найти запись аккаунта
+         *
+         * \param va_id ID аккаунта
+         * \return Запись аккаунта или пустой указатель
+         */
+        std::shared_ptr<const VirtualAccountState> find(const uint64_t va_id) const {
+            auto it = std::lower_bound(accounts.begin(), accounts.end(), va_id,
+                [](const std::shared_ptr<const VirtualAccountState> &state, const uint64_t id) {
+                return state->va_id < id;
+            });
+            if(it == accounts.end() || (*it)->va_id != va_id) return std::shared_ptr<const VirtualAccountState>();
+            return *it;
+        }
+
+        /** \brief Изменить суммарный баланс
+         *
+         * \param demo Демо аккаунт
+         * \param delta Изменение баланса
+         */
+        inline void add_balance(const bool demo, const double delta) {
+            if(demo) demo_balance += delta;
+            else real_balance += delta;
+        }
+
+        /** \brief Посчитать суммарный баланс по всем аккаунтам
+         *
+         * \param sum_demo_balance Баланс включенных демо аккаунтов
+         * \param sum_real_balance Баланс включенных реальных аккаунтов
+         */
+        void calc_balance(double &sum_demo_balance, double &sum_real_balance) const {
+            sum_demo_balance = 0.0d;
+            sum_real_balance = 0.0d;
+            for(auto &state : accounts) {
+                if(!state->config->enabled) continue;
+                if(state->config->demo) sum_demo_balance += state->balance;
+                else sum_real_balance += state->balance;
+            }
+        }
+    };
+
     /** \brief Класс для работы с массивом виртуальных аккаунтов
      */
     class VirtualAccounts {
@@ -168,7 +615,6 @@ namespace open_bo_api {
         sqlite3 *db = 0;
         bool is_error = false;
 
-        std::map<uint64_t, VirtualAccount> virtual_accounts;            /**< Массив виртуальных аккаунтов */
         std::map<uint64_t, VirtualAccount> callback_virtual_accounts;   /**< Массив виртуальных аккаунтов для callback */
         std::map<uint64_t, VirtualAccount> update_virtual_accounts;     /**< Массив виртуальных аккаунтов для callback */
         std::mutex virtual_accounts_mutex;
@@ -182,22 +628,140 @@ namespace open_bo_api {
         std::future<void> update_va_future;
         std::atomic<bool> is_stop_command;  /**< Команда завершения работы */
 
-        /** \brief Разобрать строку списка
+        std::shared_ptr<const VirtualAccountsSnapshot> snapshot;   /**< Массив виртуальных аккаунтов. Доступ только через std::atomic_load/std::atomic_store, новый снимок публикуется под virtual_accounts_mutex */
+        std::atomic<bool> is_date_balance_loaded;   /**< История депозита всех аккаунтов загружена */
+
+        std::function<void(std::function<void()> task)> callback_executor = nullptr; /**< Исполнитель функций обратного вызова */
+        std::mutex callback_executor_mutex;
+
+        /** \brief Запрос столбцов, нужных для торговли
+         *
+         * Столбец json с историей депозита не читается при запуске
+         * и загружается при первом обращении к истории
+         */
+        const char *select_trading_sql =
+            "SELECT id,holder_name,note,start_balance,balance,"
+            "absolute_stop_loss,absolute_take_profit,"
+            "kelly_attenuation_multiplier,kelly_attenuation_limiter,"
+            "payout_limiter,winrate_limiter,list_strategies,"
+            "demo,enabled,start_timestamp,timestamp,"
+            "wins,losses from virtual_accounts";
+
+        /** \brief Опубликовать новый снимок аккаунтов
+         *
+         * Метод нужно вызывать под virtual_accounts_mutex
+         * \param next Новый снимок
+         */
+        inline void publish_snapshot(std::shared_ptr<VirtualAccountsSnapshot> next) {
+            std::atomic_store(&snapshot, std::shared_ptr<const VirtualAccountsSnapshot>(std::move(next)));
+        }
+
+        /** \brief Исправить суммарный баланс аккаунтов
+         *
+         * При сделках суммарный баланс меняется на разницу балансов аккаунтов.
+         * Здесь он считается заново по всем аккаунтам, чтобы не накапливать ошибку округления
+         */
+        void correct_balance() {
+            std::lock_guard<std::mutex> lock(virtual_accounts_mutex);
+            std::shared_ptr<const VirtualAccountsSnapshot> current = get_snapshot();
+            if(!current) return;
+            double sum_demo_balance = 0.0d;
+            double sum_real_balance = 0.0d;
+            current->calc_balance(sum_demo_balance, sum_real_balance);
+            if(sum_demo_balance == current->demo_balance &&
+               sum_real_balance == current->real_balance) return;
+            std::shared_ptr<VirtualAccountsSnapshot> next = std::make_shared<VirtualAccountsSnapshot>(*current);
+            next->demo_balance = sum_demo_balance;
+            next->real_balance = sum_real_balance;
+            publish_snapshot(std::move(next));
+        }
+
+        /** \brief Рассчитать сумму ставок аккаунтов снимка
+         *
+         * \param current Снимок аккаунтов
+         * \return Сумма расчетных ставок
+         */
+        static double calc_sum_amount(
+                const VirtualAccountsSnapshot &current,
+                const uint32_t strategy_id,
+                const bool demo,
+                const double payout,
+                const double winrate,
+                const double kelly_attenuation) {
+            double sum_amount = 0.0d;
+            for(auto &state : current.accounts) {
+                if(state->config->enabled && state->config->demo == demo) {
+                    double temp = 0.0d;
+                    if(state->calc_amount(
+                        temp,
+                        strategy_id,
+                        demo,
+                        payout,
+                        winrate,
+                        kelly_attenuation)) {
+                        sum_amount += temp;
+                    }
+                }
+            }
+            return sum_amount;
+        }
+
+        /** \brief Распределить ставку между аккаунтами
          *
-         * \param value Список
-         * \param elemet_list Элементы списка
+         * Ставка публикуется одним новым снимком, в котором заменены только записи аккаунтов сделки.
+         * Метод нужно вызывать под virtual_accounts_mutex
+         * \param sum_amount Сумма расчетных ставок, относительно которой считается доля каждого аккаунта
          */
-        void parse_list(std::string value, std::set<std::string> &elemet_list) noexcept {
-            if(value.back() != ',') value += ",";
-            std::size_t start_pos = 0;
-            while(true) {
-                std::size_t found_beg = value.find_first_of(",", start_pos);
-                if(found_beg != std::string::npos) {
-                    std::size_t len = found_beg - start_pos;
-                    if(len > 0) elemet_list.insert(value.substr(start_pos, len));
-                    start_pos = found_beg + 1;
-                } else break;
+        bool apply_bet(const uint64_t id_deal,
+                       const double amount,
+                       const double sum_amount,
+                       const uint32_t strategy_id,
+                       const bool demo,
+                       const double payout,
+                       const double winrate,
+                       const double kelly_attenuation,
+                       const xtime::timestamp_t date,
+                       const uint64_t precision) {
+            std::shared_ptr<const VirtualAccountsSnapshot> current = get_snapshot();
+            if(!current) return false;
+
+            const uint64_t factor = std::pow(10, precision);
+
+            const double coarsening_sum_amount = (double)((uint64_t)(sum_amount * (double)factor)) / (double)factor;
+            const double coarsening_sum_profit = (double)((uint64_t)(coarsening_sum_amount * payout * (double)factor)) / (double)factor;
+
+            const double error_sum_amount = std::abs(sum_amount - coarsening_sum_amount);
+            const double error_sum_profit = std::abs((sum_amount * payout) - coarsening_sum_profit);
+
+            /* выведем соотношение от общей ставки для каждого аккаунта */
+            std::shared_ptr<VirtualAccountsSnapshot> next;
+            for(size_t i = 0; i < current->accounts.size(); ++i) {
+                const VirtualAccountState &state = *current->accounts[i];
+                if(!state.config->enabled || state.config->demo != demo) continue;
+                double temp = 0.0d;
+                if(!state.calc_amount(
+                    temp,
+                    strategy_id,
+                    demo,
+                    payout,
+                    winrate,
+                    kelly_attenuation)) continue;
+                const double p = temp / sum_amount;
+                temp = p * amount - p * error_sum_amount;
+                if(!next) next = std::make_shared<VirtualAccountsSnapshot>(*current);
+                std::shared_ptr<VirtualAccountState> va = std::make_shared<VirtualAccountState>(state);
+                va->roll_day(date);
+                va->balance -= temp;
+                va->mem_amount[id_deal] = temp;
+                va->mem_profit[id_deal] = temp * payout - p * error_sum_profit;
+                va->timestamp = date;
+                next->add_balance(demo, -temp);
+                next->accounts[i] = va;
             }
+
+            if(!next) return false;
+            publish_snapshot(std::move(next));
+            return true;
         }
 
         void va_callback(int argc, char **argv, char **key_name) {
@@ -216,18 +780,114 @@ namespace open_bo_api {
             va.kelly_attenuation_limiter = atof(argv[8]);
             va.payout_limiter = atof(argv[9]);
             va.winrate_limiter = atof(argv[10]);
-            parse_list(argv[11], va.list_strategies);
+            if(!StrategyRegistry::instance().parse_list(argv[11], va.strategy_mask)) {
+                std::cerr << "VirtualAccounts error: strategy registry is full, account: " << va_id << std::endl;
+                va.is_strategies_lost = true;
+            }
             va.demo = atoi(argv[12]) == 0 ? false : true;
             va.enabled = atoi(argv[13]) == 0 ? false : true;
             va.start_timestamp = atoll(argv[14]);
             va.timestamp = atoll(argv[15]);
             va.wins = atoll(argv[16]);
             va.losses = atoll(argv[17]);
-            va.convert_json_to_date_balance(argv[18]);
-            callback_virtual_accounts[va_id] = va;
+            /* история депозита загружается при первом обращении, см. load_date_balance */
+            if(argc > 18 && argv[18]) va.convert_json_to_date_balance(argv[18]);
+            else va.is_date_balance_loaded = false;
+            callback_virtual_accounts[va_id] = std::move(va);
+        }
+
+        static int json_callback(void *userdata, int argc, char **argv, char **key_name) {
+            std::string *str_data = static_cast<std::string*>(userdata);
+            if(str_data && argc > 0 && argv[0]) *str_data = argv[0];
+            return 0;
+        }
+
+        /** \brief Прочитать историю депозита аккаунта из базы данных
+         *
+         * \param va_id ID аккаунта
+         * \param date_balance Данные депозита по дням
+         * \return Вернет true в случае успеха
+         */
+        bool read_date_balance(const uint64_t va_id, std::map<xtime::timestamp_t, double> &date_balance) {
+            if(!db) return false;
+            if(is_error) return false;
+            std::string buffer("SELECT json FROM virtual_accounts WHERE id = ");
+            buffer += std::to_string(va_id);
+            std::string str_data;
+            char *err = 0;
+            if(sqlite3_exec(db, buffer.c_str(), json_callback, &str_data, &err) != SQLITE_OK) {
+                std::cerr << "VirtualAccounts SQL error: " << err << std::endl;
+                sqlite3_free(err);
+                return false;
+            }
+            VirtualAccount::parse_date_balance(str_data, date_balance);
+            return true;
+        }
+
+        /** \brief Загрузить историю депозита аккаунтов
+         *
+         * JSON разбирается без блокировки virtual_accounts_mutex,
+         * блокировка нужна только для объединения с новыми днями
+         * \param list_va_id Список ID аккаунтов
+         */
+        void load_date_balance(const std::vector<uint64_t> &list_va_id) {
+            if(list_va_id.empty()) return;
+            std::map<uint64_t, std::map<xtime::timestamp_t, double>> history;
+            for(const uint64_t va_id : list_va_id) {
+                if(!read_date_balance(va_id, history[va_id])) history.erase(va_id);
+            }
+
+            std::lock_guard<std::mutex> lock(virtual_accounts_mutex);
+            std::shared_ptr<const VirtualAccountsSnapshot> current = get_snapshot();
+            if(!current) return;
+            std::shared_ptr<VirtualAccountsSnapshot> next;
+            for(size_t i = 0; i < current->accounts.size(); ++i) {
+                const VirtualAccountState &state = *current->accounts[i];
+                if(state.is_date_balance_loaded()) continue;
+                auto it = history.find(state.va_id);
+                if(it == history.end()) continue;
+                if(!next) next = std::make_shared<VirtualAccountsSnapshot>(*current);
+                std::shared_ptr<VirtualAccountState> va = std::make_shared<VirtualAccountState>(state);
+                va->merge_date_balance(it->second);
+                next->accounts[i] = va;
+            }
+            if(next) publish_snapshot(std::move(next));
+        }
+
+        /** \brief Загрузить историю депозита всех аккаунтов, если она еще не загружена
+         */
+        void load_all_date_balance() {
+            if(is_date_balance_loaded) return;
+            std::lock_guard<std::mutex> lock(va_editot_mutex);
+            std::shared_ptr<const VirtualAccountsSnapshot> current = get_snapshot();
+            if(!current) return;
+            std::vector<uint64_t> list_va_id;
+            for(auto &state : current->accounts) {
+                if(!state->is_date_balance_loaded()) list_va_id.push_back(state->va_id);
+            }
+            load_date_balance(list_va_id);
+            is_date_balance_loaded = true;
+        }
+
+        /** \brief Заменить массив аккаунтов данными, прочитанными из базы данных
+         *
+         * Метод нужно вызывать под callback_virtual_accounts_mutex
+         */
+        void reload_virtual_accounts() {
+            std::shared_ptr<VirtualAccountsSnapshot> next = std::make_shared<VirtualAccountsSnapshot>();
+            next->accounts.reserve(callback_virtual_accounts.size());
+            for(auto &it : callback_virtual_accounts) {
+                next->accounts.push_back(VirtualAccountState::create(it.second));
+            }
+            callback_virtual_accounts.clear();
+            next->calc_balance(next->demo_balance, next->real_balance);
+
+            std::lock_guard<std::mutex> lock(virtual_accounts_mutex);
+            is_date_balance_loaded = false;
+            publish_snapshot(std::move(next));
         }
 
-        bool update_va_balance(const VirtualAccount &va) {
+        bool update_va_balance(const VirtualAccountState &va) {
             if(!db) return false;
             if(is_error) return false;
             std::string buffer("UPDATE virtual_accounts SET ");
@@ -239,9 +899,14 @@ namespace open_bo_api {
             buffer += std::to_string(va.wins);
             buffer += ", losses = ";
             buffer += std::to_string(va.losses);
-            buffer += ", json = '";
-            buffer += va.convert_date_balance_to_str_json();
-            buffer += "'";
+            /* пока история депозита не загружена, столбец json не трогаем */
+            if(va.is_date_balance_loaded()) {
+                std::map<xtime::timestamp_t, double> date_balance;
+                va.get_date_balance(date_balance);
+                buffer += ", json = '";
+                buffer += VirtualAccount::convert_date_balance_to_str_json(date_balance);
+                buffer += "'";
+            }
             buffer += " WHERE id = ";
             buffer += std::to_string(va.va_id);
             buffer += "; ";
@@ -262,6 +927,8 @@ namespace open_bo_api {
 
     public:
 
+        static const uint64_t AUTO_VA_ID = 0xFFFFFFFFFFFFFFFF;  /**< ID аккаунта, который нужно назначить автоматически */
+
         static int callback(void *userdata, int argc, char **argv, char **key_name) {
             VirtualAccounts* app = static_cast<VirtualAccounts*>(userdata);
             if(app) app->va_callback(argc, argv, key_name);
@@ -282,6 +949,7 @@ namespace open_bo_api {
             is_stop_command = false;
             is_update_virtual_accounts = false;
             is_update_va_completed = false;
+            is_date_balance_loaded = false;
 
             char *err = 0;
             /* таблица для хранения виртуальных аккаунтов */
@@ -329,8 +997,7 @@ namespace open_bo_api {
             /* читаем данные */
             {
                 std::lock_guard<std::mutex> lock(callback_virtual_accounts_mutex);
-                const char *select_sql = "SELECT * from virtual_accounts";
-                if(sqlite3_exec(db, select_sql, callback, this, &err) != SQLITE_OK) {
+                if(sqlite3_exec(db, select_trading_sql, callback, this, &err) != SQLITE_OK) {
                     std::cerr << "VirtualAccounts SQL error: " << err << std::endl;
                     sqlite3_free(err);
                     sqlite3_close(db);
@@ -341,8 +1008,7 @@ namespace open_bo_api {
                     //std::cout << "VirtualAccounts Operation done successfully" << std::endl;
                 }
 
-                std::lock_guard<std::mutex> lock2(virtual_accounts_mutex);
-                virtual_accounts = callback_virtual_accounts;
+                reload_virtual_accounts();
             }
 
             /* создаем поток обработки событий */
@@ -355,17 +1021,32 @@ namespace open_bo_api {
                         /* блокируем редактирование счетов */
                         std::lock_guard<std::mutex> lock(va_editot_mutex);
 
-                        /* копируем данные счетов */
-                        std::map<uint64_t, VirtualAccount> update_virtual_accounts;
-                        {
-                            std::lock_guard<std::mutex> lock(virtual_accounts_mutex);
-                            update_virtual_accounts = virtual_accounts;
+                        /* загружаем историю депозита только тех аккаунтов, у которых появились новые дни */
+                        std::shared_ptr<const VirtualAccountsSnapshot> update_snapshot = get_snapshot();
+                        if(update_snapshot) {
+                            std::vector<uint64_t> list_va_id;
+                            for(auto &state : update_snapshot->accounts) {
+                                if(state->config->enabled &&
+                                   !state->is_date_balance_loaded() &&
+                                   state->has_date_balance()) {
+                                    list_va_id.push_back(state->va_id);
+                                }
+                            }
+                            if(!list_va_id.empty()) {
+                                load_date_balance(list_va_id);
+                                update_snapshot = get_snapshot();
+                            }
                         }
 
+                        /* берем снимок счетов, торговый поток при этом не блокируется */
+
                         /* обновляем данные в базе данных */
-                        for(auto &it : update_virtual_accounts) {
-                            if(it.second.enabled) update_va_balance(it.second);
+                        if(update_snapshot) {
+                            for(auto &state : update_snapshot->accounts) {
+                                if(state->config->enabled) update_va_balance(*state);
+                            }
                         }
+                        correct_balance();
                         is_update_va_completed = true;
                     }
                     std::this_thread::yield();
@@ -406,9 +1087,8 @@ namespace open_bo_api {
          * \return Вернет true, если аккаунты есть в наличии
          */
         bool check_accounts() {
-            /* блокируем доступ к virtual_accounts из других потоков */
-            std::lock_guard<std::mutex> lock(virtual_accounts_mutex);
-            if(virtual_accounts.size() == 0) return false;
+            std::shared_ptr<const VirtualAccountsSnapshot> current = get_snapshot();
+            if(!current || current->accounts.empty()) return false;
             return true;
         }
 
@@ -419,13 +1099,7 @@ namespace open_bo_api {
          * \return Вернет true, если баланс виртуальных аккаунтов меньше или равен реальному балансу
          */
         bool check_balance(const double total_balance, const bool demo) {
-            double sum_balance = 0.0d;
-            /* блокируем доступ к virtual_accounts из других потоков */
-            std::lock_guard<std::mutex> lock(virtual_accounts_mutex);
-            for(auto &it : virtual_accounts) {
-                if(it.second.enabled && it.second.demo == demo) sum_balance += it.second.balance;
-            }
-            if(sum_balance > total_balance) return false;
+            if(get_balance(demo) > total_balance) return false;
             return true;
         }
 
@@ -435,39 +1109,196 @@ namespace open_bo_api {
          * \return Баланс виртуальных аккаунтов
          */
         double get_balance(const bool demo) {
-            double sum_balance = 0.0d;
-            /* блокируем доступ к virtual_accounts из других потоков */
-            std::lock_guard<std::mutex> lock(virtual_accounts_mutex);
-            for(auto &it : virtual_accounts) {
-                if(it.second.enabled && it.second.demo == demo) sum_balance += it.second.balance;
-            }
-            return sum_balance;
+            std::shared_ptr<const VirtualAccountsSnapshot> current = get_snapshot();
+            if(!current) return 0.0d;
+            return demo ? current->demo_balance : current->real_balance;
         }
 
+        /** \brief Добавить виртуальный аккаунт
+         *
+         * ID аккаунта назначается автоматически и записывается в va.va_id
+         * \param va Виртуальный аккаунт
+         * \return Вернет true в случае успеха
+         */
         bool add_virtual_account(VirtualAccount &va) {
             std::lock_guard<std::mutex> lock(va_editot_mutex);
 
             if(!db) return false;
             if(is_error) return false;
-            std::string buffer("INSERT INTO virtual_accounts ("
+            va.va_id = 0;
+            uint64_t max_va_id = 0;
+            if(get_max_va_id(max_va_id)) va.va_id = max_va_id + 1;
+            return insert_va(va);
+        }
+
+        /** \brief Добавить виртуальный аккаунт с заранее назначенным ID
+         *
+         * Метод нужен, когда ID выдает внешний распределитель (например, ShardedVirtualAccounts)
+         * \param va Виртуальный аккаунт
+         * \return Вернет true в случае успеха
+         */
+        bool insert_virtual_account(const VirtualAccount &va) {
+            std::lock_guard<std::mutex> lock(va_editot_mutex);
+
+            if(!db) return false;
+            if(is_error) return false;
+            return insert_va(va);
+        }
+
+        /** \brief Добавить или заменить массив аккаунтов одной транзакцией
+         *
+         * Все аккаунты записываются в базу данных в одной транзакции через подготовленный запрос.
+         * Если запись любого аккаунта не удалась, транзакция откатывается и память не меняется.
+         * После фиксации транзакции массив аккаунтов в памяти обновляется за одну блокировку
+         * и публикуется один снимок. У заменяемых аккаунтов сохраняются открытые сделки.
+         * \param list_va Массив аккаунтов. Аккаунтам с va_id == AUTO_VA_ID будет назначен новый ID
+         * \return Вернет true в случае успеха
+         */
+        bool import_virtual_accounts(std::vector<VirtualAccount> &list_va) {
+            std::lock_guard<std::mutex> lock(va_editot_mutex);
+
+            if(!db) return false;
+            if(is_error) return false;
+            if(list_va.empty()) return true;
+            for(auto &va : list_va) {
+                if(!va.is_strategies_lost) continue;
+                std::cerr << "VirtualAccounts error: account strategies are lost, account: " << va.va_id << std::endl;
+                return false;
+            }
+
+            /* назначаем новые ID */
+            uint64_t next_va_id = 0;
+            if(get_max_va_id(next_va_id)) ++next_va_id;
+            for(auto &va : list_va) {
+                if(va.va_id != AUTO_VA_ID && va.va_id >= next_va_id) next_va_id = va.va_id + 1;
+            }
+            for(auto &va : list_va) {
+                if(va.va_id == AUTO_VA_ID) va.va_id = next_va_id++;
+            }
+
+            /* пишем все аккаунты одной транзакцией */
+            const char *insert_sql =
+                "INSERT OR REPLACE INTO virtual_accounts ("
                 "id,holder_name,note,start_balance,balance,"
                 "absolute_stop_loss,absolute_take_profit,"
                 "kelly_attenuation_multiplier,kelly_attenuation_limiter,"
                 "payout_limiter,winrate_limiter,list_strategies,"
                 "demo,enabled,start_timestamp,timestamp,"
-                "wins,losses,json) ");
-            va.va_id = 0;
+                "wins,losses,json) "
+                "VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?)";
+            char *err = 0;
+            if(sqlite3_exec(db, "BEGIN TRANSACTION", NULL, NULL, &err) != SQLITE_OK) {
+                std::cerr << "VirtualAccounts SQL error: " << err << std::endl;
+                sqlite3_free(err);
+                return false;
+            }
+            sqlite3_stmt *stmt = 0;
+            if(sqlite3_prepare_v2(db, insert_sql, -1, &stmt, NULL) != SQLITE_OK) {
+                std::cerr << "VirtualAccounts SQL error: " << sqlite3_errmsg(db) << std::endl;
+                sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+                return false;
+            }
+            bool is_ok = true;
+            for(auto &va : list_va) {
+                const std::string str_list_strategies(StrategyRegistry::instance().to_str_list(va.strategy_mask));
+                const std::string str_json(va.convert_date_balance_to_str_json());
+                sqlite3_bind_int64(stmt, 1, va.va_id);
+                sqlite3_bind_text(stmt, 2, va.holder_name.c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_text(stmt, 3, va.note.c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_double(stmt, 4, va.start_balance);
+                sqlite3_bind_double(stmt, 5, va.balance);
+                sqlite3_bind_double(stmt, 6, va.absolute_stop_loss);
+                sqlite3_bind_double(stmt, 7, va.absolute_take_profit);
+                sqlite3_bind_double(stmt, 8, va.kelly_attenuation_multiplier);
+                sqlite3_bind_double(stmt, 9, va.kelly_attenuation_limiter);
+                sqlite3_bind_double(stmt, 10, va.payout_limiter);
+                sqlite3_bind_double(stmt, 11, va.winrate_limiter);
+                sqlite3_bind_text(stmt, 12, str_list_strategies.c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_int(stmt, 13, va.demo ? 1 : 0);
+                sqlite3_bind_int(stmt, 14, va.enabled ? 1 : 0);
+                sqlite3_bind_int64(stmt, 15, va.start_timestamp);
+                sqlite3_bind_int64(stmt, 16, va.timestamp);
+                sqlite3_bind_int64(stmt, 17, va.wins);
+                sqlite3_bind_int64(stmt, 18, va.losses);
+                sqlite3_bind_text(stmt, 19, str_json.c_str(), -1, SQLITE_TRANSIENT);
+                if(sqlite3_step(stmt) != SQLITE_DONE) {
+                    std::cerr << "VirtualAccounts SQL error: " << sqlite3_errmsg(db) << std::endl;
+                    is_ok = false;
+                    break;
+                }
+                sqlite3_reset(stmt);
+            }
+            sqlite3_finalize(stmt);
+            if(!is_ok) {
+                sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+                return false;
+            }
+            if(sqlite3_exec(db, "COMMIT", NULL, NULL, &err) != SQLITE_OK) {
+                std::cerr << "VirtualAccounts SQL error: " << err << std::endl;
+                sqlite3_free(err);
+                sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+                return false;
+            }
 
-            {
-                std::lock_guard<std::mutex> lock(virtual_accounts_mutex);
-                if(!virtual_accounts.empty()) {
-                    auto it = virtual_accounts.begin();
-                    auto it_end = std::next(it, virtual_accounts.size() - 1);
-                    va.va_id = it_end->first;
-                    ++va.va_id;
+            /* обновляем массив аккаунтов в памяти за одну блокировку */
+            std::lock_guard<std::mutex> lock2(virtual_accounts_mutex);
+            std::map<uint64_t, std::shared_ptr<const VirtualAccountState>> temp;
+            std::shared_ptr<const VirtualAccountsSnapshot> current = get_snapshot();
+            if(current) {
+                for(auto &state : current->accounts) {
+                    temp.insert(temp.end(), std::make_pair(state->va_id, state));
+                }
+            }
+            for(auto &va : list_va) {
+                auto it = temp.find(va.va_id);
+                if(it != temp.end()) {
+                    va.mem_amount = it->second->mem_amount;
+                    va.mem_profit = it->second->mem_profit;
                 }
+                temp[va.va_id] = VirtualAccountState::create(va);
+            }
+            std::shared_ptr<VirtualAccountsSnapshot> next = std::make_shared<VirtualAccountsSnapshot>();
+            next->accounts.reserve(temp.size());
+            for(auto &it : temp) {
+                next->accounts.push_back(it.second);
             }
+            next->calc_balance(next->demo_balance, next->real_balance);
+            publish_snapshot(std::move(next));
+            return true;
+        }
+
+        /** \brief Получить максимальный ID аккаунта
+         *
+         * \param va_id Максимальный ID аккаунта
+         * \return Вернет false, если аккаунтов нет
+         */
+        bool get_max_va_id(uint64_t &va_id) {
+            std::shared_ptr<const VirtualAccountsSnapshot> current = get_snapshot();
+            if(!current || current->accounts.empty()) return false;
+            va_id = current->accounts.back()->va_id;
+            return true;
+        }
+
+    private:
 
+        /** \brief Записать новый аккаунт в базу данных
+         *
+         * Метод нужно вызывать под va_editot_mutex
+         * \param va Виртуальный аккаунт
+         * \return Вернет true в случае успеха
+         */
+        bool insert_va(const VirtualAccount &va) {
+            if(va.is_strategies_lost) {
+                std::cerr << "VirtualAccounts error: account strategies are lost, account: " << va.va_id << std::endl;
+                return false;
+            }
+            std::string buffer("INSERT INTO virtual_accounts ("
+                "id,holder_name,note,start_balance,balance,"
+                "absolute_stop_loss,absolute_take_profit,"
+                "kelly_attenuation_multiplier,kelly_attenuation_limiter,"
+                "payout_limiter,winrate_limiter,list_strategies,"
+                "demo,enabled,start_timestamp,timestamp,"
+                "wins,losses,json) ");
             buffer += "VALUES (";
             buffer += std::to_string(va.va_id);
             buffer += ",'";
@@ -491,10 +1322,7 @@ namespace open_bo_api {
             buffer += ",";
             buffer += std::to_string(va.winrate_limiter);
             buffer += ",'";
-            for(auto strategy_name : va.list_strategies) {
-                buffer += strategy_name;
-                buffer += ",";
-            }
+            buffer += StrategyRegistry::instance().to_str_list(va.strategy_mask);
             buffer += "',";
             if(va.demo) buffer += "1,";
             else buffer += "0,";
@@ -511,7 +1339,7 @@ namespace open_bo_api {
             buffer += va.convert_date_balance_to_str_json();
             buffer += "'";
             buffer += "); ";
-            buffer += "SELECT * from virtual_accounts";
+            buffer += select_trading_sql;
 
 
             std::lock_guard<std::mutex> lock2(callback_virtual_accounts_mutex);
@@ -526,17 +1354,21 @@ namespace open_bo_api {
                 std::cout << "Records created successfully" << std::endl;
             }
 
-            /* блокируем доступ к virtual_accounts из других потоков */
-            std::lock_guard<std::mutex> lock3(virtual_accounts_mutex);
-            virtual_accounts = callback_virtual_accounts;
+            reload_virtual_accounts();
             return true;
         }
 
+    public:
+
         bool update_virtual_account(const VirtualAccount &va) {
             std::lock_guard<std::mutex> lock(va_editot_mutex);
 
             if(!db) return false;
             if(is_error) return false;
+            if(va.is_strategies_lost) {
+                std::cerr << "VirtualAccounts error: account strategies are lost, account: " << va.va_id << std::endl;
+                return false;
+            }
             std::string buffer("UPDATE virtual_accounts SET ");
             buffer += "holder_name = '";
             buffer += va.holder_name;
@@ -559,10 +1391,7 @@ namespace open_bo_api {
             buffer += ", winrate_limiter = ";
             buffer += std::to_string(va.winrate_limiter);
             buffer += ", list_strategies = '";
-            for(auto strategy_name : va.list_strategies) {
-                buffer += strategy_name;
-                buffer += ",";
-            }
+            buffer += StrategyRegistry::instance().to_str_list(va.strategy_mask);
             buffer += "', demo = ";
             if(va.demo) buffer += "1, enabled = ";
             else buffer += "0, enabled = ";
@@ -575,12 +1404,16 @@ namespace open_bo_api {
             buffer += std::to_string(va.wins);
             buffer += ", losses = ";
             buffer += std::to_string(va.losses);
-            buffer += ", json = '";
-            buffer += va.convert_date_balance_to_str_json();
-            buffer += "'";
+            /* пока история депозита не загружена, столбец json не трогаем */
+            if(va.is_date_balance_loaded) {
+                buffer += ", json = '";
+                buffer += va.convert_date_balance_to_str_json();
+                buffer += "'";
+            }
             buffer += " WHERE id = ";
             buffer += std::to_string(va.va_id);
-            buffer += "; SELECT * from virtual_accounts";
+            buffer += "; ";
+            buffer += select_trading_sql;
 
             std::lock_guard<std::mutex> lock2(callback_virtual_accounts_mutex);
             callback_virtual_accounts.clear();
@@ -594,9 +1427,7 @@ namespace open_bo_api {
                 std::cout << "UPDATE created successfully" << std::endl;
             }
 
-            /* блокируем доступ к virtual_accounts из других потоков */
-            std::lock_guard<std::mutex> lock3(virtual_accounts_mutex);
-            virtual_accounts = callback_virtual_accounts;
+            reload_virtual_accounts();
             return true;
         }
 
@@ -607,7 +1438,8 @@ namespace open_bo_api {
             if(is_error) return false;
             std::string buffer("DELETE from virtual_accounts WHERE id = ");
             buffer += std::to_string(va_id);
-            buffer += "; SELECT * from virtual_accounts";
+            buffer += "; ";
+            buffer += select_trading_sql;
 
 
             std::lock_guard<std::mutex> lock2(callback_virtual_accounts_mutex);
@@ -622,9 +1454,7 @@ namespace open_bo_api {
                 //std::cout << "VirtualAccounts DELETE created successfully" << std::endl;
             }
 
-            /* блокируем доступ к virtual_accounts из других потоков */
-            std::lock_guard<std::mutex> lock3(virtual_accounts_mutex);
-            virtual_accounts = callback_virtual_accounts;
+            reload_virtual_accounts();
             return true;
         }
 
@@ -632,17 +1462,47 @@ namespace open_bo_api {
             return delete_virtual_account(va.va_id);
         }
 
+        /** \brief Получить последний опубликованный снимок аккаунтов
+         *
+         * Снимок читается без блокировок и не меняется после публикации
+         * \return Указатель на снимок (может быть пустым, если база данных не открылась)
+         */
+        inline std::shared_ptr<const VirtualAccountsSnapshot> get_snapshot() const {
+            return std::atomic_load(&snapshot);
+        }
+
+        /** \brief Получить копию массива виртуальных аккаунтов
+         *
+         * Копия собирается из снимка и не блокирует торговый поток
+         * \return Массив виртуальных аккаунтов
+         */
         inline std::map<uint64_t, VirtualAccount> get_virtual_accounts() {
-            /* блокируем доступ к virtual_accounts из других потоков */
-            std::lock_guard<std::mutex> lock(virtual_accounts_mutex);
-            return virtual_accounts;
+            load_all_date_balance();
+            std::map<uint64_t, VirtualAccount> temp;
+            std::shared_ptr<const VirtualAccountsSnapshot> current = get_snapshot();
+            if(!current) return temp;
+            for(auto &state : current->accounts) {
+                temp.insert(temp.end(), std::make_pair(state->va_id, state->get_virtual_account()));
+            }
+            return temp;
         }
 
 
+        /** \brief Получить номер стратегии
+         *
+         * Номер стоит получить один раз при инициализации робота
+         * и затем передавать его в calc_amount и make_bet
+         * \param strategy_name Имя стратегии
+         * \return Номер стратегии в StrategyRegistry
+         */
+        inline uint32_t get_strategy_id(const std::string &strategy_name) {
+            return StrategyRegistry::instance().get_id(strategy_name);
+        }
+
         /** \brief Рассчитать размер ставки
          *
          * \param amount Посчитанный размер ставки
-         * \param strategy_name Имя стратегии
+         * \param strategy_id Номер стратегии в StrategyRegistry
          * \param demo Использовать демо аккаунт
          * \param payout Процент выплаты брокера
          * \param winrate Винрейт
@@ -650,31 +1510,16 @@ namespace open_bo_api {
          * \return Вернет true в случае успеха
          */
         bool calc_amount(double &amount,
-                         const std::string &strategy_name,
+                         const uint32_t strategy_id,
                          const bool demo,
                          const double payout,
                          const double winrate,
                          const double kelly_attenuation) {
+            /* читаем снимок, торговый поток при этом не блокируется */
             amount = 0.0d;
-            /* блокируем доступ к virtual_accounts из других потоков */
-            std::lock_guard<std::mutex> lock(virtual_accounts_mutex);
-
-            if(virtual_accounts.size() == 0) return false;
-            double sum_amount = 0.0d;
-            for(auto &it : virtual_accounts) {
-                if(it.second.enabled && it.second.demo == demo) {
-                    double temp = 0.0d;
-                    if(it.second.calc_amount(
-                        temp,
-                        strategy_name,
-                        demo,
-                        payout,
-                        winrate,
-                        kelly_attenuation)) {
-                        sum_amount += temp;
-                    }
-                }
-            }
+            std::shared_ptr<const VirtualAccountsSnapshot> current = get_snapshot();
+            if(!current || current->accounts.empty()) return false;
+            const double sum_amount = calc_sum_amount(*current, strategy_id, demo, payout, winrate, kelly_attenuation);
             if(sum_amount > 0.0d) {
                 amount = sum_amount;
                 return true;
@@ -682,11 +1527,36 @@ namespace open_bo_api {
             return false;
         };
 
+        /** \brief Рассчитать размер ставки
+         *
+         * \param amount Посчитанный размер ставки
+         * \param strategy_name Имя стратегии
+         * \param demo Использовать демо аккаунт
+         * \param payout Процент выплаты брокера
+         * \param winrate Винрейт
+         * \param kelly_attenuation Коэффициент ослабления Келли
+         * \return Вернет true в случае успеха
+         */
+        inline bool calc_amount(double &amount,
+                                const std::string &strategy_name,
+                                const bool demo,
+                                const double payout,
+                                const double winrate,
+                                const double kelly_attenuation) {
+            return calc_amount(
+                amount,
+                StrategyRegistry::instance().find_id(strategy_name),
+                demo,
+                payout,
+                winrate,
+                kelly_attenuation);
+        }
+
         /** \brief Сделать ставку
          *
          * \param id_deal Уникальный номер сделки
          * \param amount Посчитанный размер ставки
-         * \param strategy_name Имя стратегии
+         * \param strategy_id Номер стратегии в StrategyRegistry
          * \param demo Использовать демо аккаунт
          * \param payout Процент выплаты брокера
          * \param winrate Винрейт
@@ -697,66 +1567,138 @@ namespace open_bo_api {
          */
         bool make_bet(const uint64_t id_deal,
                       const double amount,
-                      const std::string &strategy_name,
+                      const uint32_t strategy_id,
                       const bool demo,
                       const double payout,
                       const double winrate,
                       const double kelly_attenuation,
                       const xtime::timestamp_t date,
                       const uint64_t precision = 2) {
-            /* блокируем доступ к virtual_accounts из других потоков */
+            /* блокируем изменение аккаунтов из других потоков */
             std::lock_guard<std::mutex> lock(virtual_accounts_mutex);
-
-            if(virtual_accounts.size() == 0) return false;
+            std::shared_ptr<const VirtualAccountsSnapshot> current = get_snapshot();
+            if(!current || current->accounts.empty()) return false;
 
             /* найдем ставку для каждого аккаунта */
-            double sum_amount = 0.0d;
-            for(auto &it : virtual_accounts) {
-                if(it.second.enabled && it.second.demo == demo) {
-                    double temp = 0.0d;
-                    if(it.second.calc_amount(
-                        temp,
-                        strategy_name,
-                        demo,
-                        payout,
-                        winrate,
-                        kelly_attenuation)) {
-                        sum_amount += temp;
-                    }
-                }
-            }
-            if(sum_amount == 0.0d) return false;
+            const double sum_amount = calc_sum_amount(*current, strategy_id, demo, payout, winrate, kelly_attenuation);
+            if(sum_amount <= 0.0d) return false;
+            return apply_bet(id_deal, amount, sum_amount, strategy_id, demo, payout, winrate, kelly_attenuation, date, precision);
+        }
 
-            const uint64_t factor = std::pow(10, precision);
+        /** \brief Сделать ставку, которая является частью общей ставки нескольких хранилищ
+         *
+         * Размер ставки каждого аккаунта считается как доля от общей суммы ставок total_sum_amount,
+         * а не от суммы ставок аккаунтов этого хранилища. Так ставку можно распределить
+         * между несколькими хранилищами (см. ShardedVirtualAccounts)
+         * \param id_deal Уникальный номер сделки
+         * \param amount Общий размер ставки
+         * \param total_sum_amount Сумма расчетных ставок всех хранилищ (см. calc_amount)
+         * \param strategy_id Номер стратегии в StrategyRegistry
+         * \param demo Использовать демо аккаунт
+         * \param payout Процент выплаты брокера
+         * \param winrate Винрейт
+         * \param kelly_attenuation Коэффициент ослабления Келли
+         * \param date Метка времени даты
+         * \param precision Точность, указывать число кратное 10
+         * \return Вернет true, если хотя бы один аккаунт хранилища участвует в ставке
+         */
+        bool make_bet_part(const uint64_t id_deal,
+                           const double amount,
+                           const double total_sum_amount,
+                           const uint32_t strategy_id,
+                           const bool demo,
+                           const double payout,
+                           const double winrate,
+                           const double kelly_attenuation,
+                           const xtime::timestamp_t date,
+                           const uint64_t precision = 2) {
+            if(total_sum_amount <= 0.0d) return false;
+            /* блокируем изменение аккаунтов из других потоков */
+            std::lock_guard<std::mutex> lock(virtual_accounts_mutex);
+            return apply_bet(id_deal, amount, total_sum_amount, strategy_id, demo, payout, winrate, kelly_attenuation, date, precision);
+        }
 
-            const double coarsening_sum_amount = (double)((uint64_t)(sum_amount * (double)factor)) / (double)factor;
-            const double coarsening_sum_profit = (double)((uint64_t)(coarsening_sum_amount * payout * (double)factor)) / (double)factor;
+        /** \brief Сделать ставку
+         *
+         * \param id_deal Уникальный номер сделки
+         * \param amount Посчитанный размер ставки
+         * \param strategy_name Имя стратегии
+         * \param demo Использовать демо аккаунт
+         * \param payout Процент выплаты брокера
+         * \param winrate Винрейт
+         * \param kelly_attenuation Коэффициент ослабления Келли
+         * \param date Метка времени даты
+         * \param precision Точность, указывать число кратное 10
+         * \return Вернет true в случае успеха
+         */
+        inline bool make_bet(const uint64_t id_deal,
+                             const double amount,
+                             const std::string &strategy_name,
+                             const bool demo,
+                             const double payout,
+                             const double winrate,
+                             const double kelly_attenuation,
+                             const xtime::timestamp_t date,
+                             const uint64_t precision = 2) {
+            return make_bet(
+                id_deal,
+                amount,
+                StrategyRegistry::instance().find_id(strategy_name),
+                demo,
+                payout,
+                winrate,
+                kelly_attenuation,
+                date,
+                precision);
+        }
 
-            const double error_sum_amount = std::abs(sum_amount - coarsening_sum_amount);
-            const double error_sum_profit = std::abs((sum_amount * payout) - coarsening_sum_profit);
+        /** \brief Результат сделки
+         */
+        enum class BetResult {
+            WIN,        /**< Выигрыш */
+            LOSS,       /**< Проигрыш */
+            STANDOFF,   /**< Ничья */
+        };
 
-            /* выведем соотношение от общей ставки для каждого аккаунта */
-            for(auto &it : virtual_accounts) {
-                if(it.second.enabled && it.second.demo == demo) {
-                    double temp = 0.0d;
-                    if(it.second.calc_amount(
-                        temp,
-                        strategy_name,
-                        demo,
-                        payout,
-                        winrate,
-                        kelly_attenuation)) {
-                        const double p = temp / sum_amount;
-                        temp = p * amount - p * error_sum_amount;
-                        it.second.balance -= temp;
-                        it.second.mem_amount[id_deal] = temp;
-                        it.second.mem_profit[id_deal] = temp * payout - p * error_sum_profit;
-                        it.second.timestamp = date;
-                        it.second.date_balance[xtime::get_first_timestamp_day(date)] = it.second.balance;
-                    } // if
-                }
-            }
+        using AccountCallback = std::function<void(const VirtualAccount &va)>;  /**< Функция обратного вызова для одного аккаунта */
+        using BatchCallback = std::function<void(
+            const uint64_t id_deal,
+            const std::vector<std::shared_ptr<const VirtualAccountState>> &list_va)>; /**< Функция обратного вызова для всех аккаунтов сделки */
+        using CallbackExecutor = std::function<void(std::function<void()> task)>;  /**< Исполнитель функций обратного вызова */
+
+        /** \brief Установить исполнитель функций обратного вызова
+         *
+         * По умолчанию функции обратного вызова вызываются в потоке,
+         * который установил результат сделки, но уже после снятия блокировки.
+         * Исполнитель позволяет перенести их, например, в пул потоков
+         * \param executor Исполнитель (nullptr - вызывать в текущем потоке)
+         */
+        void set_callback_executor(CallbackExecutor executor) {
+            std::lock_guard<std::mutex> lock(callback_executor_mutex);
+            callback_executor = executor;
+        }
 
+        /** \brief Установить результат сделки
+         *
+         * Результаты аккаунтов собираются под блокировкой в виде неизменяемых записей,
+         * а функция обратного вызова вызывается уже после снятия блокировки.
+         * Записи передаются без копирования, настройки аккаунта доступны через VirtualAccountState::config
+         * \param id_deal Уникальный номер сделки
+         * \param date Метка времени даты
+         * \param result Результат сделки
+         * \param batch_callback Функция для обратного вызова со всеми аккаунтами сделки
+         * \return Вернет true в случае успеха
+         */
+        bool set_bet_result(
+                const uint64_t id_deal,
+                const xtime::timestamp_t date,
+                const BetResult result,
+                BatchCallback batch_callback) {
+            std::vector<std::shared_ptr<const VirtualAccountState>> list_va = settle_bet(id_deal, date, result);
+            if(batch_callback == nullptr || list_va.empty()) return true;
+            dispatch_callback([batch_callback, id_deal, list_va]() {
+                batch_callback(id_deal, list_va);
+            });
             return true;
         }
 
@@ -770,32 +1712,8 @@ namespace open_bo_api {
         bool set_win(
                 const uint64_t id_deal,
                 const xtime::timestamp_t date,
-                std::function<void(const VirtualAccount &va)> callback = nullptr) {
-            /* блокируем доступ к virtual_accounts из других потоков */
-            std::lock_guard<std::mutex> lock(virtual_accounts_mutex);
-
-            for(auto &it : virtual_accounts) {
-                auto it_amount = it.second.mem_amount.find(id_deal);
-                auto it_profit = it.second.mem_profit.find(id_deal);
-
-                if((it_amount != it.second.mem_amount.end() &&
-                    it_profit != it.second.mem_profit.end()) &&
-                    it.second.enabled &&
-                    it_amount->second > 0.0d &&
-                    it_profit->second > 0.0d) {
-                    it.second.balance += it_amount->second;
-                    it.second.balance += it_profit->second;
-                    it.second.timestamp = date;
-                    it.second.wins++;
-                    it.second.date_balance[xtime::get_first_timestamp_day(date)] = it.second.balance;
-                    if(callback != nullptr) callback(it.second);
-                }
-
-                if(it_amount != it.second.mem_amount.end()) it.second.mem_amount.erase(id_deal);
-                if(it_profit != it.second.mem_profit.end()) it.second.mem_profit.erase(id_deal);
-            }
-
-            return true;
+                AccountCallback callback = nullptr) {
+            return set_bet_result_per_account(id_deal, date, BetResult::WIN, callback);
         }
 
         /** \brief Установить проигрыш ставки
@@ -808,30 +1726,8 @@ namespace open_bo_api {
         bool set_loss(
                 const uint64_t id_deal,
                 const xtime::timestamp_t date,
-                std::function<void(const VirtualAccount &va)> callback = nullptr) {
-            /* блокируем доступ к virtual_accounts из других потоков */
-            std::lock_guard<std::mutex> lock(virtual_accounts_mutex);
-
-            for(auto &it : virtual_accounts) {
-                auto it_amount = it.second.mem_amount.find(id_deal);
-                auto it_profit = it.second.mem_profit.find(id_deal);
-
-                if((it_amount != it.second.mem_amount.end() &&
-                    it_profit != it.second.mem_profit.end()) &&
-                    it.second.enabled &&
-                    it_amount->second > 0.0d &&
-                    it_profit->second > 0.0d) {
-                    it.second.timestamp = date;
-                    it.second.losses++;
-                    it.second.date_balance[xtime::get_first_timestamp_day(date)] = it.second.balance;
-                    if(callback != nullptr) callback(it.second);
-                }
-
-                if(it_amount != it.second.mem_amount.end()) it.second.mem_amount.erase(id_deal);
-                if(it_profit != it.second.mem_profit.end()) it.second.mem_profit.erase(id_deal);
-            }
-
-            return true;
+                AccountCallback callback = nullptr) {
+            return set_bet_result_per_account(id_deal, date, BetResult::LOSS, callback);
         }
 
         /** \brief Установить ничью
@@ -844,32 +1740,106 @@ namespace open_bo_api {
         bool set_standoff(
                 const uint64_t id_deal,
                 const xtime::timestamp_t date,
-                std::function<void(const VirtualAccount &va)> callback = nullptr) {
-            /* блокируем доступ к virtual_accounts из других потоков */
-            std::lock_guard<std::mutex> lock(virtual_accounts_mutex);
+                AccountCallback callback = nullptr) {
+            return set_bet_result_per_account(id_deal, date, BetResult::STANDOFF, callback);
+        }
+
+    private:
+
+        /** \brief Установить результат сделки с функцией обратного вызова для каждого аккаунта
+         *
+         * Копия каждого аккаунта для функции обратного вызова собирается уже после снятия блокировки
+         */
+        bool set_bet_result_per_account(
+                const uint64_t id_deal,
+                const xtime::timestamp_t date,
+                const BetResult result,
+                AccountCallback callback) {
+            std::vector<std::shared_ptr<const VirtualAccountState>> list_va = settle_bet(id_deal, date, result);
+            if(callback == nullptr || list_va.empty()) return true;
+            dispatch_callback([callback, list_va]() {
+                for(auto &va : list_va) {
+                    callback(va->get_virtual_account());
+                }
+            });
+            return true;
+        }
 
-            for(auto &it : virtual_accounts) {
-                auto it_amount = it.second.mem_amount.find(id_deal);
-                auto it_profit = it.second.mem_profit.find(id_deal);
+        /** \brief Передать функцию обратного вызова исполнителю
+         */
+        void dispatch_callback(std::function<void()> task) {
+            CallbackExecutor executor;
+            {
+                std::lock_guard<std::mutex> lock(callback_executor_mutex);
+                executor = callback_executor;
+            }
+            if(executor != nullptr) executor(std::move(task));
+            else task();
+        }
 
-                if((it_amount != it.second.mem_amount.end() &&
-                    it_profit != it.second.mem_profit.end()) &&
-                    it.second.enabled &&
+        /** \brief Рассчитать результат сделки для всех аккаунтов
+         *
+         * Результат сделки публикуется одним новым снимком
+         * \param id_deal Уникальный номер сделки
+         * \param date Метка времени даты
+         * \param result Результат сделки
+         * \return Неизменяемые записи аккаунтов, у которых изменился баланс
+         */
+        std::vector<std::shared_ptr<const VirtualAccountState>> settle_bet(
+                const uint64_t id_deal,
+                const xtime::timestamp_t date,
+                const BetResult result) {
+            std::vector<std::shared_ptr<const VirtualAccountState>> list_va;
+            /* блокируем изменение аккаунтов из других потоков */
+            std::lock_guard<std::mutex> lock(virtual_accounts_mutex);
+            std::shared_ptr<const VirtualAccountsSnapshot> current = get_snapshot();
+            if(!current) return list_va;
+
+            std::shared_ptr<VirtualAccountsSnapshot> next;
+            for(size_t i = 0; i < current->accounts.size(); ++i) {
+                const VirtualAccountState &state = *current->accounts[i];
+                auto it_amount = state.mem_amount.find(id_deal);
+                auto it_profit = state.mem_profit.find(id_deal);
+                if(it_amount == state.mem_amount.end() &&
+                   it_profit == state.mem_profit.end()) continue;
+
+                if(!next) next = std::make_shared<VirtualAccountsSnapshot>(*current);
+                std::shared_ptr<VirtualAccountState> va = std::make_shared<VirtualAccountState>(state);
+                if((it_amount != state.mem_amount.end() &&
+                    it_profit != state.mem_profit.end()) &&
+                    state.config->enabled &&
                     it_amount->second > 0.0d &&
                     it_profit->second > 0.0d) {
-                    it.second.balance += it_amount->second;
-                    it.second.timestamp = date;
-                    it.second.losses++;
-                    it.second.date_balance[xtime::get_first_timestamp_day(date)] = it.second.balance;
-                    if(callback != nullptr) callback(it.second);
+                    va->roll_day(date);
+                    switch(result) {
+                    case BetResult::WIN:
+                        va->balance += it_amount->second;
+                        va->balance += it_profit->second;
+                        va->wins++;
+                        break;
+                    case BetResult::LOSS:
+                        va->losses++;
+                        break;
+                    case BetResult::STANDOFF:
+                        va->balance += it_amount->second;
+                        va->losses++;
+                        break;
+                    };
+                    va->timestamp = date;
+                    next->add_balance(state.config->demo, va->balance - state.balance);
+                    list_va.push_back(va);
                 }
-                if(it_amount != it.second.mem_amount.end()) it.second.mem_amount.erase(id_deal);
-                if(it_profit != it.second.mem_profit.end()) it.second.mem_profit.erase(id_deal);
+                va->mem_amount.erase(id_deal);
+                va->mem_profit.erase(id_deal);
+                next->accounts[i] = va;
             }
 
-            return true;
+            if(next) publish_snapshot(std::move(next));
+            return list_va;
         }
 
+    public:
+
         /** \brief Загрузить изменения виртуальных счетов в базу данных
          *
          * \param is_wait Флаг ожидания результата
@@ -885,6 +1855,7 @@ namespace open_bo_api {
 
         /** \brief Получить усиление за день
          *
+         * Усиление считается по индексу депозита по дням, как и get_daily_stats
          * \param date Дата
          * \param demo Демо счет
          * \param callback Функция обратного вызова
@@ -897,33 +1868,50 @@ namespace open_bo_api {
                     const std::string &holder_name,
                     const double gain)> callback) {
             if(callback == nullptr) return;
-            /* блокируем доступ к virtual_accounts из других потоков */
-            std::lock_guard<std::mutex> lock(virtual_accounts_mutex);
-
-            for(auto &it : virtual_accounts) {
-                if(it.second.enabled && it.second.demo == demo) {
-                    /* если данных баланса по дням нет, значит торговли не было */
-                    if(it.second.date_balance.size() == 0) {
-                        callback(it.second.va_id, it.second.holder_name, 1.0d);
-                        continue;
-                    }
+            load_all_date_balance();
+            /* читаем снимок, торговый поток при этом не блокируется */
+            std::shared_ptr<const VirtualAccountsSnapshot> current = get_snapshot();
+            if(!current) return;
+
+            /* усиление за день - это статистика индекса депозита за диапазон из одного дня.
+             * День без торговли наследует баланс предыдущего дня, поэтому его усиление единичное,
+             * а первый торговый день считается относительно начального депозита
+             */
+            for(auto &state : current->accounts) {
+                const VirtualAccount &va = *state->config;
+                if(va.enabled && va.demo == demo) {
+                    callback(va.va_id, va.holder_name, state->get_daily_stats(date, date).gain);
+                }
+            }
+        }
 
-                    auto it_date = it.second.date_balance.find(xtime::get_first_timestamp_day(date));
-                    /* за указанный день не было торгов, то значит усилени единичное */
-                    if(it_date == it.second.date_balance.end()) {
-                        callback(it.second.va_id, it.second.holder_name, 1.0d);
-                        continue;
-                    }
-                    /* если это первый торговый день, то усиление измеряется относительно стартвого баланса */
-                    if(it_date == it.second.date_balance.begin()) {
-                        const double gain = it.second.start_balance == 0.0 ? 1.0 : it_date->second / it.second.start_balance;
-                        callback(it.second.va_id, it.second.holder_name, gain);
-                        continue;
-                    }
-                    auto it_date_start = it_date;
-                    std::advance(it_date_start, -1);
-                    const double gain = it_date_start->second == 0.0 ? 1.0 : it_date->second / it_date_start->second;
-                    callback(it.second.va_id, it.second.holder_name, gain);
+        /** \brief Получить статистику депозита за диапазон дат для всех аккаунтов
+         *
+         * Статистика каждого аккаунта считается по индексу депозита по дням,
+         * поэтому время расчета не зависит от длины диапазона
+         * \param start_date Первый день диапазона
+         * \param stop_date Последний день диапазона (включительно)
+         * \param demo Демо счет
+         * \param callback Функция обратного вызова
+         */
+        void get_daily_stats(
+                const xtime::timestamp_t start_date,
+                const xtime::timestamp_t stop_date,
+                const bool demo,
+                std::function<void(
+                    const uint64_t va_id,
+                    const std::string &holder_name,
+                    const DailyBalanceStats &stats)> callback) {
+            if(callback == nullptr) return;
+            load_all_date_balance();
+            /* читаем снимок, торговый поток при этом не блокируется */
+            std::shared_ptr<const VirtualAccountsSnapshot> current = get_snapshot();
+            if(!current) return;
+
+            for(auto &state : current->accounts) {
+                const VirtualAccount &va = *state->config;
+                if(va.enabled && va.demo == demo) {
+                    callback(va.va_id, va.holder_name, state->get_daily_stats(start_date, stop_date));
                 }
             }
         }